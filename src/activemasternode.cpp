@@ -37,9 +37,9 @@ void CActiveMasternode::ManageStatus()
     if (status == ACTIVE_MASTERNODE_SYNC_IN_PROCESS) status = ACTIVE_MASTERNODE_INITIAL;
 
     if (status == ACTIVE_MASTERNODE_INITIAL) {
-        CMasternode* pmn;
+        CMasternodePtr pmn;
         pmn = mnodeman.Find(pubKeyMasternode);
-        if (pmn != NULL) {
+        if (pmn) {
             pmn->Check();
             if (pmn->IsEnabled() && pmn->protocolVersion == PROTOCOL_VERSION) EnableHotColdMasterNode(pmn->vin, pmn->addr);
         }
@@ -184,20 +184,26 @@ bool CActiveMasternode::SendMasternodePing(std::string& errorMessage)
     }
 
     // Update lastPing for our masternode in Masternode list
-    CMasternode* pmn = mnodeman.Find(vin);
-    if (pmn != NULL) {
+    CMasternodePtr pmn = mnodeman.Find(vin);
+    if (pmn) {
         if (pmn->IsPingedWithin(MASTERNODE_PING_SECONDS, mnp.sigTime)) {
             errorMessage = "Too early to send Masternode Ping";
             return false;
         }
 
         pmn->lastPing = mnp;
+        pmn->fDirty = true;
         mnodeman.mapSeenMasternodePing.insert(make_pair(mnp.GetHash(), mnp));
 
         //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
         CMasternodeBroadcast mnb(*pmn);
         uint256 hash = mnb.GetHash();
-        if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) mnodeman.mapSeenMasternodeBroadcast[hash].lastPing = mnp;
+        seencache<uint256, CMasternodeBroadcast>::iterator it = mnodeman.mapSeenMasternodeBroadcast.find(hash);
+        if (it != mnodeman.mapSeenMasternodeBroadcast.end()) {
+            CMasternodeBroadcast mnbSeen = it->second;
+            mnbSeen.lastPing = mnp;
+            mnodeman.mapSeenMasternodeBroadcast.Insert(hash, mnbSeen);
+        }
 
         mnp.Relay();
 
@@ -278,12 +284,12 @@ bool CActiveMasternode::Register(CTxIn vin, CService service, CKey keyCollateral
     mnodeman.mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
     masternodeSync.AddedMasternodeList(mnb.GetHash());
 
-    CMasternode* pmn = mnodeman.Find(vin);
-    if (pmn == NULL) {
+    CMasternodePtr pmn = mnodeman.Find(vin);
+    if (!pmn) {
         CMasternode mn(mnb);
         mnodeman.Add(mn);
     } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+        mnodeman.UpdateFromNewBroadcast(pmn, mnb);
     }
 
     //send to all peers
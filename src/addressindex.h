@@ -0,0 +1,250 @@
+// Copyright (c) 2016 BitPay, Inc.
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Address types used as the first byte of the address index keys */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_PUBKEYHASH = 1, //! P2PKH outputs, and P2PK outputs under the hash of their pubkey
+    ADDRESS_INDEX_SCRIPTHASH = 2,
+};
+
+/**
+ * Key of an entry in the address index: one credit or debit of an address.
+ * Heights and transaction positions are stored big endian so that LevelDB
+ * iterates the entries of an address in chain order.
+ */
+struct CAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    CAddressIndexKey(unsigned int addressType, const uint160& addressHash, int height, unsigned int blockindex, const uint256& txid, unsigned int indexValue, bool isSpending)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+        txindex = blockindex;
+        txhash = txid;
+        index = indexValue;
+        spending = isSpending;
+    }
+
+    void SetNull()
+    {
+        type = 0;
+        hashBytes = 0;
+        blockHeight = 0;
+        txindex = 0;
+        txhash = 0;
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 66;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        // Heights are stored big-endian for key sorting in LevelDB
+        WriteBE32(buf, blockHeight);
+        s.write((char*)buf, 4);
+        WriteBE32(buf, txindex);
+        s.write((char*)buf, 4);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[4];
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        s.read((char*)buf, 4);
+        blockHeight = ReadBE32(buf);
+        s.read((char*)buf, 4);
+        txindex = ReadBE32(buf);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Prefix of CAddressIndexKey used to seek to the first entry of an address */
+struct CAddressIndexIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+
+    CAddressIndexIteratorKey(unsigned int addressType, const uint160& addressHash)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 21;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+    }
+};
+
+/** Prefix of CAddressIndexKey used to seek to the first entry of an address at or above a height */
+struct CAddressIndexIteratorHeightKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+
+    CAddressIndexIteratorHeightKey(unsigned int addressType, const uint160& addressHash, int height)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 25;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        WriteBE32(buf, blockHeight);
+        s.write((char*)buf, 4);
+    }
+};
+
+/** Key of an entry in the address unspent index: one unspent output of an address */
+struct CAddressUnspentKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    CAddressUnspentKey(unsigned int addressType, const uint160& addressHash, const uint256& txid, unsigned int indexValue)
+    {
+        type = addressType;
+        hashBytes = addressHash;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    void SetNull()
+    {
+        type = 0;
+        hashBytes = 0;
+        txhash = 0;
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 57;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+/** Value of an entry in the address unspent index; a null value erases the entry */
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue(CAmount sats, const CScript& scriptPubKey, int height)
+    {
+        satoshis = sats;
+        script = scriptPubKey;
+        blockHeight = height;
+    }
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return (satoshis == -1);
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
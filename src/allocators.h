@@ -261,7 +261,7 @@ struct zero_after_free_allocator : public std::allocator<T> {
 // This is exactly like std::string, but with a custom allocator.
 typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
-// Byte-vector that clears its contents before deletion.
+// Byte-vector that clears its contents before deletion, the buffer of CSecureDataStream.
 typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
 
 #endif // BITCOIN_ALLOCATORS_H
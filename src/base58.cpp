@@ -4,6 +4,7 @@
 
 #include "base58.h"
 
+#include "addressindex.h"
 #include "hash.h"
 #include "uint256.h"
 
@@ -288,6 +289,20 @@ bool CBitcoinAddress::GetKeyID(CKeyID& keyID) const
     return true;
 }
 
+bool CBitcoinAddress::GetIndexKey(uint160& hashBytes, int& type) const
+{
+    if (!IsValid())
+        return false;
+    if (vchVersion == Params().Base58Prefix(CChainParams::PUBKEY_ADDRESS))
+        type = ADDRESS_INDEX_PUBKEYHASH;
+    else if (vchVersion == Params().Base58Prefix(CChainParams::SCRIPT_ADDRESS))
+        type = ADDRESS_INDEX_SCRIPTHASH;
+    else
+        return false;
+    memcpy(&hashBytes, &vchData[0], 20);
+    return true;
+}
+
 bool CBitcoinAddress::IsScript() const
 {
     return IsValid() && vchVersion == Params().Base58Prefix(CChainParams::SCRIPT_ADDRESS);
@@ -0,0 +1,17 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#define BOOST_TEST_MODULE RDCT Benchmarks
+
+#include <boost/test/unit_test.hpp>
+
+/** Benchmarks report their timings as messages, so show them without --log_level */
+struct BenchLogSetup {
+    BenchLogSetup()
+    {
+        boost::unit_test::unit_test_log.set_threshold_level(boost::unit_test::log_messages);
+    }
+};
+
+BOOST_GLOBAL_FIXTURE(BenchLogSetup);
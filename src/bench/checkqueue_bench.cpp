@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "crypto/sha256.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(checkqueue_bench)
+
+static std::atomic<unsigned int> nChecked(0);
+
+/** Counts itself and does some hashing, standing in for a script check */
+struct FakeCheck {
+    int nRounds;
+
+    FakeCheck(int nRoundsIn = 0) : nRounds(nRoundsIn) {}
+
+    bool operator()()
+    {
+        unsigned char buf[32] = {};
+        for (int i = 0; i < nRounds; i++)
+            CSHA256().Write(buf, sizeof(buf)).Finalize(buf);
+        nChecked++;
+        return true;
+    }
+
+    void swap(FakeCheck& check)
+    {
+        std::swap(nRounds, check.nRounds);
+    }
+};
+
+typedef CCheckQueue<FakeCheck> FakeCheckQueue;
+
+BOOST_AUTO_TEST_CASE(checkqueue_threads)
+{
+    // A block's worth of script checks, fed one transaction at a time
+    const int nTxs = 2000;
+    const int nRounds = 20;
+    const int vThreads[] = {1, 2, 4, 8, 16, 32, 64};
+    for (unsigned int t = 0; t < sizeof(vThreads) / sizeof(vThreads[0]); t++) {
+        int nThreads = vThreads[t];
+        FakeCheckQueue queue(128, nThreads);
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads - 1; i++)
+            threads.create_thread(boost::bind(&FakeCheckQueue::Thread, &queue));
+        nChecked = 0;
+        unsigned int nTotal = 0;
+        int64_t nStart = GetTimeMicros();
+        {
+            CCheckQueueControl<FakeCheck> control(&queue);
+            for (int i = 0; i < nTxs; i++) {
+                std::vector<FakeCheck> vChecks(1 + i % 4, FakeCheck(nRounds));
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        BOOST_CHECK_EQUAL(nChecked, nTotal);
+        BOOST_TEST_MESSAGE(strprintf("CCheckQueue: %d checks on %d threads in %dus", nTotal, nThreads, nElapsed));
+        threads.interrupt_all();
+        threads.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypter.h"
+
+#include "random.h"
+#include "script/standard.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(crypter_bench)
+
+/** Opens up encryption and unlocking, which CWallet normally drives */
+class BenchCryptoKeyStore : public CCryptoKeyStore
+{
+public:
+    bool EncryptKeys(CKeyingMaterial& vMasterKeyIn) { return CCryptoKeyStore::EncryptKeys(vMasterKeyIn); }
+    bool Unlock(const CKeyingMaterial& vMasterKeyIn) { return CCryptoKeyStore::Unlock(vMasterKeyIn); }
+};
+
+BOOST_AUTO_TEST_CASE(crypter_sign)
+{
+    // Look up and sign with every key of a wallet, as bulk sends and staking do
+    const int nKeys = 500;
+    const int nRounds = 4;
+    BenchCryptoKeyStore plain, encrypted;
+    std::vector<CKeyID> vIDs;
+    for (int i = 0; i < nKeys; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        vIDs.push_back(key.GetPubKey().GetID());
+        BOOST_REQUIRE(plain.AddKeyPubKey(key, key.GetPubKey()));
+        BOOST_REQUIRE(encrypted.AddKeyPubKey(key, key.GetPubKey()));
+    }
+    CKeyingMaterial vMasterKey(WALLET_CRYPTO_KEY_SIZE);
+    GetRandBytes(&vMasterKey[0], WALLET_CRYPTO_KEY_SIZE);
+    BOOST_REQUIRE(encrypted.EncryptKeys(vMasterKey));
+
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    const char* vNames[] = {"unencrypted", "encrypted", "encrypted, warmed"};
+    for (int nCase = 0; nCase < 3; nCase++) {
+        BenchCryptoKeyStore& keystore = nCase == 0 ? plain : encrypted;
+        if (nCase > 0)
+            BOOST_REQUIRE(keystore.Unlock(vMasterKey));
+        int64_t nStart = GetTimeMicros();
+        if (nCase == 2) {
+            keystore.WarmKeyCache(std::set<CKeyID>(vIDs.begin(), vIDs.end()));
+        }
+        int64_t nFirst = 0;
+        for (int nRound = 0; nRound < nRounds; nRound++) {
+            for (int i = 0; i < nKeys; i++) {
+                CKey key;
+                BOOST_REQUIRE(keystore.GetKey(vIDs[i], key));
+            }
+            if (nRound == 0)
+                nFirst = GetTimeMicros() - nStart;
+        }
+        int64_t nLookups = GetTimeMicros() - nStart;
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nKeys; i++) {
+            CKey key;
+            BOOST_REQUIRE(keystore.GetKey(vIDs[i], key));
+            BOOST_REQUIRE(key.Sign(hash, vchSig));
+        }
+        int64_t nSigning = GetTimeMicros() - nStart;
+        BOOST_TEST_MESSAGE(strprintf("CCryptoKeyStore (%s): %d key lookups in %dus (the first %d in %dus), %d signatures in %dus",
+            vNames[nCase], nKeys * nRounds, nLookups, nKeys, nFirst, nKeys, nSigning));
+        if (nCase > 0)
+            BOOST_REQUIRE(keystore.Lock());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
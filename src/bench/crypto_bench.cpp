@@ -0,0 +1,54 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bip38.h"
+#include "crypto/scrypt.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <string.h>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(crypto_bench)
+
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Batched double-SHA256 of 64 byte messages against hashing one at a time
+    const int nBlocks = 1 << 16;
+    std::vector<unsigned char> in(64 * nBlocks), out(32 * nBlocks);
+    GetRandBytes(&in[0], in.size());
+    int64_t nStart = GetTimeMicros();
+    for (int j = 0; j < nBlocks; j++) {
+        uint256 hash = Hash(in.begin() + 64 * j, in.begin() + 64 * (j + 1));
+        memcpy(&out[32 * j], hash.begin(), 32);
+    }
+    int64_t nSerial = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    SHA256D64(out.data(), in.data(), nBlocks);
+    int64_t nBatch = GetTimeMicros() - nStart;
+    BOOST_TEST_MESSAGE(strprintf("SHA256D64 (%s): %d messages in %dus, one at a time in %dus",
+        SHA256AutoDetect(), nBlocks, nBatch, nSerial));
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_threads)
+{
+    // BIP38's parameters, the plain primitive against BIP38 spreading the lanes over every core
+    char out[64];
+    int64_t nStart = GetTimeMicros();
+    scrypt("passphrase", 10, "salt", 4, out, 16384, 8, 8, 64);
+    int64_t nSingle = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    BIP38_Scrypt("passphrase", 10, "salt", 4, out, 64, 0);
+    int64_t nParallel = GetTimeMicros() - nStart;
+    BOOST_TEST_MESSAGE(strprintf("scrypt (%s) N=16384 r=8 p=8: %dus on one thread, %dus on %d",
+        ScryptAutoDetect(), nSingle, nParallel, boost::thread::hardware_concurrency()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,58 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "pubkey.h"
+
+#include "ecwrapper.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "uint256.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(key_bench)
+
+BOOST_AUTO_TEST_CASE(key_verify)
+{
+    // ECDSA verification throughput, through OpenSSL as it used to be done and through libsecp256k1
+    const int nSigs = 500;
+    std::vector<CPubKey> vPubKeys;
+    std::vector<uint256> vHashes;
+    std::vector<std::vector<unsigned char> > vSigs(nSigs);
+    for (int i = 0; i < nSigs; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        vPubKeys.push_back(key.GetPubKey());
+        vHashes.push_back(GetRandHash());
+        BOOST_CHECK(key.Sign(vHashes[i], vSigs[i]));
+    }
+
+    int nValidOld = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nSigs; i++) {
+        CECKey key;
+        if (key.SetPubKey(vPubKeys[i].begin(), vPubKeys[i].size()) && key.Verify(vHashes[i], vSigs[i]))
+            nValidOld++;
+    }
+    int64_t nOld = GetTimeMicros() - nStart;
+
+    int nValidNew = 0;
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nSigs; i++) {
+        if (vPubKeys[i].Verify(vHashes[i], vSigs[i]))
+            nValidNew++;
+    }
+    int64_t nNew = GetTimeMicros() - nStart;
+
+    BOOST_CHECK_EQUAL(nValidOld, nSigs);
+    BOOST_CHECK_EQUAL(nValidNew, nSigs);
+    BOOST_TEST_MESSAGE(strprintf("ECDSA verify: %d signatures in %dus with libsecp256k1, %dus with OpenSSL",
+        nSigs, nNew, nOld));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
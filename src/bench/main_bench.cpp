@@ -0,0 +1,156 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "keystore.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx, const CScript& scriptPubKey);
+
+BOOST_AUTO_TEST_SUITE(main_bench)
+
+/** A block of nTxs distinct transactions, returning how long their txids took */
+static int64_t MakeBlock(CBlock& block, int nTxs)
+{
+    block.vtx.clear();
+    block.vtx.reserve(nTxs);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(2);
+    tx.vout[0].nValue = tx.vout[1].nValue = COIN;
+    tx.vout[0].scriptPubKey = tx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    int64_t nTime = 0;
+    for (int i = 0; i < nTxs; i++) {
+        tx.vin[0].prevout.n = i;
+        int64_t nStart = GetTimeMicros();
+        block.vtx.push_back(tx);
+        nTime += GetTimeMicros() - nStart;
+    }
+    return nTime;
+}
+
+BOOST_AUTO_TEST_CASE(merkle_tree)
+{
+    const int vSizes[] = {1000, 2000, 5000, 10000, 20000};
+    const int nRounds = 20;
+    for (unsigned int n = 0; n < sizeof(vSizes) / sizeof(vSizes[0]); n++) {
+        CBlock block;
+        int64_t nTxids = MakeBlock(block, vSizes[n]);
+        int64_t nStart = GetTimeMicros();
+        for (int i = 0; i < nRounds; i++)
+            block.BuildMerkleTree();
+        int64_t nSerial = (GetTimeMicros() - nStart) / nRounds;
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nRounds; i++)
+            block.BuildMerkleTree(NULL, ParallelSHA256D64);
+        int64_t nParallel = (GetTimeMicros() - nStart) / nRounds;
+        BOOST_TEST_MESSAGE(strprintf("BuildMerkleTree: %d txs, txids in %dus, tree in %dus, %dus on %d threads",
+            vSizes[n], nTxids, nSerial, nParallel, nScriptCheckThreads));
+    }
+}
+
+/** A transaction paying nValue to each of nOutputs copies of scriptPubKey */
+static CMutableTransaction MakeSplit(const CKeyStore& keystore, const CTransaction& txFrom, const CScript& scriptPubKey, int nOutputs, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    tx.vout.resize(nOutputs);
+    for (int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = nValue;
+        tx.vout[i].scriptPubKey = scriptPubKey;
+    }
+    BOOST_REQUIRE(SignSignature(keystore, txFrom, tx, 0));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(connect_block)
+{
+    // Connecting a block of pay-to-pubkey-hash spends, one case per way the
+    // node may have seen its transactions before
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    Checkpoints::fEnabled = false;
+    const int nTxs = 1000;
+    const int nCases = 3;
+    const CAmount nFee = 10000;
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // A mature coinbase per case, each split into the coins the case spends
+    std::vector<CMutableTransaction> vNoTx, vSplits;
+    std::vector<CTransaction> vCoinbases;
+    for (int nCase = 0; nCase < nCases; nCase++)
+        vCoinbases.push_back(CreateAndProcessBlock(vNoTx, scriptPubKey).vtx[0]);
+    for (int i = 0; i < Params().COINBASE_MATURITY(); i++)
+        CreateAndProcessBlock(vNoTx, CScript() << OP_TRUE);
+    CAmount nValue = vCoinbases[0].vout[0].nValue / nTxs;
+    for (int nCase = 0; nCase < nCases; nCase++)
+        vSplits.push_back(MakeSplit(keystore, vCoinbases[nCase], scriptPubKey, nTxs, nValue));
+    CreateAndProcessBlock(vSplits, CScript() << OP_TRUE);
+    BOOST_REQUIRE(pcoinsTip->HaveCoins(vSplits[0].GetHash()));
+
+    const char* vNames[] = {"cold", "signatures cached", "accepted to the mempool"};
+    for (int nCase = 0; nCase < nCases; nCase++) {
+        std::vector<CMutableTransaction> vSpends;
+        for (int i = 0; i < nTxs; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(vSplits[nCase].GetHash(), i);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = nValue - nFee;
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            BOOST_REQUIRE(SignSignature(keystore, vSplits[nCase], tx, 0));
+            vSpends.push_back(tx);
+        }
+
+        if (nCase == 1) {
+            // Verified with other flags, as by a node that did not know the next block's
+            LOCK(cs_main);
+            for (int i = 0; i < nTxs; i++) {
+                CValidationState state;
+                BOOST_REQUIRE(CheckInputs(vSpends[i], state, *pcoinsTip, true, SCRIPT_VERIFY_P2SH, true, false));
+            }
+        } else if (nCase == 2) {
+            LOCK(cs_main);
+            for (int i = 0; i < nTxs; i++) {
+                CValidationState state;
+                BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, vSpends[i], false, NULL));
+            }
+        }
+
+        int nHeight = chainActive.Height();
+        int64_t nStart = GetTimeMicros();
+        CreateAndProcessBlock(vSpends, CScript() << OP_TRUE);
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        BOOST_CHECK_EQUAL(chainActive.Height(), nHeight + 1);
+        BOOST_CHECK_EQUAL(mempool.size(), 0U);
+        BOOST_TEST_MESSAGE(strprintf("Connecting a block (%s): %d txs in %dus on %d threads",
+            vNames[nCase], nTxs, nElapsed, nScriptCheckThreads));
+    }
+
+    // Rewind the chain for the benchmarks that follow
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainActive[1]));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+    mempool.clear();
+    Checkpoints::fEnabled = true;
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,182 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "masternode.h"
+#include "masternode-helpers.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "spork.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_bench)
+
+static CPubKey RandomPubKey()
+{
+    unsigned char vch[33];
+    GetRandBytes(vch, sizeof(vch));
+    vch[0] = 0x02;
+    return CPubKey(vch, vch + sizeof(vch));
+}
+
+static CMasternode RandomMasternode()
+{
+    CMasternode mn;
+    mn.vin = CTxIn(GetRandHash(), GetRandInt(4));
+    mn.pubKeyCollateralAddress = RandomPubKey();
+    mn.pubKeyMasternode = RandomPubKey();
+    mn.protocolVersion = PROTOCOL_VERSION;
+    return mn;
+}
+
+static CDataStream SignedPing(CKey& key)
+{
+    CMasternodePing mnp;
+    mnp.vin = CTxIn(GetRandHash(), 0);
+    mnp.sigTime = GetAdjustedTime();
+    std::string errorMessage;
+    BOOST_CHECK(masternodeSigner.SignMessage(mnp.GetStrMessage(), errorMessage, mnp.vchSig, key));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnp;
+    return ss;
+}
+
+BOOST_AUTO_TEST_CASE(ping_storm)
+{
+    const int nMasternodes = 5000;
+    const int nPingRounds = 20;
+
+    CMasternodeMan mnman;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < nMasternodes; i++) {
+        vMasternodes.push_back(RandomMasternode());
+        BOOST_CHECK(mnman.Add(vMasternodes.back()));
+    }
+    std::vector<CScript> vPayees;
+    BOOST_FOREACH (const CMasternode& mn, vMasternodes)
+        vPayees.push_back(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+
+    // Every masternode pings every round, each ping resolves its sender by outpoint
+    // and its signer by pubkey, and every block looks up a payee
+    int64_t nStart = GetTimeMicros();
+    int nFound = 0;
+    for (int nRound = 0; nRound < nPingRounds; nRound++) {
+        for (int i = 0; i < nMasternodes; i++) {
+            CMasternodePtr pmn = mnman.Find(vMasternodes[i].vin);
+            if (pmn && mnman.Find(pmn->pubKeyMasternode) == pmn)
+                nFound++;
+        }
+        mnman.Find(vPayees[nRound % nMasternodes]);
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nFound, nMasternodes * nPingRounds);
+    BOOST_TEST_MESSAGE(strprintf("Masternode ping storm: %d pings over %d masternodes in %dus",
+        nMasternodes * nPingRounds, nMasternodes, nElapsed));
+}
+
+BOOST_AUTO_TEST_CASE(message_verifier)
+{
+    const int nMessages = 400;
+    const int nThreads = 4;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    std::vector<CDataStream> vSerial, vParallel;
+    for (int i = 0; i < nMessages; i++) {
+        vSerial.push_back(SignedPing(key));
+        vParallel.push_back(SignedPing(key));
+    }
+
+    // Baseline: verify inline on one thread
+    std::string errorMessage;
+    int64_t nStart = GetTimeMicros();
+    BOOST_FOREACH (CDataStream& ss, vSerial) {
+        CMasternodePing mnp;
+        ss >> mnp;
+        BOOST_CHECK(masternodeSigner.VerifyMessage(pubkey, mnp.vchSig, mnp.GetStrMessage(), errorMessage));
+    }
+    int64_t nSerial = GetTimeMicros() - nStart;
+
+    CMasternodeMessageVerifier verifier;
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CMasternodeMessageVerifier::Thread, &verifier));
+    MilliSleep(10);
+
+    // The verifier threads check the signatures, the message handler finds them cached
+    nStart = GetTimeMicros();
+    BOOST_FOREACH (const CDataStream& ss, vParallel)
+        BOOST_CHECK(verifier.Push(1, "mnp", ss));
+    int nPopped = 0;
+    int64_t nTimeout = GetTimeMillis() + 60 * 1000;
+    while (nPopped < nMessages && GetTimeMillis() < nTimeout) {
+        std::string strCommand;
+        CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+        if (!verifier.PopVerified(1, strCommand, vRecv)) {
+            MilliSleep(1);
+            continue;
+        }
+        CMasternodePing mnp;
+        vRecv >> mnp;
+        BOOST_CHECK(masternodeSigner.VerifyMessage(pubkey, mnp.vchSig, mnp.GetStrMessage(), errorMessage));
+        nPopped++;
+    }
+    int64_t nParallel = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nPopped, nMessages);
+
+    threads.interrupt_all();
+    threads.join_all();
+
+    BOOST_TEST_MESSAGE(strprintf("Masternode ping signatures: %d inline in %dus, %d on %d threads in %dus",
+        nMessages, nSerial, nMessages, nThreads, nParallel));
+}
+
+BOOST_AUTO_TEST_CASE(rank_sporks)
+{
+    // Ranking with payment enforcement on checks every masternode's age against SPORK_16
+    CSporkMessage spork;
+    spork.nSporkID = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT;
+    spork.nValue = 0;
+    spork.nTimeSigned = GetTime();
+    SetSporkActive(spork);
+
+    const int nBlockHeight = 1000;
+    mapCacheBlockHashes[nBlockHeight] = GetRandHash();
+
+    CMasternodeMan mnman;
+    const int nMasternodes = 2000;
+    std::vector<CTxIn> vecVin;
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternode mn = RandomMasternode();
+        mn.sigTime = GetAdjustedTime() - SPORK_16_MN_WINNER_MINIMUM_AGE_DEFAULT * 2;
+        mnman.Add(mn);
+        vecVin.push_back(mn.vin);
+    }
+
+    const int nRuns = 20;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nRuns; i++)
+        BOOST_CHECK(mnman.GetMasternodeRank(vecVin[i], nBlockHeight, 0, false) > 0);
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    spork.nValue = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
+    spork.nTimeSigned++;
+    SetSporkActive(spork);
+    mapCacheBlockHashes.erase(nBlockHeight);
+
+    BOOST_TEST_MESSAGE(strprintf("GetMasternodeRank over %d masternodes with sporks active: %dus per call",
+        nMasternodes, nElapsed / nRuns));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
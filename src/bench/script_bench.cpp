@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "data/script_valid.json.h"
+
+#include "core_io.h"
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "script/script_error.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/assign/list_of.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_AUTO_TEST_SUITE(script_bench)
+
+static std::map<std::string, unsigned int> mapFlagNames = boost::assign::map_list_of
+    (std::string("NONE"), (unsigned int)SCRIPT_VERIFY_NONE)
+    (std::string("P2SH"), (unsigned int)SCRIPT_VERIFY_P2SH)
+    (std::string("STRICTENC"), (unsigned int)SCRIPT_VERIFY_STRICTENC)
+    (std::string("DERSIG"), (unsigned int)SCRIPT_VERIFY_DERSIG)
+    (std::string("LOW_S"), (unsigned int)SCRIPT_VERIFY_LOW_S)
+    (std::string("SIGPUSHONLY"), (unsigned int)SCRIPT_VERIFY_SIGPUSHONLY)
+    (std::string("MINIMALDATA"), (unsigned int)SCRIPT_VERIFY_MINIMALDATA)
+    (std::string("NULLDUMMY"), (unsigned int)SCRIPT_VERIFY_NULLDUMMY)
+    (std::string("DISCOURAGE_UPGRADABLE_NOPS"), (unsigned int)SCRIPT_VERIFY_DISCOURAGE_UPGRADABLE_NOPS);
+
+static unsigned int ParseFlags(const std::string& strFlags)
+{
+    unsigned int flags = 0;
+    if (strFlags.empty())
+        return flags;
+    std::vector<std::string> words;
+    boost::algorithm::split(words, strFlags, boost::algorithm::is_any_of(","));
+    BOOST_FOREACH (const std::string& word, words) {
+        BOOST_REQUIRE_MESSAGE(mapFlagNames.count(word), "unknown verification flag " << word);
+        flags |= mapFlagNames[word];
+    }
+    return flags;
+}
+
+/** A transaction spending the single output of a transaction paying to scriptPubKey */
+static CTransaction MakeSpend(const CScript& scriptSig, const CScript& scriptPubKey)
+{
+    CMutableTransaction txCredit;
+    txCredit.nVersion = 1;
+    txCredit.vin.resize(1);
+    txCredit.vin[0].prevout.SetNull();
+    txCredit.vin[0].scriptSig = CScript() << CScriptNum(0) << CScriptNum(0);
+    txCredit.vin[0].nSequence = std::numeric_limits<unsigned int>::max();
+    txCredit.vout.resize(1);
+    txCredit.vout[0].scriptPubKey = scriptPubKey;
+    txCredit.vout[0].nValue = 0;
+
+    CMutableTransaction txSpend;
+    txSpend.nVersion = 1;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txCredit.GetHash(), 0);
+    txSpend.vin[0].scriptSig = scriptSig;
+    txSpend.vin[0].nSequence = std::numeric_limits<unsigned int>::max();
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 0;
+    return txSpend;
+}
+
+BOOST_AUTO_TEST_CASE(script_valid)
+{
+    // Time VerifyScript alone over the valid test vectors
+    struct ValidTest {
+        CScript scriptSig;
+        CScript scriptPubKey;
+        unsigned int flags;
+        CTransaction tx;
+    };
+    std::vector<ValidTest> vTests;
+    UniValue tests;
+    BOOST_REQUIRE(tests.read(std::string(json_tests::script_valid, json_tests::script_valid + sizeof(json_tests::script_valid))));
+    for (unsigned int idx = 0; idx < tests.size(); idx++) {
+        UniValue test = tests[idx];
+        if (test.size() < 3)
+            continue;
+        ValidTest vt;
+        vt.scriptSig = ParseScript(test[0].get_str());
+        vt.scriptPubKey = ParseScript(test[1].get_str());
+        vt.flags = ParseFlags(test[2].get_str());
+        vt.tx = MakeSpend(vt.scriptSig, vt.scriptPubKey);
+        vTests.push_back(vt);
+    }
+
+    const int nRuns = 20;
+    int nFailed = 0;
+    int64_t nStart = GetTimeMicros();
+    for (int run = 0; run < nRuns; run++) {
+        BOOST_FOREACH (const ValidTest& vt, vTests) {
+            ScriptError err;
+            if (!VerifyScript(vt.scriptSig, vt.scriptPubKey, vt.flags, TransactionSignatureChecker(&vt.tx, 0), &err))
+                nFailed++;
+        }
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nFailed, 0);
+    BOOST_TEST_MESSAGE(strprintf("VerifyScript: %d script_valid vectors x %d in %dus",
+        vTests.size(), nRuns, nElapsed));
+}
+
+BOOST_AUTO_TEST_CASE(sighash_cache)
+{
+    CMutableTransaction txTo;
+    for (int i = 0; i < 1000; i++) {
+        txTo.vin.push_back(CTxIn(GetRandHash(), i % 4));
+        txTo.vin.back().scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+    }
+    for (int i = 0; i < 2; i++)
+        txTo.vout.push_back(CTxOut(i + 1, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG));
+    CTransaction tx(txTo);
+    CScript scriptCode = tx.vout[0].scriptPubKey;
+
+    // Hash every input the way a full check of the transaction does
+    int64_t nStart = GetTimeMicros();
+    uint256 hashAll;
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+        hashAll ^= SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL);
+    int64_t nLegacy = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    uint256 hashAllCached;
+    CSignatureHashCache sighashCache(tx);
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+        hashAllCached ^= sighashCache.SignatureHash(scriptCode, nIn, SIGHASH_ALL);
+    int64_t nCached = GetTimeMicros() - nStart;
+
+    BOOST_CHECK(hashAll == hashAllCached);
+    BOOST_TEST_MESSAGE(strprintf("SignatureHash of %d inputs: %dus without cache, %dus with cache",
+        tx.vin.size(), nLegacy, nCached));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
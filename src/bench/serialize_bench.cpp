@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "serialize.h"
+#include "streams.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <stdint.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(serialize_bench)
+
+/** A transaction spending nIn pay-to-pubkey-hash outputs to nOut */
+static CTransaction MakeTransaction(int nIn, int nOut)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(nIn);
+    for (int i = 0; i < nIn; i++) {
+        tx.vin[i].prevout = COutPoint(GetRandHash(), i);
+        std::vector<unsigned char> vchSig(72), vchPubKey(33);
+        GetRandBytes(&vchSig[0], vchSig.size());
+        GetRandBytes(&vchPubKey[0], vchPubKey.size());
+        tx.vin[i].scriptSig = CScript() << vchSig << vchPubKey;
+    }
+    tx.vout.resize(nOut);
+    for (int i = 0; i < nOut; i++) {
+        std::vector<unsigned char> vchHash(20);
+        GetRandBytes(&vchHash[0], vchHash.size());
+        tx.vout[i].nValue = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return tx;
+}
+
+/** Serialize obj nRounds times, then read it back by copying into a CDataStream and in place */
+template <typename T>
+static void BenchSerialize(const char* pszName, const T& obj, int nRounds)
+{
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nRounds; i++) {
+        CSecureDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << obj;
+    }
+    int64_t nSecure = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    std::string strData;
+    for (int i = 0; i < nRounds; i++) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << obj;
+        if (i == 0)
+            strData = ss.str();
+    }
+    int64_t nWrite = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nRounds; i++) {
+        CDataStream ss(strData.data(), strData.data() + strData.size(), SER_DISK, CLIENT_VERSION);
+        T objRead;
+        ss >> objRead;
+    }
+    int64_t nCopy = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nRounds; i++) {
+        CSpanReader reader(strData.data(), strData.data() + strData.size(), SER_DISK, CLIENT_VERSION);
+        T objRead;
+        reader >> objRead;
+    }
+    int64_t nSpan = GetTimeMicros() - nStart;
+    BOOST_TEST_MESSAGE(strprintf("%s (%d bytes) x%d: serialize %dus (wiped buffer %dus), deserialize from a copy %dus, in place %dus",
+        pszName, strData.size(), nRounds, nWrite, nSecure, nCopy, nSpan));
+}
+
+BOOST_AUTO_TEST_CASE(serialize_roundtrip)
+{
+    CTransaction txSmall = MakeTransaction(1, 2);
+    CTransaction txLarge = MakeTransaction(50, 20);
+    CBlock block;
+    for (int i = 0; i < 1000; i++)
+        block.vtx.push_back(i % 100 == 0 ? txLarge : txSmall);
+    CCoins coins(txLarge, 100000);
+
+    BenchSerialize("CTransaction 1-in 2-out", txSmall, 20000);
+    BenchSerialize("CTransaction 50-in 20-out", txLarge, 2000);
+    BenchSerialize("CBlock 1000 tx", block, 20);
+    BenchSerialize("CCoins 20 outputs", coins, 20000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,44 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "key.h"
+#include "keystore.h"
+#include "random.h"
+#include "script/standard.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+#include "wallet_ismine.h"
+
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(wallet_ismine_bench)
+
+BOOST_AUTO_TEST_CASE(ismine_foreign)
+{
+    // The outputs of a block range that pays to other wallets, against a wallet of a few keys
+    CBasicKeyStore keystore;
+    for (int i = 0; i < 100; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        keystore.AddCScript(GetScriptForDestination(key.GetPubKey().GetID()));
+    }
+
+    std::vector<CScript> vScripts;
+    for (int i = 0; i < 100000; i++)
+        vScripts.push_back(GetScriptForDestination(CKeyID(Hash160(ToByteVector(GetRandHash())))));
+    int64_t nStart = GetTimeMicros();
+    int nMine = 0;
+    BOOST_FOREACH (const CScript& script, vScripts)
+        nMine += IsMine(keystore, script) != ISMINE_NO;
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nMine, 0);
+    BOOST_TEST_MESSAGE(strprintf("IsMine: %u outputs in %dus", vScripts.size(), nElapsed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
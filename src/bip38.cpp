@@ -4,6 +4,7 @@
 
 #include "bip38.h"
 #include "base58.h"
+#include "crypto/scrypt.h"
 #include "hash.h"
 #include "pubkey.h"
 #include "util.h"
@@ -12,8 +13,12 @@
 #include <openssl/aes.h>
 #include <openssl/sha.h>
 #include <secp256k1.h>
+#include <algorithm>
 #include <string>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 
 /** 39 bytes - 78 characters
  * 1) Prefix - 2 bytes - 4 chars - strKey[0..3]
@@ -31,11 +36,34 @@ void DecryptAES(uint256 encryptedIn, uint256 decryptionKey, uint256& output)
     AES_decrypt(encryptedIn.begin(), output.begin(), &key);
 }
 
-void ComputePreFactor(std::string strPassphrase, std::string strSalt, uint256& prefactor)
+void BIP38_Scrypt(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char* output, unsigned int dkLen, unsigned int nThreads)
+{
+    const unsigned int N = 16384, r = 8, p = 8;
+    void* B1 = malloc(128 * r * p + 63);
+    uint8_t* B = (uint8_t*)(((uintptr_t)(B1) + 63) & ~(uintptr_t)(63));
+
+    scrypt_begin(pass, pLen, salt, sLen, B, r, p);
+
+    // The lanes are independent; hand them out over the threads, this one included
+    if (nThreads == 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1U, std::min(nThreads, scrypt_lane_jobs(p)));
+    boost::thread_group threads;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&scrypt_lanes, B, r, N, p, i, nThreads));
+    scrypt_lanes(B, r, N, p, 0, nThreads);
+    threads.join_all();
+
+    scrypt_end(pass, pLen, B, r, p, output, dkLen);
+
+    free(B1);
+}
+
+void ComputePreFactor(std::string strPassphrase, std::string strSalt, uint256& prefactor, unsigned int nThreads)
 {
     //passfactor is the scrypt hash of passphrase and ownersalt (NOTE this needs to handle alt cases too in the future)
     uint64_t s = uint256(ReverseEndianString(strSalt)).Get64();
-    scrypt_hash(strPassphrase.c_str(), strPassphrase.size(), BEGIN(s), strSalt.size() / 2, BEGIN(prefactor), 16384, 8, 8, 32);
+    BIP38_Scrypt(strPassphrase.c_str(), strPassphrase.size(), BEGIN(s), strSalt.size() / 2, BEGIN(prefactor), 32, nThreads);
 }
 
 void ComputePassfactor(std::string ownersalt, uint256 prefactor, uint256& passfactor)
@@ -83,7 +111,7 @@ std::string BIP38_Encrypt(std::string strAddress, std::string strPassphrase, uin
 
     uint512 hashed;
     uint64_t salt = uint256(ReverseEndianString(strAddressHash)).Get64();
-    scrypt_hash(strPassphrase.c_str(), strPassphrase.size(), BEGIN(salt), strAddressHash.size() / 2, BEGIN(hashed), 16384, 8, 8, 64);
+    BIP38_Scrypt(strPassphrase.c_str(), strPassphrase.size(), BEGIN(salt), strAddressHash.size() / 2, BEGIN(hashed), 64, 0);
 
     uint256 derivedHalf1(hashed.ToString().substr(64, 64));
     uint256 derivedHalf2(hashed.ToString().substr(0, 64));
@@ -128,7 +156,7 @@ std::string BIP38_Encrypt(std::string strAddress, std::string strPassphrase, uin
     return EncodeBase58(encryptedKey.begin(), encryptedKey.begin() + 43);
 }
 
-bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint256& privKey, bool& fCompressed)
+bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint256& privKey, bool& fCompressed, unsigned int nThreads)
 {
     std::string strKey = DecodeBase58(strEncryptedKey.c_str());
 
@@ -154,7 +182,7 @@ bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint2
         uint512 hashed;
         encryptedPart1 = uint256(ReverseEndianString(strKey.substr(14, 32)));
         uint64_t salt = uint256(ReverseEndianString(strAddressHash)).Get64();
-        scrypt_hash(strPassphrase.c_str(), strPassphrase.size(), BEGIN(salt), strAddressHash.size() / 2, BEGIN(hashed), 16384, 8, 8, 64);
+        BIP38_Scrypt(strPassphrase.c_str(), strPassphrase.size(), BEGIN(salt), strAddressHash.size() / 2, BEGIN(hashed), 64, nThreads);
 
         uint256 derivedHalf1(hashed.ToString().substr(64, 64));
         uint256 derivedHalf2(hashed.ToString().substr(0, 64));
@@ -172,7 +200,12 @@ bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint2
         //xor the decryption with the derived half 1 for the final key
         privKey = temp1 ^ derivedHalf1;
 
-        return true;
+        //a wrong passphrase still decrypts to some key, so check it against the address hash
+        CKey k;
+        k.Set(privKey.begin(), privKey.end(), fCompressed);
+        if (!k.IsValid())
+            return false;
+        return strAddressHash == AddressToBip38Hash(CBitcoinAddress(k.GetPubKey().GetID()).ToString());
     } else if (type != uint256(0x43)) //invalid type
         return false;
 
@@ -183,7 +216,7 @@ bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint2
         prefactorSalt = ownersalt.substr(0, 8);
 
     uint256 prefactor;
-    ComputePreFactor(strPassphrase, prefactorSalt, prefactor);
+    ComputePreFactor(strPassphrase, prefactorSalt, prefactor, nThreads);
 
     uint256 passfactor;
     if (fLotSequence)
@@ -22,7 +22,10 @@
 
 void DecryptAES(uint256 encryptedIn, uint256 decryptionKey, uint256& output);
 
-void ComputePreFactor(std::string strPassphrase, std::string strSalt, uint256& prefactor);
+/** scrypt at BIP38's N=16384, r=8, p=8, its lanes spread over up to nThreads threads (0 for one per core) */
+void BIP38_Scrypt(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char* output, unsigned int dkLen, unsigned int nThreads);
+
+void ComputePreFactor(std::string strPassphrase, std::string strSalt, uint256& prefactor, unsigned int nThreads = 0);
 
 void ComputePassfactor(std::string ownersalt, uint256 prefactor, uint256& passfactor);
 
@@ -33,7 +36,8 @@ void ComputeSeedBPass(CPubKey passpoint, std::string strAddressHash, std::string
 void ComputeFactorB(uint256 seedB, uint256& factorB);
 
 std::string BIP38_Encrypt(std::string strAddress, std::string strPassphrase, uint256 privKey, bool fCompressed);
-bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint256& privKey, bool& fCompressed);
+/** Decrypt strEncryptedKey, running scrypt on up to nThreads threads (0 for one per core) */
+bool BIP38_Decrypt(std::string strPassphrase, std::string strEncryptedKey, uint256& privKey, bool& fCompressed, unsigned int nThreads = 0);
 
 std::string AddressToBip38Hash(std::string address);
 
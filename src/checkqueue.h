@@ -6,6 +6,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -25,12 +28,26 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Each worker has a deque of its own, guarded by its own mutex. The master
+  * deals batches out over the deques as it adds them, a worker takes from
+  * the back of its own deque, and steals from the front of the others once
+  * that runs dry. The shared mutex is only taken to sleep and to wake up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A worker's share of the queue
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> queue;
+    };
+
+    //! The per-worker queues; the master uses the first, workers beyond their number share them
+    std::vector<WorkerQueue> vQueues;
+
+    //! Mutex to sleep and wake up on
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,96 +56,137 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The number of elements in the worker queues
+    std::atomic<unsigned int> nQueued;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of workers (excluding the master) that are idle.
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
+     * This includes elements that are not anymore in a queue, but still in
      * worker's own batches.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Hands out the worker queues to worker threads
+    std::atomic<unsigned int> nNextWorker;
+
+    //! The worker queue the master adds the next batch to
+    unsigned int nNextQueue;
+
+    /** Fill vChecks from queue n, or steal from the others if it is empty. */
+    bool Take(unsigned int n, std::vector<T>& vChecks)
+    {
+        {
+            WorkerQueue& own = vQueues[n];
+            boost::unique_lock<boost::mutex> lock(own.mutex);
+            if (!own.queue.empty()) {
+                // Decide how many work units to process now.
+                // * Do not try to do everything at once, but aim for increasingly smaller batches so
+                //   all workers finish approximately simultaneously.
+                // * Try to account for idle jobs which will instantly start helping.
+                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+                unsigned int nNow = std::max(1U, std::min(nBatchSize, nQueued / (nTotal + nIdle + 1)));
+                nNow = std::min(nNow, (unsigned int)own.queue.size());
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++) {
+                    vChecks[i].swap(own.queue.back());
+                    own.queue.pop_back();
+                }
+                nQueued -= nNow;
+                return true;
+            }
+        }
+        for (unsigned int i = 1; i < vQueues.size(); i++) {
+            WorkerQueue& victim = vQueues[(n + i) % vQueues.size()];
+            boost::unique_lock<boost::mutex> lock(victim.mutex);
+            if (victim.queue.empty())
+                continue;
+            // Steal the older half, its owner keeps working on what it added last
+            unsigned int nNow = std::min(nBatchSize, ((unsigned int)victim.queue.size() + 1) / 2);
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                vChecks[j].swap(victim.queue.front());
+                victim.queue.pop_front();
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int n = fMaster ? 0 : (1 + nNextWorker++) % vQueues.size();
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        nTotal++;
         do {
-            {
+            if (!Take(n, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
+                if (fMaster) {
+                    // Only the master adds checks, so once it finds every queue empty the
+                    // rest is in the workers' hands; nQueued may still lag behind their pops
+                    while (nTodo != 0)
+                        condMaster.wait(lock);
+                    if (nTodo == 0) {
                         nTotal--;
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
+                        fAllOk = true;
                         // return the current status
                         return fRet;
                     }
+                } else {
+                    // Add reads nIdle after queueing, so either it wakes us or we see its checks
                     nIdle++;
-                    cond.wait(lock); // wait
+                    while (nQueued == 0)
+                        condWorker.wait(lock);
                     nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             BOOST_FOREACH (T& check, vChecks)
                 if (fOk)
                     fOk = check();
+            if (!fOk)
+                fAllOk = false;
+            unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master he can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, with a worker queue per expected thread
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nThreadsIn) : vQueues(std::max(1U, nThreadsIn)), nQueued(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn), nNextWorker(0), nNextQueue(0) {}
+
+    //! Size the worker queues to the threads that will run them, before any of them starts
+    void SetThreads(unsigned int nThreadsIn)
+    {
+        assert(nTotal == 0 && IsIdle());
+        std::vector<WorkerQueue>(std::max(1U, nThreadsIn)).swap(vQueues);
+        nNextWorker = 0;
+        nNextQueue = 0;
+    }
 
     //! Worker thread
     void Thread()
@@ -142,19 +200,30 @@ public:
         return Loop(true);
     }
 
-    //! Add a batch of checks to the queue
+    //! Add a batch of checks to the queue. Workers start on them right away.
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Deal the checks out over the worker queues, whoever runs dry steals the rest
+        for (size_t nStart = 0; nStart < vChecks.size(); nStart += nBatchSize) {
+            size_t nEnd = std::min(vChecks.size(), nStart + nBatchSize);
+            WorkerQueue& target = vQueues[nNextQueue++ % vQueues.size()];
+            boost::unique_lock<boost::mutex> lock(target.mutex);
+            for (size_t i = nStart; i < nEnd; i++) {
+                target.queue.push_back(T());
+                vChecks[i].swap(target.queue.back());
+            }
+            nQueued += nEnd - nStart;
+        }
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -163,8 +232,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && nQueued == 0 && fAllOk == true);
     }
 };
 
@@ -8,9 +8,12 @@
 #include "script/standard.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include <openssl/aes.h>
 #include <openssl/evp.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -208,6 +211,7 @@ bool CCryptoKeyStore::Lock()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        mapKeyCache.clear();
     }
 
     NotifyStatusChanged(this);
@@ -253,6 +257,7 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
         if (keyFail || !keyPass)
             return false;
         vMasterKey = vMasterKeyIn;
+        mapKeyCache.clear();
         fDecryptionThoroughlyChecked = true;
     }
     NotifyStatusChanged(this);
@@ -289,6 +294,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey& vchPubKey, const std::vector<
             return false;
 
         mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+        AddKeyScriptPubKeys(vchPubKey);
     }
     return true;
 }
@@ -303,6 +309,11 @@ bool CCryptoKeyStore::GetKey(const CKeyID& address, CKey& keyOut) const
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
         if (mi != mapCryptedKeys.end()) {
             const CPubKey& vchPubKey = (*mi).second.first;
+            std::map<CKeyID, CKeyingMaterial>::const_iterator it = mapKeyCache.find(address);
+            if (it != mapKeyCache.end()) {
+                keyOut.Set(it->second.begin(), it->second.end(), vchPubKey.IsCompressed());
+                return true;
+            }
             const std::vector<unsigned char>& vchCryptedSecret = (*mi).second.second;
             CKeyingMaterial vchSecret;
             if (!DecryptSecret(vMasterKey, vchCryptedSecret, vchPubKey.GetHash(), vchSecret))
@@ -310,12 +321,64 @@ bool CCryptoKeyStore::GetKey(const CKeyID& address, CKey& keyOut) const
             if (vchSecret.size() != 32)
                 return false;
             keyOut.Set(vchSecret.begin(), vchSecret.end(), vchPubKey.IsCompressed());
+            if (mapKeyCache.size() < MAX_KEY_CACHE_SIZE)
+                mapKeyCache[address] = vchSecret;
             return true;
         }
     }
     return false;
 }
 
+typedef std::pair<CKeyID, std::pair<CPubKey, std::vector<unsigned char> > > CCryptedKeyEntry;
+
+static void DecryptKeys(const CKeyingMaterial* pvMasterKey, const std::vector<CCryptedKeyEntry>* pvCrypted, std::vector<CKeyingMaterial>* pvSecrets, unsigned int nThread, unsigned int nThreads)
+{
+    for (unsigned int i = nThread; i < pvCrypted->size(); i += nThreads) {
+        const CPubKey& vchPubKey = (*pvCrypted)[i].second.first;
+        if (!DecryptSecret(*pvMasterKey, (*pvCrypted)[i].second.second, vchPubKey.GetHash(), (*pvSecrets)[i]))
+            (*pvSecrets)[i].clear();
+    }
+}
+
+void CCryptoKeyStore::WarmKeyCache(const std::set<CKeyID>& setAddress, unsigned int nThreads)
+{
+    // Copy out what to decrypt, so the decryption runs without cs_KeyStore
+    CKeyingMaterial vMasterKeyCopy;
+    std::vector<CCryptedKeyEntry> vCrypted;
+    {
+        LOCK(cs_KeyStore);
+        if (!IsCrypted() || vMasterKey.empty())
+            return;
+        vMasterKeyCopy = vMasterKey;
+        BOOST_FOREACH (const CKeyID& address, setAddress) {
+            if (mapKeyCache.size() + vCrypted.size() >= MAX_KEY_CACHE_SIZE)
+                break;
+            CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
+            if (mi != mapCryptedKeys.end() && !mapKeyCache.count(address))
+                vCrypted.push_back(*mi);
+        }
+    }
+
+    std::vector<CKeyingMaterial> vSecrets(vCrypted.size());
+    if (nThreads == 0)
+        nThreads = boost::thread::hardware_concurrency();
+    nThreads = std::max(1U, std::min(nThreads, (unsigned int)vCrypted.size()));
+    boost::thread_group threads;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&DecryptKeys, &vMasterKeyCopy, &vCrypted, &vSecrets, i, nThreads));
+    DecryptKeys(&vMasterKeyCopy, &vCrypted, &vSecrets, 0, nThreads);
+    threads.join_all();
+
+    LOCK(cs_KeyStore);
+    // The wallet may have been locked, or unlocked with another master key, meanwhile
+    if (vMasterKey != vMasterKeyCopy)
+        return;
+    for (unsigned int i = 0; i < vCrypted.size() && mapKeyCache.size() < MAX_KEY_CACHE_SIZE; i++) {
+        if (vSecrets[i].size() == 32)
+            mapKeyCache[vCrypted[i].first] = vSecrets[i];
+    }
+}
+
 bool CCryptoKeyStore::GetPubKey(const CKeyID& address, CPubKey& vchPubKeyOut) const
 {
     {
@@ -13,6 +13,8 @@ class uint256;
 
 const unsigned int WALLET_CRYPTO_KEY_SIZE = 32;
 const unsigned int WALLET_CRYPTO_SALT_SIZE = 8;
+//! Most keys CCryptoKeyStore keeps decrypted while unlocked
+const unsigned int MAX_KEY_CACHE_SIZE = 10000;
 
 /**
  * Private key encryption is done based on a CMasterKey,
@@ -132,6 +134,9 @@ private:
     //! keeps track of whether Unlock has run a thorough check before
     bool fDecryptionThoroughlyChecked;
 
+    //! secrets GetKey has decrypted since Unlock, in locked memory and wiped by Lock
+    mutable std::map<CKeyID, CKeyingMaterial> mapKeyCache;
+
 protected:
     bool SetCrypted();
 
@@ -177,6 +182,8 @@ public:
         return false;
     }
     bool GetKey(const CKeyID& address, CKey& keyOut) const;
+    //! Decrypt these keys into the cache ahead of signing, on up to nThreads threads (0 for one per core)
+    void WarmKeyCache(const std::set<CKeyID>& setAddress, unsigned int nThreads = 0);
     bool GetPubKey(const CKeyID& address, CPubKey& vchPubKeyOut) const;
     void GetKeys(std::set<CKeyID>& setAddress) const
     {
@@ -36,6 +36,26 @@
 #include <string.h>
 #include <stdint.h>
 
+#if defined(HAVE_CONFIG_H)
+#include "config/rdct-config.h"
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__amd64__) || defined(__i386__)) && !defined(BUILD_BITCOIN_INTERNAL)
+#include <cpuid.h>
+#endif
+
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace scrypt_avx2
+{
+void SMix_2way(uint8_t* B0, uint8_t* B1, unsigned int r, unsigned int N, void* V, void* XY);
+}
+#endif
+
 #ifndef __FreeBSD__
 static inline void be32enc(void *pp, uint32_t x)
 {
@@ -359,26 +379,272 @@ void SMix(uint8_t *B, unsigned int r, unsigned int N, void* _V, void* XY)
         le32enc_2(&B[4 * k], X[k]);
 }
 
-void scrypt(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char *output, unsigned int N, unsigned int r, unsigned int p, unsigned int dkLen)
+#if defined(__SSE2__)
+/**
+ * salsa20_8_sse2(B):
+ * Apply the salsa20/8 core to a block whose words are stored in the order
+ * 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11, so that each quarter
+ * round works on whole vectors.
+ */
+static void
+salsa20_8_sse2(__m128i B[4])
 {
-    //containers
-    void* V0 = malloc(128 * r * N + 63);
-    void* XY0 = malloc(256 * r + 64 + 63);
-    void* B1 = malloc(128 * r * p + 63);
-    uint8_t* B = (uint8_t *)(((uintptr_t)(B1) + 63) & ~ (uintptr_t)(63));
+    __m128i X0 = B[0], X1 = B[1], X2 = B[2], X3 = B[3];
+    __m128i T;
+    size_t i;
+
+    for (i = 0; i < 8; i += 2) {
+#define R(a,b) _mm_xor_si128(_mm_slli_epi32((a), (b)), _mm_srli_epi32((a), 32 - (b)))
+        /* Operate on columns. */
+        T = _mm_add_epi32(X0, X3);  X1 = _mm_xor_si128(X1, R(T, 7));
+        T = _mm_add_epi32(X1, X0);  X2 = _mm_xor_si128(X2, R(T, 9));
+        T = _mm_add_epi32(X2, X1);  X3 = _mm_xor_si128(X3, R(T, 13));
+        T = _mm_add_epi32(X3, X2);  X0 = _mm_xor_si128(X0, R(T, 18));
+
+        /* Rearrange data. */
+        X1 = _mm_shuffle_epi32(X1, 0x93);
+        X2 = _mm_shuffle_epi32(X2, 0x4E);
+        X3 = _mm_shuffle_epi32(X3, 0x39);
+
+        /* Operate on rows. */
+        T = _mm_add_epi32(X0, X1);  X3 = _mm_xor_si128(X3, R(T, 7));
+        T = _mm_add_epi32(X3, X0);  X2 = _mm_xor_si128(X2, R(T, 9));
+        T = _mm_add_epi32(X2, X3);  X1 = _mm_xor_si128(X1, R(T, 13));
+        T = _mm_add_epi32(X1, X2);  X0 = _mm_xor_si128(X0, R(T, 18));
+
+        /* Rearrange data. */
+        X1 = _mm_shuffle_epi32(X1, 0x39);
+        X2 = _mm_shuffle_epi32(X2, 0x4E);
+        X3 = _mm_shuffle_epi32(X3, 0x93);
+#undef R
+    }
+    B[0] = _mm_add_epi32(B[0], X0);
+    B[1] = _mm_add_epi32(B[1], X1);
+    B[2] = _mm_add_epi32(B[2], X2);
+    B[3] = _mm_add_epi32(B[3], X3);
+}
+
+/**
+ * blockmix_salsa8_sse2(Bin, Bout, X, r):
+ * blockmix_salsa8 on blocks in the order salsa20_8_sse2 uses.
+ */
+static void
+blockmix_salsa8_sse2(const __m128i * Bin, __m128i * Bout, __m128i * X, size_t r)
+{
+    size_t i;
+    int k;
+
+    /* 1: X <-- B_{2r - 1} */
+    for (k = 0; k < 4; k++)
+        X[k] = Bin[8 * r - 4 + k];
+
+    /* 2: for i = 0 to 2r - 1 do */
+    for (i = 0; i < r; i++) {
+        /* 3: X <-- H(X \xor B_i) */
+        for (k = 0; k < 4; k++)
+            X[k] = _mm_xor_si128(X[k], Bin[8 * i + k]);
+        salsa20_8_sse2(X);
+
+        /* 4: Y_i <-- X */
+        /* 6: B' <-- (Y_0, Y_2 ... Y_{2r-2}, Y_1, Y_3 ... Y_{2r-1}) */
+        for (k = 0; k < 4; k++)
+            Bout[4 * i + k] = X[k];
+
+        /* 3: X <-- H(X \xor B_i) */
+        for (k = 0; k < 4; k++)
+            X[k] = _mm_xor_si128(X[k], Bin[8 * i + 4 + k]);
+        salsa20_8_sse2(X);
+
+        /* 4: Y_i <-- X */
+        /* 6: B' <-- (Y_0, Y_2 ... Y_{2r-2}, Y_1, Y_3 ... Y_{2r-1}) */
+        for (k = 0; k < 4; k++)
+            Bout[4 * (r + i) + k] = X[k];
+    }
+}
+
+static void
+blkxor_sse2(__m128i * dest, const __m128i * src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        dest[i] = _mm_xor_si128(dest[i], src[i]);
+}
+
+/** SMix with the SSE2 Salsa20/8. The word 0 of each block stays in place, so Integerify is unchanged. */
+static void SMix_sse2(uint8_t *B, unsigned int r, unsigned int N, void* _V, void* XY)
+{
+    __m128i* X = (__m128i*)XY;
+    __m128i* Y = X + 8 * r;
+    __m128i* Z = Y + 8 * r;
+    __m128i* V = (__m128i*)_V;
+    uint32_t* X32 = (uint32_t*)X;
+    size_t k;
+    int i;
+
+    /* 1: X <-- B */
+    for (k = 0; k < 2 * r; k++)
+        for (i = 0; i < 16; i++)
+            X32[k * 16 + i] = le32dec_2(&B[(k * 16 + (i * 5 % 16)) * 4]);
+
+    /* 2: for i = 0 to N - 1 do */
+    for (size_t n = 0; n < N; n += 2) {
+        /* 3: V_i <-- X */
+        blkcpy(&V[n * (8 * r)], X, 128 * r);
+
+        /* 4: X <-- H(X) */
+        blockmix_salsa8_sse2(X, Y, Z, r);
+
+        /* 3: V_i <-- X */
+        blkcpy(&V[(n + 1) * (8 * r)], Y, 128 * r);
+
+        /* 4: X <-- H(X) */
+        blockmix_salsa8_sse2(Y, X, Z, r);
+    }
+
+    /* 6: for i = 0 to N - 1 do */
+    for (size_t n = 0; n < N; n += 2) {
+        /* 7: j <-- Integerify(X) mod N */
+        size_t j = integerify(X, r) & (N - 1);
+
+        /* 8: X <-- H(X \xor V_j) */
+        blkxor_sse2(X, &V[j * (8 * r)], 8 * r);
+        blockmix_salsa8_sse2(X, Y, Z, r);
+
+        /* 7: j <-- Integerify(X) mod N */
+        j = integerify(Y, r) & (N - 1);
+
+        /* 8: X <-- H(X \xor V_j) */
+        blkxor_sse2(Y, &V[j * (8 * r)], 8 * r);
+        blockmix_salsa8_sse2(Y, X, Z, r);
+    }
+
+    /* 10: B' <-- X */
+    for (k = 0; k < 2 * r; k++)
+        for (i = 0; i < 16; i++)
+            le32enc_2(&B[(k * 16 + (i * 5 % 16)) * 4], X32[k * 16 + i]);
+}
+#endif
+
+namespace
+{
+typedef void (*SMixFn)(uint8_t* B, unsigned int r, unsigned int N, void* V, void* XY);
+typedef void (*SMix2Fn)(uint8_t* B0, uint8_t* B1, unsigned int r, unsigned int N, void* V, void* XY);
+
+#if defined(__SSE2__)
+SMixFn SMix_1way = SMix_sse2;
+#else
+SMixFn SMix_1way = SMix;
+#endif
+
+//! Two lanes at once, when ScryptAutoDetect found a CPU that can
+SMix2Fn SMix_2way = NULL;
+
+#if (defined(__x86_64__) || defined(__amd64__) || defined(__i386__)) && !defined(BUILD_BITCOIN_INTERNAL)
+/** Whether the OS saves the AVX registers on context switches */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+/** Whether SMix_2way agrees with SMix_1way on both of its lanes */
+bool SelfTest()
+{
+    if (!SMix_2way)
+        return true;
+    const unsigned int r = 2, N = 16;
+    uint8_t B[2 * 128 * r], B2[2 * 128 * r];
+    for (unsigned int i = 0; i < sizeof(B); i++)
+        B[i] = B2[i] = i * 7 + 1;
+    void* V0 = malloc(2 * 128 * r * N + 63);
+    void* XY0 = malloc(2 * (256 * r + 64) + 63);
     uint32_t* V = (uint32_t *)(((uintptr_t)(V0) + 63) & ~ (uintptr_t)(63));
     uint32_t* XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
+    SMix_1way(B, r, N, V, XY);
+    SMix_1way(B + 128 * r, r, N, V, XY);
+    SMix_2way(B2, B2 + 128 * r, r, N, V, XY);
+    free(V0);
+    free(XY0);
+    return memcmp(B, B2, sizeof(B)) == 0;
+}
+} // namespace
 
+std::string ScryptAutoDetect()
+{
+#if defined(__SSE2__)
+    std::string ret = "sse2";
+#else
+    std::string ret = "standard";
+#endif
+#if (defined(__x86_64__) || defined(__amd64__) || defined(__i386__)) && !defined(BUILD_BITCOIN_INTERNAL) && defined(ENABLE_AVX2)
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(1, 0, eax, ebx, ecx, edx);
+        bool fAVX = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled(); // OSXSAVE and AVX
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (fAVX && ((ebx >> 5) & 1)) {
+            SMix_2way = scrypt_avx2::SMix_2way;
+            ret += ",avx2(2way)";
+        }
+    }
+#endif
+    if (!SelfTest()) {
+        // Never derive keys with an implementation that disagrees with the single lane one
+        SMix_2way = NULL;
+        ret += " (2way disabled)";
+    }
+    return ret;
+}
+
+unsigned int scrypt_lane_jobs(unsigned int p)
+{
+    // Lanes go in pairs when two can run at once
+    unsigned int nWidth = SMix_2way && p > 1 ? 2 : 1;
+    return (p + nWidth - 1) / nWidth;
+}
+
+void scrypt_begin(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, uint8_t* B, unsigned int r, unsigned int p)
+{
     PBKDF2_SHA256((const uint8_t *)pass, pLen, (const uint8_t *)salt, sLen, 1, B, p * 128 * r);
+}
 
-    for(unsigned int i = 0; i < p; i++)
-    {
-        SMix(&B[i * 128 * r], r, N, V, XY);
-    }
+void scrypt_lanes(uint8_t* B, unsigned int r, unsigned int N, unsigned int p, unsigned int nThread, unsigned int nThreads)
+{
+    // Lanes go in pairs when two can run at once
+    unsigned int nWidth = SMix_2way && p > 1 ? 2 : 1;
+    void* V0 = malloc(nWidth * (size_t)128 * r * N + 63);
+    void* XY0 = malloc(nWidth * (256 * r + 64) + 63);
+    uint32_t* V = (uint32_t *)(((uintptr_t)(V0) + 63) & ~ (uintptr_t)(63));
+    uint32_t* XY = (uint32_t *)(((uintptr_t)(XY0) + 63) & ~ (uintptr_t)(63));
 
-    PBKDF2_SHA256((const uint8_t *)pass, pLen, B, p * 128 * r, 1, (uint8_t *)output, dkLen);
+    for (unsigned int i = nThread * nWidth; i < p; i += nThreads * nWidth) {
+        if (nWidth == 2 && i + 1 < p)
+            SMix_2way(&B[i * 128 * r], &B[(i + 1) * 128 * r], r, N, V, XY);
+        else
+            SMix_1way(&B[i * 128 * r], r, N, V, XY);
+    }
 
     free(V0);
     free(XY0);
+}
+
+void scrypt_end(const char* pass, unsigned int pLen, const uint8_t* B, unsigned int r, unsigned int p, char* output, unsigned int dkLen)
+{
+    PBKDF2_SHA256((const uint8_t *)pass, pLen, B, p * 128 * r, 1, (uint8_t *)output, dkLen);
+}
+
+void scrypt(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char *output, unsigned int N, unsigned int r, unsigned int p, unsigned int dkLen)
+{
+    //containers
+    void* B1 = malloc(128 * r * p + 63);
+    uint8_t* B = (uint8_t *)(((uintptr_t)(B1) + 63) & ~ (uintptr_t)(63));
+
+    scrypt_begin(pass, pLen, salt, sLen, B, r, p);
+    scrypt_lanes(B, r, N, p, 0, 1);
+    scrypt_end(pass, pLen, B, r, p, output, dkLen);
+
     free(B1);
 }
@@ -4,6 +4,21 @@
 #include <stdint.h>
 #include <string>
 
+/** scrypt key derivation, all p lanes of SMix on the calling thread. */
 void scrypt(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, char *output, unsigned int N, unsigned int r, unsigned int p, unsigned int dkLen);
 
+/** The same derivation in steps, for callers that run the lanes on threads of
+ *  their own. scrypt_begin fills B (128 * r * p bytes) from the passphrase,
+ *  scrypt_lanes(B, ..., i, n) for every i < n mixes the lanes, in any order or
+ *  at once, and scrypt_end derives the key from B. More than
+ *  scrypt_lane_jobs(p) parts leaves some of them idle. */
+void scrypt_begin(const char* pass, unsigned int pLen, const char* salt, unsigned int sLen, uint8_t* B, unsigned int r, unsigned int p);
+void scrypt_lanes(uint8_t* B, unsigned int r, unsigned int N, unsigned int p, unsigned int nThread, unsigned int nThreads);
+void scrypt_end(const char* pass, unsigned int pLen, const uint8_t* B, unsigned int r, unsigned int p, char* output, unsigned int dkLen);
+unsigned int scrypt_lane_jobs(unsigned int p);
+
+/** Pick the fastest SMix this CPU supports, check it against the SSE2 one and
+ *  return its name. Call once at startup, before deriving keys. */
+std::string ScryptAutoDetect();
+
 #endif
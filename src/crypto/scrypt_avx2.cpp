@@ -0,0 +1,135 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// scrypt's SMix for two independent lanes at once, each in one 128-bit half
+// of the AVX2 registers. Blocks are kept in the same diagonal word order as
+// the SSE2 code in scrypt.cpp. Only built with ENABLE_AVX2.
+
+#ifdef ENABLE_AVX2
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace scrypt_avx2
+{
+namespace
+{
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Rot(__m256i x, int n) { return Xor(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+/** Salsa20/8 on one 64-byte block of each lane */
+void Salsa20_8(__m256i B[4])
+{
+    __m256i X0 = B[0], X1 = B[1], X2 = B[2], X3 = B[3];
+    for (int i = 0; i < 8; i += 2) {
+        // Operate on columns
+        X1 = Xor(X1, Rot(Add(X0, X3), 7));
+        X2 = Xor(X2, Rot(Add(X1, X0), 9));
+        X3 = Xor(X3, Rot(Add(X2, X1), 13));
+        X0 = Xor(X0, Rot(Add(X3, X2), 18));
+
+        X1 = _mm256_shuffle_epi32(X1, 0x93);
+        X2 = _mm256_shuffle_epi32(X2, 0x4E);
+        X3 = _mm256_shuffle_epi32(X3, 0x39);
+
+        // Operate on rows
+        X3 = Xor(X3, Rot(Add(X0, X1), 7));
+        X2 = Xor(X2, Rot(Add(X3, X0), 9));
+        X1 = Xor(X1, Rot(Add(X2, X3), 13));
+        X0 = Xor(X0, Rot(Add(X1, X2), 18));
+
+        X1 = _mm256_shuffle_epi32(X1, 0x39);
+        X2 = _mm256_shuffle_epi32(X2, 0x4E);
+        X3 = _mm256_shuffle_epi32(X3, 0x93);
+    }
+    B[0] = Add(B[0], X0);
+    B[1] = Add(B[1], X1);
+    B[2] = Add(B[2], X2);
+    B[3] = Add(B[3], X3);
+}
+
+/** Bout = BlockMix_{salsa20/8, r}(Bin), 8r vectors each */
+void BlockMix(const __m256i* Bin, __m256i* Bout, __m256i* X, size_t r)
+{
+    for (int k = 0; k < 4; k++)
+        X[k] = Bin[8 * r - 4 + k];
+    for (size_t i = 0; i < r; i++) {
+        for (int k = 0; k < 4; k++)
+            X[k] = Xor(X[k], Bin[8 * i + k]);
+        Salsa20_8(X);
+        for (int k = 0; k < 4; k++)
+            Bout[4 * i + k] = X[k];
+        for (int k = 0; k < 4; k++)
+            X[k] = Xor(X[k], Bin[8 * i + 4 + k]);
+        Salsa20_8(X);
+        for (int k = 0; k < 4; k++)
+            Bout[4 * (r + i) + k] = X[k];
+    }
+}
+
+/** Integerify of one lane (0 or 1) of B */
+uint32_t inline Integerify(const __m256i* B, size_t r, int lane)
+{
+    const uint32_t* X = (const uint32_t*)&B[8 * r - 4];
+    return X[4 * lane];
+}
+} // namespace
+
+/** SMix on lanes B0 and B1 of 128r bytes. V holds 256rN bytes and XY 512r + 128, both 32-byte aligned. */
+void SMix_2way(uint8_t* B0, uint8_t* B1, unsigned int r, unsigned int N, void* _V, void* XY)
+{
+    __m256i* X = (__m256i*)XY;
+    __m256i* Y = X + 8 * r;
+    __m256i* Z = Y + 8 * r;
+    __m256i* V = (__m256i*)_V;
+    uint32_t* X32 = (uint32_t*)X;
+
+    // X <-- B, word k of each block at position 5k mod 16, lane 0 in the low half
+    for (size_t k = 0; k < 2 * r; k++) {
+        for (int i = 0; i < 16; i++) {
+            size_t nPos = k * 16 + i;
+            size_t nWord = k * 16 + (i * 5 % 16);
+            X32[8 * (nPos / 4) + nPos % 4] = ReadLE32(&B0[4 * nWord]);
+            X32[8 * (nPos / 4) + 4 + nPos % 4] = ReadLE32(&B1[4 * nWord]);
+        }
+    }
+
+    for (size_t i = 0; i < N; i += 2) {
+        for (size_t k = 0; k < 8 * r; k++)
+            V[i * 8 * r + k] = X[k];
+        BlockMix(X, Y, Z, r);
+        for (size_t k = 0; k < 8 * r; k++)
+            V[(i + 1) * 8 * r + k] = Y[k];
+        BlockMix(Y, X, Z, r);
+    }
+
+    for (size_t i = 0; i < N; i += 2) {
+        // Each lane indexes V by its own Integerify
+        size_t j0 = Integerify(X, r, 0) & (N - 1), j1 = Integerify(X, r, 1) & (N - 1);
+        for (size_t k = 0; k < 8 * r; k++)
+            X[k] = Xor(X[k], _mm256_blend_epi32(V[j0 * 8 * r + k], V[j1 * 8 * r + k], 0xF0));
+        BlockMix(X, Y, Z, r);
+        j0 = Integerify(Y, r, 0) & (N - 1);
+        j1 = Integerify(Y, r, 1) & (N - 1);
+        for (size_t k = 0; k < 8 * r; k++)
+            Y[k] = Xor(Y[k], _mm256_blend_epi32(V[j0 * 8 * r + k], V[j1 * 8 * r + k], 0xF0));
+        BlockMix(Y, X, Z, r);
+    }
+
+    for (size_t k = 0; k < 2 * r; k++) {
+        for (int i = 0; i < 16; i++) {
+            size_t nPos = k * 16 + i;
+            size_t nWord = k * 16 + (i * 5 % 16);
+            WriteLE32(&B0[4 * nWord], X32[8 * (nPos / 4) + nPos % 4]);
+            WriteLE32(&B1[4 * nWord], X32[8 * (nPos / 4) + 4 + nPos % 4]);
+        }
+    }
+}
+} // namespace scrypt_avx2
+
+#endif
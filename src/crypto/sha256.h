@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,14 @@ public:
     CSHA256& Reset();
 };
 
+/** Pick the fastest SHA-256 implementation this CPU supports, check it against
+ *  the portable one and return its name. Call once at startup, before hashing
+ *  from several threads. */
+std::string SHA256AutoDetect();
+
+/** Double-SHA256 of blocks 64-byte messages, as used for the levels of a merkle tree.
+ *  out: blocks * 32 bytes
+ *  in:  blocks * 64 bytes */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
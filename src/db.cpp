@@ -142,11 +142,20 @@ void CDBEnv::MakeMock()
     fMockDb = true;
 }
 
+bool CDBEnv::IsLevelDB(const std::string& strFile)
+{
+    return boost::filesystem::is_directory(GetDataDir() / strFile);
+}
+
 CDBEnv::VerifyResult CDBEnv::Verify(std::string strFile, bool (*recoverFunc)(CDBEnv& dbenv, std::string strFile))
 {
     LOCK(cs_db);
     assert(mapFileUseCount.count(strFile) == 0);
 
+    // LevelDB checks its own log and tables when the database is opened
+    if (IsLevelDB(strFile))
+        return VERIFY_OK;
+
     Db db(&dbenv, 0);
     int result = db.verify(strFile.c_str(), NULL, NULL, 0);
     if (result == 0)
@@ -211,6 +220,8 @@ bool CDBEnv::Salvage(std::string strFile, bool fAggressive, std::vector<CDBEnv::
 
 void CDBEnv::CheckpointLSN(const std::string& strFile)
 {
+    if (IsLevelDB(strFile))
+        return;
     dbenv.txn_checkpoint(0, 0, 0);
     if (fMockDb)
         return;
@@ -218,7 +229,76 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activeTxn(NULL)
+CDBCursor::~CDBCursor()
+{
+    if (pcursor)
+        pcursor->close();
+    delete piter;
+}
+
+int CDBCursor::Read(CSecureDataStream& ssKey, CSecureDataStream& ssValue, unsigned int fFlags)
+{
+    if (piter) {
+        if (fFlags == DB_SET_RANGE)
+            piter->Seek(leveldb::Slice(&ssKey[0], ssKey.size()));
+        else if (fFlags != DB_NEXT)
+            return EINVAL;
+        else if (!fStarted)
+            piter->SeekToFirst();
+        else if (piter->Valid())
+            piter->Next();
+        fStarted = true;
+        if (!piter->Valid())
+            return piter->status().ok() ? DB_NOTFOUND : DB_RUNRECOVERY;
+
+        leveldb::Slice slKey = piter->key();
+        leveldb::Slice slValue = piter->value();
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write(slKey.data(), slKey.size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write(slValue.data(), slValue.size());
+        return 0;
+    }
+
+    // Read at cursor
+    Dbt datKey;
+    if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
+        datKey.set_data(&ssKey[0]);
+        datKey.set_size(ssKey.size());
+    }
+    Dbt datValue;
+    if (fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
+        datValue.set_data(&ssValue[0]);
+        datValue.set_size(ssValue.size());
+    }
+    datKey.set_flags(DB_DBT_MALLOC);
+    datValue.set_flags(DB_DBT_MALLOC);
+    int ret = pcursor->get(&datKey, &datValue, fFlags);
+    if (ret != 0)
+        return ret;
+    else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
+        return 99999;
+
+    // Convert to streams
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write((char*)datKey.get_data(), datKey.get_size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+    // Clear and free memory
+    memset(datKey.get_data(), 0, datKey.get_size());
+    memset(datValue.get_data(), 0, datValue.get_size());
+    free(datKey.get_data());
+    free(datValue.get_data());
+    return 0;
+}
+
+
+CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), pldb(NULL), activeTxn(NULL), fLevelDBTxn(false)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -237,6 +317,32 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activ
 
         strFile = strFilename;
         ++bitdb.mapFileUseCount[strFile];
+
+        bool fLevelDB = CDBEnv::IsLevelDB(strFile);
+        if (!fLevelDB && fCreate && GetArg("-walletbackend", "bdb") == "leveldb")
+            fLevelDB = !boost::filesystem::exists(GetDataDir() / strFile) && !bitdb.mapDb[strFile];
+        if (fLevelDB) {
+            pldb = bitdb.mapLevelDb[strFile];
+            if (pldb == NULL) {
+                try {
+                    pldb = new CLevelDBWrapper(GetDataDir() / strFile, nWalletLevelDBCache);
+                } catch (const std::exception& e) {
+                    --bitdb.mapFileUseCount[strFile];
+                    throw runtime_error(strprintf("CDB : Error opening LevelDB database %s: %s", strFile, e.what()));
+                }
+
+                if (fCreate && !Exists(string("version"))) {
+                    bool fTmp = fReadOnly;
+                    fReadOnly = false;
+                    WriteVersion(CLIENT_VERSION);
+                    fReadOnly = fTmp;
+                }
+
+                bitdb.mapLevelDb[strFile] = pldb;
+            }
+            return;
+        }
+
         pdb = bitdb.mapDb[strFile];
         if (pdb == NULL) {
             pdb = new Db(&bitdb.dbenv, 0);
@@ -289,8 +395,37 @@ void CDB::Flush()
     bitdb.dbenv.txn_checkpoint(nMinutes ? GetArg("-dblogsize", 100) * 1024 : 0, nMinutes, 0);
 }
 
+CDBCursor* CDB::GetCursor()
+{
+    if (pldb)
+        return new CDBCursor(pldb->NewIterator());
+    if (!pdb)
+        return NULL;
+    Dbc* pcursor = NULL;
+    int ret = pdb->cursor(NULL, &pcursor, 0);
+    if (ret != 0)
+        return NULL;
+    return new CDBCursor(pcursor);
+}
+
+void CDB::ClearLevelDBTxn()
+{
+    fLevelDBTxn = false;
+    batchTxn = CLevelDBBatch();
+    mapTxnWrites.clear();
+    setTxnErased.clear();
+}
+
 void CDB::Close()
 {
+    if (pldb) {
+        // Writes already went to the LevelDB log, an open transaction is dropped
+        ClearLevelDBTxn();
+        pldb = NULL;
+        LOCK(bitdb.cs_db);
+        --bitdb.mapFileUseCount[strFile];
+        return;
+    }
     if (!pdb)
         return;
     if (activeTxn)
@@ -317,6 +452,17 @@ void CDBEnv::CloseDb(const string& strFile)
             delete pdb;
             mapDb[strFile] = NULL;
         }
+        std::map<std::string, CLevelDBWrapper*>::iterator it = mapLevelDb.find(strFile);
+        if (it != mapLevelDb.end() && it->second != NULL) {
+            CLevelDBWrapper* pldb = it->second;
+            try {
+                pldb->Sync();
+            } catch (const leveldb_error& e) {
+                LogPrintf("CDBEnv::CloseDb : Failed to sync %s: %s\n", strFile, e.what());
+            }
+            delete pldb;
+            it->second = NULL;
+        }
     }
 }
 
@@ -329,6 +475,20 @@ bool CDBEnv::RemoveDb(const string& strFile)
     return (rc == 0);
 }
 
+/** Rename a wallet file in the data directory, a LevelDB directory or a file of the BDB environment */
+static bool RenameWalletFile(const string& strFrom, const string& strTo, bool fLevelDB)
+{
+    if (fLevelDB) {
+        try {
+            boost::filesystem::rename(GetDataDir() / strFrom, GetDataDir() / strTo);
+        } catch (const boost::filesystem::filesystem_error&) {
+            return false;
+        }
+        return true;
+    }
+    return bitdb.dbenv.dbrename(NULL, strFrom.c_str(), NULL, strTo.c_str(), DB_AUTO_COMMIT) == 0;
+}
+
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
     while (true) {
@@ -343,6 +503,80 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                 bool fSuccess = true;
                 LogPrintf("CDB::Rewrite : Rewriting %s...\n", strFile);
                 string strFileRes = strFile + ".rewrite";
+                if (CDBEnv::IsLevelDB(strFile)) {
+                    // Erased records stay in the LevelDB log and tables until a compaction
+                    // drops them, so copy the live records into a new directory and swap it
+                    // in: no unencrypted key of an encrypted wallet survives the rewrite
+                    { // surround usage of db with extra {}
+                        CDB db(strFile.c_str(), "r");
+                        CLevelDBWrapper* pldbCopy = NULL;
+                        CLevelDBBatch batch;
+                        try {
+                            pldbCopy = new CLevelDBWrapper(GetDataDir() / strFileRes, nWalletLevelDBCache, false, true);
+                        } catch (const std::exception& e) {
+                            LogPrintf("CDB::Rewrite : Can't create database %s: %s\n", strFileRes, e.what());
+                            fSuccess = false;
+                        }
+
+                        CDBCursor* pcursor = db.GetCursor();
+                        if (!pcursor)
+                            fSuccess = false;
+                        unsigned int nRecords = 0;
+                        while (fSuccess) {
+                            CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                            int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
+                            if (ret == DB_NOTFOUND) {
+                                break;
+                            } else if (ret != 0) {
+                                fSuccess = false;
+                                break;
+                            }
+                            if (pszSkip &&
+                                strncmp(&ssKey[0], pszSkip, std::min(ssKey.size(), strlen(pszSkip))) == 0)
+                                continue;
+                            if (strncmp(&ssKey[0], "\x07version", 8) == 0) {
+                                // Update version:
+                                ssValue.clear();
+                                ssValue << CLIENT_VERSION;
+                            }
+                            batch.WriteSecure(CFlatData(&ssKey[0], &ssKey[0] + ssKey.size()), CFlatData(&ssValue[0], &ssValue[0] + ssValue.size()));
+                            if (++nRecords % 1000 == 0) {
+                                try {
+                                    fSuccess = pldbCopy->WriteBatch(batch);
+                                } catch (const leveldb_error&) {
+                                    fSuccess = false;
+                                }
+                                batch = CLevelDBBatch();
+                            }
+                        }
+                        delete pcursor;
+
+                        if (pldbCopy) {
+                            try {
+                                fSuccess = fSuccess && pldbCopy->WriteBatch(batch, true);
+                            } catch (const leveldb_error&) {
+                                fSuccess = false;
+                            }
+                            delete pldbCopy;
+                        }
+                        db.Close();
+                        bitdb.CloseDb(strFile);
+                        bitdb.mapFileUseCount.erase(strFile);
+                    }
+                    if (fSuccess) {
+                        try {
+                            boost::filesystem::remove_all(GetDataDir() / strFile);
+                        } catch (const boost::filesystem::filesystem_error&) {
+                            fSuccess = false;
+                        }
+                    }
+                    if (fSuccess)
+                        fSuccess = RenameWalletFile(strFileRes, strFile, true);
+                    if (!fSuccess)
+                        LogPrintf("CDB::Rewrite : Failed to rewrite database %s\n", strFile);
+                    return fSuccess;
+                }
                 { // surround usage of db with extra {}
                     CDB db(strFile.c_str(), "r");
                     Db* pdbCopy = new Db(&bitdb.dbenv, 0);
@@ -358,17 +592,15 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
-                            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-                            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                            CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
                             int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
                             if (ret == DB_NOTFOUND) {
-                                pcursor->close();
                                 break;
                             } else if (ret != 0) {
-                                pcursor->close();
                                 fSuccess = false;
                                 break;
                             }
@@ -386,6 +618,7 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                             if (ret2 > 0)
                                 fSuccess = false;
                         }
+                    delete pcursor;
                     if (fSuccess) {
                         db.Close();
                         bitdb.CloseDb(strFile);
@@ -412,6 +645,130 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
     return false;
 }
 
+bool CDB::Convert(const string& strFile, bool fToLevelDB)
+{
+    while (true) {
+        {
+            LOCK(bitdb.cs_db);
+            if (!bitdb.mapFileUseCount.count(strFile) || bitdb.mapFileUseCount[strFile] == 0) {
+                bool fFromLevelDB = CDBEnv::IsLevelDB(strFile);
+                if (fFromLevelDB == fToLevelDB) {
+                    LogPrintf("CDB::Convert : %s already uses %s\n", strFile, fToLevelDB ? "leveldb" : "bdb");
+                    return true;
+                }
+
+                // Flush log data to the dat file
+                bitdb.CloseDb(strFile);
+                bitdb.CheckpointLSN(strFile);
+                bitdb.mapFileUseCount.erase(strFile);
+
+                bool fSuccess = true;
+                LogPrintf("CDB::Convert : Converting %s to %s...\n", strFile, fToLevelDB ? "leveldb" : "bdb");
+                string strFileRes = strFile + ".convert";
+                string strFileBak = strFile + (fFromLevelDB ? ".leveldb.bak" : ".bdb.bak");
+                unsigned int nRecords = 0;
+                { // surround usage of db with extra {}
+                    CDB db(strFile.c_str(), "r");
+                    CLevelDBWrapper* pldbCopy = NULL;
+                    Db* pdbCopy = NULL;
+                    DbTxn* ptxn = NULL;
+                    CLevelDBBatch batch;
+                    if (fToLevelDB) {
+                        try {
+                            pldbCopy = new CLevelDBWrapper(GetDataDir() / strFileRes, nWalletLevelDBCache, false, true);
+                        } catch (const std::exception& e) {
+                            LogPrintf("CDB::Convert : Can't create database %s: %s\n", strFileRes, e.what());
+                            fSuccess = false;
+                        }
+                    } else {
+                        pdbCopy = new Db(&bitdb.dbenv, 0);
+                        int ret = pdbCopy->open(NULL, // Txn pointer
+                            strFileRes.c_str(),       // Filename
+                            "main",                   // Logical db name
+                            DB_BTREE,                 // Database type
+                            DB_CREATE,                // Flags
+                            0);
+                        if (ret > 0) {
+                            LogPrintf("CDB::Convert : Can't create database file %s\n", strFileRes);
+                            fSuccess = false;
+                        }
+                        ptxn = bitdb.TxnBegin();
+                    }
+
+                    CDBCursor* pcursor = db.GetCursor();
+                    if (!pcursor)
+                        fSuccess = false;
+                    while (fSuccess) {
+                        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                        CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                        int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
+                        if (ret == DB_NOTFOUND) {
+                            break;
+                        } else if (ret != 0) {
+                            fSuccess = false;
+                            break;
+                        }
+                        nRecords++;
+                        if (fToLevelDB) {
+                            // Records are written in sorted batches, the way LevelDB appends them best
+                            batch.WriteSecure(CFlatData(&ssKey[0], &ssKey[0] + ssKey.size()), CFlatData(&ssValue[0], &ssValue[0] + ssValue.size()));
+                            if (nRecords % 1000 == 0) {
+                                try {
+                                    fSuccess = pldbCopy->WriteBatch(batch);
+                                } catch (const leveldb_error&) {
+                                    fSuccess = false;
+                                }
+                                batch = CLevelDBBatch();
+                            }
+                        } else {
+                            Dbt datKey(&ssKey[0], ssKey.size());
+                            Dbt datValue(&ssValue[0], ssValue.size());
+                            if (pdbCopy->put(ptxn, &datKey, &datValue, DB_NOOVERWRITE) > 0)
+                                fSuccess = false;
+                        }
+                    }
+                    delete pcursor;
+
+                    if (pldbCopy) {
+                        try {
+                            fSuccess = fSuccess && pldbCopy->WriteBatch(batch, true);
+                        } catch (const leveldb_error&) {
+                            fSuccess = false;
+                        }
+                        delete pldbCopy;
+                    }
+                    if (pdbCopy) {
+                        if (ptxn && ptxn->commit(0))
+                            fSuccess = false;
+                        if (pdbCopy->close(0))
+                            fSuccess = false;
+                        delete pdbCopy;
+                    }
+                    db.Close();
+                    bitdb.CloseDb(strFile);
+                    bitdb.mapFileUseCount.erase(strFile);
+                }
+                // Keep the original wallet next to the converted one, and put it
+                // back if the converted one cannot be moved into its place
+                if (fSuccess)
+                    fSuccess = RenameWalletFile(strFile, strFileBak, fFromLevelDB);
+                if (fSuccess && !RenameWalletFile(strFileRes, strFile, fToLevelDB)) {
+                    fSuccess = false;
+                    if (!RenameWalletFile(strFileBak, strFile, fFromLevelDB))
+                        LogPrintf("CDB::Convert : Can't restore %s from %s\n", strFile, strFileBak);
+                }
+                if (fSuccess)
+                    LogPrintf("CDB::Convert : Converted %u records, original kept as %s\n", nRecords, strFileBak);
+                else
+                    LogPrintf("CDB::Convert : Failed to convert database file %s\n", strFile);
+                return fSuccess;
+            }
+        }
+        MilliSleep(100);
+    }
+    return false;
+}
+
 
 void CDBEnv::Flush(bool fShutdown)
 {
@@ -427,7 +784,13 @@ void CDBEnv::Flush(bool fShutdown)
             string strFile = (*mi).first;
             int nRefCount = (*mi).second;
             LogPrint("db", "CDBEnv::Flush : Flushing %s (refcount = %d)...\n", strFile, nRefCount);
-            if (nRefCount == 0) {
+            if (nRefCount == 0 && IsLevelDB(strFile)) {
+                // LevelDB keeps its own log, closing the handle is enough
+                CloseDb(strFile);
+                mapLevelDb.erase(strFile);
+                LogPrint("db", "CDBEnv::Flush : %s closed\n", strFile);
+                mapFileUseCount.erase(mi++);
+            } else if (nRefCount == 0) {
                 // Move log data to the dat file
                 CloseDb(strFile);
                 LogPrint("db", "CDBEnv::Flush : %s checkpoint\n", strFile);
@@ -7,12 +7,14 @@
 #define BITCOIN_DB_H
 
 #include "clientversion.h"
+#include "leveldbwrapper.h"
 #include "serialize.h"
 #include "streams.h"
 #include "sync.h"
 #include "version.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -27,6 +29,9 @@ struct CBlockLocator;
 
 extern unsigned int nWalletDBUpdated;
 
+//! Cache size of a LevelDB wallet database
+static const size_t nWalletLevelDBCache = 1 << 20;
+
 void ThreadFlushWalletDB(const std::string& strWalletFile);
 
 
@@ -46,12 +51,16 @@ public:
     DbEnv dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    std::map<std::string, CLevelDBWrapper*> mapLevelDb;
 
     CDBEnv();
     ~CDBEnv();
     void MakeMock();
     bool IsMock() { return fMockDb; }
 
+    /** Whether strFile is kept in a LevelDB directory instead of a Berkeley DB file */
+    static bool IsLevelDB(const std::string& strFile);
+
     /**
      * Verify that database file strFile is OK. If it is not,
      * call the callback to try to recover.
@@ -93,15 +102,48 @@ public:
 extern CDBEnv bitdb;
 
 
-/** RAII class that provides access to a Berkeley database */
+/** Cursor over the records of a wallet database, whichever backend keeps it */
+class CDBCursor
+{
+private:
+    Dbc* pcursor;
+    leveldb::Iterator* piter;
+    bool fStarted;
+
+    CDBCursor(const CDBCursor&);
+    void operator=(const CDBCursor&);
+
+public:
+    explicit CDBCursor(Dbc* pcursorIn) : pcursor(pcursorIn), piter(NULL), fStarted(false) {}
+    explicit CDBCursor(leveldb::Iterator* piterIn) : pcursor(NULL), piter(piterIn), fStarted(false) {}
+    ~CDBCursor();
+
+    /** Same semantics as Dbc::get, only DB_NEXT and DB_SET_RANGE are supported for LevelDB */
+    int Read(CSecureDataStream& ssKey, CSecureDataStream& ssValue, unsigned int fFlags);
+};
+
+
+/**
+ * RAII class that provides access to a wallet database. Files are Berkeley
+ * databases; LevelDB directories (see -walletbackend) keep records in an
+ * append-only log instead, and batch the writes of a transaction into one
+ * atomic write.
+ */
 class CDB
 {
 protected:
     Db* pdb;
+    CLevelDBWrapper* pldb;
     std::string strFile;
     DbTxn* activeTxn;
     bool fReadOnly;
 
+    //! Writes of the active LevelDB transaction, also seen by reads made during it
+    bool fLevelDBTxn;
+    CLevelDBBatch batchTxn;
+    std::map<std::string, CSecureDataStream> mapTxnWrites;
+    std::set<std::string> setTxnErased;
+
     explicit CDB(const std::string& strFilename, const char* pszMode = "r+");
     ~CDB() { Close(); }
 
@@ -113,15 +155,90 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    template <typename K>
+    static std::string KeyString(const K& key)
+    {
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        return std::string(ssKey.begin(), ssKey.end());
+    }
+
+    template <typename K, typename T>
+    bool ReadLevelDB(const K& key, T& value)
+    {
+        if (fLevelDBTxn) {
+            std::string strKey = KeyString(key);
+            if (setTxnErased.count(strKey))
+                return false;
+            std::map<std::string, CSecureDataStream>::const_iterator it = mapTxnWrites.find(strKey);
+            if (it != mapTxnWrites.end()) {
+                try {
+                    CSecureDataStream ssValue(it->second);
+                    ssValue >> value;
+                } catch (const std::exception&) {
+                    return false;
+                }
+                return true;
+            }
+        }
+        try {
+            return pldb->Read(key, value);
+        } catch (const leveldb_error&) {
+            return false;
+        }
+    }
+
+    template <typename K, typename T>
+    bool WriteLevelDB(const K& key, const T& value)
+    {
+        if (fLevelDBTxn) {
+            std::string strKey = KeyString(key);
+            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            ssValue << value;
+            mapTxnWrites.erase(strKey);
+            mapTxnWrites.insert(std::make_pair(strKey, ssValue));
+            setTxnErased.erase(strKey);
+            batchTxn.WriteSecure(key, value);
+            return true;
+        }
+        // Synced like a committed transaction, as BDB logs every write
+        try {
+            return pldb->WriteSecure(key, value, true);
+        } catch (const leveldb_error&) {
+            return false;
+        }
+    }
+
+    template <typename K>
+    bool EraseLevelDB(const K& key)
+    {
+        if (fLevelDBTxn) {
+            std::string strKey = KeyString(key);
+            mapTxnWrites.erase(strKey);
+            setTxnErased.insert(strKey);
+            batchTxn.Erase(key);
+            return true;
+        }
+        try {
+            return pldb->Erase(key, true);
+        } catch (const leveldb_error&) {
+            return false;
+        }
+    }
+
+    void ClearLevelDBTxn();
+
 protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
+        if (pldb)
+            return ReadLevelDB(key, value);
         if (!pdb)
             return false;
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
         Dbt datKey(&ssKey[0], ssKey.size());
@@ -136,7 +253,7 @@ protected:
 
         // Unserialize value
         try {
-            CDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -151,19 +268,24 @@ protected:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !pldb)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
+        if (pldb) {
+            if (!fOverwrite && Exists(key))
+                return false;
+            return WriteLevelDB(key, value);
+        }
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
         Dbt datValue(&ssValue[0], ssValue.size());
@@ -180,13 +302,15 @@ protected:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !pldb)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
+        if (pldb)
+            return EraseLevelDB(key);
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
         Dbt datKey(&ssKey[0], ssKey.size());
@@ -202,11 +326,25 @@ protected:
     template <typename K>
     bool Exists(const K& key)
     {
+        if (pldb) {
+            if (fLevelDBTxn) {
+                std::string strKey = KeyString(key);
+                if (setTxnErased.count(strKey))
+                    return false;
+                if (mapTxnWrites.count(strKey))
+                    return true;
+            }
+            try {
+                return pldb->Exists(key);
+            } catch (const leveldb_error&) {
+                return false;
+            }
+        }
         if (!pdb)
             return false;
 
         // Key
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
         Dbt datKey(&ssKey[0], ssKey.size());
@@ -219,57 +357,20 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
-    {
-        if (!pdb)
-            return NULL;
-        Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
-        if (ret != 0)
-            return NULL;
-        return pcursor;
-    }
+    CDBCursor* GetCursor();
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
+    int ReadAtCursor(CDBCursor* pcursor, CSecureDataStream& ssKey, CSecureDataStream& ssValue, unsigned int fFlags = DB_NEXT)
     {
-        // Read at cursor
-        Dbt datKey;
-        if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
-            datKey.set_data(&ssKey[0]);
-            datKey.set_size(ssKey.size());
-        }
-        Dbt datValue;
-        if (fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
-            datValue.set_data(&ssValue[0]);
-            datValue.set_size(ssValue.size());
-        }
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        memset(datValue.get_data(), 0, datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
+        return pcursor->Read(ssKey, ssValue, fFlags);
     }
 
 public:
     bool TxnBegin()
     {
+        if (pldb && !fLevelDBTxn) {
+            fLevelDBTxn = true;
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -281,6 +382,16 @@ public:
 
     bool TxnCommit()
     {
+        if (pldb && fLevelDBTxn) {
+            bool fSuccess = true;
+            try {
+                fSuccess = pldb->WriteBatch(batchTxn, true);
+            } catch (const leveldb_error&) {
+                fSuccess = false;
+            }
+            ClearLevelDBTxn();
+            return fSuccess;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -290,6 +401,10 @@ public:
 
     bool TxnAbort()
     {
+        if (pldb && fLevelDBTxn) {
+            ClearLevelDBTxn();
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -309,6 +424,8 @@ public:
     }
 
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
+    /** Copy all records of strFile into the other backend, keeping the original next to it */
+    bool static Convert(const std::string& strFile, bool fToLevelDB);
 };
 
 #endif // BITCOIN_DB_H
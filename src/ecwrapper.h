@@ -12,7 +12,10 @@
 
 class uint256;
 
-/** RAII Wrapper around OpenSSL's EC_KEY */
+/**
+ * RAII Wrapper around OpenSSL's EC_KEY. Signatures are verified with
+ * libsecp256k1; this is kept to test and benchmark against.
+ */
 class CECKey
 {
 private:
@@ -110,9 +110,9 @@ static bool SelectBlockFromCandidates(
         else
             hashProof = pindex->IsProofOfStake() ? 0 : pindex->GetBlockHash();
 
-        CDataStream ss(SER_GETHASH, 0);
+        CHashWriter ss(SER_GETHASH, 0);
         ss << hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
+        uint256 hashSelection = ss.GetHash();
 
         // the selection hash is divided by 2**32 so that proof-of-stake block
         // is always favored over proof-of-work block. this is to preserve
@@ -418,11 +418,11 @@ unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
 {
     assert(pindex->pprev || pindex->GetBlockHash() == Params().HashGenesisBlock());
     // Hash previous checksum with flags, hashProofOfStake and nStakeModifier
-    CDataStream ss(SER_GETHASH, 0);
+    CHashWriter ss(SER_GETHASH, 0);
     if (pindex->pprev)
         ss << pindex->pprev->nStakeModifierChecksum;
     ss << pindex->nFlags << pindex->hashProofOfStake << pindex->nStakeModifier;
-    uint256 hashChecksum = Hash(ss.begin(), ss.end());
+    uint256 hashChecksum = ss.GetHash();
     hashChecksum >>= (256 - 32);
     return hashChecksum.Get64();
 }
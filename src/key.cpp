@@ -10,7 +10,6 @@
 #include "pubkey.h"
 #include "random.h"
 
-#include "ecwrapper.h"
 #include <secp256k1.h>
 
 //! anonymous namespace
@@ -21,11 +20,11 @@ class CSecp256k1Init
 public:
     CSecp256k1Init()
     {
-        secp256k1_start(SECP256K1_START_SIGN);
+        ECC_Start(SECP256K1_START_SIGN);
     }
     ~CSecp256k1Init()
     {
-        secp256k1_stop();
+        ECC_Stop();
     }
 };
 static CSecp256k1Init instance_of_csecp256k1;
@@ -238,11 +237,6 @@ void CExtKey::Decode(const unsigned char code[74])
 
 bool ECC_InitSanityCheck()
 {
-#if !defined(USE_SECP256K1)
-    if (!CECKey::SanityCheck()) {
-        return false;
-    }
-#endif
     CKey key;
     key.MakeNewKey(true);
     CPubKey pubkey = key.GetPubKey();
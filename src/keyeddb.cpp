@@ -0,0 +1,30 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "keyeddb.h"
+
+CKeyedDB::CKeyedDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(path, nCacheSize, fMemory, fWipe), nStagedWrites(0), fRewrite(false) {}
+
+bool CKeyedDB::Commit(unsigned int& nWritten, unsigned int& nErased)
+{
+    nWritten = nStagedWrites;
+    nErased = setPendingErases.size();
+    for (std::set<std::string>::const_iterator it = setPendingErases.begin(); it != setPendingErases.end(); ++it)
+        batch.Erase(CFlatData((void*)it->data(), (void*)(it->data() + it->size())));
+
+    bool fOk = true;
+    try {
+        WriteBatch(batch);
+        fRewrite = false;
+        setPendingErases.clear();
+    } catch (const leveldb_error& e) {
+        // the marks of this batch are gone, so the next flush rewrites everything
+        // and stages the erasures, which are kept, again
+        fRewrite = true;
+        fOk = error("%s : %s", __func__, e.what());
+    }
+    batch = CLevelDBBatch();
+    nStagedWrites = 0;
+    return fOk;
+}
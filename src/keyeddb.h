@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_KEYEDDB_H
+#define BITCOIN_KEYEDDB_H
+
+#include "leveldbwrapper.h"
+#include "sync.h"
+
+#include <set>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/scoped_ptr.hpp>
+
+/**
+ * LevelDB store for the objects an in-memory manager keeps, each one under its
+ * own (type, key). The managers mark the keys of the objects they add, change
+ * or remove, and a flush stages only those: the ones still there are written
+ * and the others erased, so a flush costs what changed rather than the whole
+ * set. Records that fail to decode on load are dropped by the next Commit.
+ * Erasures stay pending until a Commit writes them, as a record a manager no
+ * longer has can't be found again by rewriting what it has.
+ */
+class CKeyedDB : public CLevelDBWrapper
+{
+private:
+    CLevelDBBatch batch;
+    unsigned int nStagedWrites;
+    //! serialized (type, key) of the records to erase, kept until a Commit succeeds
+    std::set<std::string> setPendingErases;
+    //! a Commit failed, so what is on disk is unknown until everything is written again
+    bool fRewrite;
+
+    CKeyedDB(const CKeyedDB&);
+    void operator=(const CKeyedDB&);
+
+    template <typename K>
+    static std::string SerializeKey(char chType, const K& key)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << std::make_pair(chType, key);
+        return ssKey.str();
+    }
+
+protected:
+    //! serializes the flushes and loads of a store
+    mutable CCriticalSection cs;
+
+public:
+    CKeyedDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Queue a record for the next Commit */
+    template <typename K, typename V>
+    void Stage(char chType, const K& key, const V& value)
+    {
+        if (!setPendingErases.empty())
+            setPendingErases.erase(SerializeKey(chType, key));
+        batch.Write(std::make_pair(chType, key), value);
+        nStagedWrites++;
+    }
+
+    /** Queue the erasure of a record until a Commit writes it */
+    template <typename K>
+    void StageErase(char chType, const K& key)
+    {
+        setPendingErases.insert(SerializeKey(chType, key));
+    }
+
+    /**
+     * Queue the records of map marked in keys, or their erasure for the ones
+     * map no longer has, and clear the marks. After a failed Commit every
+     * record of map is written again; the erasures it lost are still pending.
+     */
+    template <typename Map, typename Keys>
+    void StageChanges(char chType, const Map& map, Keys& keys)
+    {
+        if (fRewrite) {
+            for (typename Map::const_iterator it = map.begin(); it != map.end(); ++it)
+                Stage(chType, it->first, it->second);
+        }
+        for (typename Keys::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+            typename Map::const_iterator itMap = map.find(*it);
+            if (itMap == map.end())
+                StageErase(chType, *it);
+            else if (!fRewrite)
+                Stage(chType, itMap->first, itMap->second);
+        }
+        keys.clear();
+    }
+
+    /** Whether the next flush has to stage every record, not only the marked ones */
+    bool RewriteAll() const { return fRewrite; }
+
+    /** Write the queued records and erasures */
+    bool Commit(unsigned int& nWritten, unsigned int& nErased);
+
+    /** Insert every record of a type into map, returning how many could not be decoded */
+    template <typename Map>
+    unsigned int Load(char chType, Map& map)
+    {
+        unsigned int nBad = 0;
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << chType;
+        for (pcursor->Seek(ssKeySet.str()); pcursor->Valid(); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() == 0 || slKey[0] != chType)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            try {
+                CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                CSpanReader ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                char chTypeIn;
+                typename Map::key_type key;
+                typename Map::mapped_type value;
+                ssKey >> chTypeIn >> key;
+                ssValue >> value;
+                map.insert(std::make_pair(key, value));
+            } catch (const std::exception&) {
+                setPendingErases.insert(std::string(slKey.data(), slKey.size()));
+                nBad++;
+            }
+        }
+        HandleError(pcursor->status());
+        return nBad;
+    }
+};
+
+#endif // BITCOIN_KEYEDDB_H
@@ -27,10 +27,18 @@ bool CKeyStore::AddKey(const CKey& key)
     return AddKeyPubKey(key, key.GetPubKey());
 }
 
+void CBasicKeyStore::AddKeyScriptPubKeys(const CPubKey& pubkey)
+{
+    AssertLockHeld(cs_KeyStore);
+    setScriptPubKeys.insert(GetScriptForDestination(pubkey.GetID()));
+    setScriptPubKeys.insert(CScript() << ToByteVector(pubkey) << OP_CHECKSIG);
+}
+
 bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey& pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    AddKeyScriptPubKeys(pubkey);
     return true;
 }
 
@@ -41,6 +49,7 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    setScriptPubKeys.insert(GetScriptForDestination(CScriptID(redeemScript)));
     return true;
 }
 
@@ -65,6 +74,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript& dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    setScriptPubKeys.insert(dest);
     return true;
 }
 
@@ -91,6 +101,7 @@ bool CBasicKeyStore::AddMultiSig(const CScript& dest)
 {
     LOCK(cs_KeyStore);
     setMultiSig.insert(dest);
+    setScriptPubKeys.insert(dest);
     return true;
 }
 
@@ -112,3 +123,9 @@ bool CBasicKeyStore::HaveMultiSig() const
     LOCK(cs_KeyStore);
     return (!setMultiSig.empty());
 }
+
+bool CBasicKeyStore::HaveScriptPubKey(const CScript& scriptPubKey) const
+{
+    LOCK(cs_KeyStore);
+    return setScriptPubKeys.count(scriptPubKey) > 0;
+}
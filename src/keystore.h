@@ -8,12 +8,14 @@
 
 #include "key.h"
 #include "pubkey.h"
+#include "script/script.h"
 #include "sync.h"
 
+#include <boost/functional/hash.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/variant.hpp>
 
-class CScript;
 class CScriptID;
 
 /** A virtual base class for key stores */
@@ -51,12 +53,27 @@ public:
     virtual bool RemoveMultiSig(const CScript& dest) = 0;
     virtual bool HaveMultiSig(const CScript& dest) const = 0;
     virtual bool HaveMultiSig() const = 0;
+
+    /**
+     * Whether scriptPubKey is one of the P2PKH, P2PK or P2SH scripts of the
+     * store's keys and redeem scripts, or one of its watch-only or multisig scripts.
+     * A P2PKH, P2PK or P2SH script that is not can't be mine.
+     */
+    virtual bool HaveScriptPubKey(const CScript& scriptPubKey) const = 0;
+};
+
+struct CScriptHasher {
+    size_t operator()(const CScript& script) const
+    {
+        return boost::hash_range(script.begin(), script.end());
+    }
 };
 
 typedef std::map<CKeyID, CKey> KeyMap;
 typedef std::map<CScriptID, CScript> ScriptMap;
 typedef std::set<CScript> WatchOnlySet;
 typedef std::set<CScript> MultiSigScriptSet;
+typedef boost::unordered_set<CScript, CScriptHasher> ScriptPubKeySet;
 
 /** Basic key store, that keeps keys in an address->secret map */
 class CBasicKeyStore : public CKeyStore
@@ -67,6 +84,10 @@ protected:
     WatchOnlySet setWatchOnly;
     MultiSigScriptSet setMultiSig;
 
+    //! Scripts paying to the entries above, only grows until the store is rebuilt
+    ScriptPubKeySet setScriptPubKeys;
+    void AddKeyScriptPubKeys(const CPubKey& pubkey);
+
 public:
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey);
     bool HaveKey(const CKeyID& address) const
@@ -115,6 +136,8 @@ public:
     virtual bool RemoveMultiSig(const CScript& dest);
     virtual bool HaveMultiSig(const CScript& dest) const;
     virtual bool HaveMultiSig() const;
+
+    virtual bool HaveScriptPubKey(const CScript& scriptPubKey) const;
 };
 
 typedef std::vector<unsigned char, secure_allocator<unsigned char> > CKeyingMaterial;
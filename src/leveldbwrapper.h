@@ -32,16 +32,15 @@ class CLevelDBBatch
 private:
     leveldb::WriteBatch batch;
 
-public:
-    template <typename K, typename V>
-    void Write(const K& key, const V& value)
+    template <typename Stream, typename K, typename V>
+    void Put(const K& key, const V& value)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        Stream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        Stream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(ssValue.GetSerializeSize(value));
         ssValue << value;
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
@@ -49,6 +48,20 @@ public:
         batch.Put(slKey, slValue);
     }
 
+public:
+    template <typename K, typename V>
+    void Write(const K& key, const V& value)
+    {
+        Put<CDataStream>(key, value);
+    }
+
+    /** Write a record that may hold private keys, serializing it into buffers wiped on free */
+    template <typename K, typename V>
+    void WriteSecure(const K& key, const V& value)
+    {
+        Put<CSecureDataStream>(key, value);
+    }
+
     template <typename K>
     void Erase(const K& key)
     {
@@ -106,7 +119,7 @@ public:
             HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -122,6 +135,14 @@ public:
         return WriteBatch(batch, fSync);
     }
 
+    template <typename K, typename V>
+    bool WriteSecure(const K& key, const V& value, bool fSync = false) throw(leveldb_error)
+    {
+        CLevelDBBatch batch;
+        batch.WriteSecure(key, value);
+        return WriteBatch(batch, fSync);
+    }
+
     template <typename K>
     bool Exists(const K& key) const throw(leveldb_error)
     {
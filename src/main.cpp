@@ -13,9 +13,11 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "crypto/sha256.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
+#include "masternode-helpers.h"
 #include "masternode-payments.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
@@ -72,6 +74,12 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
+bool fTimestampIndex = DEFAULT_TIMESTAMPINDEX;
+/** Last block of the active chain reflected in the address, spent and timestamp indexes,
+ *  -1 while stale entries still have to be erased. Protected by cs_main. */
+static int nAddressIndexHeight = -1;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 unsigned int nCoinCacheSize = 5000;
@@ -367,6 +375,7 @@ void FinalizeNode(NodeId nodeid)
     BOOST_FOREACH (const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
+    masternodeMessageVerifier.RemoveNode(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
@@ -1091,6 +1100,20 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+/** Script verification flags of a block with version nVersion and time nTime on top of pindexPrev */
+static unsigned int GetBlockScriptFlags(int nVersion, int64_t nTime, const CBlockIndex* pindexPrev)
+{
+    // BIP16 didn't become active until RDCT 1 2012
+    int64_t nBIP16SwitchTime = 1333238400;
+    unsigned int flags = nTime >= nBIP16SwitchTime ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks, when 75% of the network has upgraded:
+    if (nVersion >= 3 && CBlockIndex::IsSuperMajority(3, pindexPrev, Params().EnforceBlockUpgradeMajority()))
+        flags |= SCRIPT_VERIFY_DERSIG;
+
+    return flags;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
@@ -1253,7 +1276,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        // Only the pass with the flags of the next block goes into the script
+        // execution cache, as the entry ConnectBlock looks up. The other passes
+        // store their signatures only.
+        unsigned int nBlockFlags = GetBlockScriptFlags(CBlockHeader::CURRENT_VERSION, GetAdjustedTime(), chainActive.Tip());
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false)) {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1266,10 +1293,17 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, nBlockFlags == MANDATORY_SCRIPT_VERIFY_FLAGS)) {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
 
+        // And against the flags of the next block, which the standard flags
+        // include, so that ConnectBlock finds the transaction in the script
+        // execution cache. The signatures come out of the signature cache.
+        if (nBlockFlags != MANDATORY_SCRIPT_VERIFY_FLAGS && !CheckInputs(tx, state, view, true, nBlockFlags, true, true)) {
+            return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against block but not STANDARD flags %s", hash.ToString());
+        }
+
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
     }
@@ -1438,7 +1472,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputs(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, true, false)) {
             return error("AcceptableInputs: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1532,6 +1566,54 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 }
 
 
+bool AddressIndexesSynced()
+{
+    LOCK(cs_main);
+    return nAddressIndexHeight >= chainActive.Height();
+}
+
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("%s : unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetTimestampIndex(unsigned int high, unsigned int low, std::vector<uint256>& hashes)
+{
+    if (!fTimestampIndex)
+        return error("%s : timestamp index not enabled", __func__);
+
+    if (!pblocktree->ReadTimestampIndex(high, low, hashes))
+        return error("%s : unable to get hashes for timestamps", __func__);
+
+    return true;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
@@ -1817,13 +1899,64 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, sighashCache.get()), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+namespace
+{
+/**
+ * Transactions whose scripts all passed under a set of verification flags.
+ * AcceptToMemoryPool fills it so that ConnectBlock can skip every script of
+ * a transaction it already verified with the flags of the block, which saves
+ * running the scripts and hashing the transaction for each input on top of
+ * what the signature cache saves. The transaction hash commits to the
+ * scriptSigs and to the outputs they spend, so it covers all the scripts see.
+ */
+class CScriptExecutionCache
+{
+private:
+    //! entry_type is (transaction hash, script verification flags)
+    typedef std::pair<uint256, unsigned int> entry_type;
+    std::set<entry_type> setValid;
+    boost::shared_mutex cs_scriptcache;
+
+public:
+    bool Get(const uint256& hash, unsigned int flags, bool fErase)
+    {
+        entry_type k(hash, flags);
+        if (!fErase) {
+            boost::shared_lock<boost::shared_mutex> lock(cs_scriptcache);
+            return setValid.count(k) > 0;
+        }
+        boost::unique_lock<boost::shared_mutex> lock(cs_scriptcache);
+        return setValid.erase(k) > 0;
+    }
+
+    void Set(const uint256& hash, unsigned int flags)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxscriptcachesize", DEFAULT_MAX_SCRIPT_CACHE_SIZE);
+        if (nMaxCacheSize <= 0)
+            return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_scriptcache);
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize) {
+            // Evict a random entry, for the same reason as the signature cache
+            std::set<entry_type>::iterator it = setValid.lower_bound(entry_type(GetRandHash(), 0));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+        setValid.insert(entry_type(hash, flags));
+    }
+};
+
+CScriptExecutionCache scriptExecutionCache;
+} // anon namespace
+
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, std::vector<CScriptCheck>* pvChecks)
 {
     if (!tx.IsCoinBase()) {
         if (pvChecks)
@@ -1884,13 +2017,25 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // Seen with these flags before, e.g. on its way into the mempool.
+            // Callers that store nothing, like a block being connected, are
+            // done with the transaction.
+            if (scriptExecutionCache.Get(tx.GetHash(), flags, !cacheSigStore && !cacheFullScriptStore))
+                return true;
+
+            // Every input hashes the same serialized transaction, so share the
+            // parts that do not depend on the input between all of their checks
+            boost::shared_ptr<const CSignatureHashCache> sighashCache;
+            if (tx.vin.size() > 1)
+                sighashCache.reset(new CSignatureHashCache(tx));
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheSigStore, sighashCache);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1903,7 +2048,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, sighashCache);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1917,8 +2062,173 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                     return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            // Checks handed to a queue have not run yet
+            if (cacheFullScriptStore && !pvChecks)
+                scriptExecutionCache.Set(tx.GetHash(), flags);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Map an output script to the address it is indexed under. Pay-to-pubkey outputs,
+ * as created by coinstakes, are indexed under the hash of their pubkey so that they
+ * show up in the history of the corresponding address.
+ */
+static bool GetAddressIndexKey(const CScript& script, unsigned int& nType, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        nType = ADDRESS_INDEX_SCRIPTHASH;
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        return true;
+    }
+    if (script.IsPayToPublicKeyHash()) {
+        nType = ADDRESS_INDEX_PUBKEYHASH;
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        return true;
+    }
+    if (((script.size() == 35 && script[0] == 33) || (script.size() == 67 && script[0] == 65)) && script.back() == OP_CHECKSIG) {
+        nType = ADDRESS_INDEX_PUBKEYHASH;
+        hashBytes = Hash160(script.begin() + 1, script.end() - 1);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Add the address, spent and timestamp index entries of a block connected on top of
+ * nAddressIndexHeight. The undo data provides the outputs spent by the block, so this
+ * works both while connecting a block and when indexing an old block in the background.
+ */
+static bool ConnectAddressIndexes(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    assert(pindex->nHeight == nAddressIndexHeight + 1);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        unsigned int nType;
+        uint160 hashBytes;
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const CTxOut& out = txundo.vprevout[j].txout;
+                if (GetAddressIndexKey(out.scriptPubKey, nType, hashBytes)) {
+                    if (fAddressIndex) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, j, true), out.nValue * -1));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    }
+                } else {
+                    nType = ADDRESS_INDEX_NONE;
+                    hashBytes = 0;
+                }
+                if (fSpentIndex)
+                    spentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, out.nValue, nType, hashBytes)));
+            }
         }
+
+        if (fAddressIndex) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                if (!GetAddressIndexKey(out.scriptPubKey, nType, hashBytes))
+                    continue;
+                addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
+        }
+    }
+
+    // The entries of every index and the height they reach go to disk together
+    CLevelDBBatch batch;
+    if (fAddressIndex) {
+        pblocktree->WriteAddressIndex(batch, addressIndex);
+        pblocktree->UpdateAddressUnspentIndex(batch, addressUnspentIndex);
     }
+    if (fSpentIndex)
+        pblocktree->UpdateSpentIndex(batch, spentIndex);
+    if (fTimestampIndex)
+        pblocktree->WriteTimestampIndex(batch, CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+    pblocktree->WriteInt(batch, "addressindexheight", pindex->nHeight);
+    pblocktree->WriteHash(batch, "addressindexblock", pindex->GetBlockHash());
+    if (!pblocktree->WriteBatch(batch))
+        return error("%s : failed to write address indexes", __func__);
+    nAddressIndexHeight = pindex->nHeight;
+
+    return true;
+}
+
+/**
+ * Remove the address, spent and timestamp index entries of the block at nAddressIndexHeight.
+ * Must be called after the block has been disconnected from view, which then holds the
+ * outputs spent by the block again.
+ */
+static bool DisconnectAddressIndexes(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex, CCoinsViewCache& view)
+{
+    AssertLockHeld(cs_main);
+    assert(pindex->nHeight == nAddressIndexHeight);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
+    // Undo transactions in reverse order, so that outputs created and spent within
+    // the block end up erased from the unspent index
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        unsigned int nType;
+        uint160 hashBytes;
+
+        if (fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                if (!GetAddressIndexKey(out.scriptPubKey, nType, hashBytes))
+                    continue;
+                addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k), CAddressUnspentValue()));
+            }
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (unsigned int j = tx.vin.size(); j-- > 0;) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const CTxOut& out = txundo.vprevout[j].txout;
+            if (fAddressIndex && GetAddressIndexKey(out.scriptPubKey, nType, hashBytes)) {
+                const CCoins* coins = view.AccessCoins(prevout.hash);
+                addressIndex.push_back(make_pair(CAddressIndexKey(nType, hashBytes, pindex->nHeight, i, txhash, j, true), out.nValue * -1));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue(out.nValue, out.scriptPubKey, coins ? coins->nHeight : 0)));
+            }
+            if (fSpentIndex)
+                spentIndex.push_back(make_pair(CSpentIndexKey(prevout.hash, prevout.n), CSpentIndexValue()));
+        }
+    }
+
+    CLevelDBBatch batch;
+    if (fAddressIndex) {
+        pblocktree->EraseAddressIndex(batch, addressIndex);
+        pblocktree->UpdateAddressUnspentIndex(batch, addressUnspentIndex);
+    }
+    if (fSpentIndex)
+        pblocktree->UpdateSpentIndex(batch, spentIndex);
+    if (fTimestampIndex)
+        pblocktree->EraseTimestampIndex(batch, CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+    pblocktree->WriteInt(batch, "addressindexheight", pindex->nHeight - 1);
+    pblocktree->WriteHash(batch, "addressindexblock", pindex->pprev->GetBlockHash());
+    if (!pblocktree->WriteBatch(batch))
+        return error("%s : failed to delete address indexes", __func__);
+    nAddressIndexHeight = pindex->nHeight - 1;
 
     return true;
 }
@@ -2001,6 +2311,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
     }
 
+    // Only a disconnect of the active tip touches the indexes, VerifyDB passes pfClean
+    if (!pfClean && pindex->nHeight == nAddressIndexHeight && (fAddressIndex || fSpentIndex || fTimestampIndex)) {
+        if (!DisconnectAddressIndexes(block, blockUndo, pindex, view))
+            return state.Abort("Failed to update address indexes");
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2037,7 +2353,68 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/** A slice of a merkle tree level */
+class CMerkleHashCheck
+{
+private:
+    unsigned char* out;
+    const unsigned char* in;
+    size_t blocks;
+
+public:
+    CMerkleHashCheck() : out(NULL), in(NULL), blocks(0) {}
+    CMerkleHashCheck(unsigned char* outIn, const unsigned char* inIn, size_t blocksIn) : out(outIn), in(inIn), blocks(blocksIn) {}
+
+    bool IsNull() const { return blocks == 0; }
+
+    bool operator()()
+    {
+        SHA256D64(out, in, blocks);
+        return true;
+    }
+
+    void swap(CMerkleHashCheck& check)
+    {
+        std::swap(out, check.out);
+        std::swap(in, check.in);
+        std::swap(blocks, check.blocks);
+    }
+};
+
+/**
+ * What the script check threads run: the scripts of an input while a block
+ * is connected, or a slice of a merkle tree level while one is checked.
+ */
+class CBlockCheck
+{
+private:
+    CScriptCheck script;
+    CMerkleHashCheck merkle;
+
+public:
+    CBlockCheck() {}
+    explicit CBlockCheck(const CMerkleHashCheck& merkleIn) : merkle(merkleIn) {}
+
+    bool operator()()
+    {
+        return merkle.IsNull() ? script() : merkle();
+    }
+
+    void swap(CBlockCheck& check)
+    {
+        script.swap(check.script);
+        merkle.swap(check.merkle);
+    }
+
+    void swap(CScriptCheck& check)
+    {
+        script.swap(check);
+    }
+};
+
+static CCheckQueue<CBlockCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
+//! Held by whoever is feeding scriptcheckqueue, as CheckBlock and the miner may run next to ConnectBlock
+static boost::mutex csScriptCheckQueue;
 
 void ThreadScriptCheck()
 {
@@ -2045,6 +2422,29 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+void InitScriptCheckQueues(int nThreads)
+{
+    scriptcheckqueue.SetThreads(nThreads);
+}
+
+void ParallelSHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    boost::unique_lock<boost::mutex> lock(csScriptCheckQueue, boost::try_to_lock);
+    if (blocks < MIN_PARALLEL_MERKLE_PAIRS || nScriptCheckThreads == 0 || !lock.owns_lock()) {
+        SHA256D64(out, in, blocks);
+        return;
+    }
+
+    // One slice per thread, in multiples of 8 so the 8-way transforms stay full
+    size_t nSlice = ((blocks + nScriptCheckThreads - 1) / nScriptCheckThreads + 7) & ~(size_t)7;
+    std::vector<CBlockCheck> vChecks;
+    for (size_t i = 0; i < blocks; i += nSlice)
+        vChecks.push_back(CBlockCheck(CMerkleHashCheck(out + 32 * i, in + 64 * i, std::min(nSlice, blocks - i))));
+    CCheckQueueControl<CBlockCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -2103,20 +2503,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    // BIP16 didn't become active until RDCT 1 2012
-    int64_t nBIP16SwitchTime = 1333238400;
-    bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
-
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-
-    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks, when 75% of the network has upgraded:
-    if (block.nVersion >= 3 && CBlockIndex::IsSuperMajority(3, pindex->pprev, Params().EnforceBlockUpgradeMajority())) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
+    unsigned int flags = GetBlockScriptFlags(block.nVersion, pindex->GetBlockTime(), pindex->pprev);
+    bool fStrictPayToScriptHash = (flags & SCRIPT_VERIFY_P2SH) != 0;
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // A merkle tree hashed on another thread meanwhile waits, or hashes on its own thread
+    boost::unique_lock<boost::mutex> lockQueue(csScriptCheckQueue, boost::defer_lock);
+    if (fScriptChecks && nScriptCheckThreads)
+        lockQueue.lock();
+    CCheckQueueControl<CBlockCheck> control(lockQueue.owns_lock() ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -2158,9 +2554,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            // Only a block that is just being checked adds to the caches; connecting
+            // one takes its transactions out of the script execution cache
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fJustCheck, fJustCheck, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
-            control.Add(vChecks);
+            std::vector<CBlockCheck> vBlockChecks(vChecks.size());
+            for (unsigned int i = 0; i < vChecks.size(); i++)
+                vBlockChecks[i].swap(vChecks[i]);
+            control.Add(vBlockChecks);
         }
         nValueOut += tx.GetValueOut();
 
@@ -2229,6 +2630,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    // While a background build is behind, ThreadBuildAddressIndexes indexes this block later
+    if (pindex->nHeight == nAddressIndexHeight + 1 && (fAddressIndex || fSpentIndex || fTimestampIndex))
+        if (!ConnectAddressIndexes(block, blockundo, pindex))
+            return state.Abort("Failed to write address indexes");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3059,7 +3465,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
+        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated, ParallelSHA256D64);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"),
                 REJECT_INVALID, "bad-txnmrklroot", true);
@@ -3652,6 +4058,158 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+/**
+ * Remove the address, spent and timestamp index entries of pindex and its ancestors
+ * down to the active chain, so the indexes end at a block of the active chain again.
+ */
+static bool RewindAddressIndexes(CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    nAddressIndexHeight = pindex->nHeight;
+    int nRewound = 0;
+    while (!chainActive.Contains(pindex)) {
+        CBlock block;
+        CBlockUndo blockundo;
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (!ReadBlockFromDisk(block, pindex) || pos.IsNull() || !blockundo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()) ||
+            blockundo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s : failed to read block data at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+        // The coins of the tip hold the outputs these blocks spent, unless an earlier one created them
+        if (!DisconnectAddressIndexes(block, blockundo, pindex, *pcoinsTip))
+            return false;
+        pindex = pindex->pprev;
+        nRewound++;
+    }
+    if (nRewound > 0)
+        LogPrintf("%s: removed the index entries of %d blocks, indexes now end at height %d\n", __func__, nRewound, nAddressIndexHeight);
+    return true;
+}
+
+/**
+ * Load which of the address, spent and timestamp indexes are maintained and how far they
+ * follow the active chain. Changing the set of enabled indexes drops all their entries;
+ * ThreadBuildAddressIndexes then rebuilds them in the background, no -reindex needed.
+ */
+static void LoadAddressIndexState(bool fNewDB)
+{
+    AssertLockHeld(cs_main);
+
+    bool fAddressIndexDB = false;
+    bool fSpentIndexDB = false;
+    bool fTimestampIndexDB = false;
+    pblocktree->ReadFlag("addressindex", fAddressIndexDB);
+    pblocktree->ReadFlag("spentindex", fSpentIndexDB);
+    pblocktree->ReadFlag("timestampindex", fTimestampIndexDB);
+
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+
+    if (fNewDB) {
+        // The genesis block has no spendable outputs and is never indexed
+        nAddressIndexHeight = 0;
+    } else if (fAddressIndex != fAddressIndexDB || fSpentIndex != fSpentIndexDB || fTimestampIndex != fTimestampIndexDB) {
+        LogPrintf("%s: optional index settings changed, rebuilding address, spent and timestamp indexes\n", __func__);
+        nAddressIndexHeight = -1;
+    } else if (!pblocktree->ReadInt("addressindexheight", nAddressIndexHeight)) {
+        nAddressIndexHeight = -1;
+    } else if (nAddressIndexHeight >= 0) {
+        // The indexes may have been written for blocks the coins database never saw
+        // flushed, ahead of the tip or on a branch since reorganized away
+        uint256 hashIndexed;
+        CBlockIndex* pindexIndexed = NULL;
+        if (pblocktree->ReadHash("addressindexblock", hashIndexed)) {
+            BlockMap::iterator mi = mapBlockIndex.find(hashIndexed);
+            if (mi != mapBlockIndex.end() && mi->second->nHeight == nAddressIndexHeight)
+                pindexIndexed = mi->second;
+        } else if (nAddressIndexHeight <= chainActive.Height()) {
+            // Written before the indexed block was recorded
+            pindexIndexed = chainActive[nAddressIndexHeight];
+        }
+        if (!pindexIndexed || !RewindAddressIndexes(pindexIndexed)) {
+            LogPrintf("%s: cannot find the blocks the indexes were written for, rebuilding address, spent and timestamp indexes\n", __func__);
+            nAddressIndexHeight = -1;
+        }
+    }
+
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    pblocktree->WriteFlag("timestampindex", fTimestampIndex);
+    pblocktree->WriteInt("addressindexheight", nAddressIndexHeight);
+    LogPrintf("%s: address index %s, spent index %s, timestamp index %s (height %d)\n", __func__,
+        fAddressIndex ? "enabled" : "disabled", fSpentIndex ? "enabled" : "disabled",
+        fTimestampIndex ? "enabled" : "disabled", nAddressIndexHeight);
+}
+
+void ThreadBuildAddressIndexes()
+{
+    RenameThread("rdct-addrindex");
+
+    bool fWipe;
+    {
+        LOCK(cs_main);
+        fWipe = nAddressIndexHeight < 0;
+    }
+    if (fWipe) {
+        // Block connection leaves the indexes alone while nAddressIndexHeight is negative
+        LogPrintf("%s: erasing address, spent and timestamp index entries\n", __func__);
+        if (!pblocktree->WipeAddressIndexes()) {
+            LogPrintf("%s: failed to erase index entries\n", __func__);
+            return;
+        }
+        LOCK(cs_main);
+        nAddressIndexHeight = 0;
+        CLevelDBBatch batch;
+        pblocktree->WriteInt(batch, "addressindexheight", nAddressIndexHeight);
+        pblocktree->WriteHash(batch, "addressindexblock", chainActive.Genesis()->GetBlockHash());
+        if (!pblocktree->WriteBatch(batch)) {
+            LogPrintf("%s: failed to write the index height\n", __func__);
+            return;
+        }
+    }
+
+    if (!fAddressIndex && !fSpentIndex && !fTimestampIndex)
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    int nStartHeight = -1;
+    while (true) {
+        boost::this_thread::interruption_point();
+        {
+            LOCK(cs_main);
+            if (nStartHeight < 0) {
+                nStartHeight = nAddressIndexHeight;
+                if (nStartHeight < chainActive.Height())
+                    LogPrintf("%s: indexing blocks %d to %d\n", __func__, nStartHeight + 1, chainActive.Height());
+            }
+
+            // Index a bounded number of blocks per lock, block connection goes on meanwhile
+            for (int n = 0; n < 100 && nAddressIndexHeight < chainActive.Height(); n++) {
+                CBlockIndex* pindex = chainActive[nAddressIndexHeight + 1];
+                CBlock block;
+                CBlockUndo blockundo;
+                CDiskBlockPos pos = pindex->GetUndoPos();
+                if (!ReadBlockFromDisk(block, pindex) || pos.IsNull() || !blockundo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()) ||
+                    blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+                    LogPrintf("%s: failed to read block data at %d, hash=%s\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+                    return;
+                }
+                if (!ConnectAddressIndexes(block, blockundo, pindex))
+                    return;
+                if (nAddressIndexHeight % 10000 == 0)
+                    LogPrintf("%s: indexed up to height %d\n", __func__, nAddressIndexHeight);
+            }
+
+            if (nAddressIndexHeight >= chainActive.Height()) {
+                if (nAddressIndexHeight > nStartHeight)
+                    LogPrintf("%s: indexed blocks %d to %d in %dms\n", __func__, nStartHeight + 1, nAddressIndexHeight, GetTimeMillis() - nStart);
+                return;
+            }
+        }
+        MilliSleep(1);
+    }
+}
+
 bool static LoadBlockIndexDB(string& strError)
 {
     if (!pblocktree->LoadBlockIndexGuts())
@@ -3814,6 +4372,8 @@ bool static LoadBlockIndexDB(string& strError)
         return true;
     chainActive.SetTip(it->second);
 
+    LoadAddressIndexState(false);
+
     PruneBlockIndexCandidates();
 
     LogPrintf("LoadBlockIndexDB(): hashBestChain=%s height=%d date=%s progress=%f\n",
@@ -3938,6 +4498,7 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    LoadAddressIndexState(true);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4432,7 +4993,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (mapTxLockVote.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
+                        ss << mapTxLockVote.find(inv.hash)->second;
                         pfrom->PushMessage("txlvote", ss);
                         pushed = true;
                     }
@@ -4459,7 +5020,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+                        ss << masternodePayments.mapMasternodePayeeVotes.find(inv.hash)->second;
                         pfrom->PushMessage("mnw", ss);
                         pushed = true;
                     }
@@ -4468,7 +5029,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
+                        ss << budget.mapSeenMasternodeBudgetVotes.find(inv.hash)->second;
                         pfrom->PushMessage("mvote", ss);
                         pushed = true;
                     }
@@ -4478,7 +5039,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
+                        ss << budget.mapSeenMasternodeBudgetProposals.find(inv.hash)->second;
                         pfrom->PushMessage("mprop", ss);
                         pushed = true;
                     }
@@ -4488,7 +5049,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
+                        ss << budget.mapSeenFinalizedBudgetVotes.find(inv.hash)->second;
                         pfrom->PushMessage("fbvote", ss);
                         pushed = true;
                     }
@@ -4498,7 +5059,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
+                        ss << budget.mapSeenFinalizedBudgets.find(inv.hash)->second;
                         pfrom->PushMessage("fbs", ss);
                         pushed = true;
                     }
@@ -4508,7 +5069,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
+                        ss << mnodeman.mapSeenMasternodeBroadcast.find(inv.hash)->second;
                         pfrom->PushMessage("mnb", ss);
                         pushed = true;
                     }
@@ -4518,7 +5079,7 @@ void static ProcessGetData(CNode* pfrom)
                     if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
+                        ss << mnodeman.mapSeenMasternodePing.find(inv.hash)->second;
                         pfrom->PushMessage("mnp", ss);
                         pushed = true;
                     }
@@ -4552,6 +5113,8 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+void static ProcessMasternodeMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -5315,18 +5878,25 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     } else {
         //probably one the extensions
-        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        budget.ProcessMessage(pfrom, strCommand, vRecv);
-        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+        // signed masternode messages get their signatures checked on the verification threads first
+        if (!masternodeSync.IsBlockchainSynced() || !masternodeMessageVerifier.Push(pfrom->GetId(), strCommand, vRecv))
+            ProcessMasternodeMessage(pfrom, strCommand, vRecv);
     }
 
 
     return true;
 }
 
+void static ProcessMasternodeMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+{
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    budget.ProcessMessage(pfrom, strCommand, vRecv);
+    masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
+    ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
+    ProcessSpork(pfrom, strCommand, vRecv);
+    masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+}
+
 // Note: whenever a protocol update is needed toggle between both implementations (comment out the formerly active one)
 //       so we can leave the existing clients untouched (old SPORK will stay on so they don't see even older clients).
 //       Those old clients won't react to the changes of the other (new) SPORK because at the time of their implementation
@@ -5371,7 +5941,21 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // masternode messages whose signatures have been checked go to their handlers now
+    try {
+        std::string strVerifiedCommand;
+        CDataStream vVerified(SER_NETWORK, PROTOCOL_VERSION);
+        while (!pfrom->fDisconnect && masternodeMessageVerifier.PopVerified(pfrom->GetId(), strVerifiedCommand, vVerified))
+            ProcessMasternodeMessage(pfrom, strVerifiedCommand, vVerified);
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
+    // masternode messages held back at the front of the receive buffer
+    size_t nHeld = 0;
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -5389,6 +5973,17 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // While this peer's signature checks are behind, its masternode messages wait at the
+        // front of the receive buffer, in order, and its other messages go past them. If they
+        // pile up, the receive flood limit stops reading from this peer only.
+        if ((nHeld > 0 || masternodeMessageVerifier.IsFull(pfrom->GetId())) &&
+            CMasternodeMessageVerifier::IsVerifiedCommand(msg.hdr.GetCommand())) {
+            it = pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin() + nHeld, it);
+            nHeld++;
+            it++;
+            continue;
+        }
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -5453,7 +6048,7 @@ bool ProcessMessages(CNode* pfrom)
 
     // In case the connection got shut down, its receive buffer was wiped
     if (!pfrom->fDisconnect)
-        pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+        pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin() + nHeld, it);
 
     return fOk;
 }
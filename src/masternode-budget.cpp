@@ -17,6 +17,8 @@
 #include "util.h"
 #include "wallet.h"
 
+#include <limits>
+
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -105,7 +107,7 @@ void CBudgetManager::CheckOrphanVotes()
 
 
     std::string strError = "";
-    std::map<uint256, CBudgetVote>::iterator it1 = mapOrphanMasternodeBudgetVotes.begin();
+    seencache<uint256, CBudgetVote>::iterator it1 = mapOrphanMasternodeBudgetVotes.begin();
     while (it1 != mapOrphanMasternodeBudgetVotes.end()) {
         if (budget.UpdateProposal(((*it1).second), NULL, strError)) {
             LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
@@ -114,7 +116,7 @@ void CBudgetManager::CheckOrphanVotes()
             ++it1;
         }
     }
-    std::map<uint256, CFinalizedBudgetVote>::iterator it2 = mapOrphanFinalizedBudgetVotes.begin();
+    seencache<uint256, CFinalizedBudgetVote>::iterator it2 = mapOrphanFinalizedBudgetVotes.begin();
     while (it2 != mapOrphanFinalizedBudgetVotes.end()) {
         if (budget.UpdateFinalizedBudget(((*it2).second), NULL, strError)) {
             LogPrint("masternode","CBudgetManager::CheckOrphanVotes - Proposal/Budget is known, activating and removing orphan vote\n");
@@ -249,155 +251,87 @@ void CBudgetManager::SubmitFinalBudget()
 // CBudgetDB
 //
 
-CBudgetDB::CBudgetDB()
-{
-    pathDB = GetDataDir() / "budget.dat";
-    strMagicMessage = "MasternodeBudget";
-}
+CBudgetDB* pBudgetDB = NULL;
 
-bool CBudgetDB::Write(const CBudgetManager& objToSave)
-{
-    LOCK(objToSave.cs);
+CBudgetDB::CBudgetDB(size_t nCacheSize, bool fMemory, bool fWipe) : CKeyedDB(GetDataDir() / "budget", nCacheSize, fMemory, fWipe) {}
 
+bool CBudgetDB::Write(CBudgetManager& objToSave)
+{
     int64_t nStart = GetTimeMillis();
+    LOCK2(cs, objToSave.cs);
+
+    StageChanges('p', objToSave.mapProposals, objToSave.setDirtyProposals);
+    StageChanges('f', objToSave.mapFinalizedBudgets, objToSave.setDirtyFinalizedBudgets);
+    StageChanges('P', objToSave.mapSeenMasternodeBudgetProposals, objToSave.mapSeenMasternodeBudgetProposals.changed_keys());
+    StageChanges('v', objToSave.mapSeenMasternodeBudgetVotes, objToSave.mapSeenMasternodeBudgetVotes.changed_keys());
+    StageChanges('o', objToSave.mapOrphanMasternodeBudgetVotes, objToSave.mapOrphanMasternodeBudgetVotes.changed_keys());
+    StageChanges('F', objToSave.mapSeenFinalizedBudgets, objToSave.mapSeenFinalizedBudgets.changed_keys());
+    StageChanges('V', objToSave.mapSeenFinalizedBudgetVotes, objToSave.mapSeenFinalizedBudgetVotes.changed_keys());
+    StageChanges('O', objToSave.mapOrphanFinalizedBudgetVotes, objToSave.mapOrphanFinalizedBudgetVotes.changed_keys());
+
+    unsigned int nWritten, nErased;
+    if (!Commit(nWritten, nErased))
+        return false;
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
-
+    LogPrintf("Flushed budget cache: %u records written, %u erased  %dms\n", nWritten, nErased, GetTimeMillis() - nStart);
     return true;
 }
 
-CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
+bool CBudgetDB::Read(CBudgetManager& objToLoad)
 {
-    LOCK(objToLoad.cs);
-
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
+    unsigned int nBad = 0;
     try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CBudgetManager object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
+        LOCK2(cs, objToLoad.cs);
         objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
+        nBad += Load('p', objToLoad.mapProposals);
+        nBad += Load('f', objToLoad.mapFinalizedBudgets);
+        nBad += Load('P', objToLoad.mapSeenMasternodeBudgetProposals);
+        nBad += Load('v', objToLoad.mapSeenMasternodeBudgetVotes);
+        nBad += Load('o', objToLoad.mapOrphanMasternodeBudgetVotes);
+        nBad += Load('F', objToLoad.mapSeenFinalizedBudgets);
+        nBad += Load('V', objToLoad.mapSeenFinalizedBudgetVotes);
+        nBad += Load('O', objToLoad.mapOrphanFinalizedBudgetVotes);
+        objToLoad.ClearDirty();
+    } catch (const std::exception& e) {
+        objToLoad.Clear();
+        return error("%s : %s", __func__, e.what());
     }
 
-    LogPrint("masternode","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrintf("Loaded budget cache: %s, %u bad records dropped  %dms\n", objToLoad.ToString(), nBad, GetTimeMillis() - nStart);
+    LogPrint("masternode","Budget manager - cleaning....\n");
+    objToLoad.CheckAndRemove();
+    LogPrint("masternode","Budget manager - result:\n");
     LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("masternode","Budget manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
 
-    return Ok;
+    return true;
 }
 
 void DumpBudgets()
 {
-    int64_t nStart = GetTimeMillis();
+    // nothing to flush into if init stopped short of opening the store
+    if (pBudgetDB)
+        pBudgetDB->Write(budget);
+}
 
-    CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint("masternode","Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint("masternode","Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint("masternode","Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to budget.dat...\n");
-    budgetdb.Write(budget);
+void CBudgetManager::Clear()
+{
+    LOCK(cs);
 
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    LogPrintf("Budget object cleared\n");
+    for (map<uint256, CBudgetProposal>::iterator it = mapProposals.begin(); it != mapProposals.end(); ++it)
+        setDirtyProposals.insert(it->first);
+    for (map<uint256, CFinalizedBudget>::iterator it = mapFinalizedBudgets.begin(); it != mapFinalizedBudgets.end(); ++it)
+        setDirtyFinalizedBudgets.insert(it->first);
+    mapProposals.clear();
+    mapFinalizedBudgets.clear();
+    mapSeenMasternodeBudgetProposals.clear();
+    mapSeenMasternodeBudgetVotes.clear();
+    mapSeenFinalizedBudgets.clear();
+    mapSeenFinalizedBudgetVotes.clear();
+    mapOrphanMasternodeBudgetVotes.clear();
+    mapOrphanFinalizedBudgetVotes.clear();
+    fCachedBudgetDirty = true;
 }
 
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
@@ -410,6 +344,7 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
     }
 
     mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+    setDirtyFinalizedBudgets.insert(finalizedBudget.GetHash());
     return true;
 }
 
@@ -427,6 +362,8 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    setDirtyProposals.insert(budgetProposal.GetHash());
+    fCachedBudgetDirty = true;
     LogPrint("masternode","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
     return true;
 }
@@ -439,6 +376,7 @@ void CBudgetManager::CheckAndRemove()
     // map<uint256, CBudgetProposal> tmpMapProposals;
 
     std::string strError = "";
+    fCachedBudgetDirty = true;
 
     LogPrint("mnbudget", "CBudgetManager::CheckAndRemove - mapFinalizedBudgets cleanup - size before: %d\n", mapFinalizedBudgets.size());
     std::map<uint256, CFinalizedBudget>::iterator it = mapFinalizedBudgets.begin();
@@ -455,7 +393,10 @@ void CBudgetManager::CheckAndRemove()
         }
 
         if (pfinalizedBudget->fValid) {
+            bool fAutoChecked = pfinalizedBudget->IsAutoChecked();
             pfinalizedBudget->AutoCheck();
+            if (pfinalizedBudget->IsAutoChecked() != fAutoChecked)
+                setDirtyFinalizedBudgets.insert(it->first);
             // tmpMapFinalizedBudgets.insert(make_pair(pfinalizedBudget->GetHash(), *pfinalizedBudget));
         }
 
@@ -562,6 +503,37 @@ CFinalizedBudget* CBudgetManager::FindFinalizedBudget(uint256 nHash)
     return NULL;
 }
 
+bool CBudgetManager::IsSeenProposalLive(const uint256& hash, const CBudgetProposalBroadcast& budgetProposalBroadcast)
+{
+    // proposals stay in mapProposals, an expired one is no longer valid
+    CBudgetProposal* pbudgetProposal = FindProposal(hash);
+    return pbudgetProposal && pbudgetProposal->fValid;
+}
+
+bool CBudgetManager::IsSeenProposalVoteLive(const uint256& hash, const CBudgetVote& vote)
+{
+    CBudgetProposal* pbudgetProposal = FindProposal(vote.nProposalHash);
+    if (!pbudgetProposal || !pbudgetProposal->fValid)
+        return false;
+    std::map<uint256, CBudgetVote>::iterator it = pbudgetProposal->mapVotes.find(vote.vin.prevout.GetHash());
+    return it != pbudgetProposal->mapVotes.end() && it->second.GetHash() == hash;
+}
+
+bool CBudgetManager::IsSeenFinalizedBudgetLive(const uint256& hash, const CFinalizedBudgetBroadcast& finalizedBudgetBroadcast)
+{
+    CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget(hash);
+    return pfinalizedBudget && pfinalizedBudget->fValid;
+}
+
+bool CBudgetManager::IsSeenFinalizedBudgetVoteLive(const uint256& hash, const CFinalizedBudgetVote& vote)
+{
+    CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget(vote.nBudgetHash);
+    if (!pfinalizedBudget || !pfinalizedBudget->fValid)
+        return false;
+    std::map<uint256, CFinalizedBudgetVote>::iterator it = pfinalizedBudget->mapVotes.find(vote.vin.prevout.GetHash());
+    return it != pfinalizedBudget->mapVotes.end() && it->second.GetHash() == hash;
+}
+
 CBudgetProposal* CBudgetManager::FindProposal(const std::string& strProposalName)
 {
     //find the prop with the highest yes count
@@ -669,16 +641,34 @@ bool CBudgetManager::IsTransactionValid(const CTransaction& txNew, int nBlockHei
     return false;
 }
 
+void CBudgetManager::CheckVotesAgainstList()
+{
+    unsigned int nListVersion = mnodeman.GetListVersion();
+    if (nListVersion == nVotesListVersion) return;
+
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        (*it).second.CleanAndRemove(false);
+        ++it;
+    }
+    std::map<uint256, CFinalizedBudget>::iterator it2 = mapFinalizedBudgets.begin();
+    while (it2 != mapFinalizedBudgets.end()) {
+        (*it2).second.CleanAndRemove(false);
+        ++it2;
+    }
+    nVotesListVersion = nListVersion;
+    fCachedBudgetDirty = true;
+}
+
 std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 {
     LOCK(cs);
 
     std::vector<CBudgetProposal*> vBudgetProposalRet;
 
+    CheckVotesAgainstList();
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
 
@@ -705,14 +695,33 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    std::vector<CBudgetProposal*> vBudgetProposalsRet;
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev == NULL) return vBudgetProposalsRet;
+
+    int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
+    int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
+    int nThreshold = mnodeman.CountEnabled(ActiveProtocol()) / 10;
+
+    // proposals and votes only change through this class, which flags the cache when they do,
+    // and vote validity only with the masternode list
+    CheckVotesAgainstList();
+    if (!fCachedBudgetDirty && nBlockStart == nCachedBudgetBlockStart && nThreshold == nCachedBudgetThreshold &&
+        GetTime() < nCachedBudgetExpires)
+        return vCachedBudget;
+
     // ------- Sort budgets by Yes Count
 
     std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
+    int64_t nNextEstablished = std::numeric_limits<int64_t>::max();
 
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
         (*it).second.CleanAndRemove(false);
         vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetYeas() - (*it).second.GetNays()));
+        if (!(*it).second.IsEstablished())
+            nNextEstablished = std::min(nNextEstablished, (*it).second.GetEstablishedTime());
         ++it;
     }
 
@@ -720,14 +729,7 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 
     // ------- Grab The Budgets In Order
 
-    std::vector<CBudgetProposal*> vBudgetProposalsRet;
-
     CAmount nBudgetAllocated = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    if (pindexPrev == NULL) return vBudgetProposalsRet;
-
-    int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
-    int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
 
 
@@ -739,12 +741,12 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         //prop start/end should be inside this period
         if (pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= nBlockStart &&
             pbudgetProposal->nBlockEnd >= nBlockEnd &&
-            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > mnodeman.CountEnabled(ActiveProtocol()) / 10 &&
+            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > nThreshold &&
             pbudgetProposal->IsEstablished()) {
 
             LogPrint("masternode","CBudgetManager::GetBudget() -   Check 1 passed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), nThreshold,
                       pbudgetProposal->IsEstablished());
 
             if (pbudgetProposal->GetAmount() + nBudgetAllocated <= nTotalBudget) {
@@ -760,13 +762,19 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         else {
             LogPrint("masternode","CBudgetManager::GetBudget() -   Check 1 failed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), nThreshold,
                       pbudgetProposal->IsEstablished());
         }
 
         ++it2;
     }
 
+    vCachedBudget = vBudgetProposalsRet;
+    fCachedBudgetDirty = false;
+    nCachedBudgetBlockStart = nBlockStart;
+    nCachedBudgetThreshold = nThreshold;
+    nCachedBudgetExpires = nNextEstablished;
+
     return vBudgetProposalsRet;
 }
 
@@ -918,6 +926,7 @@ void CBudgetManager::NewBlock()
         (*it2).second.CleanAndRemove(false);
         ++it2;
     }
+    fCachedBudgetDirty = true;
 
     LogPrint("masternode","CBudgetManager::NewBlock - mapFinalizedBudgets cleanup - size: %d\n", mapFinalizedBudgets.size());
     std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
@@ -1052,8 +1061,8 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        CMasternode* pmn = mnodeman.Find(vote.vin);
-        if (pmn == NULL) {
+        CMasternodePtr pmn = mnodeman.Find(vote.vin);
+        if (!pmn) {
             LogPrint("masternode","mvote - unknown masternode - vin: %s\n", vote.vin.prevout.hash.ToString());
             mnodeman.AskForMN(pfrom, vote.vin);
             return;
@@ -1125,8 +1134,8 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             return;
         }
 
-        CMasternode* pmn = mnodeman.Find(vote.vin);
-        if (pmn == NULL) {
+        CMasternodePtr pmn = mnodeman.Find(vote.vin);
+        if (!pmn) {
             LogPrint("mnbudget", "fbvote - unknown masternode - vin: %s\n", vote.vin.prevout.hash.ToString());
             mnodeman.AskForMN(pfrom, vote.vin);
             return;
@@ -1165,7 +1174,7 @@ void CBudgetManager::ResetSync()
     LOCK(cs);
 
 
-    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
+    seencache<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
     while (it1 != mapSeenMasternodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid) {
@@ -1179,7 +1188,7 @@ void CBudgetManager::ResetSync()
         ++it1;
     }
 
-    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
+    seencache<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid) {
@@ -1202,7 +1211,7 @@ void CBudgetManager::MarkSynced()
         Mark that we've sent all valid items
     */
 
-    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
+    seencache<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
     while (it1 != mapSeenMasternodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid) {
@@ -1217,7 +1226,7 @@ void CBudgetManager::MarkSynced()
         ++it1;
     }
 
-    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
+    seencache<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid) {
@@ -1250,7 +1259,7 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     int nInvCount = 0;
 
-    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
+    seencache<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
     while (it1 != mapSeenMasternodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
@@ -1278,7 +1287,7 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
 
     nInvCount = 0;
 
-    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
+    seencache<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
@@ -1315,7 +1324,7 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("masternode","CBudgetManager::UpdateProposal - Unknown proposal %d, asking for source proposal\n", vote.nProposalHash.ToString());
-            mapOrphanMasternodeBudgetVotes[vote.nProposalHash] = vote;
+            mapOrphanMasternodeBudgetVotes.Insert(vote.nProposalHash, vote);
 
             if (!askedForSourceProposalOrBudget.count(vote.nProposalHash)) {
                 pfrom->PushMessage("mnvs", vote.nProposalHash);
@@ -1328,6 +1337,8 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
+    fCachedBudgetDirty = true;
+    setDirtyProposals.insert(vote.nProposalHash);
     return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
 }
 
@@ -1342,7 +1353,7 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
             if (!masternodeSync.IsSynced()) return false;
 
             LogPrint("masternode","CBudgetManager::UpdateFinalizedBudget - Unknown Finalized Proposal %s, asking for source budget\n", vote.nBudgetHash.ToString());
-            mapOrphanFinalizedBudgetVotes[vote.nBudgetHash] = vote;
+            mapOrphanFinalizedBudgetVotes.Insert(vote.nBudgetHash, vote);
 
             if (!askedForSourceProposalOrBudget.count(vote.nBudgetHash)) {
                 pfrom->PushMessage("mnvs", vote.nBudgetHash);
@@ -1354,6 +1365,7 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
         return false;
     }
     LogPrint("masternode","CBudgetManager::UpdateFinalizedBudget - Finalized Proposal %s added\n", vote.nBudgetHash.ToString());
+    setDirtyFinalizedBudgets.insert(vote.nBudgetHash);
     return mapFinalizedBudgets[vote.nBudgetHash].AddOrUpdateVote(vote, strError);
 }
 
@@ -1365,6 +1377,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    Recount();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1377,6 +1390,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    Recount();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1391,6 +1405,7 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
     fValid = true;
+    Recount();
 }
 
 bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral)
@@ -1497,7 +1512,10 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    if (mapVotes.count(hash))
+        Tally(mapVotes[hash], -1);
     mapVotes[hash] = vote;
+    Tally(vote, 1);
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
@@ -1509,66 +1527,58 @@ void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        bool fValidVote = (*it).second.SignatureValid(fSignatureCheck);
+        if (fValidVote != (*it).second.fValid) {
+            Tally((*it).second, -1);
+            (*it).second.fValid = fValidVote;
+            Tally((*it).second, 1);
+        }
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+void CBudgetProposal::Tally(const CBudgetVote& vote, int nWeight)
 {
-    int yeas = 0;
-    int nays = 0;
+    if (vote.nVote == VOTE_YES) nAllYeas += nWeight;
+    if (vote.nVote == VOTE_NO) nAllNays += nWeight;
+    if (!vote.fValid) return;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    if (vote.nVote == VOTE_YES) nYeas += nWeight;
+    if (vote.nVote == VOTE_NO) nNays += nWeight;
+    if (vote.nVote == VOTE_ABSTAIN) nAbstains += nWeight;
+}
 
+void CBudgetProposal::Recount()
+{
+    nYeas = nNays = nAbstains = nAllYeas = nAllNays = 0;
+
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        Tally((*it).second, 1);
         ++it;
     }
+}
 
-    if (yeas + nays == 0) return 0.0f;
+double CBudgetProposal::GetRatio()
+{
+    if (nAllYeas + nAllNays == 0) return 0.0f;
 
-    return ((double)(yeas) / (double)(yeas + nays));
+    return ((double)(nAllYeas) / (double)(nAllYeas + nAllNays));
 }
 
 int CBudgetProposal::GetYeas()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nYeas;
 }
 
 int CBudgetProposal::GetNays()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nNays;
 }
 
 int CBudgetProposal::GetAbstains()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nAbstains;
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1668,6 +1678,11 @@ void CBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -1675,7 +1690,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!masternodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1693,11 +1708,11 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
-    CMasternode* pmn = mnodeman.Find(vin);
+    CMasternodePtr pmn = mnodeman.Find(vin);
 
-    if (pmn == NULL) {
+    if (!pmn) {
         if (fDebug){
             LogPrint("masternode","CBudgetVote::SignatureValid() - Unknown Masternode - %s\n", vin.prevout.hash.ToString());
         }
@@ -2112,6 +2127,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -2119,7 +2139,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!masternodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2138,11 +2158,11 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
-    CMasternode* pmn = mnodeman.Find(vin);
+    CMasternodePtr pmn = mnodeman.Find(vin);
 
-    if (pmn == NULL) {
+    if (!pmn) {
         LogPrint("masternode","CFinalizedBudgetVote::SignatureValid() - Unknown Masternode %s\n", strMessage);
         return false;
     }
@@ -9,11 +9,14 @@
 #include "base58.h"
 #include "init.h"
 #include "key.h"
+#include "keyeddb.h"
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
+#include "seencache.h"
 #include "sync.h"
 #include "util.h"
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -35,6 +38,15 @@ static const CAmount PROPOSAL_FEE_TX = (50 * COIN);
 static const CAmount BUDGET_FEE_TX = (50 * COIN);
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
 
+// Bounds of the seen budget message caches. Proposals, budgets and their votes
+// are served to syncing peers for as long as they are active, so those caches
+// are bounded by size only.
+static const unsigned int BUDGET_SEEN_PROPOSALS_MAX = 10000;
+static const unsigned int BUDGET_SEEN_FINALIZED_MAX = 1000;
+static const unsigned int BUDGET_SEEN_VOTES_MAX = 500000;
+static const unsigned int BUDGET_ORPHAN_VOTES_MAX = 10000;
+static const int64_t BUDGET_ORPHAN_VOTES_SECONDS = 24 * 60 * 60;
+
 extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
@@ -67,6 +79,8 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    /// The message covered by vchSig
+    std::string GetStrMessage() const;
     void Relay();
 
     std::string GetVoteString()
@@ -119,6 +133,8 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    /// The message covered by vchSig
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -142,30 +158,20 @@ public:
     }
 };
 
-/** Save Budget Manager (budget.dat)
+/** Keyed store of the proposals, finalized budgets and seen budget messages (budget/)
  */
-class CBudgetDB
+class CBudgetDB : public CKeyedDB
 {
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CBudgetDB();
-    bool Write(const CBudgetManager& objToSave);
-    ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+    CBudgetDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Write what changed since the last call */
+    bool Write(CBudgetManager& objToSave);
+    bool Read(CBudgetManager& objToLoad);
 };
 
+extern CBudgetDB* pBudgetDB;
+
 
 //
 // Budget Manager : Contains all proposals for the budget
@@ -177,6 +183,19 @@ private:
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    // last result of GetBudget, flagged dirty whenever a proposal or vote changes
+    std::vector<CBudgetProposal*> vCachedBudget;
+    bool fCachedBudgetDirty;
+    int nCachedBudgetBlockStart;
+    int nCachedBudgetThreshold;
+    // when the next proposal becomes established
+    int64_t nCachedBudgetExpires;
+    // masternode list version the validity of the votes was last checked against
+    unsigned int nVotesListVersion;
+
+    /// Recheck whether the votes come from listed masternodes if the list changed since the last time
+    void CheckVotesAgainstList();
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -184,18 +203,42 @@ public:
     // keep track of the scanning errors I've seen
     map<uint256, CBudgetProposal> mapProposals;
     map<uint256, CFinalizedBudget> mapFinalizedBudgets;
-
-    std::map<uint256, CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
-    std::map<uint256, CBudgetVote> mapSeenMasternodeBudgetVotes;
-    std::map<uint256, CBudgetVote> mapOrphanMasternodeBudgetVotes;
-    std::map<uint256, CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
-    std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
-    std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
-
-    CBudgetManager()
+    // keys of the proposals and finalized budgets changed since the budget cache was last flushed
+    std::set<uint256> setDirtyProposals;
+    std::set<uint256> setDirtyFinalizedBudgets;
+
+    seencache<uint256, CBudgetProposalBroadcast> mapSeenMasternodeBudgetProposals;
+    seencache<uint256, CBudgetVote> mapSeenMasternodeBudgetVotes;
+    seencache<uint256, CBudgetVote> mapOrphanMasternodeBudgetVotes;
+    seencache<uint256, CFinalizedBudgetBroadcast> mapSeenFinalizedBudgets;
+    seencache<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
+    seencache<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
+
+    CBudgetManager() : fCachedBudgetDirty(true),
+                       nCachedBudgetBlockStart(0),
+                       nCachedBudgetThreshold(0),
+                       nCachedBudgetExpires(0),
+                       nVotesListVersion(0),
+                       mapSeenMasternodeBudgetProposals(BUDGET_SEEN_PROPOSALS_MAX),
+                       mapSeenMasternodeBudgetVotes(BUDGET_SEEN_VOTES_MAX),
+                       mapOrphanMasternodeBudgetVotes(BUDGET_ORPHAN_VOTES_MAX, BUDGET_ORPHAN_VOTES_SECONDS),
+                       mapSeenFinalizedBudgets(BUDGET_SEEN_FINALIZED_MAX),
+                       mapSeenFinalizedBudgetVotes(BUDGET_SEEN_VOTES_MAX),
+                       mapOrphanFinalizedBudgetVotes(BUDGET_ORPHAN_VOTES_MAX, BUDGET_ORPHAN_VOTES_SECONDS)
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
+        mapSeenMasternodeBudgetProposals.track_changes();
+        mapSeenMasternodeBudgetVotes.track_changes();
+        mapOrphanMasternodeBudgetVotes.track_changes();
+        mapSeenFinalizedBudgets.track_changes();
+        mapSeenFinalizedBudgetVotes.track_changes();
+        mapOrphanFinalizedBudgetVotes.track_changes();
+        // Sync and getdata serve from these, the caps never cost a live object
+        mapSeenMasternodeBudgetProposals.keep_if(boost::bind(&CBudgetManager::IsSeenProposalLive, this, _1, _2));
+        mapSeenMasternodeBudgetVotes.keep_if(boost::bind(&CBudgetManager::IsSeenProposalVoteLive, this, _1, _2));
+        mapSeenFinalizedBudgets.keep_if(boost::bind(&CBudgetManager::IsSeenFinalizedBudgetLive, this, _1, _2));
+        mapSeenFinalizedBudgetVotes.keep_if(boost::bind(&CBudgetManager::IsSeenFinalizedBudgetVoteLive, this, _1, _2));
     }
 
     void ClearSeen()
@@ -219,6 +262,11 @@ public:
     CBudgetProposal* FindProposal(const std::string& strProposalName);
     CBudgetProposal* FindProposal(uint256 nHash);
     CFinalizedBudget* FindFinalizedBudget(uint256 nHash);
+    /// Whether a seen entry is still served to peers: its object, or the one voted on, is known and valid
+    bool IsSeenProposalLive(const uint256& hash, const CBudgetProposalBroadcast& budgetProposalBroadcast);
+    bool IsSeenProposalVoteLive(const uint256& hash, const CBudgetVote& vote);
+    bool IsSeenFinalizedBudgetLive(const uint256& hash, const CFinalizedBudgetBroadcast& finalizedBudgetBroadcast);
+    bool IsSeenFinalizedBudgetVoteLive(const uint256& hash, const CFinalizedBudgetVote& vote);
     std::pair<std::string, std::string> GetVotes(std::string strProposalName);
 
     CAmount GetTotalBudget(int nHeight);
@@ -238,19 +286,18 @@ public:
     void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStake);
 
     void CheckOrphanVotes();
-    void Clear()
+    void Clear();
+    /// Forget what changed, for entries that match the cache on disk
+    void ClearDirty()
     {
-        LOCK(cs);
-
-        LogPrintf("Budget object cleared\n");
-        mapProposals.clear();
-        mapFinalizedBudgets.clear();
-        mapSeenMasternodeBudgetProposals.clear();
-        mapSeenMasternodeBudgetVotes.clear();
-        mapSeenFinalizedBudgets.clear();
-        mapSeenFinalizedBudgetVotes.clear();
-        mapOrphanMasternodeBudgetVotes.clear();
-        mapOrphanFinalizedBudgetVotes.clear();
+        setDirtyProposals.clear();
+        setDirtyFinalizedBudgets.clear();
+        mapSeenMasternodeBudgetProposals.changed_keys().clear();
+        mapSeenMasternodeBudgetVotes.changed_keys().clear();
+        mapOrphanMasternodeBudgetVotes.changed_keys().clear();
+        mapSeenFinalizedBudgets.changed_keys().clear();
+        mapSeenFinalizedBudgetVotes.changed_keys().clear();
+        mapOrphanFinalizedBudgetVotes.changed_keys().clear();
     }
     void CheckAndRemove();
     std::string ToString() const;
@@ -270,6 +317,8 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead())
+            fCachedBudgetDirty = true;
     }
 };
 
@@ -360,6 +409,7 @@ public:
 
     //check to see if we should vote on this
     void AutoCheck();
+    bool IsAutoChecked() const { return fAutoChecked; }
     //total rdct paid out by this budget
     CAmount GetTotalPayout();
     //vote on this finalized budget as a masternode
@@ -456,6 +506,15 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // running tallies of mapVotes: counted (fValid) votes, and all votes for GetRatio
+    int nYeas;
+    int nNays;
+    int nAbstains;
+    int nAllYeas;
+    int nAllNays;
+
+    void Tally(const CBudgetVote& vote, int nWeight);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -486,15 +545,17 @@ public:
 
     bool IsValid(std::string& strError, bool fCheckCollateral = true);
 
-    bool IsEstablished()
+    int64_t GetEstablishedTime()
     {
         // Proposals must be at least a day old to make it into a budget
-        if (Params().NetworkID() == CBaseChainParams::MAIN) return (nTime < GetTime() - (60 * 60 * 24));
+        if (Params().NetworkID() == CBaseChainParams::MAIN) return nTime + (60 * 60 * 24) + 1;
 
         // For testing purposes - 5 minutes
-        return (nTime < GetTime() - (60 * 5));
+        return nTime + (60 * 5) + 1;
     }
 
+    bool IsEstablished() { return GetTime() >= GetEstablishedTime(); }
+
     std::string GetName() { return strProposalName; }
     std::string GetURL() { return strURL; }
     int GetBlockStart() { return nBlockStart; }
@@ -514,6 +575,8 @@ public:
     CAmount GetAllotted() { return nAlloted; }
 
     void CleanAndRemove(bool fSignatureCheck);
+    /// Recompute the tallies after mapVotes was replaced as a whole
+    void Recount();
 
     uint256 GetHash()
     {
@@ -547,6 +610,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            Recount();
     }
 };
 
@@ -575,6 +640,8 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        first.Recount();
+        second.Recount();
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
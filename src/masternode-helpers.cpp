@@ -9,12 +9,18 @@
 #include "main.h"
 #include "masternodeman.h"
 #include "activemasternode.h"
+#include "hash.h"
+#include "masternode-budget.h"
 #include "masternode-payments.h"
+#include "random.h"
 #include "swifttx.h"
 
 // A helper object for signing messages from Masternodes
 CMasternodeSigner masternodeSigner;
 
+// Checks masternode message signatures off the message handler thread
+CMasternodeMessageVerifier masternodeMessageVerifier;
+
 void ThreadMasternodePool()
 {
     if (fLiteMode) return; //disable all Masternode related functionality
@@ -43,10 +49,23 @@ void ThreadMasternodePool()
                 masternodePayments.CleanPaymentList();
                 CleanTransactionLocksList();
             }
+
+            if (c % MASTERNODES_DUMP_SECONDS == 0) {
+                DumpMasternodes();
+                DumpBudgets();
+                DumpMasternodePayments();
+            }
         }
     }
 }
 
+void ThreadMasternodeVerify()
+{
+    // Make this thread recognisable
+    RenameThread("rdct-mnverify");
+    masternodeMessageVerifier.Thread();
+}
+
 bool CMasternodeSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
 {
     CScript payee2;
@@ -108,21 +127,70 @@ bool CMasternodeSigner::SignMessage(std::string strMessage, std::string& errorMe
 }
 
 bool CMasternodeSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    CKeyID keyID;
+    if (!RecoverMessageSigner(strMessage, vchSig, keyID)) {
+        errorMessage = _("Error recovering public key.");
+        return false;
+    }
+
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CMasternodeSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
+
+    return (keyID == pubkey.GetID());
+}
+
+static uint256 GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
+uint256 CMasternodeSigner::GetSignerCacheKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig)
+{
+    return Hash(hashMessage.begin(), hashMessage.end(), vchSig.begin(), vchSig.end());
+}
+
+bool CMasternodeSigner::RecoverMessageSigner(const std::string& strMessage, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet)
+{
+    uint256 hash = GetMessageHash(strMessage);
+    uint256 hashKey = GetSignerCacheKey(hash, vchSig);
+
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_signercache);
+        std::map<uint256, CKeyID>::iterator it = mapSignerCache.find(hashKey);
+        if (it != mapSignerCache.end()) {
+            keyIDRet = it->second;
+            return true;
+        }
+    }
+
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hash, vchSig))
         return false;
+    keyIDRet = pubkey.GetID();
+
+    boost::unique_lock<boost::shared_mutex> lock(cs_signercache);
+    while (mapSignerCache.size() >= MAX_MASTERNODE_SIG_CACHE_SIZE) {
+        // Evict a random entry, so a peer can't pick which entries survive
+        std::map<uint256, CKeyID>::iterator it = mapSignerCache.lower_bound(GetRandHash());
+        if (it == mapSignerCache.end())
+            it = mapSignerCache.begin();
+        mapSignerCache.erase(it);
     }
+    mapSignerCache.insert(std::make_pair(hashKey, keyIDRet));
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CMasternodeSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    return true;
+}
+
+bool CMasternodeSigner::HaveMessageSigner(const std::string& strMessage, const std::vector<unsigned char>& vchSig)
+{
+    uint256 hashKey = GetSignerCacheKey(GetMessageHash(strMessage), vchSig);
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    boost::shared_lock<boost::shared_mutex> lock(cs_signercache);
+    return mapSignerCache.count(hashKey) > 0;
 }
 
 bool CMasternodeSigner::SetCollateralAddress(std::string strAddress)
@@ -134,4 +202,169 @@ bool CMasternodeSigner::SetCollateralAddress(std::string strAddress)
     }
     collateralPubKey = GetScriptForDestination(address.Get());
     return true;
-}
\ No newline at end of file
+}
+
+bool CMasternodeMessageVerifier::IsVerifiedCommand(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnlistdiff" || strCommand == "mnp" || strCommand == "mnw" ||
+           strCommand == "mvote" || strCommand == "fbvote" || strCommand == "txlvote";
+}
+
+bool CMasternodeMessageVerifier::Push(NodeId nodeId, const std::string& strCommand, const CDataStream& vRecv)
+{
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > vSignatures;
+
+    try {
+        CDataStream vCopy(vRecv);
+        if (strCommand == "mnb") {
+            CMasternodeBroadcast mnb;
+            vCopy >> mnb;
+            vSignatures.push_back(make_pair(mnb.GetStrMessage(), mnb.sig));
+            if (mnb.lastPing != CMasternodePing())
+                vSignatures.push_back(make_pair(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+        } else if (strCommand == "mnlistdiff") {
+            std::vector<CMasternodeBroadcast> vMnb;
+            vCopy >> vMnb;
+            BOOST_FOREACH (const CMasternodeBroadcast& mnb, vMnb) {
+                vSignatures.push_back(make_pair(mnb.GetStrMessage(), mnb.sig));
+                if (mnb.lastPing != CMasternodePing())
+                    vSignatures.push_back(make_pair(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+            }
+        } else if (strCommand == "mnp") {
+            CMasternodePing mnp;
+            vCopy >> mnp;
+            vSignatures.push_back(make_pair(mnp.GetStrMessage(), mnp.vchSig));
+        } else if (strCommand == "mnw") {
+            CMasternodePaymentWinner winner;
+            vCopy >> winner;
+            vSignatures.push_back(make_pair(winner.GetStrMessage(), winner.vchSig));
+        } else if (strCommand == "mvote") {
+            CBudgetVote vote;
+            vCopy >> vote;
+            vSignatures.push_back(make_pair(vote.GetStrMessage(), vote.vchSig));
+        } else if (strCommand == "fbvote") {
+            CFinalizedBudgetVote vote;
+            vCopy >> vote;
+            vSignatures.push_back(make_pair(vote.GetStrMessage(), vote.vchSig));
+        } else if (strCommand == "txlvote") {
+            CConsensusVote vote;
+            vCopy >> vote;
+            vSignatures.push_back(make_pair(vote.GetStrMessage(), vote.vchMasterNodeSignature));
+        } else {
+            return false;
+        }
+    } catch (const std::exception&) {
+        // malformed, leave it to the handler
+        return false;
+    }
+
+    // signatures recovered before need no second look
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > vUnchecked;
+    for (unsigned int i = 0; i < vSignatures.size(); i++) {
+        if (!masternodeSigner.HaveMessageSigner(vSignatures[i].first, vSignatures[i].second))
+            vUnchecked.push_back(vSignatures[i]);
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (nWorkers == 0)
+        return false;
+
+    // nothing to wait for and nothing queued ahead of it from this peer
+    std::map<NodeId, std::deque<boost::shared_ptr<CPendingMessage> > >::iterator it = mapPending.find(nodeId);
+    if (vUnchecked.empty() && it == mapPending.end())
+        return false;
+
+    // never dropped: ProcessMessages holds back the peer's next masternode messages while IsFull
+    boost::shared_ptr<CPendingMessage> pmsg(new CPendingMessage(nodeId, strCommand, vRecv));
+    for (unsigned int i = 0; i < vUnchecked.size(); i++) {
+        CPendingSignature sig;
+        sig.pmsg = pmsg;
+        sig.strMessage = vUnchecked[i].first;
+        sig.vchSig = vUnchecked[i].second;
+        queueSignatures.push_back(sig);
+        pmsg->nRemaining++;
+    }
+    if (!vUnchecked.empty())
+        mapQueued[nodeId] += vUnchecked.size();
+
+    mapPending[nodeId].push_back(pmsg);
+    condWorker.notify_all();
+    return true;
+}
+
+bool CMasternodeMessageVerifier::IsFull(NodeId nodeId)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<NodeId, unsigned int>::const_iterator itQueued = mapQueued.find(nodeId);
+    if (itQueued != mapQueued.end() && itQueued->second >= MAX_MASTERNODE_VERIFY_SIGNATURES)
+        return true;
+    std::map<NodeId, std::deque<boost::shared_ptr<CPendingMessage> > >::const_iterator it = mapPending.find(nodeId);
+    return it != mapPending.end() && it->second.size() >= MAX_MASTERNODE_VERIFY_PENDING;
+}
+
+bool CMasternodeMessageVerifier::PopVerified(NodeId nodeId, std::string& strCommand, CDataStream& vRecv)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+
+    std::map<NodeId, std::deque<boost::shared_ptr<CPendingMessage> > >::iterator it = mapPending.find(nodeId);
+    if (it == mapPending.end() || it->second.front()->nRemaining > 0)
+        return false;
+
+    strCommand = it->second.front()->strCommand;
+    vRecv = it->second.front()->vRecv;
+    it->second.pop_front();
+    if (it->second.empty())
+        mapPending.erase(it);
+    return true;
+}
+
+void CMasternodeMessageVerifier::RemoveNode(NodeId nodeId)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapPending.erase(nodeId);
+    mapQueued.erase(nodeId);
+}
+
+void CMasternodeMessageVerifier::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers++;
+    }
+
+    std::vector<CPendingSignature> vBatch;
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queueSignatures.empty())
+                    condWorker.wait(lock);
+                while (!queueSignatures.empty() && vBatch.size() < MASTERNODE_VERIFY_BATCH_SIZE) {
+                    vBatch.push_back(queueSignatures.front());
+                    queueSignatures.pop_front();
+                    // node ids are never reused, so a disconnected peer's count stays gone
+                    std::map<NodeId, unsigned int>::iterator it = mapQueued.find(vBatch.back().pmsg->nodeId);
+                    if (it != mapQueued.end() && --it->second == 0)
+                        mapQueued.erase(it);
+                }
+            }
+
+            // a bad signature is simply not cached, the handler rejects it
+            BOOST_FOREACH (const CPendingSignature& sig, vBatch) {
+                CKeyID keyID;
+                masternodeSigner.RecoverMessageSigner(sig.strMessage, sig.vchSig, keyID);
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                BOOST_FOREACH (const CPendingSignature& sig, vBatch)
+                    sig.pmsg->nRemaining--;
+            }
+            vBatch.clear();
+        }
+    } catch (const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers--;
+        throw;
+    }
+}
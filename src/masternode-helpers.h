@@ -11,10 +11,33 @@
 #include "sync.h"
 #include "base58.h"
 
+#include <deque>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+/** Maximum number of recovered masternode message signers to keep */
+static const unsigned int MAX_MASTERNODE_SIG_CACHE_SIZE = 100000;
+/** Maximum number of threads verifying masternode message signatures */
+static const int MAX_MASTERNODE_VERIFY_THREADS = 4;
+/** Number of signatures a verification thread takes at a time */
+static const unsigned int MASTERNODE_VERIFY_BATCH_SIZE = 16;
+/** Number of masternode messages of one peer waiting for their signatures to be checked at which its next ones wait */
+static const unsigned int MAX_MASTERNODE_VERIFY_PENDING = 1000;
+/** Number of signatures of one peer waiting to be checked at which its next masternode messages wait */
+static const unsigned int MAX_MASTERNODE_VERIFY_SIGNATURES = 2000;
+
 /** Helper object for signing and checking signatures
  */
 class CMasternodeSigner
 {
+private:
+    // signer key IDs recovered from (message hash, signature), by the hash of both
+    std::map<uint256, CKeyID> mapSignerCache;
+    boost::shared_mutex cs_signercache;
+
+    static uint256 GetSignerCacheKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig);
+
 public:
     CScript collateralPubKey;
 
@@ -28,6 +51,10 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Recover the key ID that signed the message, returns true if successful
+    bool RecoverMessageSigner(const std::string& strMessage, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet);
+    /// Has the signer of this message already been recovered?
+    bool HaveMessageSigner(const std::string& strMessage, const std::vector<unsigned char>& vchSig);
 
     bool SetCollateralAddress(std::string strAddress);
 
@@ -38,9 +65,61 @@ public:
 
 };
 
+/** Checks the signatures of incoming masternode messages on a pool of threads.
+ *  A message is held back until every signature it carries has been recovered
+ *  into the masternodeSigner cache, then handed back to the message handler in
+ *  the order its peer sent it. Relay and state updates therefore only run once
+ *  verification is done, and the handler's own checks hit the cache.
+ */
+class CMasternodeMessageVerifier
+{
+private:
+    struct CPendingMessage {
+        NodeId nodeId;
+        std::string strCommand;
+        CDataStream vRecv;
+        int nRemaining;
+
+        CPendingMessage(NodeId nodeIdIn, const std::string& strCommandIn, const CDataStream& vRecvIn) : nodeId(nodeIdIn), strCommand(strCommandIn), vRecv(vRecvIn), nRemaining(0) {}
+    };
+
+    struct CPendingSignature {
+        boost::shared_ptr<CPendingMessage> pmsg;
+        std::string strMessage;
+        std::vector<unsigned char> vchSig;
+    };
+
+    boost::mutex cs;
+    boost::condition_variable condWorker;
+    std::deque<CPendingSignature> queueSignatures;
+    std::map<NodeId, std::deque<boost::shared_ptr<CPendingMessage> > > mapPending;
+    // signatures in queueSignatures, by the peer that sent them
+    std::map<NodeId, unsigned int> mapQueued;
+    int nWorkers;
+
+public:
+    CMasternodeMessageVerifier() : nWorkers(0) {}
+
+    /// Is this a message whose signatures are checked here?
+    static bool IsVerifiedCommand(const std::string& strCommand);
+    /// Queue a message for verification, returns false if it should be processed right away
+    bool Push(NodeId nodeId, const std::string& strCommand, const CDataStream& vRecv);
+    /// Whether the masternode messages of this peer should wait until its earlier ones are checked
+    bool IsFull(NodeId nodeId);
+    /// Take the next message from this peer once it is verified
+    bool PopVerified(NodeId nodeId, std::string& strCommand, CDataStream& vRecv);
+    /// Drop the messages of a disconnected peer
+    void RemoveNode(NodeId nodeId);
+
+    /// Worker thread loop
+    void Thread();
+};
+
 void ThreadMasternodePool();
+void ThreadMasternodeVerify();
 
 extern CMasternodeSigner masternodeSigner;
+extern CMasternodeMessageVerifier masternodeMessageVerifier;
 
 
 #endif
@@ -29,150 +29,59 @@ CCriticalSection cs_mapMasternodePayeeVotes;
 // CMasternodePaymentDB
 //
 
-CMasternodePaymentDB::CMasternodePaymentDB()
-{
-    pathDB = GetDataDir() / "mnpayments.dat";
-    strMagicMessage = "MasternodePayments";
-}
+CMasternodePaymentDB* pMasternodePaymentDB = NULL;
 
-bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
+CMasternodePaymentDB::CMasternodePaymentDB(size_t nCacheSize, bool fMemory, bool fWipe) : CKeyedDB(GetDataDir() / "mnpayments", nCacheSize, fMemory, fWipe) {}
+
+bool CMasternodePaymentDB::Write(CMasternodePayments& objToSave)
 {
     int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    LOCK(cs);
+    {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        StageChanges('v', objToSave.mapMasternodePayeeVotes, objToSave.mapMasternodePayeeVotes.changed_keys());
+        StageChanges('b', objToSave.mapMasternodeBlocks, objToSave.setDirtyBlocks);
     }
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    unsigned int nWritten, nErased;
+    if (!Commit(nWritten, nErased))
+        return false;
 
+    LogPrintf("Flushed masternode payment cache: %u records written, %u erased  %dms\n", nWritten, nErased, GetTimeMillis() - nStart);
     return true;
 }
 
-CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
+bool CMasternodePaymentDB::Read(CMasternodePayments& objToLoad)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
+    unsigned int nBad = 0;
     try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode payement cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CMasternodePayments object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
+        LOCK(cs);
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
+        nBad += Load('v', objToLoad.mapMasternodePayeeVotes);
+        nBad += Load('b', objToLoad.mapMasternodeBlocks);
+        objToLoad.ClearDirty();
+        objToLoad.ReindexPaidHeights();
+    } catch (const std::exception& e) {
+        objToLoad.Clear();
+        return error("%s : %s", __func__, e.what());
     }
 
-    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrintf("Loaded masternode payment cache: %s, %u bad records dropped  %dms\n", objToLoad.ToString(), nBad, GetTimeMillis() - nStart);
+    LogPrint("masternode","Masternode payments manager - cleaning....\n");
+    objToLoad.CleanPaymentList();
+    LogPrint("masternode","Masternode payments manager - result:\n");
     LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("masternode","Masternode payments manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
 
-    return Ok;
+    return true;
 }
 
 void DumpMasternodePayments()
 {
-    int64_t nStart = GetTimeMillis();
-
-    CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint("masternode","Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint("masternode","Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint("masternode","Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to mnpayments.dat...\n");
-    paymentdb.Write(masternodePayments);
-
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    // nothing to flush into if init stopped short of opening the store
+    if (pMasternodePaymentDB)
+        pMasternodePaymentDB->Write(masternodePayments);
 }
 
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
@@ -291,7 +200,7 @@ void CMasternodePayments::FillBlockPayee(CMutableTransaction& txNew, int64_t nFe
     //spork
     if (!masternodePayments.GetBlockPayee(pindexPrev->nHeight + 1, payee)) {
         //no masternode detected
-        CMasternode* winningNode = mnodeman.GetCurrentMasterNode(1);
+        CMasternodePtr winningNode = mnodeman.GetCurrentMasterNode(1);
         if (winningNode) {
             payee = GetScriptForDestination(winningNode->pubKeyCollateralAddress.GetID());
         } else {
@@ -422,14 +331,19 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
     }
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!masternodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -456,32 +370,77 @@ bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
 // Is this masternode scheduled to get paid soon?
 // -- Only look ahead up to 8 blocks to allow for propagation of the latest 2 winners
 bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
+{
+    return GetScheduledPayees(nNotBlockHeight).count(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+}
+
+ScriptPubKeySet CMasternodePayments::GetScheduledPayees(int nNotBlockHeight)
 {
     LOCK(cs_mapMasternodeBlocks);
 
+    ScriptPubKeySet setPayees;
     int nHeight;
     {
         TRY_LOCK(cs_main, locked);
-        if (!locked || chainActive.Tip() == NULL) return false;
+        if (!locked || chainActive.Tip() == NULL) return setPayees;
         nHeight = chainActive.Tip()->nHeight;
     }
 
-    CScript mnpayee;
-    mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-
     CScript payee;
-    for (int64_t h = nHeight; h <= nHeight + 8; h++) {
-        if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h)) {
-            if (mapMasternodeBlocks[h].GetPayee(payee)) {
-                if (mnpayee == payee) {
-                    return true;
-                }
-            }
-        }
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.lower_bound(nHeight);
+    for (; it != mapMasternodeBlocks.end() && it->first <= nHeight + 8; ++it) {
+        if (it->first == nNotBlockHeight) continue;
+        if (it->second.GetPayee(payee))
+            setPayees.insert(payee);
     }
 
-    return false;
+    return setPayees;
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nHeight, int nBlocks)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    boost::unordered_map<CScript, std::set<int>, SaltedScriptHasher>::const_iterator it = mapPaidHeights.find(payee);
+    if (it == mapPaidHeights.end()) return 0;
+
+    // the last height up to nHeight, if it is one of the nBlocks looked back over
+    std::set<int>::const_iterator itHeight = it->second.upper_bound(nHeight);
+    if (itHeight == it->second.begin()) return 0;
+    --itHeight;
+    if (*itHeight <= 0 || *itHeight <= nHeight - nBlocks) return 0;
+
+    return *itHeight;
+}
+
+void CMasternodePayments::IndexPaidHeight(const CScript& payee, int nBlockHeight)
+{
+    mapPaidHeights[payee].insert(nBlockHeight);
+}
+
+void CMasternodePayments::UnindexPaidHeights(const CMasternodeBlockPayees& blockPayees)
+{
+    LOCK(cs_vecPayments);
+    BOOST_FOREACH (const CMasternodePayee& payee, blockPayees.vecPayments) {
+        boost::unordered_map<CScript, std::set<int>, SaltedScriptHasher>::iterator it = mapPaidHeights.find(payee.scriptPubKey);
+        if (it == mapPaidHeights.end()) continue;
+        it->second.erase(blockPayees.nBlockHeight);
+        if (it->second.empty())
+            mapPaidHeights.erase(it);
+    }
+}
+
+void CMasternodePayments::ReindexPaidHeights()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_vecPayments);
+
+    mapPaidHeights.clear();
+    for (std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin(); it != mapMasternodeBlocks.end(); ++it) {
+        BOOST_FOREACH (const CMasternodePayee& payee, it->second.vecPayments) {
+            if (payee.nVotes >= MNPAYMENTS_PAID_VOTES)
+                IndexPaidHeight(payee.scriptPubKey, it->first);
+        }
+    }
 }
 
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
@@ -498,15 +457,19 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
             return false;
         }
 
-        mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
+        mapMasternodePayeeVotes.Insert(winnerIn.GetHash(), winnerIn);
 
         if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
-    }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+        CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(winnerIn.payee, 1);
+        setDirtyBlocks.insert(winnerIn.nBlockHeight);
+        if (blockPayees.HasPayeeWithVotes(winnerIn.payee, MNPAYMENTS_PAID_VOTES))
+            IndexPaidHeight(winnerIn.payee, winnerIn.nBlockHeight);
+    }
 
     return true;
 }
@@ -630,7 +593,7 @@ void CMasternodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
+    seencache<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
         CMasternodePaymentWinner winner = (*it).second;
 
@@ -638,7 +601,12 @@ void CMasternodePayments::CleanPaymentList()
             LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            std::map<int, CMasternodeBlockPayees>::iterator itBlock = mapMasternodeBlocks.find(winner.nBlockHeight);
+            if (itBlock != mapMasternodeBlocks.end()) {
+                UnindexPaidHeights(itBlock->second);
+                setDirtyBlocks.insert(itBlock->first);
+                mapMasternodeBlocks.erase(itBlock);
+            }
         } else {
             ++it;
         }
@@ -647,7 +615,7 @@ void CMasternodePayments::CleanPaymentList()
 
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
 {
-    CMasternode* pmn = mnodeman.Find(vinMasternode);
+    CMasternodePtr pmn = mnodeman.Find(vinMasternode);
 
     if (!pmn) {
         strError = strprintf("Unknown Masternode %s", vinMasternode.prevout.hash.ToString());
@@ -707,9 +675,9 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
 
         // pay to the oldest MN that still had no payment but its input is old enough and it was active long enough
         int nCount = 0;
-        CMasternode* pmn = mnodeman.GetNextMasternodeInQueueForPayment(nBlockHeight, true, nCount);
+        CMasternodePtr pmn = mnodeman.GetNextMasternodeInQueueForPayment(nBlockHeight, true, nCount);
 
-        if (pmn != NULL) {
+        if (pmn) {
             LogPrint("masternode","CMasternodePayments::ProcessBlock() Found by FindOldestNotInVec \n");
 
             newWinner.nBlockHeight = nBlockHeight;
@@ -758,12 +726,10 @@ void CMasternodePaymentWinner::Relay()
 
 bool CMasternodePaymentWinner::SignatureValid()
 {
-    CMasternode* pmn = mnodeman.Find(vinMasternode);
+    CMasternodePtr pmn = mnodeman.Find(vinMasternode);
 
-    if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+    if (pmn) {
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!masternodeSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -791,7 +757,7 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
     int nInvCount = 0;
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
+    seencache<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
         CMasternodePaymentWinner winner = (*it).second;
         if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
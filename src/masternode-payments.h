@@ -7,11 +7,18 @@
 #define MASTERNODE_PAYMENTS_H
 
 #include "key.h"
+#include "keyeddb.h"
+#include "keystore.h"
 #include "main.h"
 #include "masternode.h"
+#include "masternodeman.h"
 #include "clientversion.h"
+#include "seencache.h"
+
+#include <set>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
 
 using namespace std;
 
@@ -27,6 +34,13 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// votes a payee needs on a block for the block to count as its last payment
+#define MNPAYMENTS_PAID_VOTES 2
+
+// bounds of the seen payment vote cache, votes are kept for the last
+// max(1000, 1.25 * masternode count) blocks by CleanPaymentList
+#define MNPAYMENTS_SEEN_VOTES_MAX 100000
+#define MNPAYMENTS_SEEN_VOTES_SECONDS (7 * 24 * 60 * 60)
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -36,30 +50,20 @@ void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStak
 
 void DumpMasternodePayments();
 
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Keyed store of the payment votes and the payees voted for each block (mnpayments/)
  */
-class CMasternodePaymentDB
+class CMasternodePaymentDB : public CKeyedDB
 {
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CMasternodePaymentDB();
-    bool Write(const CMasternodePayments& objToSave);
-    ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
+    CMasternodePaymentDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Write what changed since the last call */
+    bool Write(CMasternodePayments& objToSave);
+    bool Read(CMasternodePayments& objToLoad);
 };
 
+extern CMasternodePaymentDB* pMasternodePaymentDB;
+
 class CMasternodePayee
 {
 public:
@@ -197,6 +201,8 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    /// The message covered by vchSig
+    std::string GetStrMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn)
@@ -237,25 +243,47 @@ class CMasternodePayments
 private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
+    // heights of the blocks each payee has MNPAYMENTS_PAID_VOTES on, guarded by cs_mapMasternodeBlocks
+    boost::unordered_map<CScript, std::set<int>, SaltedScriptHasher> mapPaidHeights;
+
+    void IndexPaidHeight(const CScript& payee, int nBlockHeight);
+    void UnindexPaidHeights(const CMasternodeBlockPayees& blockPayees);
 
 public:
-    std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
+    seencache<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
+    // heights of the mapMasternodeBlocks entries changed since the payment cache was last flushed
+    std::set<int> setDirtyBlocks;
     std::map<uint256, int> mapMasternodesLastVote; //prevout.hash + prevout.n, nBlockHeight
 
-    CMasternodePayments()
+    CMasternodePayments() : mapMasternodePayeeVotes(MNPAYMENTS_SEEN_VOTES_MAX, MNPAYMENTS_SEEN_VOTES_SECONDS)
     {
         nSyncedFromPeer = 0;
         nLastBlockHeight = 0;
+        mapMasternodePayeeVotes.track_changes();
     }
 
     void Clear()
     {
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        for (std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin(); it != mapMasternodeBlocks.end(); ++it)
+            setDirtyBlocks.insert(it->first);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPaidHeights.clear();
+    }
+
+    /// Forget what changed, for entries that match the cache on disk
+    void ClearDirty()
+    {
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+        setDirtyBlocks.clear();
+        mapMasternodePayeeVotes.changed_keys().clear();
     }
 
+    /// Rebuild the last paid index after mapMasternodeBlocks was filled in directly
+    void ReindexPaidHeights();
+
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     bool ProcessBlock(int nBlockHeight);
 
@@ -266,6 +294,10 @@ public:
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
+    /// Payees in the lead for the blocks from the tip up to 8 ahead, but nNotBlockHeight
+    ScriptPubKeySet GetScheduledPayees(int nNotBlockHeight);
+    /// Height of the last of the nBlocks blocks up to nHeight that paid payee, or 0
+    int GetLastPaidHeight(const CScript& payee, int nHeight, int nBlocks);
 
     bool CanVote(COutPoint outMasternode, int nBlockHeight)
     {
@@ -195,6 +195,9 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeList += nCount;
             countMasternodeList++;
+            // a list digest reply only carries what we were missing, the rest of the count is already in our list
+            if (pfrom->nVersion >= MNLISTDIFF_VERSION && nCount > 0)
+                lastMasternodeList = GetTime();
             break;
         case (MASTERNODE_SYNC_MNW):
             if (nItemID != RequestedMasternodeAssets) return;
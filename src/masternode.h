@@ -14,6 +14,8 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <boost/shared_ptr.hpp>
+
 #define MASTERNODE_MIN_CONFIRMATIONS 15
 #define MASTERNODE_MIN_MNP_SECONDS (10 * 60)
 #define MASTERNODE_MIN_MNB_SECONDS (5 * 60)
@@ -63,6 +65,8 @@ public:
 
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
+    /// The message covered by vchSig
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -112,6 +116,8 @@ private:
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
 
+    void SetActiveState(int nState);
+
 public:
     enum state {
         MASTERNODE_PRE_ENABLED,
@@ -147,6 +153,7 @@ public:
 
     int64_t nLastDsee;  // temporary, do not save. Remove after migration to v12
     int64_t nLastDseep; // temporary, do not save. Remove after migration to v12
+    bool fDirty;        // changed since the masternode cache was last flushed, do not save
 
     CMasternode();
     CMasternode(const CMasternode& other);
@@ -181,6 +188,7 @@ public:
     CMasternode& operator=(CMasternode from)
     {
         swap(*this, from);
+        fDirty = true;
         return *this;
     }
     friend bool operator==(const CMasternode& a, const CMasternode& b)
@@ -220,6 +228,7 @@ public:
     }
 
     int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nCountEnabled);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -283,9 +292,14 @@ public:
     }
 
     int64_t GetLastPaid();
+    /// Time of the last payment over the last 1.25 * nCountEnabled blocks, or 0
+    int64_t GetLastPaid(int nCountEnabled);
     bool IsValidNetAddr();
 };
 
+/** Handle to a listed masternode, which keeps the entry alive after CMasternodeMan drops it */
+typedef boost::shared_ptr<CMasternode> CMasternodePtr;
+
 
 //
 // The Masternode Broadcast Class : Contains a different serialize method for sending masternodes through the network
@@ -299,6 +313,8 @@ public:
     CMasternodeBroadcast(const CMasternode& mn);
 
     bool CheckAndUpdate(int& nDoS);
+    /// The message covered by sig
+    std::string GetStrMessage() const;
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
     void Relay();
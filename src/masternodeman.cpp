@@ -10,7 +10,9 @@
 #include "addrman.h"
 #include "masternode.h"
 #include "spork.h"
+#include "swifttx.h"
 #include "util.h"
+#include "utilmoneystr.h"
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -45,155 +47,184 @@ struct CompareScoreMN {
 // CMasternodeDB
 //
 
-CMasternodeDB::CMasternodeDB()
-{
-    pathMN = GetDataDir() / "mncache.dat";
-    strMagicMessage = "MasternodeCache";
-}
+CMasternodeDB* pMasternodeDB = NULL;
 
-bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
+CMasternodeDB::CMasternodeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CKeyedDB(GetDataDir() / "mncache", nCacheSize, fMemory, fWipe) {}
+
+bool CMasternodeDB::Write(CMasternodeMan& mnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    LOCK(cs);
+    {
+        LOCK(mnodemanToSave.cs);
+        BOOST_FOREACH (const CMasternodePtr& pmn, mnodemanToSave.listMasternodes) {
+            if (pmn->fDirty || RewriteAll()) {
+                Stage('m', pmn->vin.prevout, *pmn);
+                pmn->fDirty = false;
+            }
+        }
+        BOOST_FOREACH (const COutPoint& outpoint, mnodemanToSave.setRemovedMasternodes) {
+            if (!mnodemanToSave.mapMasternodesByOutpoint.count(outpoint))
+                StageErase('m', outpoint);
+        }
+        mnodemanToSave.setRemovedMasternodes.clear();
+        StageChanges('a', mnodemanToSave.mAskedUsForMasternodeList, mnodemanToSave.setDirtyAskedUs);
+        StageChanges('w', mnodemanToSave.mWeAskedForMasternodeList, mnodemanToSave.setDirtyWeAsked);
+        StageChanges('e', mnodemanToSave.mWeAskedForMasternodeListEntry, mnodemanToSave.setDirtyWeAskedEntry);
+        StageChanges('b', mnodemanToSave.mapSeenMasternodeBroadcast, mnodemanToSave.mapSeenMasternodeBroadcast.changed_keys());
+        StageChanges('p', mnodemanToSave.mapSeenMasternodePing, mnodemanToSave.mapSeenMasternodePing.changed_keys());
     }
-    //    FileCommit(fileout);
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
+    unsigned int nWritten, nErased;
+    if (!Commit(nWritten, nErased))
+        return false;
 
+    LogPrintf("Flushed masternode cache: %u records written, %u erased  %dms\n", nWritten, nErased, GetTimeMillis() - nStart);
     return true;
 }
 
-CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
+bool CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathMN.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathMN);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
+    unsigned int nBad = 0;
     try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
+        LOCK2(cs, mnodemanToLoad.cs);
+        mnodemanToLoad.Clear();
+        std::map<COutPoint, CMasternode> mapMasternodes;
+        nBad += Load('m', mapMasternodes);
+        std::vector<CMasternode> vMasternodes;
+        for (std::map<COutPoint, CMasternode>::iterator it = mapMasternodes.begin(); it != mapMasternodes.end(); ++it)
+            vMasternodes.push_back(it->second);
+        mnodemanToLoad.SetMasternodes(vMasternodes);
+        nBad += Load('a', mnodemanToLoad.mAskedUsForMasternodeList);
+        nBad += Load('w', mnodemanToLoad.mWeAskedForMasternodeList);
+        nBad += Load('e', mnodemanToLoad.mWeAskedForMasternodeListEntry);
+        nBad += Load('b', mnodemanToLoad.mapSeenMasternodeBroadcast);
+        nBad += Load('p', mnodemanToLoad.mapSeenMasternodePing);
+        mnodemanToLoad.ClearDirty();
+    } catch (const std::exception& e) {
+        mnodemanToLoad.Clear();
+        return error("%s : %s", __func__, e.what());
     }
-    filein.fclose();
 
-    CDataStream ssMasternodes(vchData, SER_DISK, CLIENT_VERSION);
+    LogPrintf("Loaded masternode cache: %s, %u bad records dropped  %dms\n", mnodemanToLoad.ToString(), nBad, GetTimeMillis() - nStart);
+    LogPrint("masternode","Masternode manager - cleaning....\n");
+    mnodemanToLoad.CheckAndRemove(true);
+    LogPrint("masternode","Masternode manager - result:\n");
+    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
 
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
+    return true;
+}
 
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
+void DumpMasternodes()
+{
+    // nothing to flush into if init stopped short of opening the store
+    if (pMasternodeDB)
+        pMasternodeDB->Write(mnodeman);
+}
 
-        ssMasternodes >> strMagicMessageTmp;
+CMasternodeMan::CMasternodeMan() : nListVersion(0),
+                                   mapSeenMasternodeBroadcast(MASTERNODES_SEEN_MNB_MAX, MASTERNODES_SEEN_SECONDS),
+                                   mapSeenMasternodePing(MASTERNODES_SEEN_MNP_MAX, MASTERNODES_SEEN_SECONDS)
+{
+    mapSeenMasternodeBroadcast.track_changes();
+    mapSeenMasternodePing.track_changes();
+}
 
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
+void CMasternodeMan::AddToIndexes(const CMasternodePtr& pmn)
+{
+    mapMasternodesByOutpoint[pmn->vin.prevout] = pmn;
+    mapMasternodesByPayee.insert(make_pair(GetScriptForDestination(pmn->pubKeyCollateralAddress.GetID()), pmn));
+    mapMasternodesByPubKey.insert(make_pair(pmn->pubKeyMasternode, pmn));
+}
 
-        // de-serialize file header (network specific magic number) and ..
-        ssMasternodes >> FLATDATA(pchMsgTmp);
+void CMasternodeMan::RemoveFromIndexes(const CMasternodePtr& pmn)
+{
+    mapMasternodesByOutpoint.erase(pmn->vin.prevout);
+
+    CScript payee = GetScriptForDestination(pmn->pubKeyCollateralAddress.GetID());
+    typedef boost::unordered_multimap<CScript, CMasternodePtr, SaltedScriptHasher>::iterator payee_iterator;
+    std::pair<payee_iterator, payee_iterator> rangePayee = mapMasternodesByPayee.equal_range(payee);
+    for (payee_iterator it = rangePayee.first; it != rangePayee.second; ++it) {
+        if (it->second == pmn) {
+            mapMasternodesByPayee.erase(it);
+            break;
+        }
+    }
 
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
+    typedef boost::unordered_multimap<CPubKey, CMasternodePtr, SaltedPubKeyHasher>::iterator pubkey_iterator;
+    std::pair<pubkey_iterator, pubkey_iterator> rangePubKey = mapMasternodesByPubKey.equal_range(pmn->pubKeyMasternode);
+    for (pubkey_iterator it = rangePubKey.first; it != rangePubKey.second; ++it) {
+        if (it->second == pmn) {
+            mapMasternodesByPubKey.erase(it);
+            break;
         }
-        // de-serialize data into CMasternodeMan object
-        ssMasternodes >> mnodemanToLoad;
-    } catch (std::exception& e) {
-        mnodemanToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
     }
+}
 
-    LogPrint("masternode","Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint("masternode","Masternode manager - result:\n");
-        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+void CMasternodeMan::RebuildIndexes()
+{
+    mapMasternodesByOutpoint.clear();
+    mapMasternodesByPayee.clear();
+    mapMasternodesByPubKey.clear();
+
+    LOCK(cs_collaterals);
+    mapCollaterals.clear();
+
+    std::list<CMasternodePtr>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
+        // drop duplicate outpoints, Add never lets them in
+        if (mapMasternodesByOutpoint.count((*it)->vin.prevout)) {
+            it = Erase(it);
+            continue;
+        }
+        AddToIndexes(*it);
+        mapCollaterals[(*it)->vin.prevout] = false;
+        ++it;
     }
+}
 
-    return Ok;
+void CMasternodeMan::ListChanged()
+{
+    nListVersion++;
+    txLockManager.ClearQuorums();
 }
 
-void DumpMasternodes()
+void CMasternodeMan::ClearDirty()
 {
-    int64_t nStart = GetTimeMillis();
+    BOOST_FOREACH (const CMasternodePtr& pmn, listMasternodes)
+        pmn->fDirty = false;
+    setRemovedMasternodes.clear();
+    setDirtyAskedUs.clear();
+    setDirtyWeAsked.clear();
+    setDirtyWeAskedEntry.clear();
+    mapSeenMasternodeBroadcast.changed_keys().clear();
+    mapSeenMasternodePing.changed_keys().clear();
+}
 
-    CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint("masternode","Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint("masternode","Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint("masternode","Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
+std::list<CMasternodePtr>::iterator CMasternodeMan::Erase(std::list<CMasternodePtr>::iterator it)
+{
+    const CMasternodePtr& pmn = *it;
+    setRemovedMasternodes.insert(pmn->vin.prevout);
+    if (mapMasternodesByOutpoint.count(pmn->vin.prevout) && mapMasternodesByOutpoint[pmn->vin.prevout] == pmn) {
+        RemoveFromIndexes(pmn);
+        LOCK(cs_collaterals);
+        mapCollaterals.erase(pmn->vin.prevout);
     }
-    LogPrint("masternode","Writting info to mncache.dat...\n");
-    mndb.Write(mnodeman);
-
-    LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
+    ListChanged();
+    return listMasternodes.erase(it);
 }
 
-CMasternodeMan::CMasternodeMan()
+void CMasternodeMan::SetMasternodes(const std::vector<CMasternode>& vMasternodes)
 {
+    LOCK(cs);
+    BOOST_FOREACH (const CMasternodePtr& pmn, listMasternodes)
+        setRemovedMasternodes.insert(pmn->vin.prevout);
+    listMasternodes.clear();
+    BOOST_FOREACH (const CMasternode& mn, vMasternodes)
+        listMasternodes.push_back(CMasternodePtr(new CMasternode(mn)));
+    RebuildIndexes();
+    ListChanged();
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -203,16 +234,143 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (!mn.IsEnabled())
         return false;
 
-    CMasternode* pmn = Find(mn.vin);
+    CMasternodePtr pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vMasternodes.push_back(mn);
+        listMasternodes.push_back(CMasternodePtr(new CMasternode(mn)));
+        AddToIndexes(listMasternodes.back());
+        ListChanged();
+        LOCK(cs_collaterals);
+        mapCollaterals.insert(std::make_pair(mn.vin.prevout, false));
         return true;
     }
 
     return false;
 }
 
+bool CMasternodeMan::CheckCollateral(const CTxIn& vin, int& nDoS)
+{
+    AssertLockHeld(cs_main);
+    nDoS = 0;
+
+    // a lock is a spend on its way
+    if (mapLockedInputs.count(vin.prevout))
+        return false;
+
+    CCoins coins;
+    {
+        LOCK(mempool.cs);
+        if (mempool.mapNextTx.count(vin.prevout))
+            return false;
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        if (!viewMemPool.GetCoins(vin.prevout.hash, coins) || !coins.IsAvailable(vin.prevout.n))
+            return false;
+    }
+
+    // enough to pay MASTERNODE_COLLATERAL less a 0.01 fee
+    if (coins.vout[vin.prevout.n].nValue < (MASTERNODE_COLLATERAL - 0.01) * COIN) {
+        LogPrint("masternode", "CMasternodeMan::CheckCollateral - Collateral amount too low %s for %s\n",
+            FormatMoney(coins.vout[vin.prevout.n].nValue), vin.prevout.ToString());
+        nDoS = 100;
+        return false;
+    }
+
+    if ((coins.IsCoinBase() || coins.IsCoinStake()) && chainActive.Height() + 1 - coins.nHeight < Params().COINBASE_MATURITY())
+        return false;
+
+    // spends are notified under cs_main, so none can slip in before the entry is added
+    LOCK(cs_collaterals);
+    mapCollaterals.insert(std::make_pair(vin.prevout, false));
+    return true;
+}
+
+bool CMasternodeMan::IsCollateralSpent(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    boost::unordered_map<COutPoint, bool, SaltedOutPointHasher>::const_iterator it = mapCollaterals.find(outpoint);
+    return it != mapCollaterals.end() && it->second;
+}
+
+void CMasternodeMan::CheckCollaterals()
+{
+    std::vector<CTxIn> vCollaterals;
+    {
+        LOCK(cs);
+        BOOST_FOREACH (const CMasternodePtr& pmn, listMasternodes)
+            vCollaterals.push_back(pmn->vin);
+    }
+
+    // spends from before a restart never came through SyncTransaction
+    int nSpent = 0;
+    LOCK(cs_main);
+    BOOST_FOREACH (const CTxIn& vin, vCollaterals) {
+        int nDoS;
+        if (!CheckCollateral(vin, nDoS)) {
+            LOCK(cs_collaterals);
+            mapCollaterals[vin.prevout] = true;
+            nSpent++;
+        }
+    }
+    LogPrint("masternode", "CMasternodeMan::CheckCollaterals - %d of %d collaterals spent\n", nSpent, vCollaterals.size());
+}
+
+void CMasternodeMan::RecheckSpentCollaterals()
+{
+    std::vector<COutPoint> vSpent;
+    {
+        LOCK(cs_collaterals);
+        for (boost::unordered_map<COutPoint, bool, SaltedOutPointHasher>::const_iterator it = mapCollaterals.begin(); it != mapCollaterals.end(); ++it) {
+            if (it->second)
+                vSpent.push_back(it->first);
+        }
+    }
+    if (vSpent.empty())
+        return;
+
+    // SyncTransaction can't tell a spend from a disconnected or conflicted one, so
+    // look the coins up again. Spends are notified under cs_main, which is held
+    // from the lookup until the flag is cleared.
+    std::vector<COutPoint> vUnspent;
+    {
+        LOCK(cs_main);
+        BOOST_FOREACH (const COutPoint& outpoint, vSpent) {
+            int nDoS;
+            if (!CheckCollateral(CTxIn(outpoint), nDoS))
+                continue;
+            LOCK(cs_collaterals);
+            LogPrint("masternode", "CMasternodeMan::RecheckSpentCollaterals - Collateral %s is unspent again\n", outpoint.ToString());
+            mapCollaterals[outpoint] = false;
+            vUnspent.push_back(outpoint);
+        }
+    }
+
+    // entries already marked VIN_SPENT get their state back
+    LOCK(cs);
+    BOOST_FOREACH (const COutPoint& outpoint, vUnspent) {
+        CMasternodePtr pmn = Find(CTxIn(outpoint));
+        if (pmn)
+            pmn->Check(true);
+    }
+}
+
+void CMasternodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    if (tx.IsCoinBase())
+        return;
+
+    LOCK(cs_collaterals);
+    if (mapCollaterals.empty())
+        return;
+
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        boost::unordered_map<COutPoint, bool, SaltedOutPointHasher>::iterator it = mapCollaterals.find(txin.prevout);
+        if (it != mapCollaterals.end() && !it->second) {
+            LogPrint("masternode", "CMasternodeMan::SyncTransaction - Collateral %s spent by %s\n", txin.prevout.ToString(), tx.GetHash().ToString());
+            it->second = true;
+        }
+    }
+}
+
 void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 {
     std::map<COutPoint, int64_t>::iterator i = mWeAskedForMasternodeListEntry.find(vin.prevout);
@@ -227,40 +385,66 @@ void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
     pnode->PushMessage("dseg", vin);
     int64_t askAgain = GetTime() + MASTERNODE_MIN_MNP_SECONDS;
     mWeAskedForMasternodeListEntry[vin.prevout] = askAgain;
+    setDirtyWeAskedEntry.insert(vin.prevout);
 }
 
 void CMasternodeMan::Check()
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        pmn->Check();
     }
 }
 
+std::vector<CMasternode> CMasternodeMan::GetFullMasternodeVector()
+{
+    Check();
+    LOCK(cs);
+    std::vector<CMasternode> vMasternodes;
+    vMasternodes.reserve(listMasternodes.size());
+    BOOST_FOREACH (const CMasternodePtr& pmn, listMasternodes)
+        vMasternodes.push_back(*pmn);
+    return vMasternodes;
+}
+
 void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 {
+    // don't remove anyone over a spend that a reorg or a double spend undid
+    RecheckSpentCollaterals();
     Check();
 
     LOCK(cs);
 
+    // drop collaterals that were checked but never made it into the list
+    {
+        LOCK(cs_collaterals);
+        boost::unordered_map<COutPoint, bool, SaltedOutPointHasher>::iterator itCollateral = mapCollaterals.begin();
+        while (itCollateral != mapCollaterals.end()) {
+            if (!mapMasternodesByOutpoint.count(itCollateral->first))
+                itCollateral = mapCollaterals.erase(itCollateral);
+            else
+                ++itCollateral;
+        }
+    }
+
     //remove inactive and outdated
-    vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
-            (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
-            (forceExpiredRemoval && (*it).activeState == CMasternode::MASTERNODE_EXPIRED) ||
-            (*it).protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
-            LogPrint("masternode", "CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+    std::list<CMasternodePtr>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
+        if ((*it)->activeState == CMasternode::MASTERNODE_REMOVE ||
+            (*it)->activeState == CMasternode::MASTERNODE_VIN_SPENT ||
+            (forceExpiredRemoval && (*it)->activeState == CMasternode::MASTERNODE_EXPIRED) ||
+            (*it)->protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
+            LogPrint("masternode", "CMasternodeMan: Removing inactive Masternode %s - %i now\n", (*it)->vin.prevout.hash.ToString(), size() - 1);
 
             //erase all of the broadcasts we've seen from this vin
             // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
             //    sending a brand new mnb
-            map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
+            seencache<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
             while (it3 != mapSeenMasternodeBroadcast.end()) {
-                if ((*it3).second.vin == (*it).vin) {
+                if ((*it3).second.vin == (*it)->vin) {
                     masternodeSync.mapSeenSyncMNB.erase((*it3).first);
-                    mapSeenMasternodeBroadcast.erase(it3++);
+                    it3 = mapSeenMasternodeBroadcast.erase(it3);
                 } else {
                     ++it3;
                 }
@@ -269,14 +453,15 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             // allow us to ask for this masternode again if we see another ping
             map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
             while (it2 != mWeAskedForMasternodeListEntry.end()) {
-                if ((*it2).first == (*it).vin.prevout) {
+                if ((*it2).first == (*it)->vin.prevout) {
+                    setDirtyWeAskedEntry.insert((*it2).first);
                     mWeAskedForMasternodeListEntry.erase(it2++);
                 } else {
                     ++it2;
                 }
             }
 
-            it = vMasternodes.erase(it);
+            it = Erase(it);
         } else {
             ++it;
         }
@@ -286,6 +471,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
     while (it1 != mAskedUsForMasternodeList.end()) {
         if ((*it1).second < GetTime()) {
+            setDirtyAskedUs.insert((*it1).first);
             mAskedUsForMasternodeList.erase(it1++);
         } else {
             ++it1;
@@ -296,6 +482,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     it1 = mWeAskedForMasternodeList.begin();
     while (it1 != mWeAskedForMasternodeList.end()) {
         if ((*it1).second < GetTime()) {
+            setDirtyWeAsked.insert((*it1).first);
             mWeAskedForMasternodeList.erase(it1++);
         } else {
             ++it1;
@@ -306,6 +493,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
     while (it2 != mWeAskedForMasternodeListEntry.end()) {
         if ((*it2).second < GetTime()) {
+            setDirtyWeAskedEntry.insert((*it2).first);
             mWeAskedForMasternodeListEntry.erase(it2++);
         } else {
             ++it2;
@@ -313,21 +501,21 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     }
 
     // remove expired mapSeenMasternodeBroadcast
-    map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
+    seencache<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
     while (it3 != mapSeenMasternodeBroadcast.end()) {
         if ((*it3).second.lastPing.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMasternodeBroadcast.erase(it3++);
-            masternodeSync.mapSeenSyncMNB.erase((*it3).second.GetHash());
+            masternodeSync.mapSeenSyncMNB.erase((*it3).first);
+            it3 = mapSeenMasternodeBroadcast.erase(it3);
         } else {
             ++it3;
         }
     }
 
     // remove expired mapSeenMasternodePing
-    map<uint256, CMasternodePing>::iterator it4 = mapSeenMasternodePing.begin();
+    seencache<uint256, CMasternodePing>::iterator it4 = mapSeenMasternodePing.begin();
     while (it4 != mapSeenMasternodePing.end()) {
         if ((*it4).second.sigTime < GetTime() - (MASTERNODE_REMOVAL_SECONDS * 2)) {
-            mapSeenMasternodePing.erase(it4++);
+            it4 = mapSeenMasternodePing.erase(it4);
         } else {
             ++it4;
         }
@@ -337,12 +525,28 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
-    vMasternodes.clear();
+    BOOST_FOREACH (const CMasternodePtr& pmn, listMasternodes)
+        setRemovedMasternodes.insert(pmn->vin.prevout);
+    for (std::map<CNetAddr, int64_t>::iterator it = mAskedUsForMasternodeList.begin(); it != mAskedUsForMasternodeList.end(); ++it)
+        setDirtyAskedUs.insert(it->first);
+    for (std::map<CNetAddr, int64_t>::iterator it = mWeAskedForMasternodeList.begin(); it != mWeAskedForMasternodeList.end(); ++it)
+        setDirtyWeAsked.insert(it->first);
+    for (std::map<COutPoint, int64_t>::iterator it = mWeAskedForMasternodeListEntry.begin(); it != mWeAskedForMasternodeListEntry.end(); ++it)
+        setDirtyWeAskedEntry.insert(it->first);
+    listMasternodes.clear();
+    mapMasternodesByOutpoint.clear();
+    mapMasternodesByPayee.clear();
+    mapMasternodesByPubKey.clear();
+    {
+        LOCK(cs_collaterals);
+        mapCollaterals.clear();
+    }
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    ListChanged();
 }
 
 int CMasternodeMan::stable_size ()
@@ -352,7 +556,8 @@ int CMasternodeMan::stable_size ()
     int64_t nMasternode_Min_Age = GetSporkValue(SPORK_16_MN_WINNER_MINIMUM_AGE);
     int64_t nMasternode_Age = 0;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         if (mn.protocolVersion < nMinProtocol) {
             continue; // Skip obsolete versions
         }
@@ -372,12 +577,22 @@ int CMasternodeMan::stable_size ()
     return nStable_size;
 }
 
+void CMasternodeMan::GetSeenCacheUsage(size_t& nBroadcasts, size_t& nBroadcastBytes, size_t& nPings, size_t& nPingBytes) const
+{
+    LOCK(cs);
+    nBroadcasts = mapSeenMasternodeBroadcast.size();
+    nBroadcastBytes = mapSeenMasternodeBroadcast.memory_usage();
+    nPings = mapSeenMasternodePing.size();
+    nPingBytes = mapSeenMasternodePing.memory_usage();
+}
+
 int CMasternodeMan::CountEnabled(int protocolVersion)
 {
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
@@ -390,7 +605,8 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
 {
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         mn.Check();
         std::string strHost;
         int port;
@@ -427,55 +643,100 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    if (pnode->nVersion >= MNLISTDIFF_VERSION) {
+        // only ask for what our list, loaded from the mncache store on startup, is missing
+        std::vector<uint64_t> vShortIds;
+        uint256 hashList = GetListDigest(vShortIds);
+        pnode->PushMessage("mnlistdigest", hashList, vShortIds);
+    } else {
+        pnode->PushMessage("dseg", CTxIn());
+    }
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
+    setDirtyWeAsked.insert(pnode->addr);
 }
 
-CMasternode* CMasternodeMan::Find(const CScript& payee)
+uint256 CMasternodeMan::GetListDigest(std::vector<uint64_t>& vShortIds)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
+    vShortIds.clear();
+    vShortIds.reserve(listMasternodes.size());
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
+        // the same entries dseg hands out
+        if (mn.addr.IsRFC1918() || !mn.IsEnabled()) continue;
+        vShortIds.push_back(CMasternodeBroadcast(mn).GetHash().GetLow64());
     }
-    return NULL;
+    std::sort(vShortIds.begin(), vShortIds.end());
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << vShortIds;
+    return ss.GetHash();
 }
 
-CMasternode* CMasternodeMan::Find(const CTxIn& vin)
+bool CMasternodeMan::AllowListRequest(CNode* pfrom)
 {
-    LOCK(cs);
+    //local network
+    bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
+    if (isLocal || Params().NetworkID() != CBaseChainParams::MAIN)
+        return true;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
+    LOCK(cs);
+    std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
+    if (i != mAskedUsForMasternodeList.end()) {
+        int64_t t = (*i).second;
+        if (GetTime() < t) {
+            Misbehaving(pfrom->GetId(), 34);
+            LogPrint("masternode","dseg - peer already asked me for the list\n");
+            return false;
+        }
     }
-    return NULL;
+    int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
+    mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+    setDirtyAskedUs.insert(pfrom->addr);
+    return true;
+}
+
+CMasternodePtr CMasternodeMan::Find(const CScript& payee)
+{
+    LOCK(cs);
+
+    boost::unordered_multimap<CScript, CMasternodePtr, SaltedScriptHasher>::iterator it = mapMasternodesByPayee.find(payee);
+    if (it == mapMasternodesByPayee.end())
+        return NULL;
+    return it->second;
+}
+
+CMasternodePtr CMasternodeMan::Find(const CTxIn& vin)
+{
+    LOCK(cs);
+
+    boost::unordered_map<COutPoint, CMasternodePtr, SaltedOutPointHasher>::iterator it = mapMasternodesByOutpoint.find(vin.prevout);
+    if (it == mapMasternodesByOutpoint.end())
+        return NULL;
+    return it->second;
 }
 
 
-CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
+CMasternodePtr CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    boost::unordered_multimap<CPubKey, CMasternodePtr, SaltedPubKeyHasher>::iterator it = mapMasternodesByPubKey.find(pubKeyMasternode);
+    if (it == mapMasternodesByPubKey.end())
+        return NULL;
+    return it->second;
 }
 
 //
 // Deterministically select the oldest/best masternode to pay on the network
 //
-CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount)
+CMasternodePtr CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount)
 {
     LOCK(cs);
 
-    CMasternode* pBestMasternode = NULL;
+    CMasternodePtr pBestMasternode;
     std::vector<pair<int64_t, CTxIn> > vecMasternodeLastPaid;
 
     /*
@@ -483,15 +744,18 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     */
 
     int nMnCount = CountEnabled();
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    int nMinProtocol = masternodePayments.GetMinMasternodePaymentsProto();
+    ScriptPubKeySet setScheduled = masternodePayments.GetScheduledPayees(nBlockHeight);
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
         // //check protocol version
-        if (mn.protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) continue;
+        if (mn.protocolVersion < nMinProtocol) continue;
 
         //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        if (masternodePayments.IsScheduled(mn, nBlockHeight)) continue;
+        if (setScheduled.count(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()))) continue;
 
         //it's too new, wait for a cycle
         if (fFilterSigTime && mn.sigTime + (nMnCount * 2.6 * 60) > GetAdjustedTime()) continue;
@@ -499,7 +763,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -514,11 +778,11 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
     //  -- 1/100 payments should be a double payment on mainnet - (1/(7500/10))*2
     //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = CountEnabled() / 10;
+    int nTenthNetwork = nMnCount / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeLastPaid) {
-        CMasternode* pmn = Find(s.second);
+        CMasternodePtr pmn = Find(s.second);
         if (!pmn) break;
 
         uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
@@ -532,7 +796,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     return pBestMasternode;
 }
 
-CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude, int protocolVersion)
+CMasternodePtr CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude, int protocolVersion)
 {
     LOCK(cs);
 
@@ -546,7 +810,8 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     LogPrint("masternode", "CMasternodeMan::FindRandomNotInVec - rand %d\n", rand);
     bool found;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         found = false;
         BOOST_FOREACH (CTxIn& usedVin, vecToExclude) {
@@ -557,20 +822,21 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
         }
         if (found) continue;
         if (--rand < 1) {
-            return &mn;
+            return pmn;
         }
     }
 
     return NULL;
 }
 
-CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
+CMasternodePtr CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
     int64_t score = 0;
-    CMasternode* winner = NULL;
+    CMasternodePtr winner;
 
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         mn.Check();
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
@@ -581,25 +847,25 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
         // determine the winner
         if (n2 > score) {
             score = n2;
-            winner = &mn;
+            winner = pmn;
         }
     }
 
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+bool CMasternodeMan::GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = GetSporkValue(SPORK_16_MN_WINNER_MINIMUM_AGE);
     int64_t nMasternode_Age = 0;
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return false;
 
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
@@ -623,6 +889,13 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     }
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    return true;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(nBlockHeight, minProtocol, fOnlyActive, vecMasternodeScores)) return -1;
 
     int rank = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
@@ -635,6 +908,17 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+bool CMasternodeMan::GetTopRankedMasternodes(int64_t nBlockHeight, int minProtocol, unsigned int nCount, std::vector<CTxIn>& vecTop)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(nBlockHeight, minProtocol, true, vecMasternodeScores)) return false;
+
+    vecTop.clear();
+    for (unsigned int i = 0; i < vecMasternodeScores.size() && i < nCount; i++)
+        vecTop.push_back(vecMasternodeScores[i].second);
+    return true;
+}
+
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
@@ -645,7 +929,8 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
@@ -672,12 +957,13 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     return vecMasternodeRanks;
 }
 
-CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+CMasternodePtr CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
     std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
 
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+        CMasternode& mn = *pmn;
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
@@ -729,40 +1015,21 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
 
-        if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
-            masternodeSync.AddedMasternodeList(mnb.GetHash());
-            return;
-        }
-        mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
-
-        int nDoS = 0;
-        if (!mnb.CheckAndUpdate(nDoS)) {
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
+        ProcessBroadcast(pfrom, mnb);
+    }
 
-            //failed
-            return;
-        }
+    else if (strCommand == "mnlistdiff") { //Masternode broadcasts missing from our list digest
+        std::vector<CMasternodeBroadcast> vMnb;
+        vRecv >> vMnb;
 
-        // make sure the vout that was signed is related to the transaction that spawned the Masternode
-        //  - this is expensive, so it's only done once per Masternode
-        if (!masternodeSigner.IsVinAssociatedWithPubkey(mnb.vin, mnb.pubKeyCollateralAddress)) {
-            LogPrint("masternode","mnb - Got mismatched pubkey and vin\n");
-            Misbehaving(pfrom->GetId(), 33);
+        if (vMnb.size() > MASTERNODES_DIFF_BATCH_SIZE) {
+            Misbehaving(pfrom->GetId(), 20);
             return;
         }
 
-        // make sure it's still unspent
-        if (mnb.CheckInputsAndAdd(nDoS)) {
-            // use this as a peer
-            addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
-            masternodeSync.AddedMasternodeList(mnb.GetHash());
-        } else {
-            LogPrint("masternode","mnb - Rejected Masternode entry %s\n", mnb.vin.prevout.hash.ToString());
-
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
-        }
+        LogPrint("masternode", "mnlistdiff - Got %d Masternode entries from peer %i\n", vMnb.size(), pfrom->GetId());
+        BOOST_FOREACH (CMasternodeBroadcast& mnb, vMnb)
+            ProcessBroadcast(pfrom, mnb);
     }
 
     else if (strCommand == "mnp") { //Masternode Ping
@@ -782,7 +1049,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             Misbehaving(pfrom->GetId(), nDoS);
         } else {
             // if nothing significant failed, search existing Masternode list
-            CMasternode* pmn = Find(mnp.vin);
+            CMasternodePtr pmn = Find(mnp.vin);
             // if it's known, don't ask for the mnb, just return
             if (pmn != NULL) return;
         }
@@ -797,28 +1064,14 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vin;
 
         if (vin == CTxIn()) { //only should ask for this once
-            //local network
-            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
-
-            if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
-                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
-                if (i != mAskedUsForMasternodeList.end()) {
-                    int64_t t = (*i).second;
-                    if (GetTime() < t) {
-                        Misbehaving(pfrom->GetId(), 34);
-                        LogPrint("masternode","dseg - peer already asked me for the list\n");
-                        return;
-                    }
-                }
-                int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
-                mAskedUsForMasternodeList[pfrom->addr] = askAgain;
-            }
+            if (!AllowListRequest(pfrom)) return;
         } //else, asking for a specific node which is ok
 
 
         int nInvCount = 0;
 
-        BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+            CMasternode& mn = *pmn;
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled()) {
@@ -843,6 +1096,91 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, nInvCount);
             LogPrint("masternode", "dseg - Sent %d Masternode entries to peer %i\n", nInvCount, pfrom->GetId());
         }
+
+    } else if (strCommand == "mnlistdigest") { //Get the Masternode entries missing from a peer's list
+
+        // rate limited before the digest is read or sorted
+        if (!AllowListRequest(pfrom)) return;
+
+        uint256 hashList;
+        std::vector<uint64_t> vShortIds;
+        vRecv >> hashList >> vShortIds;
+
+        // a digest far longer than our list is not sorted, the peer gets the whole
+        // list instead; not punished, as our own list may still be syncing
+        if (vShortIds.size() > (unsigned int)(MASTERNODES_DIGEST_SLACK * (size() + 1))) {
+            LogPrint("masternode", "mnlistdigest - Ignoring %d ids from peer %i\n", vShortIds.size(), pfrom->GetId());
+            vShortIds.clear();
+        }
+
+        std::vector<uint64_t> vOurShortIds;
+        int nInvCount = 0;
+        if (GetListDigest(vOurShortIds) != hashList) {
+            std::sort(vShortIds.begin(), vShortIds.end());
+            std::vector<CMasternodeBroadcast> vMnb;
+
+            LOCK(cs);
+            BOOST_FOREACH (CMasternodePtr& pmn, listMasternodes) {
+                CMasternode& mn = *pmn;
+                if (mn.addr.IsRFC1918() || !mn.IsEnabled()) continue;
+
+                CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
+                uint256 hash = mnb.GetHash();
+                if (std::binary_search(vShortIds.begin(), vShortIds.end(), hash.GetLow64())) continue;
+
+                if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
+                vMnb.push_back(mnb);
+                nInvCount++;
+                if (vMnb.size() == MASTERNODES_DIFF_BATCH_SIZE) {
+                    pfrom->PushMessage("mnlistdiff", vMnb);
+                    vMnb.clear();
+                }
+            }
+            if (!vMnb.empty())
+                pfrom->PushMessage("mnlistdiff", vMnb);
+        }
+
+        // the count covers the whole list, the peer holds whatever we didn't send
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, (int)vOurShortIds.size());
+        LogPrint("masternode", "mnlistdigest - Sent %d of %d Masternode entries to peer %i\n", nInvCount, vOurShortIds.size(), pfrom->GetId());
+    }
+}
+
+void CMasternodeMan::ProcessBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
+{
+    if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
+        masternodeSync.AddedMasternodeList(mnb.GetHash());
+        return;
+    }
+    mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+
+    int nDoS = 0;
+    if (!mnb.CheckAndUpdate(nDoS)) {
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+
+        //failed
+        return;
+    }
+
+    // make sure the vout that was signed is related to the transaction that spawned the Masternode
+    //  - this is expensive, so it's only done once per Masternode
+    if (!masternodeSigner.IsVinAssociatedWithPubkey(mnb.vin, mnb.pubKeyCollateralAddress)) {
+        LogPrint("masternode","mnb - Got mismatched pubkey and vin\n");
+        Misbehaving(pfrom->GetId(), 33);
+        return;
+    }
+
+    // make sure it's still unspent
+    if (mnb.CheckInputsAndAdd(nDoS)) {
+        // use this as a peer
+        addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
+        masternodeSync.AddedMasternodeList(mnb.GetHash());
+    } else {
+        LogPrint("masternode","mnb - Rejected Masternode entry %s\n", mnb.vin.prevout.hash.ToString());
+
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
     }
 }
 
@@ -850,17 +1188,33 @@ void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMasternodes.erase(it);
+    std::list<CMasternodePtr>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
+        if ((*it)->vin == vin) {
+            LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it)->vin.prevout.hash.ToString(), size() - 1);
+            Erase(it);
             break;
         }
         ++it;
     }
 }
 
+bool CMasternodeMan::UpdateFromNewBroadcast(const CMasternodePtr& pmn, CMasternodeBroadcast& mnb)
+{
+    LOCK(cs);
+
+    // the broadcast may carry new keys, re-key the entry around the update
+    bool fIndexed = mapMasternodesByOutpoint.count(pmn->vin.prevout) && mapMasternodesByOutpoint[pmn->vin.prevout] == pmn;
+    if (fIndexed)
+        RemoveFromIndexes(pmn);
+    bool fUpdated = pmn->UpdateFromNewBroadcast(mnb);
+    if (fIndexed)
+        AddToIndexes(pmn);
+    if (fUpdated)
+        ListChanged();
+    return fUpdated;
+}
+
 void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
 {
     LOCK(cs);
@@ -869,13 +1223,13 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
 
     LogPrint("masternode","CMasternodeMan::UpdateMasternodeList -- masternode=%s\n", mnb.vin.prevout.ToStringShort());
 
-    CMasternode* pmn = Find(mnb.vin);
+    CMasternodePtr pmn = Find(mnb.vin);
     if (pmn == NULL) {
         CMasternode mn(mnb);
         if (Add(mn)) {
             masternodeSync.AddedMasternodeList(mnb.GetHash());
         }
-    } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+    } else if (UpdateFromNewBroadcast(pmn, mnb)) {
         masternodeSync.AddedMasternodeList(mnb.GetHash());
     }
 }
@@ -884,7 +1238,7 @@ std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Masternodes: " << (int)vMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
+    info << "Masternodes: " << (int)listMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
 
     return info.str();
 }
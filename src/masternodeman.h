@@ -8,48 +8,98 @@
 
 #include "base58.h"
 #include "key.h"
+#include "keyeddb.h"
+#include "keystore.h"
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
+#include "seencache.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <list>
+#include <set>
+
+#include <boost/unordered_map.hpp>
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
+// bounds of the seen broadcast and ping caches
+#define MASTERNODES_SEEN_MNB_MAX 20000
+#define MASTERNODES_SEEN_MNP_MAX 100000
+#define MASTERNODES_SEEN_SECONDS (MASTERNODE_REMOVAL_SECONDS * 2)
+
+// broadcasts per "mnlistdiff" message
+#define MASTERNODES_DIFF_BATCH_SIZE 100
+// a peer's "mnlistdigest" holds at most this many ids per entry of our list
+#define MASTERNODES_DIGEST_SLACK 4
+
 using namespace std;
 
 class CMasternodeMan;
 
+/** Hasher for outpoints picked by peers, salted like SaltedHashHasher so they can't aim for one bucket */
+class SaltedOutPointHasher
+{
+private:
+    uint256 salt;
+
+public:
+    SaltedOutPointHasher() : salt(GetRandHash()) {}
+    size_t operator()(const COutPoint& outpoint) const
+    {
+        uint256 hash = outpoint.hash;
+        hash ^= outpoint.n;
+        return hash.GetHash(salt);
+    }
+};
+
+/** Hasher for scripts picked by peers or miners, salted the same way over their 256-bit hash */
+class SaltedScriptHasher
+{
+private:
+    uint256 salt;
+
+public:
+    SaltedScriptHasher() : salt(GetRandHash()) {}
+    size_t operator()(const CScript& script) const { return Hash(script.begin(), script.end()).GetHash(salt); }
+};
+
+/** Hasher for pubkeys picked by peers, salted the same way over their 256-bit hash */
+class SaltedPubKeyHasher
+{
+private:
+    uint256 salt;
+
+public:
+    SaltedPubKeyHasher() : salt(GetRandHash()) {}
+    size_t operator()(const CPubKey& pubkey) const { return pubkey.GetHash().GetHash(salt); }
+};
+
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
 
-/** Access to the MN database (mncache.dat)
+/** Keyed store of the MN list, the seen broadcasts and pings and the list sync state (mncache/)
  */
-class CMasternodeDB
+class CMasternodeDB : public CKeyedDB
 {
-private:
-    boost::filesystem::path pathMN;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CMasternodeDB();
-    bool Write(const CMasternodeMan& mnodemanToSave);
-    ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
+    CMasternodeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Write what changed since the last call */
+    bool Write(CMasternodeMan& mnodemanToSave);
+    bool Read(CMasternodeMan& mnodemanToLoad);
 };
 
-class CMasternodeMan
+extern CMasternodeDB* pMasternodeDB;
+
+class CMasternodeMan : public CValidationInterface
 {
+    friend class CMasternodeDB;
+
 private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -57,20 +107,59 @@ private:
     // critical section to protect the inner data structures specifically on messaging
     mutable CCriticalSection cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CMasternode> vMasternodes;
+    // list to hold all MNs; handles given out by Find share ownership, so a removed entry
+    // lives on until the last caller holding it lets go
+    std::list<CMasternodePtr> listMasternodes;
+    // indexes into listMasternodes
+    boost::unordered_map<COutPoint, CMasternodePtr, SaltedOutPointHasher> mapMasternodesByOutpoint;
+    boost::unordered_multimap<CScript, CMasternodePtr, SaltedScriptHasher> mapMasternodesByPayee;
+    boost::unordered_multimap<CPubKey, CMasternodePtr, SaltedPubKeyHasher> mapMasternodesByPubKey;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // keys changed since the cache was last flushed, the MNs themselves carry fDirty
+    std::set<COutPoint> setRemovedMasternodes;
+    std::set<CNetAddr> setDirtyAskedUs;
+    std::set<CNetAddr> setDirtyWeAsked;
+    std::set<COutPoint> setDirtyWeAskedEntry;
+
+    // critical section to protect mapCollaterals, taken by validation notifications under cs_main
+    mutable CCriticalSection cs_collaterals;
+    // collateral of every listed MN and whether a transaction in the mempool or the chain spent it,
+    // until RecheckSpentCollaterals finds it unspent again. Never held while taking cs_main or mempool.cs
+    boost::unordered_map<COutPoint, bool, SaltedOutPointHasher> mapCollaterals;
+
+    // bumped by ListChanged, so whoever caches what was derived from the list can tell it is stale
+    std::atomic<unsigned int> nListVersion;
+
+    void AddToIndexes(const CMasternodePtr& pmn);
+    void RemoveFromIndexes(const CMasternodePtr& pmn);
+    void RebuildIndexes();
+    /// Forget what changed, for entries that match the cache on disk
+    void ClearDirty();
+    /// Take an entry out of listMasternodes and the indexes
+    std::list<CMasternodePtr>::iterator Erase(std::list<CMasternodePtr>::iterator it);
+    /// Fill listMasternodes with copies of vMasternodes and index them
+    void SetMasternodes(const std::vector<CMasternode>& vMasternodes);
+    /// Let a peer have the full list once per MASTERNODES_DSEG_SECONDS
+    bool AllowListRequest(CNode* pfrom);
+    /// Score the masternodes for nBlockHeight, best first, returns false if the block is unknown
+    bool GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores);
+    /// Check a broadcast from a peer and add or update its entry
+    void ProcessBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb);
+
+protected:
+    /// Flag the collaterals spent by a transaction entering the mempool or a connected block
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
 
 public:
     // Keep track of all broadcasts I've seen
-    map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
+    seencache<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
     // Keep track of all pings I've seen
-    map<uint256, CMasternodePing> mapSeenMasternodePing;
+    seencache<uint256, CMasternodePing> mapSeenMasternodePing;
 
     ADD_SERIALIZE_METHODS;
 
@@ -78,7 +167,14 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        std::vector<CMasternode> vMasternodes;
+        if (!ser_action.ForRead()) {
+            BOOST_FOREACH (const CMasternodePtr& pmn, listMasternodes)
+                vMasternodes.push_back(*pmn);
+        }
         READWRITE(vMasternodes);
+        if (ser_action.ForRead())
+            SetMasternodes(vMasternodes);
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -93,12 +189,26 @@ public:
     /// Add an entry
     bool Add(CMasternode& mn);
 
+    /// Check a collateral against the UTXO set and the mempool and follow its spends from then on, requires cs_main
+    bool CheckCollateral(const CTxIn& vin, int& nDoS);
+    /// Whether a transaction spent the collateral of a listed MN since it was added
+    bool IsCollateralSpent(const COutPoint& outpoint);
+    /// Look up the collaterals of the whole list once, for entries loaded from disk
+    void CheckCollaterals();
+    /// Clear the flags of spent collaterals that are unspent again, after a disconnected block or a conflicted mempool spend
+    void RecheckSpentCollaterals();
+
     /// Ask (source) node for mnb
     void AskForMN(CNode* pnode, CTxIn& vin);
 
     /// Check all Masternodes
     void Check();
 
+    /// Drop what was derived from the list, after a masternode was added, removed or changed state
+    void ListChanged();
+    /// Changes whenever ListChanged is called
+    unsigned int GetListVersion() const { return nListVersion; }
+
     /// Check all Masternodes and remove inactive
     void CheckAndRemove(bool forceExpiredRemoval = false);
 
@@ -111,44 +221,52 @@ public:
 
     void DsegUpdate(CNode* pnode);
 
+    /// Digest of the entries we hand out to peers, vShortIds gets the sorted short ids of their broadcasts
+    uint256 GetListDigest(std::vector<uint64_t>& vShortIds);
+
     /// Find an entry
-    CMasternode* Find(const CScript& payee);
-    CMasternode* Find(const CTxIn& vin);
-    CMasternode* Find(const CPubKey& pubKeyMasternode);
+    CMasternodePtr Find(const CScript& payee);
+    CMasternodePtr Find(const CTxIn& vin);
+    CMasternodePtr Find(const CPubKey& pubKeyMasternode);
 
     /// Find an entry in the masternode list that is next to be paid
-    CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
+    CMasternodePtr GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
     /// Find a random entry
-    CMasternode* FindRandomNotInVec(std::vector<CTxIn>& vecToExclude, int protocolVersion = -1);
+    CMasternodePtr FindRandomNotInVec(std::vector<CTxIn>& vecToExclude, int protocolVersion = -1);
 
     /// Get the current winner for this block
-    CMasternode* GetCurrentMasterNode(int mod = 1, int64_t nBlockHeight = 0, int minProtocol = 0);
+    CMasternodePtr GetCurrentMasterNode(int mod = 1, int64_t nBlockHeight = 0, int minProtocol = 0);
 
-    std::vector<CMasternode> GetFullMasternodeVector()
-    {
-        Check();
-        return vMasternodes;
-    }
+    /// Copies of all entries
+    std::vector<CMasternode> GetFullMasternodeVector();
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
-    CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
+    /// The first nCount active masternodes GetMasternodeRank ranks for nBlockHeight, best first
+    bool GetTopRankedMasternodes(int64_t nBlockHeight, int minProtocol, unsigned int nCount, std::vector<CTxIn>& vecTop);
+    CMasternodePtr GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
     void ProcessMasternodeConnections();
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Masternodes
-    int size() { return vMasternodes.size(); }
+    int size() { return mapMasternodesByOutpoint.size(); }
 
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size ();
 
+    /// Entries and memory usage of the seen broadcast and ping caches
+    void GetSeenCacheUsage(size_t& nBroadcasts, size_t& nBroadcastBytes, size_t& nPings, size_t& nPingBytes) const;
+
     std::string ToString() const;
 
     void Remove(CTxIn vin);
 
+    /// Apply a newer broadcast to a listed entry, keeping the indexes in sync
+    bool UpdateFromNewBroadcast(const CMasternodePtr& pmn, CMasternodeBroadcast& mnb);
+
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
 };
@@ -771,10 +771,10 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CDataStream::vector_type>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
+        CDataStream::vector_type& data = *it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -785,6 +785,7 @@ void SocketSendData(CNode* pnode)
             if (pnode->nSendOffset == data.size()) {
                 pnode->nSendOffset = 0;
                 pnode->nSendSize -= data.size();
+                pnode->RecycleSendBuffer(data);
                 it++;
             } else {
                 // could not send full message; stop sending more
@@ -2169,7 +2170,11 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
+    std::deque<CDataStream::vector_type>::iterator it = vSendMsg.insert(vSendMsg.end(), CDataStream::vector_type());
+    if (!vSendBufferPool.empty()) {
+        it->swap(vSendBufferPool.back());
+        vSendBufferPool.pop_back();
+    }
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
 
@@ -2180,6 +2185,15 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::RecycleSendBuffer(CDataStream::vector_type& data)
+{
+    if (vSendBufferPool.size() >= MAX_SEND_BUFFER_POOL || data.capacity() > MAX_POOLED_SEND_BUFFER)
+        return;
+    vSendBufferPool.push_back(CDataStream::vector_type());
+    vSendBufferPool.back().swap(data);
+    vSendBufferPool.back().clear();
+}
+
 //
 // CBanDB
 //
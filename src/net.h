@@ -62,6 +62,10 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Sent message buffers each node keeps to serialize the next messages into */
+static const unsigned int MAX_SEND_BUFFER_POOL = 8;
+/** Buffers that grew past this, for blocks and large invs, are freed once sent */
+static const size_t MAX_POOLED_SEND_BUFFER = 256 * 1024;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -288,7 +292,9 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CDataStream::vector_type> vSendMsg;
+    //! emptied buffers of sent messages, reused by EndMessage
+    std::vector<CDataStream::vector_type> vSendBufferPool;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -476,6 +482,9 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    // requires LOCK(cs_vSend)
+    void RecycleSendBuffer(CDataStream::vector_type& data);
+
     void PushVersion();
 
 
@@ -0,0 +1,339 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PREVECTOR_H
+#define BITCOIN_PREVECTOR_H
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Vector with room for N elements inside the object itself, so that it only
+ * allocates once it grows past them. Used for scripts and script stack
+ * elements, most of which are short enough to never touch the heap.
+ *
+ * Elements are moved around with memcpy/memmove, so T must not hold pointers
+ * into itself. unsigned char and prevectors of it qualify. Iterators are plain
+ * pointers, and like std::vector they are invalidated by anything that grows
+ * or shrinks the storage; value arguments must not refer into the prevector.
+ */
+template <unsigned int N, typename T, typename Size = uint32_t, typename Diff = int32_t>
+class prevector
+{
+public:
+    typedef Size size_type;
+    typedef Diff difference_type;
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type* iterator;
+    typedef const value_type* const_iterator;
+
+private:
+    //! the size while the elements are inline, N + 1 + size once they are on the heap
+    size_type _size;
+    union direct_or_indirect {
+        char direct[sizeof(T) * N];
+        struct {
+            char* indirect;
+            size_type capacity;
+        } heap;
+    } _union;
+
+    bool is_direct() const { return _size <= N; }
+    T* direct_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.direct) + pos; }
+    const T* direct_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.direct) + pos; }
+    T* indirect_ptr(difference_type pos) { return reinterpret_cast<T*>(_union.heap.indirect) + pos; }
+    const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.heap.indirect) + pos; }
+    T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+    const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
+
+    void change_capacity(size_type new_capacity)
+    {
+        if (new_capacity <= N) {
+            if (!is_direct()) {
+                char* indirect = _union.heap.indirect;
+                size_type nSize = size();
+                memcpy(_union.direct, indirect, nSize * sizeof(T));
+                free(indirect);
+                _size = nSize;
+            }
+        } else if (!is_direct()) {
+            char* p = static_cast<char*>(realloc(_union.heap.indirect, sizeof(T) * new_capacity));
+            if (!p)
+                throw std::bad_alloc();
+            _union.heap.indirect = p;
+            _union.heap.capacity = new_capacity;
+        } else {
+            char* p = static_cast<char*>(malloc(sizeof(T) * new_capacity));
+            if (!p)
+                throw std::bad_alloc();
+            memcpy(p, _union.direct, _size * sizeof(T));
+            _union.heap.indirect = p;
+            _union.heap.capacity = new_capacity;
+            _size += N + 1;
+        }
+    }
+
+    //! make room for count elements at pos, returning where they go
+    T* make_gap(size_type pos, size_type count)
+    {
+        size_type new_size = size() + count;
+        if (capacity() < new_size)
+            change_capacity(new_size + (new_size >> 1));
+        T* ptr = item_ptr(pos);
+        memmove(static_cast<void*>(ptr + count), static_cast<void*>(ptr), (size() - pos) * sizeof(T));
+        _size += count;
+        return ptr;
+    }
+
+    void destroy(T* first, T* last)
+    {
+        for (; first != last; ++first)
+            first->~T();
+    }
+
+    //! take other's storage, leaving it empty; this must hold nothing
+    void steal(prevector& other)
+    {
+        _size = other._size;
+        // Only the bytes in use, the rest of an inline buffer was never written
+        if (other.is_direct())
+            memcpy(_union.direct, other._union.direct, other._size * sizeof(T));
+        else
+            _union.heap = other._union.heap;
+        other._size = 0;
+    }
+
+public:
+    prevector() : _size(0) {}
+
+    explicit prevector(size_type n) : _size(0)
+    {
+        resize(n);
+    }
+
+    prevector(size_type n, const T& val) : _size(0)
+    {
+        assign(n, val);
+    }
+
+    template <typename InputIterator>
+    prevector(InputIterator first, InputIterator last) : _size(0)
+    {
+        assign(first, last);
+    }
+
+    prevector(const prevector& other) : _size(0)
+    {
+        assign(other.begin(), other.end());
+    }
+
+    prevector(prevector&& other) : _size(0)
+    {
+        steal(other);
+    }
+
+    ~prevector()
+    {
+        clear();
+        if (!is_direct())
+            free(_union.heap.indirect);
+    }
+
+    prevector& operator=(const prevector& other)
+    {
+        if (&other != this)
+            assign(other.begin(), other.end());
+        return *this;
+    }
+
+    prevector& operator=(prevector&& other)
+    {
+        if (&other != this) {
+            clear();
+            if (!is_direct())
+                free(_union.heap.indirect);
+            steal(other);
+        }
+        return *this;
+    }
+
+    size_type size() const { return is_direct() ? _size : _size - N - 1; }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return is_direct() ? N : _union.heap.capacity; }
+
+    iterator begin() { return item_ptr(0); }
+    const_iterator begin() const { return item_ptr(0); }
+    iterator end() { return item_ptr(size()); }
+    const_iterator end() const { return item_ptr(size()); }
+
+    T& operator[](size_type pos) { return *item_ptr(pos); }
+    const T& operator[](size_type pos) const { return *item_ptr(pos); }
+
+    T& at(size_type pos)
+    {
+        if (pos >= size())
+            throw std::out_of_range("prevector::at");
+        return *item_ptr(pos);
+    }
+    const T& at(size_type pos) const
+    {
+        if (pos >= size())
+            throw std::out_of_range("prevector::at");
+        return *item_ptr(pos);
+    }
+
+    T& front() { return *item_ptr(0); }
+    const T& front() const { return *item_ptr(0); }
+    T& back() { return *item_ptr(size() - 1); }
+    const T& back() const { return *item_ptr(size() - 1); }
+
+    T* data() { return item_ptr(0); }
+    const T* data() const { return item_ptr(0); }
+
+    void reserve(size_type new_capacity)
+    {
+        if (new_capacity > capacity())
+            change_capacity(new_capacity);
+    }
+
+    void shrink_to_fit()
+    {
+        change_capacity(size());
+    }
+
+    void resize(size_type new_size)
+    {
+        size_type cur_size = size();
+        if (new_size < cur_size) {
+            destroy(item_ptr(new_size), item_ptr(cur_size));
+            _size -= cur_size - new_size;
+            return;
+        }
+        reserve(new_size);
+        for (T* ptr = item_ptr(cur_size); cur_size < new_size; ++cur_size, ++ptr) {
+            new (static_cast<void*>(ptr)) T();
+            _size++;
+        }
+    }
+
+    void clear()
+    {
+        resize(0);
+    }
+
+    void assign(size_type n, const T& val)
+    {
+        clear();
+        reserve(n);
+        for (T* ptr = item_ptr(0); n > 0; --n, ++ptr) {
+            new (static_cast<void*>(ptr)) T(val);
+            _size++;
+        }
+    }
+
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last)
+    {
+        clear();
+        reserve(std::distance(first, last));
+        for (T* ptr = item_ptr(0); first != last; ++first, ++ptr) {
+            new (static_cast<void*>(ptr)) T(*first);
+            _size++;
+        }
+    }
+
+    iterator insert(iterator pos, const T& value)
+    {
+        T* ptr = make_gap(pos - begin(), 1);
+        new (static_cast<void*>(ptr)) T(value);
+        return ptr;
+    }
+
+    void insert(iterator pos, size_type count, const T& value)
+    {
+        T* ptr = make_gap(pos - begin(), count);
+        for (; count > 0; --count, ++ptr)
+            new (static_cast<void*>(ptr)) T(value);
+    }
+
+    template <typename InputIterator>
+    void insert(iterator pos, InputIterator first, InputIterator last)
+    {
+        T* ptr = make_gap(pos - begin(), std::distance(first, last));
+        for (; first != last; ++first, ++ptr)
+            new (static_cast<void*>(ptr)) T(*first);
+    }
+
+    iterator erase(iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        destroy(first, last);
+        memmove(static_cast<void*>(first), static_cast<void*>(last), (end() - last) * sizeof(T));
+        _size -= last - first;
+        return first;
+    }
+
+    void push_back(const T& value)
+    {
+        size_type new_size = size() + 1;
+        if (capacity() < new_size)
+            change_capacity(new_size + (new_size >> 1));
+        new (static_cast<void*>(item_ptr(size()))) T(value);
+        _size++;
+    }
+
+    void pop_back()
+    {
+        back().~T();
+        _size--;
+    }
+
+    void swap(prevector& other)
+    {
+        std::swap(_size, other._size);
+        std::swap(_union, other._union);
+    }
+
+    bool operator==(const prevector& other) const
+    {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const prevector& other) const
+    {
+        return !(*this == other);
+    }
+
+    bool operator<(const prevector& other) const
+    {
+        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+    }
+
+    //! bytes allocated on the heap
+    size_t allocated_memory() const
+    {
+        return is_direct() ? 0 : sizeof(T) * _union.heap.capacity;
+    }
+};
+
+template <unsigned int N, typename T, typename Size, typename Diff>
+inline void swap(prevector<N, T, Size, Diff>& a, prevector<N, T, Size, Diff>& b)
+{
+    a.swap(b);
+}
+
+#endif // BITCOIN_PREVECTOR_H
@@ -18,7 +18,7 @@ uint256 CBlockHeader::GetHash() const
     return HashQuark(BEGIN(nVersion), END(nNonce));
 }
 
-uint256 CBlock::BuildMerkleTree(bool* fMutated) const
+uint256 CBlock::BuildMerkleTree(bool* fMutated, MerkleLevelHasher hasher) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
@@ -59,26 +59,37 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     vMerkleTree.reserve(vtx.size() * 2 + 16); // Safe upper bound for the number of total nodes.
     for (std::vector<CTransaction>::const_iterator it(vtx.begin()); it != vtx.end(); ++it)
         vMerkleTree.push_back(it->GetHash());
-    int j = 0;
+    bool mutated = BuildMerkleLevels(vMerkleTree, hasher);
+    if (fMutated) {
+        *fMutated = mutated;
+    }
+    return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
+}
+
+bool BuildMerkleLevels(std::vector<uint256>& vMerkleTree, MerkleLevelHasher hasher)
+{
+    if (hasher == NULL)
+        hasher = SHA256D64;
     bool mutated = false;
-    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    size_t j = 0;
+    for (size_t nSize = vMerkleTree.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The pairs of a level are adjacent 64-byte messages, so they are hashed
+        // straight into the next level; an odd last hash is paired with itself.
+        size_t nNext = (nSize + 1) / 2;
+        vMerkleTree.resize(j + nSize + nNext);
+        hasher(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), nSize / 2);
+        if (nSize % 2) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree[j+nSize+nNext-1] = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
-    if (fMutated) {
-        *fMutated = mutated;
-    }
-    return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
+    return mutated;
 }
 
 std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
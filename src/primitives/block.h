@@ -16,6 +16,9 @@
 /** The maximum allowed size for a serialized block, in bytes (network rule) */
 static const unsigned int MAX_BLOCK_SIZE = 2000000;
 
+/** Double-SHA256 of blocks 64-byte messages of in into out, like SHA256D64 */
+typedef void (*MerkleLevelHasher)(unsigned char* out, const unsigned char* in, size_t blocks);
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -154,8 +157,8 @@ public:
     // Build the in-memory merkle tree for this block and return the merkle root.
     // If non-NULL, *mutated is set to whether mutation was detected in the merkle
     // tree (a duplication of transactions in the block leading to an identical
-    // merkle root).
-    uint256 BuildMerkleTree(bool* mutated = NULL) const;
+    // merkle root). Each level of the tree is hashed with one call to hasher.
+    uint256 BuildMerkleTree(bool* mutated = NULL, MerkleLevelHasher hasher = NULL) const;
 
     std::vector<uint256> GetMerkleBranch(int nIndex) const;
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
@@ -163,6 +166,13 @@ public:
     void print() const;
 };
 
+/** Append the levels of a merkle tree to vMerkleTree, which holds its leaves,
+ *  the root last. Each level is hashed in one call to hasher, SHA256D64 if
+ *  NULL. Returns whether two identical hashes were paired at the end of a
+ *  level (see BuildMerkleTree).
+ */
+bool BuildMerkleLevels(std::vector<uint256>& vMerkleTree, MerkleLevelHasher hasher = NULL);
+
 
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
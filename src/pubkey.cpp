@@ -6,48 +6,164 @@
 
 #include "eccryptoverify.h"
 
-#ifdef USE_SECP256K1
 #include <secp256k1.h>
-#else
-#include "ecwrapper.h"
-#endif
 
-bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
+//! anonymous namespace
+namespace
 {
-    if (!IsValid())
+//! Users of libsecp256k1 that haven't called ECC_Stop yet. Constant initialized,
+//! so it is ready before the static initializers of any translation unit run.
+int nSecp256k1Users = 0;
+
+/** Builds the verification tables once, for every verification in the process to share */
+class CSecp256k1VerifyInit
+{
+public:
+    CSecp256k1VerifyInit()
+    {
+        ECC_Start(SECP256K1_START_VERIFY);
+    }
+    ~CSecp256k1VerifyInit()
+    {
+        ECC_Stop();
+    }
+};
+static CSecp256k1VerifyInit instance_of_csecp256k1verifyinit;
+
+/** Read the length of a DER element at pos, advancing pos past it. */
+bool ParseDERLength(const unsigned char* input, size_t inputlen, size_t& pos, size_t& len)
+{
+    if (pos == inputlen)
         return false;
-#ifdef USE_SECP256K1
-    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, &vchSig[0], vchSig.size(), begin(), size()) != 1)
+    size_t lenbyte = input[pos++];
+    if (!(lenbyte & 0x80)) {
+        len = lenbyte;
+        return true;
+    }
+    lenbyte -= 0x80;
+    if (lenbyte > inputlen - pos)
         return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
+    while (lenbyte > 0 && input[pos] == 0) {
+        pos++;
+        lenbyte--;
+    }
+    if (lenbyte >= sizeof(size_t))
         return false;
-    if (!key.Verify(hash, vchSig))
+    len = 0;
+    while (lenbyte > 0) {
+        len = (len << 8) + input[pos];
+        pos++;
+        lenbyte--;
+    }
+    return true;
+}
+
+/**
+ * Parse a DER signature as leniently as OpenSSL used to, into big-endian R and
+ * S. Lengths may use the long form, R and S may carry leading zeroes, and
+ * anything after the sequence is ignored, but like d2i_ECDSA_SIG the sequence
+ * must fit the input and hold exactly R and S. R and S are read as unsigned,
+ * as OpenSSL's BIGNUM decoding did, so a missing 0x00 pad does not make them
+ * negative (see "too little R padding but no DERSIG" in script_valid.json).
+ * Returns false for what cannot be parsed, and for R or S longer than 32
+ * bytes, which cannot verify.
+ */
+bool ParseSignatureLax(const unsigned char* input, size_t inputlen, unsigned char r[32], unsigned char s[32])
+{
+    size_t pos = 0, seqend, rpos, rlen, spos, slen;
+
+    // Sequence tag byte and length
+    if (pos == inputlen || input[pos] != 0x30)
         return false;
-#endif
+    pos++;
+    if (!ParseDERLength(input, inputlen, pos, seqend) || seqend > inputlen - pos)
+        return false;
+    seqend += pos;
+
+    // Integer tag byte and length for R
+    if (pos == seqend || input[pos] != 0x02)
+        return false;
+    pos++;
+    if (!ParseDERLength(input, seqend, pos, rlen) || rlen > seqend - pos)
+        return false;
+    rpos = pos;
+    pos += rlen;
+
+    // Integer tag byte and length for S, which ends the sequence
+    if (pos == seqend || input[pos] != 0x02)
+        return false;
+    pos++;
+    if (!ParseDERLength(input, seqend, pos, slen) || slen != seqend - pos)
+        return false;
+    spos = pos;
+
+    // Ignore leading zeroes in R and S
+    while (rlen > 0 && input[rpos] == 0) {
+        rlen--;
+        rpos++;
+    }
+    while (slen > 0 && input[spos] == 0) {
+        slen--;
+        spos++;
+    }
+    if (rlen > 32 || slen > 32)
+        return false;
+    memset(r, 0, 32);
+    memset(s, 0, 32);
+    memcpy(r + 32 - rlen, input + rpos, rlen);
+    memcpy(s + 32 - slen, input + spos, slen);
     return true;
 }
 
+/** Strict DER encoding of a signature, as libsecp256k1 parses it. Returns its length. */
+int SerializeSignatureDER(const unsigned char r[32], const unsigned char s[32], unsigned char der[72])
+{
+    unsigned char* p = der;
+    const unsigned char* vInts[2] = {r, s};
+    *p++ = 0x30;
+    *p++ = 0;
+    for (int i = 0; i < 2; i++) {
+        const unsigned char* n = vInts[i];
+        int len = 32;
+        while (len > 1 && n[32 - len] == 0)
+            len--;
+        bool fPad = n[32 - len] & 0x80;
+        *p++ = 0x02;
+        *p++ = len + fPad;
+        if (fPad)
+            *p++ = 0;
+        memcpy(p, n + 32 - len, len);
+        p += len;
+    }
+    der[1] = p - der - 2;
+    return p - der;
+}
+
+} // anon namespace
+
+bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
+{
+    if (!IsValid())
+        return false;
+    // Signatures were checked by OpenSSL, which accepts more than strict DER.
+    // Parse them the way it did, and hand libsecp256k1 the strict encoding.
+    unsigned char r[32], s[32], der[72];
+    if (vchSig.empty() || !ParseSignatureLax(&vchSig[0], vchSig.size(), r, s))
+        return false;
+    int nDERLen = SerializeSignatureDER(r, s, der);
+    return secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, der, nDERLen, begin(), size()) == 1;
+}
+
 bool CPubKey::RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig)
 {
     if (vchSig.size() != 65)
         return false;
     int recid = (vchSig[0] - 27) & 3;
     bool fComp = ((vchSig[0] - 27) & 4) != 0;
-#ifdef USE_SECP256K1
     int pubkeylen = 65;
     if (!secp256k1_ecdsa_recover_compact((const unsigned char*)&hash, 32, &vchSig[1], (unsigned char*)begin(), &pubkeylen, fComp, recid))
         return false;
     assert((int)size() == pubkeylen);
-#else
-    CECKey key;
-    if (!key.Recover(hash, &vchSig[1], recid))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, fComp);
-    Set(pubkey.begin(), pubkey.end());
-#endif
     return true;
 }
 
@@ -55,34 +171,17 @@ bool CPubKey::IsFullyValid() const
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    if (!secp256k1_ecdsa_pubkey_verify(begin(), size()))
-        return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-#endif
-    return true;
+    return secp256k1_ec_pubkey_verify(begin(), size()) == 1;
 }
 
 bool CPubKey::Decompress()
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
     int clen = size();
-    int ret = secp256k1_ecdsa_pubkey_decompress((unsigned char*)begin(), &clen);
-    assert(ret);
+    if (!secp256k1_ec_pubkey_decompress((unsigned char*)begin(), &clen))
+        return false;
     assert(clen == (int)size());
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, false);
-    Set(pubkey.begin(), pubkey.end());
-#endif
     return true;
 }
 
@@ -94,18 +193,8 @@ bool CPubKey::Derive(CPubKey& pubkeyChild, unsigned char ccChild[32], unsigned i
     unsigned char out[64];
     BIP32Hash(cc, nChild, *begin(), begin() + 1, out);
     memcpy(ccChild, out + 32, 32);
-#ifdef USE_SECP256K1
     pubkeyChild = *this;
-    bool ret = secp256k1_ecdsa_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
-#else
-    CECKey key;
-    bool ret = key.SetPubKey(begin(), size());
-    ret &= key.TweakPublic(out);
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, true);
-    pubkeyChild.Set(pubkey.begin(), pubkey.end());
-#endif
-    return ret;
+    return secp256k1_ec_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out) == 1;
 }
 
 void CExtPubKey::Encode(unsigned char code[74]) const
@@ -138,3 +227,17 @@ bool CExtPubKey::Derive(CExtPubKey& out, unsigned int nChild) const
     out.nChild = nChild;
     return pubkey.Derive(out.pubkey, out.vchChainCode, nChild, vchChainCode);
 }
+
+void ECC_Start(unsigned int flags)
+{
+    // Only called by static initializers and destructors, which run on one thread
+    secp256k1_start(flags);
+    nSecp256k1Users++;
+}
+
+void ECC_Stop()
+{
+    assert(nSecp256k1Users > 0);
+    if (--nSecp256k1Users == 0)
+        secp256k1_stop();
+}
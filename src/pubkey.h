@@ -213,4 +213,9 @@ struct CExtPubKey {
     bool Derive(CExtPubKey& out, unsigned int nChild) const;
 };
 
+/** Start libsecp256k1 with the given SECP256K1_START_* flags, for a user that calls ECC_Stop when done */
+void ECC_Start(unsigned int flags);
+/** Stop libsecp256k1 once its last user is done with it */
+void ECC_Stop();
+
 #endif // BITCOIN_PUBKEY_H
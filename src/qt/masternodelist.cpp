@@ -125,7 +125,7 @@ void MasternodeList::StartAll(std::string strCommand)
             continue;
 
         CTxIn txin = CTxIn(uint256S(mne.getTxHash()), uint32_t(nIndex));
-        CMasternode* pmn = mnodeman.Find(txin);
+        CMasternodePtr pmn = mnodeman.Find(txin);
 
         if (strCommand == "start-missing" && pmn) continue;
 
@@ -210,8 +210,8 @@ void MasternodeList::updateMyNodeList(bool fForce)
             continue;
 
         CTxIn txin = CTxIn(uint256S(mne.getTxHash()), uint32_t(nIndex));
-        CMasternode* pmn = mnodeman.Find(txin);
-        updateMyMasternodeInfo(QString::fromStdString(mne.getAlias()), QString::fromStdString(mne.getIp()), pmn);
+        CMasternodePtr pmn = mnodeman.Find(txin);
+        updateMyMasternodeInfo(QString::fromStdString(mne.getAlias()), QString::fromStdString(mne.getIp()), pmn.get());
     }
     ui->tableWidgetMyMasternodes->setSortingEnabled(true);
 
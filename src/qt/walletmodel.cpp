@@ -424,7 +424,11 @@ bool WalletModel::setWalletLocked(bool locked, const SecureString& passPhrase, b
         return wallet->Lock();
     } else {
         // Unlock
-        return wallet->Unlock(passPhrase, stakingOnly);
+        if (!wallet->Unlock(passPhrase, stakingOnly))
+            return false;
+        if (stakingOnly)
+            wallet->StartWarmStakingKeyCache();
+        return true;
     }
 }
 
@@ -243,6 +243,40 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getblockhashes high low\n"
+            "\nReturns the hashes of blocks with a timestamp within the given range (requires -timestampindex).\n"
+            "\nArguments:\n"
+            "1. high         (numeric, required) The newer block timestamp\n"
+            "2. low          (numeric, required) The older block timestamp\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"         (string) The block hash\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockhashes", "1231614698 1231024505") + HelpExampleRpc("getblockhashes", "1231614698, 1231024505"));
+
+    if (!fTimestampIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "timestamp index not enabled, restart with -timestampindex=1");
+    if (!AddressIndexesSynced())
+        throw JSONRPCError(RPC_IN_WARMUP, "timestamp index is being built, try again later");
+
+    unsigned int high = params[0].get_int();
+    unsigned int low = params[1].get_int();
+    std::vector<uint256> blockHashes;
+    if (!GetTimestampIndex(high, low, blockHashes))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH (const uint256& hash, blockHashes)
+        result.push_back(hash.GetHex());
+    return result;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
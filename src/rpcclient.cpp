@@ -49,6 +49,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getbalance", 1},
         {"getbalance", 2},
         {"getblockhash", 0},
+        {"getblockhashes", 0},
+        {"getblockhashes", 1},
         {"move", 2},
         {"move", 3},
         {"sendfrom", 2},
@@ -88,6 +90,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"lockunspent", 1},
         {"importprivkey", 2},
         {"importaddress", 2},
+        {"bip38decryptbatch", 0},
         {"verifychain", 0},
         {"verifychain", 1},
         {"keypoolrefill", 0},
@@ -119,7 +122,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"setstakesplitthreshold", 0},
         {"autocombinerewards", 0},
         {"autocombinerewards", 1},
-        {"getfeeinfo", 0}
+        {"getfeeinfo", 0},
+        {"getaddressbalance", 0},
+        {"getaddressdeltas", 0},
+        {"getaddresstxids", 0},
+        {"getaddressutxos", 0},
+        {"getspentinfo", 0}
     };
 
 class CRPCConvertTable
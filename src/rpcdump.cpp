@@ -16,11 +16,15 @@
 #include "utiltime.h"
 #include "wallet.h"
 
+#include <atomic>
 #include <fstream>
 #include <secp256k1.h>
 #include <stdint.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <openssl/aes.h>
 #include <openssl/sha.h>
@@ -78,6 +82,19 @@ std::string DecodeDumpString(const std::string& str)
     return ret.str();
 }
 
+static void EnsureWalletIsNotScanning()
+{
+    if (pwalletMain->IsScanning())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: Wallet is currently rescanning. Abort the rescan with abortrescan or wait for it to finish.");
+}
+
+/** Rescan from pindexStart without holding cs_main or cs_wallet, so other calls go on meanwhile */
+static void RescanWallet(CBlockIndex* pindexStart, bool fUpdate)
+{
+    if (pwalletMain->ScanForWalletTransactions(pindexStart, fUpdate) < 0)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: Rescan was aborted or another rescan is running.");
+}
+
 UniValue importprivkey(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 3)
@@ -96,7 +113,7 @@ UniValue importprivkey(const UniValue& params, bool fHelp)
             "\nImport using a label and without rescan\n" + HelpExampleCli("importprivkey", "\"mykey\" \"testing\" false") +
             "\nAs a JSON-RPC call\n" + HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", false"));
 
-    EnsureWalletIsUnlocked();
+    EnsureWalletIsNotScanning();
 
     string strSecret = params[0].get_str();
     string strLabel = "";
@@ -119,7 +136,11 @@ UniValue importprivkey(const UniValue& params, bool fHelp)
     CPubKey pubkey = key.GetPubKey();
     assert(key.VerifyPubKey(pubkey));
     CKeyID vchAddress = pubkey.GetID();
+    CBlockIndex* pindexRescan;
     {
+        // Checked under the locks: thread-safe calls start without them and the wallet may relock meanwhile
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        EnsureWalletIsUnlocked();
         pwalletMain->MarkDirty();
         pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
 
@@ -134,12 +155,12 @@ UniValue importprivkey(const UniValue& params, bool fHelp)
 
         // whenever a key is imported, we need to scan the whole chain
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
-
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
-        }
+        pindexRescan = chainActive.Genesis();
     }
 
+    if (fRescan)
+        RescanWallet(pindexRescan, true);
+
     return NullUniValue;
 }
 
@@ -160,6 +181,8 @@ UniValue importaddress(const UniValue& params, bool fHelp)
             "\nImport using a label without rescan\n" + HelpExampleCli("importaddress", "\"myaddress\" \"testing\" false") +
             "\nAs a JSON-RPC call\n" + HelpExampleRpc("importaddress", "\"myaddress\", \"testing\", false"));
 
+    EnsureWalletIsNotScanning();
+
     CScript script;
 
     CBitcoinAddress address(params[0].get_str());
@@ -181,7 +204,9 @@ UniValue importaddress(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fRescan = params[2].get_bool();
 
+    CBlockIndex* pindexRescan;
     {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
             throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
 
@@ -197,11 +222,12 @@ UniValue importaddress(const UniValue& params, bool fHelp)
 
         if (!pwalletMain->AddWatchOnly(script))
             throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+        pindexRescan = chainActive.Genesis();
+    }
 
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
-            pwalletMain->ReacceptWalletTransactions();
-        }
+    if (fRescan) {
+        RescanWallet(pindexRescan, true);
+        pwalletMain->ReacceptWalletTransactions();
     }
 
     return NullUniValue;
@@ -221,80 +247,84 @@ UniValue importwallet(const UniValue& params, bool fHelp)
             "\nImport the wallet\n" + HelpExampleCli("importwallet", "\"test\"") +
             "\nImport using the json rpc call\n" + HelpExampleRpc("importwallet", "\"test\""));
 
-    EnsureWalletIsUnlocked();
-
-    ifstream file;
-    file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
-
-    int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
+    EnsureWalletIsNotScanning();
 
+    CBlockIndex* pindex;
     bool fGood = true;
-
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
-
-    pwalletMain->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
-    while (file.good()) {
-        pwalletMain->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
-        std::string line;
-        std::getline(file, line);
-        if (line.empty() || line[0] == '#')
-            continue;
-
-        std::vector<std::string> vstr;
-        boost::split(vstr, line, boost::is_any_of(" "));
-        if (vstr.size() < 2)
-            continue;
-        CBitcoinSecret vchSecret;
-        if (!vchSecret.SetString(vstr[0]))
-            continue;
-        CKey key = vchSecret.GetKey();
-        CPubKey pubkey = key.GetPubKey();
-        assert(key.VerifyPubKey(pubkey));
-        CKeyID keyid = pubkey.GetID();
-        if (pwalletMain->HaveKey(keyid)) {
-            LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
-            continue;
-        }
-        int64_t nTime = DecodeDumpTime(vstr[1]);
-        std::string strLabel;
-        bool fLabel = true;
-        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-            if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                break;
-            if (vstr[nStr] == "change=1")
-                fLabel = false;
-            if (vstr[nStr] == "reserve=1")
-                fLabel = false;
-            if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                fLabel = true;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        EnsureWalletIsUnlocked();
+        ifstream file;
+        file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
+        if (!file.is_open())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
+
+        int64_t nTimeBegin = chainActive.Tip()->GetBlockTime();
+
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
+
+        pwalletMain->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
+        while (file.good()) {
+            pwalletMain->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+            std::string line;
+            std::getline(file, line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::vector<std::string> vstr;
+            boost::split(vstr, line, boost::is_any_of(" "));
+            if (vstr.size() < 2)
+                continue;
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(vstr[0]))
+                continue;
+            CKey key = vchSecret.GetKey();
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID keyid = pubkey.GetID();
+            if (pwalletMain->HaveKey(keyid)) {
+                LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
+                continue;
             }
+            int64_t nTime = DecodeDumpTime(vstr[1]);
+            std::string strLabel;
+            bool fLabel = true;
+            for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+                if (boost::algorithm::starts_with(vstr[nStr], "#"))
+                    break;
+                if (vstr[nStr] == "change=1")
+                    fLabel = false;
+                if (vstr[nStr] == "reserve=1")
+                    fLabel = false;
+                if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+                    strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                    fLabel = true;
+                }
+            }
+            LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
+            if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
+                fGood = false;
+                continue;
+            }
+            pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
+            if (fLabel)
+                pwalletMain->SetAddressBook(keyid, strLabel, "receive");
+            nTimeBegin = std::min(nTimeBegin, nTime);
         }
-        LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
-        if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
-            fGood = false;
-            continue;
-        }
-        pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
-        if (fLabel)
-            pwalletMain->SetAddressBook(keyid, strLabel, "receive");
-        nTimeBegin = std::min(nTimeBegin, nTime);
-    }
-    file.close();
-    pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
+        file.close();
+        pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
 
-    CBlockIndex* pindex = chainActive.Tip();
-    while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
-        pindex = pindex->pprev;
+        pindex = chainActive.Tip();
+        while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
+            pindex = pindex->pprev;
 
-    if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
-        pwalletMain->nTimeFirstKey = nTimeBegin;
+        if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+            pwalletMain->nTimeFirstKey = nTimeBegin;
+    }
 
     LogPrintf("Rescanning last %i blocks\n", chainActive.Height() - pindex->nHeight + 1);
-    pwalletMain->ScanForWalletTransactions(pindex);
+    RescanWallet(pindex, false);
     pwalletMain->MarkDirty();
 
     if (!fGood)
@@ -303,6 +333,27 @@ UniValue importwallet(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue abortrescan(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "\nStops the running wallet rescan triggered by an import or a -rescan at startup.\n"
+            "The blocks scanned so far keep their transactions in the wallet.\n"
+            "\nResult:\n"
+            "true|false    (boolean) Whether a rescan was running\n"
+            "\nExamples:\n"
+            "\nImport a private key\n" +
+            HelpExampleCli("importprivkey", "\"mykey\"") +
+            "\nAbort the running wallet rescan\n" + HelpExampleCli("abortrescan", "") +
+            "\nAs a JSON-RPC call\n" + HelpExampleRpc("abortrescan", ""));
+
+    if (!pwalletMain->IsScanning())
+        return false;
+    pwalletMain->AbortRescan();
+    return true;
+}
+
 UniValue dumpprivkey(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -488,3 +539,132 @@ UniValue bip38decrypt(const UniValue& params, bool fHelp)
 
     return result;
 }
+
+struct CBIP38Job {
+    std::string strKey;
+    std::string strPassphrase;
+    uint256 privKey;
+    bool fCompressed;
+    bool fOk;
+};
+
+/** Decrypt jobs until none are left, each key's scrypt lanes on up to nScryptThreads threads */
+static void BIP38DecryptJobs(std::vector<CBIP38Job>* pvJobs, std::atomic<size_t>* pnNext, unsigned int nScryptThreads)
+{
+    size_t i;
+    while ((i = (*pnNext)++) < pvJobs->size()) {
+        CBIP38Job& job = (*pvJobs)[i];
+        job.fOk = BIP38_Decrypt(job.strPassphrase, job.strKey, job.privKey, job.fCompressed, nScryptThreads);
+    }
+}
+
+UniValue bip38decryptbatch(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "bip38decryptbatch [{\"encryptedkey\":\"key\",\"passphrase\":\"passphrase\"},...]\n"
+            "\nDecrypts several password protected private keys in parallel, then imports them with a single rescan.\n"
+            "\nArguments:\n"
+            "1. \"keys\"   (string, required) A json array of objects\n"
+            "     [\n"
+            "       {\n"
+            "         \"encryptedkey\":\"key\",   (string, required) The encrypted private key\n"
+            "         \"passphrase\":\"passphrase\" (string, required) The passphrase it was encrypted with\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"encryptedkey\": \"key\",   (string) The encrypted private key\n"
+            "    \"privatekey\": \"hex\",     (string) The decrypted private key\n"
+            "    \"Address\": \"address\",    (string) Its address\n"
+            "    \"error\": \"message\"       (string) Instead of the above, if the key could not be decrypted or imported\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nNote: This call can take minutes to complete.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("bip38decryptbatch", "\"[{\\\"encryptedkey\\\":\\\"6PnQ...\\\",\\\"passphrase\\\":\\\"secret\\\"}]\"") +
+            HelpExampleRpc("bip38decryptbatch", "[{\"encryptedkey\":\"6PnQ...\",\"passphrase\":\"secret\"}]"));
+
+    // Fail before the decryption too; both are checked again for the import
+    EnsureWalletIsUnlocked();
+    EnsureWalletIsNotScanning();
+
+    UniValue keys = params[0].get_array();
+    std::vector<CBIP38Job> vJobs(keys.size());
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        const UniValue& o = keys[i].get_obj();
+        RPCTypeCheckObj(o, boost::assign::map_list_of("encryptedkey", UniValue::VSTR)("passphrase", UniValue::VSTR));
+        vJobs[i].strKey = find_value(o, "encryptedkey").get_str();
+        vJobs[i].strPassphrase = find_value(o, "passphrase").get_str();
+    }
+
+    // Each key's scrypt is independent, so run whole keys side by side and
+    // give the cores left over, with fewer keys than cores, to their lanes.
+    // No lock is held, so blocks and other calls go on while they run.
+    std::atomic<size_t> nNext(0);
+    unsigned int nCores = std::max(1U, boost::thread::hardware_concurrency());
+    unsigned int nThreads = std::max(1U, std::min((unsigned int)vJobs.size(), nCores));
+    unsigned int nScryptThreads = nCores / nThreads;
+    boost::thread_group threads;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&BIP38DecryptJobs, &vJobs, &nNext, nScryptThreads));
+    BIP38DecryptJobs(&vJobs, &nNext, nScryptThreads);
+    threads.join_all();
+
+    UniValue result(UniValue::VARR);
+    bool fRescan = false;
+    CBlockIndex* pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        EnsureWalletIsUnlocked();
+        EnsureWalletIsNotScanning();
+        pwalletMain->MarkDirty();
+        BOOST_FOREACH (const CBIP38Job& job, vJobs) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("encryptedkey", job.strKey));
+
+            CKey key;
+            if (job.fOk)
+                key.Set(job.privKey.begin(), job.privKey.end(), job.fCompressed);
+            if (!job.fOk || !key.IsValid()) {
+                entry.push_back(Pair("error", job.fOk ? "Private Key Not Valid" : "Failed To Decrypt"));
+                result.push_back(entry);
+                continue;
+            }
+
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID vchAddress = pubkey.GetID();
+            pwalletMain->SetAddressBook(vchAddress, "", "receive");
+
+            if (pwalletMain->HaveKey(vchAddress)) {
+                entry.push_back(Pair("error", "Key already held by wallet"));
+            } else {
+                pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
+                if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
+                    entry.push_back(Pair("error", "Error adding key to wallet"));
+                } else {
+                    entry.push_back(Pair("privatekey", HexStr(job.privKey)));
+                    entry.push_back(Pair("Address", CBitcoinAddress(vchAddress).ToString()));
+                    fRescan = true;
+                }
+            }
+            result.push_back(entry);
+        }
+
+        // whenever a key is imported, we need to scan the whole chain
+        if (fRescan) {
+            pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+            pindexRescan = chainActive.Genesis();
+        }
+    }
+
+    if (fRescan)
+        RescanWallet(pindexRescan, true);
+
+    return result;
+}
@@ -407,8 +407,8 @@ UniValue mnbudgetvote(const UniValue& params, bool fHelp)
                 break;
             }
 
-            CMasternode* pmn = mnodeman.Find(activeMasternode.vin);
-            if (pmn == NULL) {
+            CMasternodePtr pmn = mnodeman.Find(activeMasternode.vin);
+            if (!pmn) {
                 failed++;
                 statusObj.push_back(Pair("node", "local"));
                 statusObj.push_back(Pair("result", "failed"));
@@ -474,8 +474,8 @@ UniValue mnbudgetvote(const UniValue& params, bool fHelp)
                 continue;
             }
 
-            CMasternode* pmn = mnodeman.Find(pubKeyMasternode);
-            if (pmn == NULL) {
+            CMasternodePtr pmn = mnodeman.Find(pubKeyMasternode);
+            if (!pmn) {
                 failed++;
                 statusObj.push_back(Pair("node", mne.getAlias()));
                 statusObj.push_back(Pair("result", "failed"));
@@ -548,8 +548,8 @@ UniValue mnbudgetvote(const UniValue& params, bool fHelp)
                 continue;
             }
 
-            CMasternode* pmn = mnodeman.Find(pubKeyMasternode);
-            if(pmn == NULL)
+            CMasternodePtr pmn = mnodeman.Find(pubKeyMasternode);
+            if (!pmn)
             {
                 failed++;
                 statusObj.push_back(Pair("node", mne.getAlias()));
@@ -829,8 +829,8 @@ UniValue mnbudgetrawvote(const UniValue& params, bool fHelp)
     if (fInvalid)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Malformed base64 encoding");
 
-    CMasternode* pmn = mnodeman.Find(vin);
-    if (pmn == NULL) {
+    CMasternodePtr pmn = mnodeman.Find(vin);
+    if (!pmn) {
         return "Failure to find masternode in list : " + vin.ToString();
     }
 
@@ -901,8 +901,8 @@ UniValue mnfinalbudget(const UniValue& params, bool fHelp)
                 continue;
             }
 
-            CMasternode* pmn = mnodeman.Find(pubKeyMasternode);
-            if (pmn == NULL) {
+            CMasternodePtr pmn = mnodeman.Find(pubKeyMasternode);
+            if (!pmn) {
                 failed++;
                 statusObj.push_back(Pair("result", "failed"));
                 statusObj.push_back(Pair("errorMessage", "Can't find masternode by pubkey"));
@@ -955,8 +955,8 @@ UniValue mnfinalbudget(const UniValue& params, bool fHelp)
         if (!masternodeSigner.SetKey(strMasterNodePrivKey, errorMessage, keyMasternode, pubKeyMasternode))
             return "Error upon calling SetKey";
 
-        CMasternode* pmn = mnodeman.Find(activeMasternode.vin);
-        if (pmn == NULL) {
+        CMasternodePtr pmn = mnodeman.Find(activeMasternode.vin);
+        if (!pmn) {
             return "Failure to find masternode in list : " + activeMasternode.vin.ToString();
         }
 
@@ -12,6 +12,7 @@
 #include "masternodeconfig.h"
 #include "masternodeman.h"
 #include "rpcserver.h"
+#include "swifttx.h"
 #include "utilmoneystr.h"
 
 #include <univalue.h>
@@ -240,7 +241,7 @@ UniValue listmasternodes(const UniValue& params, bool fHelp)
         std::string strTxHash = s.second.vin.prevout.hash.ToString();
         uint32_t oIdx = s.second.vin.prevout.n;
 
-        CMasternode* mn = mnodeman.Find(s.second.vin);
+        CMasternodePtr mn = mnodeman.Find(s.second.vin);
 
         if (mn != NULL) {
             if (strFilter != "" && strTxHash.find(strFilter) == string::npos &&
@@ -335,6 +336,111 @@ UniValue getmasternodecount (const UniValue& params, bool fHelp)
     return obj;
 }
 
+/** Entries and bytes are passed in for caches whose lock the owner holds */
+template <typename K, typename V>
+static UniValue SeenCacheInfo(const seencache<K, V>& cache, size_t nEntries, size_t nBytes, uint64_t& nTotalBytes)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", (uint64_t)nEntries));
+    obj.push_back(Pair("bytes", (uint64_t)nBytes));
+    obj.push_back(Pair("maxentries", (uint64_t)cache.max_size()));
+    obj.push_back(Pair("maxage", cache.max_age()));
+    nTotalBytes += nBytes;
+    return obj;
+}
+
+template <typename K, typename V>
+static UniValue SeenCacheInfo(const seencache<K, V>& cache, uint64_t& nTotalBytes)
+{
+    return SeenCacheInfo(cache, cache.size(), cache.memory_usage(), nTotalBytes);
+}
+
+UniValue getmessagecacheinfo (const UniValue& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 0))
+        throw runtime_error(
+            "getmessagecacheinfo\n"
+            "\nGet the size and approximate memory use of the seen masternode, budget and swifttx message caches\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"cache\": {          (object) One object per cache: mnb, mnp, mnw, mvote, mprop, fbvote, fbs, orphanmvote, orphanfbvote, txlvote\n"
+            "    \"entries\": n,     (numeric) Number of messages held\n"
+            "    \"bytes\": n,       (numeric) Approximate memory used by the messages\n"
+            "    \"maxentries\": n,  (numeric) Maximum number of messages, 0 for no limit\n"
+            "    \"maxage\": n       (numeric) Seconds a message is kept for, 0 for no limit\n"
+            "  },\n"
+            "  ...\n"
+            "  \"bytes\": n          (numeric) Approximate memory used by all caches\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagecacheinfo", "") + HelpExampleRpc("getmessagecacheinfo", ""));
+
+    UniValue obj(UniValue::VOBJ);
+    uint64_t nTotalBytes = 0;
+
+    size_t nBroadcasts, nBroadcastBytes, nPings, nPingBytes;
+    mnodeman.GetSeenCacheUsage(nBroadcasts, nBroadcastBytes, nPings, nPingBytes);
+    obj.push_back(Pair("mnb", SeenCacheInfo(mnodeman.mapSeenMasternodeBroadcast, nBroadcasts, nBroadcastBytes, nTotalBytes)));
+    obj.push_back(Pair("mnp", SeenCacheInfo(mnodeman.mapSeenMasternodePing, nPings, nPingBytes, nTotalBytes)));
+    {
+        LOCK(cs_mapMasternodePayeeVotes);
+        obj.push_back(Pair("mnw", SeenCacheInfo(masternodePayments.mapMasternodePayeeVotes, nTotalBytes)));
+    }
+    {
+        LOCK(budget.cs);
+        obj.push_back(Pair("mvote", SeenCacheInfo(budget.mapSeenMasternodeBudgetVotes, nTotalBytes)));
+        obj.push_back(Pair("mprop", SeenCacheInfo(budget.mapSeenMasternodeBudgetProposals, nTotalBytes)));
+        obj.push_back(Pair("fbvote", SeenCacheInfo(budget.mapSeenFinalizedBudgetVotes, nTotalBytes)));
+        obj.push_back(Pair("fbs", SeenCacheInfo(budget.mapSeenFinalizedBudgets, nTotalBytes)));
+        obj.push_back(Pair("orphanmvote", SeenCacheInfo(budget.mapOrphanMasternodeBudgetVotes, nTotalBytes)));
+        obj.push_back(Pair("orphanfbvote", SeenCacheInfo(budget.mapOrphanFinalizedBudgetVotes, nTotalBytes)));
+    }
+    {
+        LOCK(cs_main);
+        obj.push_back(Pair("txlvote", SeenCacheInfo(mapTxLockVote, nTotalBytes)));
+    }
+    obj.push_back(Pair("bytes", nTotalBytes));
+
+    return obj;
+}
+
+UniValue getswifttxinfo (const UniValue& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 0))
+        throw runtime_error(
+            "getswifttxinfo\n"
+            "\nGet the state of the SwiftTX lock engine and how long locks took to complete\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"locks\": n,        (numeric) Transaction locks being tracked\n"
+            "  \"quorums\": n,      (numeric) Blocks whose signing quorum is cached\n"
+            "  \"completed\": n,    (numeric) Locks completed since startup whose \"ix\" request this node received\n"
+            "  \"averagems\": x.x,  (numeric) Average milliseconds from the lock request to its last signature\n"
+            "  \"maxms\": x.x,      (numeric) Slowest lock in milliseconds\n"
+            "  \"lastms\": x.x      (numeric) Most recent lock in milliseconds\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getswifttxinfo", "") + HelpExampleRpc("getswifttxinfo", ""));
+
+    int64_t nCount, nAverage, nMax, nLast;
+    txLockManager.GetLatencyStats(nCount, nAverage, nMax, nLast);
+
+    UniValue obj(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        obj.push_back(Pair("locks", (uint64_t)mapTxLocks.size()));
+    }
+    obj.push_back(Pair("quorums", txLockManager.CountQuorums()));
+    obj.push_back(Pair("completed", nCount));
+    obj.push_back(Pair("averagems", nAverage * 0.001));
+    obj.push_back(Pair("maxms", nMax * 0.001));
+    obj.push_back(Pair("lastms", nLast * 0.001));
+
+    return obj;
+}
+
 UniValue masternodecurrent (const UniValue& params, bool fHelp)
 {
     if (fHelp || (params.size() != 0))
@@ -353,7 +459,7 @@ UniValue masternodecurrent (const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("masternodecurrent", "") + HelpExampleRpc("masternodecurrent", ""));
 
-    CMasternode* winner = mnodeman.GetCurrentMasterNode(1);
+    CMasternodePtr winner = mnodeman.GetCurrentMasterNode(1);
     if (winner) {
         UniValue obj(UniValue::VOBJ);
 
@@ -384,7 +490,7 @@ UniValue masternodedebug (const UniValue& params, bool fHelp)
         return activeMasternode.GetStatus();
 
     CTxIn vin = CTxIn();
-    CPubKey pubkey = CScript();
+    CPubKey pubkey;
     CKey key;
     if (!activeMasternode.GetMasterNodeVin(vin, pubkey, key))
         throw runtime_error("Missing masternode input, please look at the documentation for instructions on masternode creation\n");
@@ -479,9 +585,9 @@ UniValue startmasternode (const UniValue& params, bool fHelp)
             if(!mne.castOutputIndex(nIndex))
                 continue;
             CTxIn vin = CTxIn(uint256(mne.getTxHash()), uint32_t(nIndex));
-            CMasternode* pmn = mnodeman.Find(vin);
+            CMasternodePtr pmn = mnodeman.Find(vin);
 
-            if (pmn != NULL) {
+            if (pmn) {
                 if (strCommand == "missing") continue;
                 if (strCommand == "disabled" && pmn->IsEnabled()) continue;
             }
@@ -657,7 +763,7 @@ UniValue listmasternodeconf (const UniValue& params, bool fHelp)
         if(!mne.castOutputIndex(nIndex))
             continue;
         CTxIn vin = CTxIn(uint256(mne.getTxHash()), uint32_t(nIndex));
-        CMasternode* pmn = mnodeman.Find(vin);
+        CMasternodePtr pmn = mnodeman.Find(vin);
 
         std::string strStatus = pmn ? pmn->Status() : "MISSING";
 
@@ -701,7 +807,7 @@ UniValue getmasternodestatus (const UniValue& params, bool fHelp)
 
     if (!fMasterNode) throw runtime_error("This is not a masternode");
 
-    CMasternode* pmn = mnodeman.Find(activeMasternode.vin);
+    CMasternodePtr pmn = mnodeman.Find(activeMasternode.vin);
 
     if (pmn) {
         UniValue mnObj(UniValue::VOBJ);
@@ -466,6 +466,321 @@ UniValue verifymessage(const UniValue& params, bool fHelp)
     return (pubkey.GetID() == keyID);
 }
 
+static void EnsureAddressIndexesReady(bool fEnabled, const std::string& strIndex)
+{
+    if (!fEnabled)
+        throw JSONRPCError(RPC_MISC_ERROR, strIndex + " index not enabled, restart with -" + strIndex + "index=1");
+    if (!AddressIndexesSynced())
+        throw JSONRPCError(RPC_IN_WARMUP, strIndex + " index is being built, try again later");
+}
+
+/** Parse either a single address or an object {"addresses": [...]} into index keys */
+static void ParseAddressIndexParams(const UniValue& param, std::vector<std::pair<uint160, int> >& addresses)
+{
+    std::vector<std::string> vAddresses;
+    if (param.isStr()) {
+        vAddresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        UniValue addressValues = find_value(param.get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (unsigned int i = 0; i < addressValues.size(); i++)
+            vAddresses.push_back(addressValues[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with an addresses array");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vAddresses) {
+        CBitcoinAddress address(strAddress);
+        uint160 hashBytes;
+        int type = 0;
+        if (!address.GetIndexKey(hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+}
+
+static std::string AddressIndexToString(const uint160& hashBytes, int type)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+static const std::string strAddressIndexArg =
+    "1. \"addresses\"     (string or object, required) An rdct address, or an object\n"
+    "   {\n"
+    "     \"addresses\"\n"
+    "       [\n"
+    "         \"address\"  (string) The rdct address\n"
+    "         ,...\n"
+    "       ]\n"
+    "   }\n";
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance addresses\n"
+            "\nReturns the balance of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n" +
+            strAddressIndexArg +
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\"  (numeric) The current balance in satoshis\n"
+            "  \"received\" (numeric) The total number of satoshis received (including change)\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}"));
+
+    EnsureAddressIndexesReady(fAddressIndex, "address");
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++) {
+            if (itIndex->second > 0)
+                received += itIndex->second;
+            balance += itIndex->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", balance));
+    result.push_back(Pair("received", received));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos addresses\n"
+            "\nReturns all unspent outputs of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n" +
+            strAddressIndexArg +
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\"      (string) The address\n"
+            "    \"txid\"         (string) The output txid\n"
+            "    \"outputIndex\"  (number) The output index\n"
+            "    \"script\"       (string) The script hex-encoded\n"
+            "    \"satoshis\"     (number) The number of satoshis of the output\n"
+            "    \"height\"       (number) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}"));
+
+    EnsureAddressIndexesReady(fAddressIndex, "address");
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressIndexToString(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+/** Read the optional "start" and "end" heights of an address index query */
+static void ParseAddressIndexRange(const UniValue& param, int& start, int& end)
+{
+    start = 0;
+    end = 0;
+    if (!param.isObject())
+        return;
+    UniValue startValue = find_value(param.get_obj(), "start");
+    UniValue endValue = find_value(param.get_obj(), "end");
+    if (startValue.isNum() && endValue.isNum()) {
+        start = startValue.get_int();
+        end = endValue.get_int();
+        if (start <= 0 || end < start)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end must be positive and end must not be below start");
+    } else if (!startValue.isNull() || !endValue.isNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be given together");
+    }
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressdeltas addresses\n"
+            "\nReturns all changes to the balance of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"addresses\"     (string or object, required) An rdct address, or an object\n"
+            "   {\n"
+            "     \"addresses\"\n"
+            "       [\n"
+            "         \"address\"  (string) The rdct address\n"
+            "         ,...\n"
+            "       ]\n"
+            "     \"start\" (number, optional) The start block height\n"
+            "     \"end\"   (number, optional) The end block height\n"
+            "   }\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\"    (number) The difference of satoshis\n"
+            "    \"txid\"        (string) The related txid\n"
+            "    \"index\"       (number) The related input or output index\n"
+            "    \"blockindex\"  (number) The position of the transaction in its block\n"
+            "    \"height\"      (number) The block height\n"
+            "    \"address\"     (string) The address\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}'") +
+            HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}"));
+
+    EnsureAddressIndexesReady(fAddressIndex, "address");
+
+    int start, end;
+    ParseAddressIndexRange(params[0], start, end);
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        std::string strAddress = AddressIndexToString(it->first, it->second);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++) {
+            UniValue delta(UniValue::VOBJ);
+            delta.push_back(Pair("satoshis", itIndex->second));
+            delta.push_back(Pair("txid", itIndex->first.txhash.GetHex()));
+            delta.push_back(Pair("index", (int)itIndex->first.index));
+            delta.push_back(Pair("blockindex", (int)itIndex->first.txindex));
+            delta.push_back(Pair("height", itIndex->first.blockHeight));
+            delta.push_back(Pair("address", strAddress));
+            result.push_back(delta);
+        }
+    }
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids addresses\n"
+            "\nReturns the txids of one or more addresses in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"addresses\"     (string or object, required) An rdct address, or an object\n"
+            "   {\n"
+            "     \"addresses\"\n"
+            "       [\n"
+            "         \"address\"  (string) The rdct address\n"
+            "         ,...\n"
+            "       ]\n"
+            "     \"start\" (number, optional) The start block height\n"
+            "     \"end\"   (number, optional) The end block height\n"
+            "   }\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\"]}"));
+
+    EnsureAddressIndexesReady(fAddressIndex, "address");
+
+    int start, end;
+    ParseAddressIndexRange(params[0], start, end);
+
+    std::vector<std::pair<uint160, int> > addresses;
+    ParseAddressIndexParams(params[0], addresses);
+
+    // Entries of one address come in chain order, several addresses are merged by height
+    std::set<std::pair<int, std::pair<unsigned int, uint256> > > txids;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++)
+            txids.insert(std::make_pair(itIndex->first.blockHeight, std::make_pair(itIndex->first.txindex, itIndex->first.txhash)));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::set<std::pair<int, std::pair<unsigned int, uint256> > >::const_iterator it = txids.begin(); it != txids.end(); it++)
+        result.push_back(it->second.second.GetHex());
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo\n"
+            "\nReturns the txid and index where an output is spent (requires -spentindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"txid\" (string) The hex string of the txid\n"
+            "  \"index\" (number) The output index\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\"  (string) The transaction id\n"
+            "  \"index\"  (number) The spending input index\n"
+            "  \"height\"  (number) The height of the block containing the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    EnsureAddressIndexesReady(fSpentIndex, "spent");
+
+    UniValue txidValue = find_value(params[0].get_obj(), "txid");
+    UniValue indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    uint256 txid = ParseHashV(txidValue, "txid");
+    CSpentIndexKey key(txid, indexValue.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    return obj;
+}
+
 UniValue setmocktime(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
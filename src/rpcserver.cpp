@@ -280,6 +280,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockcount", &getblockcount, true, false, false},
         {"blockchain", "getblock", &getblock, true, false, false},
         {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getblockhashes", &getblockhashes, true, false, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
@@ -315,6 +316,13 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddressdeltas", &getaddressdeltas, true, false, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+        {"addressindex", "getspentinfo", &getspentinfo, true, false, false},
+
         /* Utility functions */
         {"util", "createmultisig", &createmultisig, true, true, false},
         {"util", "validateaddress", &validateaddress, true, false, false}, /* uses wallet if enabled */
@@ -331,6 +339,8 @@ static const CRPCCommand vRPCCommands[] =
         {"rdct", "masternode", &masternode, true, true, false},
         {"rdct", "listmasternodes", &listmasternodes, true, true, false},
         {"rdct", "getmasternodecount", &getmasternodecount, true, true, false},
+        {"rdct", "getmessagecacheinfo", &getmessagecacheinfo, true, false, false},
+        {"rdct", "getswifttxinfo", &getswifttxinfo, true, false, false},
         {"rdct", "masternodeconnect", &masternodeconnect, true, true, false},
         {"rdct", "masternodecurrent", &masternodecurrent, true, true, false},
         {"rdct", "masternodedebug", &masternodedebug, true, true, false},
@@ -357,6 +367,7 @@ static const CRPCCommand vRPCCommands[] =
 #ifdef ENABLE_WALLET
 
         /* Wallet */
+        {"wallet", "abortrescan", &abortrescan, true, true, true},
         {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
         {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
         {"wallet", "backupwallet", &backupwallet, true, false, true},
@@ -364,6 +375,7 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "dumpwallet", &dumpwallet, true, false, true},
         {"wallet", "bip38encrypt", &bip38encrypt, true, false, true},
         {"wallet", "bip38decrypt", &bip38decrypt, true, false, true},
+        {"wallet", "bip38decryptbatch", &bip38decryptbatch, true, true, true},
         {"wallet", "encryptwallet", &encryptwallet, true, false, true},
         {"wallet", "getaccountaddress", &getaccountaddress, true, false, true},
         {"wallet", "getaccount", &getaccount, true, false, true},
@@ -378,9 +390,9 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "gettransaction", &gettransaction, false, false, true},
         {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
         {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
-        {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
+        {"wallet", "importprivkey", &importprivkey, true, true, true},
+        {"wallet", "importwallet", &importwallet, true, true, true},
+        {"wallet", "importaddress", &importaddress, true, true, true},
         {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
         {"wallet", "listaccounts", &listaccounts, false, false, true},
         {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
@@ -1604,19 +1604,20 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
 {
     if (pwalletMain->IsCrypted() && (fHelp || params.size() < 2 || params.size() > 3))
         throw runtime_error(
-            "walletpassphrase \"passphrase\" timeout\n"
+            "walletpassphrase \"passphrase\" timeout ( stakingonly )\n"
             "\nStores the wallet decryption key in memory for 'timeout' seconds.\n"
             "This is needed prior to performing transactions related to private keys such as sending RDCTs\n"
             "\nArguments:\n"
             "1. \"passphrase\"     (string, required) The wallet passphrase\n"
             "2. timeout            (numeric, required) The time to keep the decryption key in seconds.\n"
+            "3. stakingonly        (boolean, optional, default=false) Flag the unlock as for staking, as the GUI does, and decrypt the staking keys in the background\n"
             "\nNote:\n"
             "Issuing the walletpassphrase command while the wallet is already unlocked will set a new unlock\n"
             "time that overrides the old one. A timeout of \"0\" unlocks until the wallet is closed.\n"
             "\nExamples:\n"
             "\nUnlock the wallet for 60 seconds\n" +
             HelpExampleCli("walletpassphrase", "\"my pass phrase\" 60") +
-            "\nUnlock the wallet for 60 seconds but allow Obfuscation only\n" + HelpExampleCli("walletpassphrase", "\"my pass phrase\" 60 true") +
+            "\nUnlock the wallet for staking until it is locked again\n" + HelpExampleCli("walletpassphrase", "\"my pass phrase\" 0 true") +
             "\nLock the wallet again (before 60 seconds)\n" + HelpExampleCli("walletlock", "") +
             "\nAs json rpc call\n" + HelpExampleRpc("walletpassphrase", "\"my pass phrase\", 60"));
 
@@ -1635,11 +1636,19 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
     if (!pwalletMain->IsLocked())
         throw JSONRPCError(RPC_WALLET_ALREADY_UNLOCKED, "Error: Wallet is already unlocked.");
 
-    if (!pwalletMain->Unlock(strWalletPass))
+    bool fStakingOnly = false;
+    if (params.size() > 2)
+        fStakingOnly = params[2].get_bool();
+
+    if (!pwalletMain->Unlock(strWalletPass, fStakingOnly))
         throw JSONRPCError(RPC_WALLET_PASSPHRASE_INCORRECT, "Error: The wallet passphrase entered was incorrect.");
 
     pwalletMain->TopUpKeyPool();
 
+    // Every stake attempt signs with one of these, so decrypt them all up front, side by side
+    if (fStakingOnly)
+        pwalletMain->StartWarmStakingKeyCache();
+
     int64_t nSleepTime = params[1].get_int64();
     LOCK(cs_nWalletUnlockTime);
     nWalletUnlockTime = GetTime() + nSleepTime;
@@ -1918,6 +1927,11 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             "  \"keypoololdest\": xxxxxx,    (numeric) the timestamp (seconds since GMT epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
+            "  \"scanning\":                 (json object or false) progress of the running wallet rescan, false if none\n"
+            "  {\n"
+            "    \"duration\": xxxx,         (numeric) elapsed seconds since the rescan started\n"
+            "    \"progress\": x.xxxx,       (numeric) share of the blocks to rescan that were scanned\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getwalletinfo", "") + HelpExampleRpc("getwalletinfo", ""));
@@ -1930,6 +1944,16 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    if (pwalletMain->IsScanning()) {
+        int64_t nDuration;
+        double dProgress;
+        pwalletMain->GetScanProgress(nDuration, dProgress);
+        UniValue scanning(UniValue::VOBJ);
+        scanning.push_back(Pair("duration", nDuration / 1000));
+        scanning.push_back(Pair("progress", dProgress));
+        obj.push_back(Pair("scanning", scanning));
+    } else
+        obj.push_back(Pair("scanning", false));
     return obj;
 }
 
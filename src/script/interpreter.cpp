@@ -16,8 +16,6 @@
 
 using namespace std;
 
-typedef vector<unsigned char> valtype;
-
 namespace {
 
 inline bool set_success(ScriptError* ret)
@@ -36,7 +34,7 @@ inline bool set_error(ScriptError* ret, const ScriptError serror)
 
 } // anon namespace
 
-bool CastToBool(const valtype& vch)
+bool CastToBool(const CScriptStackElement& vch)
 {
     for (unsigned int i = 0; i < vch.size(); i++)
     {
@@ -57,14 +55,20 @@ bool CastToBool(const valtype& vch)
  */
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
-static inline void popstack(vector<valtype>& stack)
+static inline void popstack(CScriptStack& stack)
 {
     if (stack.empty())
         throw runtime_error("popstack() : stack empty");
     stack.pop_back();
 }
 
-bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
+static inline void pushnum(CScriptStack& stack, const CScriptNum& bn)
+{
+    stack.push_back(CScriptStackElement());
+    bn.getvch(stack.back());
+}
+
+bool static IsCompressedOrUncompressedPubKey(const CScriptStackElement &vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
         return false;
@@ -96,7 +100,7 @@ bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
  *
  * This function is consensus-critical since BIP66.
  */
-bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
+bool static IsValidSignatureEncoding(const CScriptStackElement &sig) {
     // Format: 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S] [sighash]
     // * total-length: 1-byte length descriptor of everything that follows,
     //   excluding the sighash byte.
@@ -161,7 +165,7 @@ bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
     return true;
 }
 
-bool static IsLowDERSignature(const valtype &vchSig, ScriptError* serror) {
+bool static IsLowDERSignature(const CScriptStackElement &vchSig, ScriptError* serror) {
     if (!IsValidSignatureEncoding(vchSig)) {
         return set_error(serror, SCRIPT_ERR_SIG_DER);
     }
@@ -177,7 +181,7 @@ bool static IsLowDERSignature(const valtype &vchSig, ScriptError* serror) {
     return true;
 }
 
-bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
+bool static IsDefinedHashtypeSignature(const CScriptStackElement &vchSig) {
     if (vchSig.size() == 0) {
         return false;
     }
@@ -188,7 +192,7 @@ bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
     return true;
 }
 
-bool static CheckSignatureEncoding(const valtype &vchSig, unsigned int flags, ScriptError* serror) {
+bool static CheckSignatureEncoding(const CScriptStackElement &vchSig, unsigned int flags, ScriptError* serror) {
     // Empty signature. Not strictly DER encoded, but allowed to provide a
     // compact way to provide an invalid signature for use with CHECK(MULTI)SIG
     if (vchSig.size() == 0) {
@@ -205,14 +209,14 @@ bool static CheckSignatureEncoding(const valtype &vchSig, unsigned int flags, Sc
     return true;
 }
 
-bool static CheckPubKeyEncoding(const valtype &vchSig, unsigned int flags, ScriptError* serror) {
+bool static CheckPubKeyEncoding(const CScriptStackElement &vchSig, unsigned int flags, ScriptError* serror) {
     if ((flags & SCRIPT_VERIFY_STRICTENC) != 0 && !IsCompressedOrUncompressedPubKey(vchSig)) {
         return set_error(serror, SCRIPT_ERR_PUBKEYTYPE);
     }
     return true;
 }
 
-bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
+bool static CheckMinimalPush(const CScriptStackElement& data, opcodetype opcode) {
     if (data.size() == 0) {
         // Could have used OP_0.
         return opcode == OP_0;
@@ -235,23 +239,23 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     return true;
 }
 
-bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+bool EvalScript(CScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
     static const CScriptNum bnFalse(0);
     static const CScriptNum bnTrue(1);
-    static const valtype vchFalse(0);
-    static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
+    static const CScriptStackElement vchFalse(0);
+    static const CScriptStackElement vchZero(0);
+    static const CScriptStackElement vchTrue(1, (unsigned char)1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
-    valtype vchPushValue;
+    CScriptStackElement vchPushValue;
     vector<bool> vfExec;
-    vector<valtype> altstack;
+    CScriptStack altstack;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > 10000)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -324,7 +328,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -354,7 +358,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     {
                         if (stack.size() < 1)
                             return set_error(serror, SCRIPT_ERR_UNBALANCED_CONDITIONAL);
-                        valtype& vch = stacktop(-1);
+                        CScriptStackElement& vch = stacktop(-1);
                         fValue = CastToBool(vch);
                         if (opcode == OP_NOTIF)
                             fValue = !fValue;
@@ -437,8 +441,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
+                    CScriptStackElement vch1 = stacktop(-2);
+                    CScriptStackElement vch2 = stacktop(-1);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                 }
@@ -449,9 +453,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
+                    CScriptStackElement vch1 = stacktop(-3);
+                    CScriptStackElement vch2 = stacktop(-2);
+                    CScriptStackElement vch3 = stacktop(-1);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                     stack.push_back(vch3);
@@ -463,8 +467,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
+                    CScriptStackElement vch1 = stacktop(-4);
+                    CScriptStackElement vch2 = stacktop(-3);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                 }
@@ -475,8 +479,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    CScriptStackElement vch1 = stacktop(-6);
+                    CScriptStackElement vch2 = stacktop(-5);
                     stack.erase(stack.end()-6, stack.end()-4);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
@@ -498,7 +502,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
+                    CScriptStackElement vch = stacktop(-1);
                     if (CastToBool(vch))
                         stack.push_back(vch);
                 }
@@ -508,7 +512,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -526,7 +530,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
+                    CScriptStackElement vch = stacktop(-1);
                     stack.push_back(vch);
                 }
                 break;
@@ -545,7 +549,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-2);
+                    CScriptStackElement vch = stacktop(-2);
                     stack.push_back(vch);
                 }
                 break;
@@ -561,7 +565,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n-1);
+                    CScriptStackElement vch = stacktop(-n-1);
                     if (opcode == OP_ROLL)
                         stack.erase(stack.end()-n-1);
                     stack.push_back(vch);
@@ -594,7 +598,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
+                    CScriptStackElement vch = stacktop(-1);
                     stack.insert(stack.end()-2, vch);
                 }
                 break;
@@ -606,7 +610,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -621,8 +625,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 - bool)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype& vch1 = stacktop(-2);
-                    valtype& vch2 = stacktop(-1);
+                    CScriptStackElement& vch1 = stacktop(-2);
+                    CScriptStackElement& vch2 = stacktop(-1);
                     bool fEqual = (vch1 == vch2);
                     // OP_NOTEQUAL is disabled because it would be too easy to say
                     // something like n != 1 and have some wiseguy pass in 1 with extra
@@ -668,7 +672,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -717,7 +721,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -758,18 +762,18 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (in -- hash)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    CScriptStackElement& vch = stacktop(-1);
+                    CScriptStackElement vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
                     if (opcode == OP_RIPEMD160)
-                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_SHA1)
-                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA1().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_SHA256)
-                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_HASH160)
-                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CHash160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_HASH256)
-                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CHash256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     popstack(stack);
                     stack.push_back(vchHash);
                 }
@@ -789,14 +793,17 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
 
-                    valtype& vchSig    = stacktop(-2);
-                    valtype& vchPubKey = stacktop(-1);
+                    CScriptStackElement& vchSig    = stacktop(-2);
+                    CScriptStackElement& vchPubKey = stacktop(-1);
 
                     // Subset of script starting at the most recent codeseparator
                     CScript scriptCode(pbegincodehash, pend);
 
-                    // Drop the signature, since there's no way for a signature to sign itself
-                    scriptCode.FindAndDelete(CScript(vchSig));
+                    // Drop the signature, since there's no way for a signature to sign itself.
+                    // Its push is longer than the signature, so a script no longer than
+                    // that cannot contain it.
+                    if (scriptCode.size() > vchSig.size())
+                        scriptCode.FindAndDelete(CScript() << vchSig);
 
                     if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
                         //serror is set
@@ -851,15 +858,16 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // Drop the signatures, since there's no way for a signature to sign itself
                     for (int k = 0; k < nSigsCount; k++)
                     {
-                        valtype& vchSig = stacktop(-isig-k);
-                        scriptCode.FindAndDelete(CScript(vchSig));
+                        CScriptStackElement& vchSig = stacktop(-isig-k);
+                        if (scriptCode.size() > vchSig.size())
+                            scriptCode.FindAndDelete(CScript() << vchSig);
                     }
 
                     bool fSuccess = true;
                     while (fSuccess && nSigsCount > 0)
                     {
-                        valtype& vchSig    = stacktop(-isig);
-                        valtype& vchPubKey = stacktop(-ikey);
+                        CScriptStackElement& vchSig    = stacktop(-isig);
+                        CScriptStackElement& vchPubKey = stacktop(-ikey);
 
                         // Note how this makes the exact order of pubkey/signature evaluation
                         // distinguishable by CHECKMULTISIG NOT if the STRICTENC flag is set.
@@ -934,8 +942,47 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     return set_success(serror);
 }
 
+bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    CScriptStack stackElements;
+    stackElements.reserve(stack.size());
+    for (unsigned int i = 0; i < stack.size(); i++)
+        stackElements.push_back(CScriptStackElement(stack[i].begin(), stack[i].end()));
+
+    bool fRet = EvalScript(stackElements, script, flags, checker, serror);
+
+    stack.clear();
+    stack.reserve(stackElements.size());
+    for (unsigned int i = 0; i < stackElements.size(); i++)
+        stack.push_back(vector<unsigned char>(stackElements[i].begin(), stackElements[i].end()));
+    return fRet;
+}
+
 namespace {
 
+/** Serialize scriptCode as a script, skipping OP_CODESEPARATORs */
+template<typename S>
+void SerializeScriptCode(S &s, const CScript &scriptCode) {
+    CScript::const_iterator it = scriptCode.begin();
+    CScript::const_iterator itBegin = it;
+    opcodetype opcode;
+    unsigned int nCodeSeparators = 0;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR)
+            nCodeSeparators++;
+    }
+    ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+    it = itBegin;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR) {
+            s.write((char*)&itBegin[0], it-itBegin-1);
+            itBegin = it;
+        }
+    }
+    if (itBegin != scriptCode.end())
+        s.write((char*)&itBegin[0], it-itBegin);
+}
+
 /**
  * Wrapper that serializes like CTransaction, but with the modifications
  *  required for the signature hash done in-place
@@ -959,24 +1006,7 @@ public:
     /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
     template<typename S>
     void SerializeScriptCode(S &s, int nType, int nVersion) const {
-        CScript::const_iterator it = scriptCode.begin();
-        CScript::const_iterator itBegin = it;
-        opcodetype opcode;
-        unsigned int nCodeSeparators = 0;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR)
-                nCodeSeparators++;
-        }
-        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
-        it = itBegin;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR) {
-                s.write((char*)&itBegin[0], it-itBegin-1);
-                itBegin = it;
-            }
-        }
-        if (itBegin != scriptCode.end())
-            s.write((char*)&itBegin[0], it-itBegin);
+        ::SerializeScriptCode(s, scriptCode);
     }
 
     /** Serialize an input of txTo */
@@ -1057,25 +1087,130 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     return ss.GetHash();
 }
 
+CSignatureHashCache::CSignatureHashCache(const CTransaction& txTo) : ssInputs(SER_GETHASH, 0), ssInputsBlank(SER_GETHASH, 0), ssOutputs(SER_GETHASH, 0)
+{
+    Init(txTo);
+}
+
+CSignatureHashCache::CSignatureHashCache(const CMutableTransaction& txTo) : ssInputs(SER_GETHASH, 0), ssInputsBlank(SER_GETHASH, 0), ssOutputs(SER_GETHASH, 0)
+{
+    Init(txTo);
+}
+
+template <typename T>
+void CSignatureHashCache::Init(const T& txTo)
+{
+    nVersion = txTo.nVersion;
+    nLockTime = txTo.nLockTime;
+
+    unsigned int nInputs = txTo.vin.size();
+    vPrevout.reserve(nInputs);
+    vSequence.reserve(nInputs);
+    vInputPos.reserve(nInputs + 1);
+    vInputPos.push_back(0);
+    for (unsigned int i = 0; i < nInputs; i++) {
+        const CTxIn& txin = txTo.vin[i];
+        vPrevout.push_back(txin.prevout);
+        vSequence.push_back(txin.nSequence);
+        ssInputs << txin.prevout << CScript() << txin.nSequence;
+        ssInputsBlank << txin.prevout << CScript() << (int)0;
+        vInputPos.push_back(ssInputs.size());
+    }
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << nVersion;
+    ::WriteCompactSize(ss, nInputs);
+    vMidstate.reserve(nInputs);
+    vMidstateBlank.reserve(nInputs);
+    vMidstate.push_back(ss);
+    vMidstateBlank.push_back(ss);
+    for (unsigned int i = 1; i < nInputs; i++) {
+        vMidstate.push_back(vMidstate.back());
+        vMidstate.back().write(&ssInputs[vInputPos[i - 1]], vInputPos[i] - vInputPos[i - 1]);
+        vMidstateBlank.push_back(vMidstateBlank.back());
+        vMidstateBlank.back().write(&ssInputsBlank[vInputPos[i - 1]], vInputPos[i] - vInputPos[i - 1]);
+    }
+
+    vOutputPos.reserve(txTo.vout.size() + 1);
+    vOutputPos.push_back(0);
+    for (unsigned int i = 0; i < txTo.vout.size(); i++) {
+        ssOutputs << txTo.vout[i];
+        vOutputPos.push_back(ssOutputs.size());
+    }
+}
+
+uint256 CSignatureHashCache::SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const
+{
+    unsigned int nInputs = vPrevout.size();
+    unsigned int nOutputs = vOutputPos.size() - 1;
+    if (nIn >= nInputs) {
+        //  nIn out of range
+        return 1;
+    }
+
+    const bool fAnyoneCanPay = !!(nHashType & SIGHASH_ANYONECANPAY);
+    const bool fHashSingle = (nHashType & 0x1f) == SIGHASH_SINGLE;
+    const bool fHashNone = (nHashType & 0x1f) == SIGHASH_NONE;
+    if (fHashSingle && nIn >= nOutputs) {
+        //  nOut out of range
+        return 1;
+    }
+
+    // Everything up to the input being signed
+    CHashWriter ss(SER_GETHASH, 0);
+    if (fAnyoneCanPay) {
+        ss << nVersion;
+        ::WriteCompactSize(ss, 1);
+    } else {
+        ss = (fHashSingle || fHashNone) ? vMidstateBlank[nIn] : vMidstate[nIn];
+    }
+
+    // The input being signed, then the ones after it
+    ss << vPrevout[nIn];
+    ::SerializeScriptCode(ss, scriptCode);
+    ss << vSequence[nIn];
+    if (!fAnyoneCanPay && nIn + 1 < nInputs) {
+        const CDataStream& ssAfter = (fHashSingle || fHashNone) ? ssInputsBlank : ssInputs;
+        ss.write(&ssAfter[vInputPos[nIn + 1]], vInputPos[nInputs] - vInputPos[nIn + 1]);
+    }
+
+    // Outputs
+    if (fHashNone) {
+        ::WriteCompactSize(ss, 0);
+    } else if (fHashSingle) {
+        ::WriteCompactSize(ss, nIn + 1);
+        // Do not lock-in the txout payee at other indices as txin
+        for (unsigned int i = 0; i < nIn; i++)
+            ss << CTxOut();
+        ss.write(&ssOutputs[vOutputPos[nIn]], vOutputPos[nIn + 1] - vOutputPos[nIn]);
+    } else {
+        ::WriteCompactSize(ss, nOutputs);
+        if (nOutputs > 0)
+            ss.write(&ssOutputs[0], ssOutputs.size());
+    }
+
+    ss << nLockTime << nHashType;
+    return ss.GetHash();
+}
+
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     return pubkey.Verify(sighash, vchSig);
 }
 
-bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn, const vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+bool TransactionSignatureChecker::CheckSig(const CScriptStackElement& vchSigIn, const CScriptStackElement& vchPubKey, const CScript& scriptCode) const
 {
-    CPubKey pubkey(vchPubKey);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
     if (!pubkey.IsValid())
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    vector<unsigned char> vchSig(vchSigIn);
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
-    int nHashType = vchSig.back();
-    vchSig.pop_back();
+    int nHashType = vchSigIn.back();
+    vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.end() - 1);
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = sighashCache ? sighashCache->SignatureHash(scriptCode, nIn, nHashType) : SignatureHash(scriptCode, *txTo, nIn, nHashType);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1091,7 +1226,8 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    vector<vector<unsigned char> > stack, stackCopy;
+    // The stacks of standard scripts fit in their inline storage, in this frame
+    CScriptStack stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, serror))
         // serror is set
         return false;
@@ -1118,7 +1254,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         // an empty stack and the EvalScript above would return false.
         assert(!stackCopy.empty());
 
-        const valtype& pubKeySerialized = stackCopy.back();
+        const CScriptStackElement& pubKeySerialized = stackCopy.back();
         CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
         popstack(stackCopy);
 
@@ -7,7 +7,10 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "hash.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
+#include "streams.h"
 
 #include <vector>
 #include <stdint.h>
@@ -72,12 +75,58 @@ enum
 
 };
 
+/**
+ * Element of the script stack. Signatures and public keys, which is all that
+ * the scripts of standard transactions push, are kept inline.
+ */
+typedef prevector<80, unsigned char> CScriptStackElement;
+
+/** Script stack, with inline room for the elements of standard scripts */
+typedef prevector<16, CScriptStackElement> CScriptStack;
+
 uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 
+/**
+ * The parts of a transaction's signature hash serialization that do not depend on
+ * the input being signed or its scriptCode, computed once per transaction. The
+ * hash state after the version and each prefix of the blanked inputs is kept, so
+ * every SignatureHash starts from the input it signs instead of from the version,
+ * and the remaining inputs and the outputs are hashed from bytes serialized here
+ * once rather than reserialized for every input. Results are identical to
+ * ::SignatureHash. Nothing changes after construction, so one cache can be shared
+ * by the checks of all inputs of a transaction across threads.
+ */
+class CSignatureHashCache
+{
+private:
+    int32_t nVersion;
+    uint32_t nLockTime;
+    std::vector<COutPoint> vPrevout;
+    std::vector<uint32_t> vSequence;
+    //! every input with an empty script, with its own and with a zero nSequence
+    CDataStream ssInputs;
+    CDataStream ssInputsBlank;
+    std::vector<unsigned int> vInputPos;
+    //! hash state after the version, input count and the first k inputs
+    std::vector<CHashWriter> vMidstate;
+    std::vector<CHashWriter> vMidstateBlank;
+    CDataStream ssOutputs;
+    std::vector<unsigned int> vOutputPos;
+
+    template <typename T>
+    void Init(const T& txTo);
+
+public:
+    explicit CSignatureHashCache(const CTransaction& txTo);
+    explicit CSignatureHashCache(const CMutableTransaction& txTo);
+
+    uint256 SignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const;
+};
+
 class BaseSignatureChecker
 {
 public:
-    virtual bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+    virtual bool CheckSig(const CScriptStackElement& scriptSig, const CScriptStackElement& vchPubKey, const CScript& scriptCode) const
     {
         return false;
     }
@@ -90,13 +139,15 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const CSignatureHashCache* sighashCache;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
-    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
+    //! txToIn may be NULL when a sighash cache of the transaction is given
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CSignatureHashCache* sighashCacheIn = NULL) : txTo(txToIn), nIn(nInIn), sighashCache(sighashCacheIn) {}
+    bool CheckSig(const CScriptStackElement& scriptSig, const CScriptStackElement& vchPubKey, const CScript& scriptCode) const;
 };
 
 class MutableTransactionSignatureChecker : public TransactionSignatureChecker
@@ -108,6 +159,8 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
 };
 
+bool EvalScript(CScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
+/** Same, on a copy of the stack in the stack's representation */
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 
@@ -243,6 +243,25 @@ bool CScript::IsPayToScriptHash() const
             this->at(22) == OP_EQUAL);
 }
 
+bool CScript::IsPayToPublicKeyHash() const
+{
+    // Extra-fast test for pay-to-pubkey-hash CScripts:
+    return (this->size() == 25 &&
+            this->at(0) == OP_DUP &&
+            this->at(1) == OP_HASH160 &&
+            this->at(2) == 0x14 &&
+            this->at(23) == OP_EQUALVERIFY &&
+            this->at(24) == OP_CHECKSIG);
+}
+
+bool CScript::IsPayToPublicKey() const
+{
+    // Extra-fast test for pay-to-pubkey CScripts with a direct push of the key:
+    return (this->size() >= 35 && this->size() <= 67 &&
+            this->at(0) == this->size() - 2 &&
+            this->back() == OP_CHECKSIG);
+}
+
 bool CScript::IsPushOnly(const_iterator pc) const
 {
     while (pc < end())
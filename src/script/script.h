@@ -196,7 +196,9 @@ public:
         m_value = n;
     }
 
-    explicit CScriptNum(const std::vector<unsigned char>& vch, bool fRequireMinimal)
+    /** vch is a std::vector or a prevector, such as a script stack element */
+    template <typename T>
+    explicit CScriptNum(const T& vch, bool fRequireMinimal)
     {
         if (vch.size() > nMaxNumSize) {
             throw scriptnum_error("script number overflow");
@@ -286,12 +288,27 @@ public:
         return serialize(m_value);
     }
 
+    /** Serialize into result, which can reuse its storage */
+    template <typename T>
+    void getvch(T& result) const
+    {
+        serialize(m_value, result);
+    }
+
     static std::vector<unsigned char> serialize(const int64_t& value)
     {
+        std::vector<unsigned char> result;
+        serialize(value, result);
+        return result;
+    }
+
+    template <typename T>
+    static void serialize(const int64_t& value, T& result)
+    {
+        result.clear();
         if(value == 0)
-            return std::vector<unsigned char>();
+            return;
 
-        std::vector<unsigned char> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -315,14 +332,13 @@ public:
             result.push_back(neg ? 0x80 : 0);
         else if (neg)
             result.back() |= 0x80;
-
-        return result;
     }
 
     static const size_t nMaxNumSize = 4;
 
 private:
-    static int64_t set_vch(const std::vector<unsigned char>& vch)
+    template <typename T>
+    static int64_t set_vch(const T& vch)
     {
       if (vch.empty())
           return 0;
@@ -342,8 +358,20 @@ private:
     int64_t m_value;
 };
 
+/**
+ * Storage of CScript. A script used to be a 24 byte std::vector; with 40 bytes
+ * inline and the size field it takes 48 on 64-bit, so every CTxIn and CTxOut,
+ * and their copies in the mempool and wallet, is 24 bytes larger. What it buys
+ * is no heap allocation for the scripts most outputs carry: P2PKH (25 bytes),
+ * P2SH (23) and the compressed pay-to-pubkey (35) of every coinstake output.
+ * Bitcoin Core's 28 (32 in all) covers the first two, but would send each
+ * coinstake script to the heap: 32 plus a malloc'd block of 48 or so, more than
+ * the 48 taken inline here.
+ */
+typedef prevector<40, unsigned char> CScriptBase;
+
 /** Serialized script, used inside transaction inputs and outputs */
-class CScript : public std::vector<unsigned char>
+class CScript : public CScriptBase
 {
 protected:
     CScript& push_int64(int64_t n)
@@ -362,14 +390,43 @@ protected:
         }
         return *this;
     }
+
+    template <typename T>
+    CScript& push_data(const T& b)
+    {
+        if (b.size() < OP_PUSHDATA1)
+        {
+            insert(end(), (unsigned char)b.size());
+        }
+        else if (b.size() <= 0xff)
+        {
+            insert(end(), OP_PUSHDATA1);
+            insert(end(), (unsigned char)b.size());
+        }
+        else if (b.size() <= 0xffff)
+        {
+            insert(end(), OP_PUSHDATA2);
+            unsigned short nSize = b.size();
+            insert(end(), (unsigned char*)&nSize, (unsigned char*)&nSize + sizeof(nSize));
+        }
+        else
+        {
+            insert(end(), OP_PUSHDATA4);
+            unsigned int nSize = b.size();
+            insert(end(), (unsigned char*)&nSize, (unsigned char*)&nSize + sizeof(nSize));
+        }
+        insert(end(), b.begin(), b.end());
+        return *this;
+    }
 public:
     CScript() { }
-    CScript(const CScript& b) : std::vector<unsigned char>(b.begin(), b.end()) { }
-    CScript(const_iterator pbegin, const_iterator pend) : std::vector<unsigned char>(pbegin, pend) { }
-    CScript(const unsigned char* pbegin, const unsigned char* pend) : std::vector<unsigned char>(pbegin, pend) { }
+    CScript(const_iterator pbegin, const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(std::vector<unsigned char>::const_iterator pbegin, std::vector<unsigned char>::const_iterator pend) : CScriptBase(pbegin, pend) { }
 
     CScript& operator+=(const CScript& b)
     {
+        // b may be this script, which must not move while it is copied
+        reserve(size() + b.size());
         insert(end(), b.begin(), b.end());
         return *this;
     }
@@ -406,29 +463,14 @@ public:
 
     CScript& operator<<(const std::vector<unsigned char>& b)
     {
-        if (b.size() < OP_PUSHDATA1)
-        {
-            insert(end(), (unsigned char)b.size());
-        }
-        else if (b.size() <= 0xff)
-        {
-            insert(end(), OP_PUSHDATA1);
-            insert(end(), (unsigned char)b.size());
-        }
-        else if (b.size() <= 0xffff)
-        {
-            insert(end(), OP_PUSHDATA2);
-            unsigned short nSize = b.size();
-            insert(end(), (unsigned char*)&nSize, (unsigned char*)&nSize + sizeof(nSize));
-        }
-        else
-        {
-            insert(end(), OP_PUSHDATA4);
-            unsigned int nSize = b.size();
-            insert(end(), (unsigned char*)&nSize, (unsigned char*)&nSize + sizeof(nSize));
-        }
-        insert(end(), b.begin(), b.end());
-        return *this;
+        return push_data(b);
+    }
+
+    /** Push the data of a script stack element */
+    template <unsigned int N>
+    CScript& operator<<(const prevector<N, unsigned char>& b)
+    {
+        return push_data(b);
     }
 
     CScript& operator<<(const CScript& b)
@@ -458,22 +500,25 @@ public:
     bool GetOp(iterator& pc, opcodetype& opcodeRet)
     {
          const_iterator pc2 = pc;
-         bool fRet = GetOp2(pc2, opcodeRet, NULL);
+         bool fRet = GetOp2(pc2, opcodeRet, (std::vector<unsigned char>*)NULL);
          pc = begin() + (pc2 - begin());
          return fRet;
     }
 
-    bool GetOp(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>& vchRet) const
+    /** vchRet is a std::vector or a prevector, such as a script stack element */
+    template <typename T>
+    bool GetOp(const_iterator& pc, opcodetype& opcodeRet, T& vchRet) const
     {
         return GetOp2(pc, opcodeRet, &vchRet);
     }
 
     bool GetOp(const_iterator& pc, opcodetype& opcodeRet) const
     {
-        return GetOp2(pc, opcodeRet, NULL);
+        return GetOp2(pc, opcodeRet, (std::vector<unsigned char>*)NULL);
     }
 
-    bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet) const
+    template <typename T>
+    bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, T* pvchRet) const
     {
         opcodeRet = OP_INVALIDOPCODE;
         if (pvchRet)
@@ -587,6 +632,8 @@ public:
 
     bool IsNormalPaymentScript() const;
     bool IsPayToScriptHash() const;
+    bool IsPayToPublicKeyHash() const;
+    bool IsPayToPublicKey() const;
 
     /** Called by IsStandardTx and P2SH/BIP62 VerifyScript (which makes it consensus-critical). */
     bool IsPushOnly(const_iterator pc) const;
@@ -605,9 +652,27 @@ public:
     std::string ToString() const;
     void clear()
     {
-        // The default std::vector::clear() does not release memory.
-        std::vector<unsigned char>().swap(*this);
+        // The default prevector::clear() does not release memory
+        CScriptBase::clear();
+        shrink_to_fit();
     }
 };
 
+inline unsigned int GetSerializeSize(const CScript& v, int nType, int nVersion)
+{
+    return GetSerializeSize(static_cast<const CScriptBase&>(v), nType, nVersion);
+}
+
+template <typename Stream>
+void Serialize(Stream& os, const CScript& v, int nType, int nVersion)
+{
+    Serialize(os, static_cast<const CScriptBase&>(v), nType, nVersion);
+}
+
+template <typename Stream>
+void Unserialize(Stream& is, CScript& v, int nType, int nVersion)
+{
+    Unserialize(is, static_cast<CScriptBase&>(v), nType, nVersion);
+}
+
 #endif // BITCOIN_SCRIPT_SCRIPT_H
@@ -0,0 +1,267 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SEENCACHE_H
+#define BITCOIN_SEENCACHE_H
+
+#include "random.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <list>
+
+#include <boost/function.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+/** Kept entries an insert looks at most, so peers can't make every insert walk the whole map */
+static const unsigned int SEENCACHE_KEPT_PER_INSERT = 4;
+
+/** Hasher for keys picked by peers, salted so they can't aim for one bucket */
+class SaltedHashHasher
+{
+private:
+    uint256 salt;
+
+public:
+    SaltedHashHasher() : salt(GetRandHash()) {}
+    size_t operator()(const uint256& hash) const { return hash.GetHash(salt); }
+};
+
+/**
+ * STL-like map of messages seen on the network, bounded in both number and
+ * age of its entries. The oldest entries are evicted first, once they are older
+ * than the maximum age or when the map is over its maximum size. A maximum of
+ * 0 disables that bound. Serializes like a std::map, so the insertion times
+ * are not stored: a loaded entry starts its age again at load time, and the
+ * loaded entries are evicted in the order they were read. An owner that still
+ * serves some entries can have them kept past both bounds: those are checked
+ * again, from the back of the order, once the rest had their turn. An insert
+ * moves a few of them at most, expire() goes through all of them. When
+ * tracked, the keys of the entries inserted, replaced or erased are kept for
+ * the store that writes only those.
+ */
+template <typename K, typename V, typename Hash = SaltedHashHasher>
+class seencache
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef typename boost::unordered_map<K, V, Hash>::iterator iterator;
+    typedef typename boost::unordered_map<K, V, Hash>::const_iterator const_iterator;
+    typedef typename boost::unordered_map<K, V, Hash>::size_type size_type;
+    typedef boost::unordered_set<K, Hash> key_set;
+    typedef boost::function<bool(const K&, const V&)> keep_function;
+
+protected:
+    struct entry_info {
+        int64_t nTime;
+        K key;
+        size_t nUsage;
+    };
+    typedef std::list<entry_info> order_type;
+
+    boost::unordered_map<K, V, Hash> map;
+    //! entries in insertion order, oldest first
+    order_type order;
+    boost::unordered_map<K, typename order_type::iterator, Hash> mapOrder;
+    size_type nMaxSize;
+    int64_t nMaxAge;
+    size_t nUsage;
+    bool fTrackChanges;
+    //! keys changed since the owner last took them, when tracked
+    key_set setChanged;
+    //! entries it returns true for are never evicted
+    keep_function fnKeep;
+
+    void Changed(const K& k)
+    {
+        if (fTrackChanges)
+            setChanged.insert(k);
+    }
+
+    static size_t EntryUsage(const V& v)
+    {
+        // the node in each of the two maps and the list, plus what the value holds
+        return sizeof(value_type) + sizeof(entry_info) + sizeof(std::pair<const K, typename order_type::iterator>) +
+               8 * sizeof(void*) + ::GetSerializeSize(v, SER_NETWORK, PROTOCOL_VERSION);
+    }
+
+    void CopyOrder(const seencache& other)
+    {
+        for (typename order_type::const_iterator it = other.order.begin(); it != other.order.end(); ++it)
+            mapOrder.insert(std::make_pair(it->key, order.insert(order.end(), *it)));
+    }
+
+    void Expire(size_type nMaxKept)
+    {
+        int64_t nNow = GetTime();
+        // every entry is looked at once at most, up to nMaxKept kept ones move to the back
+        size_type nLeft = order.size();
+        while (nLeft-- > 0 && ((nMaxSize && map.size() > nMaxSize) || (nMaxAge && order.front().nTime < nNow - nMaxAge))) {
+            const K& key = order.front().key;
+            if (fnKeep && fnKeep(key, map.find(key)->second)) {
+                order.front().nTime = nNow;
+                order.splice(order.end(), order, order.begin());
+                if (--nMaxKept == 0)
+                    break;
+                continue;
+            }
+            erase(key);
+        }
+    }
+
+public:
+    seencache(size_type nMaxSizeIn = 0, int64_t nMaxAgeIn = 0) : nMaxSize(nMaxSizeIn), nMaxAge(nMaxAgeIn), nUsage(0), fTrackChanges(false) {}
+
+    // mapOrder points into order, so copies rebuild it
+    seencache(const seencache& other) : map(other.map), nMaxSize(other.nMaxSize), nMaxAge(other.nMaxAge), nUsage(other.nUsage), fTrackChanges(other.fTrackChanges), setChanged(other.setChanged), fnKeep(other.fnKeep)
+    {
+        CopyOrder(other);
+    }
+
+    seencache& operator=(const seencache& other)
+    {
+        if (this != &other) {
+            map = other.map;
+            order.clear();
+            mapOrder.clear();
+            CopyOrder(other);
+            nMaxSize = other.nMaxSize;
+            nMaxAge = other.nMaxAge;
+            nUsage = other.nUsage;
+            fTrackChanges = other.fTrackChanges;
+            setChanged = other.setChanged;
+            fnKeep = other.fnKeep;
+        }
+        return *this;
+    }
+
+    iterator begin() { return map.begin(); }
+    iterator end() { return map.end(); }
+    const_iterator begin() const { return map.begin(); }
+    const_iterator end() const { return map.end(); }
+    size_type size() const { return map.size(); }
+    bool empty() const { return map.empty(); }
+    iterator find(const key_type& k) { return map.find(k); }
+    const_iterator find(const key_type& k) const { return map.find(k); }
+    size_type count(const key_type& k) const { return map.count(k); }
+
+    std::pair<iterator, bool> insert(const value_type& x)
+    {
+        std::pair<iterator, bool> ret = map.insert(x);
+        if (ret.second) {
+            entry_info info;
+            info.nTime = GetTime();
+            info.key = x.first;
+            info.nUsage = EntryUsage(x.second);
+            mapOrder.insert(std::make_pair(x.first, order.insert(order.end(), info)));
+            nUsage += info.nUsage;
+            Changed(x.first);
+            Expire(SEENCACHE_KEPT_PER_INSERT);
+        }
+        return ret;
+    }
+
+    /**
+     * Insert the value of k, or replace the value of a known k and keep its
+     * age. Either way the memory of the value stored is what gets counted.
+     */
+    std::pair<iterator, bool> Insert(const key_type& k, const mapped_type& v)
+    {
+        iterator it = map.find(k);
+        if (it == map.end())
+            return insert(value_type(k, v));
+        entry_info& info = *mapOrder.find(k)->second;
+        nUsage -= info.nUsage;
+        info.nUsage = EntryUsage(v);
+        nUsage += info.nUsage;
+        it->second = v;
+        Changed(k);
+        return std::make_pair(it, false);
+    }
+
+    iterator erase(iterator it)
+    {
+        typename boost::unordered_map<K, typename order_type::iterator, Hash>::iterator itOrder = mapOrder.find(it->first);
+        nUsage -= itOrder->second->nUsage;
+        order.erase(itOrder->second);
+        mapOrder.erase(itOrder);
+        Changed(it->first);
+        return map.erase(it);
+    }
+
+    size_type erase(const key_type& k)
+    {
+        iterator it = map.find(k);
+        if (it == map.end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        if (fTrackChanges) {
+            for (const_iterator it = map.begin(); it != map.end(); ++it)
+                setChanged.insert(it->first);
+        }
+        map.clear();
+        order.clear();
+        mapOrder.clear();
+        nUsage = 0;
+    }
+
+    /** Evict entries past the maximum age or size, looking at every kept one */
+    void expire() { Expire(order.size()); }
+
+    size_type max_size() const { return nMaxSize; }
+    int64_t max_age() const { return nMaxAge; }
+    /** Approximate heap memory used by the entries */
+    size_t memory_usage() const { return nUsage; }
+
+    /** Never evict the entries fnKeepIn returns true for */
+    void keep_if(const keep_function& fnKeepIn) { fnKeep = fnKeepIn; }
+
+    /** Keep the keys of the entries that change from now on */
+    void track_changes() { fTrackChanges = true; }
+    /** Keys changed since the owner last cleared them */
+    key_set& changed_keys() { return setChanged; }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(map.size());
+        for (const_iterator mi = map.begin(); mi != map.end(); ++mi)
+            nSize += ::GetSerializeSize(mi->first, nType, nVersion) + ::GetSerializeSize(mi->second, nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, map.size());
+        for (const_iterator mi = map.begin(); mi != map.end(); ++mi) {
+            ::Serialize(s, mi->first, nType, nVersion);
+            ::Serialize(s, mi->second, nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        clear();
+        unsigned int nSize = ReadCompactSize(s);
+        for (unsigned int i = 0; i < nSize; i++) {
+            std::pair<K, V> item;
+            ::Unserialize(s, item.first, nType, nVersion);
+            ::Unserialize(s, item.second, nType, nVersion);
+            insert(item);
+        }
+    }
+};
+
+#endif // BITCOIN_SEENCACHE_H
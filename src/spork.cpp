@@ -14,6 +14,9 @@
 #include "sync.h"
 #include "sporkdb.h"
 #include "util.h"
+
+#include <atomic>
+
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -27,6 +30,71 @@ CSporkManager sporkManager;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
+static int64_t GetSporkDefault(int nSporkID)
+{
+    switch (nSporkID) {
+    case SPORK_2_SWIFTTX: return SPORK_2_SWIFTTX_DEFAULT;
+    case SPORK_3_SWIFTTX_BLOCK_FILTERING: return SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
+    case SPORK_5_MAX_VALUE: return SPORK_5_MAX_VALUE_DEFAULT;
+    case SPORK_7_MASTERNODE_SCANNING: return SPORK_7_MASTERNODE_SCANNING_DEFAULT;
+    case SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT: return SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
+    case SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT: return SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
+    case SPORK_10_MASTERNODE_PAY_UPDATED_NODES: return SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
+    case SPORK_11_RESET_BUDGET: return SPORK_11_RESET_BUDGET_DEFAULT;
+    case SPORK_12_RECONSIDER_BLOCKS: return SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
+    case SPORK_13_ENABLE_SUPERBLOCKS: return SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
+    case SPORK_14_NEW_PROTOCOL_ENFORCEMENT: return SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT;
+    case SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2: return SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2_DEFAULT;
+    case SPORK_16_MN_WINNER_MINIMUM_AGE: return SPORK_16_MN_WINNER_MINIMUM_AGE_DEFAULT;
+    }
+    return -1;
+}
+
+/**
+ * Current value of every spork, by nSporkID - SPORK_START. Sporks are checked
+ * from the masternode loops and block validation, so readers don't lock or go
+ * through mapSporksActive; the table only changes when a spork is accepted.
+ */
+class CSporkValues
+{
+private:
+    std::atomic<int64_t> values[SPORK_END - SPORK_START + 1];
+    //! whether a spork has a default or an accepted value, as -1 is a value a spork may have
+    std::atomic<bool> fKnown[SPORK_END - SPORK_START + 1];
+
+public:
+    CSporkValues()
+    {
+        for (int i = SPORK_START; i <= SPORK_END; i++) {
+            int64_t nDefault = GetSporkDefault(i);
+            values[i - SPORK_START].store(nDefault, std::memory_order_relaxed);
+            fKnown[i - SPORK_START].store(nDefault != -1, std::memory_order_relaxed);
+        }
+    }
+
+    bool Get(int nSporkID, int64_t& nValue) const
+    {
+        if (nSporkID < SPORK_START || nSporkID > SPORK_END) return false;
+        nValue = values[nSporkID - SPORK_START].load(std::memory_order_relaxed);
+        return fKnown[nSporkID - SPORK_START].load(std::memory_order_relaxed);
+    }
+
+    void Set(int nSporkID, int64_t nValue)
+    {
+        if (nSporkID < SPORK_START || nSporkID > SPORK_END) return;
+        values[nSporkID - SPORK_START].store(nValue, std::memory_order_relaxed);
+        fKnown[nSporkID - SPORK_START].store(true, std::memory_order_relaxed);
+    }
+};
+
+static CSporkValues sporkValues;
+
+void SetSporkActive(const CSporkMessage& spork)
+{
+    mapSporksActive[spork.nSporkID] = spork;
+    sporkValues.Set(spork.nSporkID, spork.nValue);
+}
+
 // RDCT: on startup load spork values from previous session if they exist in the sporkDB
 void LoadSporksFromDB()
 {
@@ -44,7 +112,7 @@ void LoadSporksFromDB()
 
         // add spork to memory
         mapSporks[spork.GetHash()] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        SetSporkActive(spork);
         std::time_t result = spork.nValue;
         // If SPORK Value is greater than 1,000,000 assume it's actually a Date and then convert to a more readable format
         if (spork.nValue > 1000000) {
@@ -93,7 +161,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
         }
 
         mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        SetSporkActive(spork);
         sporkManager.Relay(spork);
 
         // RDCT: add to spork database.
@@ -114,26 +182,8 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 int64_t GetSporkValue(int nSporkID)
 {
     int64_t r = -1;
-
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if (nSporkID == SPORK_2_SWIFTTX) r = SPORK_2_SWIFTTX_DEFAULT;
-        if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) r = SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
-        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if (nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING_DEFAULT;
-        if (nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
-        if (nSporkID == SPORK_11_RESET_BUDGET) r = SPORK_11_RESET_BUDGET_DEFAULT;
-        if (nSporkID == SPORK_12_RECONSIDER_BLOCKS) r = SPORK_12_RECONSIDER_BLOCKS_DEFAULT;
-        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-        if (nSporkID == SPORK_14_NEW_PROTOCOL_ENFORCEMENT) r = SPORK_14_NEW_PROTOCOL_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2) r = SPORK_15_NEW_PROTOCOL_ENFORCEMENT_2_DEFAULT;
-        if (nSporkID == SPORK_16_MN_WINNER_MINIMUM_AGE) r = SPORK_16_MN_WINNER_MINIMUM_AGE_DEFAULT;
-
-        if (r == -1) LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
-    }
+    if (!sporkValues.Get(nSporkID, r))
+        LogPrintf("GetSpork::Unknown Spork %d\n", nSporkID);
 
     return r;
 }
@@ -226,7 +276,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
     if (Sign(msg)) {
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
-        mapSporksActive[nSporkID] = msg;
+        SetSporkActive(msg);
         return true;
     }
 
@@ -65,6 +65,7 @@ extern CSporkManager sporkManager;
 
 void LoadSporksFromDB();
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+void SetSporkActive(const CSporkMessage& spork);
 int64_t GetSporkValue(int nSporkID);
 bool IsSporkActive(int nSporkID);
 void ReprocessBlocks(int nBlocks);
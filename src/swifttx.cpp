@@ -22,11 +22,25 @@ using namespace boost;
 
 std::map<uint256, CTransaction> mapTxLockReq;
 std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
+seencache<uint256, CConsensusVote> mapTxLockVote(SWIFTTX_SEEN_VOTES_MAX, SWIFTTX_SEEN_VOTES_SECONDS);
 std::map<uint256, CTransactionLock> mapTxLocks;
 std::map<COutPoint, uint256> mapLockedInputs;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+int64_t nUnknownVotesTotal = 0; //sum of mapUnknownVotes, for GetAverageVoteTime
 int nCompleteTXLocks;
+CTransactionLockManager txLockManager;
+
+static void SetUnknownVote(const uint256& hash, int64_t nTime)
+{
+    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.find(hash);
+    if (it != mapUnknownVotes.end()) {
+        nUnknownVotesTotal += nTime - it->second;
+        it->second = nTime;
+    } else {
+        nUnknownVotesTotal += nTime;
+        mapUnknownVotes.insert(make_pair(hash, nTime));
+    }
+}
 
 //txlock - Locks transaction
 //
@@ -43,6 +57,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
     if (strCommand == "ix") {
         //LogPrintf("ProcessMessageSwiftTX::ix\n");
+        int64_t nTimeReceived = GetTimeMicros();
         CDataStream vMsg(vRecv);
         CTransaction tx;
         vRecv >> tx;
@@ -68,6 +83,9 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         }
 
         int nBlockHeight = CreateNewLock(tx);
+        std::map<uint256, CTransactionLock>::iterator itLock = mapTxLocks.find(tx.GetHash());
+        if (itLock != mapTxLocks.end() && itLock->second.nTimeReceived == 0)
+            itLock->second.nTimeReceived = nTimeReceived;
 
         bool fMissingInputs = false;
         CValidationState state;
@@ -130,11 +148,14 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
-            return;
-        }
+        {
+            LOCK(cs_main);
+            if (mapTxLockVote.count(ctx.GetHash())) {
+                return;
+            }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+            mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
+        }
 
         if (ProcessConsensusVote(pfrom, ctx)) {
             //Spam/Dos protection
@@ -145,7 +166,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             */
             if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
                 if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    SetUnknownVote(ctx.vinMasternode.prevout.hash, GetTime() + (60 * 10));
                 }
 
                 if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
@@ -155,7 +176,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                         ctx.txHash.ToString().c_str());
                     return;
                 } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    SetUnknownVote(ctx.vinMasternode.prevout.hash, GetTime() + (60 * 10));
                 }
             }
             RelayInv(inv);
@@ -236,9 +257,9 @@ int64_t CreateNewLock(CTransaction tx)
 
         CTransactionLock newLock;
         newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
         newLock.nTimeout = GetTime() + (60 * 5);
         newLock.txHash = tx.GetHash();
+        txLockManager.SetExpiration(newLock, GetTime() + (60 * 60)); //locks expire after 60 minutes (24 confirmations)
         mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
     } else {
         mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
@@ -254,15 +275,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = txLockManager.GetQuorumRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
-        LogPrint("swifttx", "SwiftTX::DoConsensusVote - Unknown Masternode\n");
-        return;
-    }
-
-    if (n > SWIFTTX_SIGNATURES_TOTAL) {
-        LogPrint("swifttx", "SwiftTX::DoConsensusVote - Masternode not in the top %d (%d)\n", SWIFTTX_SIGNATURES_TOTAL, n);
+        LogPrint("swifttx", "SwiftTX::DoConsensusVote - Masternode not in the top %d\n", SWIFTTX_SIGNATURES_TOTAL);
         return;
     }
     /*
@@ -284,7 +300,10 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    {
+        LOCK(cs_main);
+        mapTxLockVote.Insert(ctx.GetHash(), ctx);
+    }
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -293,21 +312,20 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
-
-    CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
-    if (pmn != NULL)
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode ADDR %s %d\n", pmn->addr.ToString().c_str(), n);
-
-    if (n == -1) {
-        //can be caused by past versions trying to vote with an invalid protocol
+    CMasternodePtr pmn = mnodeman.Find(ctx.vinMasternode);
+    if (!pmn) {
         LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Unknown Masternode\n");
         mnodeman.AskForMN(pnode, ctx.vinMasternode);
         return false;
     }
 
-    if (n > SWIFTTX_SIGNATURES_TOTAL) {
-        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode not in the top %d (%d) - %s\n", SWIFTTX_SIGNATURES_TOTAL, n, ctx.GetHash().ToString().c_str());
+    // the quorum is ranked once per block height, not for every vote
+    int n = txLockManager.GetQuorumRank(ctx.vinMasternode, ctx.nBlockHeight);
+    LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode ADDR %s %d\n", pmn->addr.ToString().c_str(), n);
+
+    if (n == -1) {
+        //can be caused by past versions trying to vote with an invalid protocol
+        LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Masternode not in the top %d - %s\n", SWIFTTX_SIGNATURES_TOTAL, ctx.GetHash().ToString().c_str());
         return false;
     }
 
@@ -323,9 +341,9 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 
         CTransactionLock newLock;
         newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
         newLock.nTimeout = GetTime() + (60 * 5);
         newLock.txHash = ctx.txHash;
+        txLockManager.SetExpiration(newLock, GetTime() + (60 * 60));
         mapTxLocks.insert(make_pair(ctx.txHash, newLock));
     } else
         LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
@@ -348,6 +366,11 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
             LogPrint("swifttx", "SwiftTX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
 
+            if (!(*i).second.fCompleted) {
+                (*i).second.fCompleted = true;
+                txLockManager.LockCompleted((*i).second);
+            }
+
             CTransaction& tx = mapTxLockReq[ctx.txHash];
             if (!CheckForConflictingLocks(tx)) {
 #ifdef ENABLE_WALLET
@@ -395,8 +418,8 @@ bool CheckForConflictingLocks(CTransaction& tx)
         if (mapLockedInputs.count(in.prevout)) {
             if (mapLockedInputs[in.prevout] != tx.GetHash()) {
                 LogPrintf("SwiftTX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
+                if (mapTxLocks.count(tx.GetHash())) txLockManager.SetExpiration(mapTxLocks[tx.GetHash()], GetTime());
+                if (mapTxLocks.count(mapLockedInputs[in.prevout])) txLockManager.SetExpiration(mapTxLocks[mapLockedInputs[in.prevout]], GetTime());
                 return true;
             }
         }
@@ -407,47 +430,45 @@ bool CheckForConflictingLocks(CTransaction& tx)
 
 int64_t GetAverageVoteTime()
 {
-    std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
-    int64_t total = 0;
-    int64_t count = 0;
-
-    while (it != mapUnknownVotes.end()) {
-        total += it->second;
-        count++;
-        it++;
-    }
+    if (mapUnknownVotes.empty()) return 0;
 
-    return total / count;
+    return nUnknownVotesTotal / (int64_t)mapUnknownVotes.size();
 }
 
 void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    // only the expired locks are visited
+    std::vector<uint256> vecExpired;
+    txLockManager.PopExpired(GetTime(), vecExpired);
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    // the locks and their votes are read under cs_main, by getdata and RPC
+    LOCK(cs_main);
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+    BOOST_FOREACH (const uint256& hash, vecExpired) {
+        std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(hash);
+        if (it == mapTxLocks.end()) continue;
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+        LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+        if (mapTxLockReq.count(it->second.txHash)) {
+            CTransaction& tx = mapTxLockReq[it->second.txHash];
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
+            BOOST_FOREACH (const CTxIn& in, tx.vin)
+                mapLockedInputs.erase(in.prevout);
 
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+            mapTxLockReq.erase(it->second.txHash);
+            mapTxLockReqRejected.erase(it->second.txHash);
+
+            BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
+                mapTxLockVote.erase(v.GetHash());
         }
+
+        mapTxLocks.erase(it);
     }
+
+    txLockManager.CleanQuorums();
 }
 
 uint256 CConsensusVote::GetHash() const
@@ -456,15 +477,20 @@ uint256 CConsensusVote::GetHash() const
 }
 
 
+std::string CConsensusVote::GetStrMessage() const
+{
+    return txHash.ToString() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
-    CMasternode* pmn = mnodeman.Find(vinMasternode);
+    CMasternodePtr pmn = mnodeman.Find(vinMasternode);
 
-    if (pmn == NULL) {
+    if (!pmn) {
         LogPrintf("SwiftTX::CConsensusVote::SignatureValid() - Unknown Masternode\n");
         return false;
     }
@@ -483,7 +509,7 @@ bool CConsensusVote::Sign()
 
     CKey key2;
     CPubKey pubkey2;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("signing strMessage %s \n", strMessage.c_str());
     //LogPrintf("signing privkey %s \n", strMasterNodePrivKey.c_str());
 
@@ -509,15 +535,10 @@ bool CConsensusVote::Sign()
 bool CTransactionLock::SignaturesValid()
 {
     BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+        int n = txLockManager.GetQuorumRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
-            LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
-            return false;
-        }
-
-        if (n > SWIFTTX_SIGNATURES_TOTAL) {
-            LogPrintf("CTransactionLock::SignaturesValid() - Masternode not in the top %s\n", SWIFTTX_SIGNATURES_TOTAL);
+            LogPrintf("CTransactionLock::SignaturesValid() - Masternode not in the top %d\n", SWIFTTX_SIGNATURES_TOTAL);
             return false;
         }
 
@@ -552,3 +573,110 @@ int CTransactionLock::CountSignatures()
     }
     return n;
 }
+
+//
+// CTransactionLockManager
+//
+
+int CTransactionLockManager::GetQuorumRank(const CTxIn& vin, int nBlockHeight)
+{
+    uint256 hashBlock;
+    if (!GetBlockHash(hashBlock, nBlockHeight))
+        return -1;
+
+    CQuorum quorum;
+    bool fFound = false;
+    uint64_t nGeneration;
+    {
+        LOCK(cs);
+        std::map<uint256, CQuorum>::const_iterator it = mapQuorums.find(hashBlock);
+        if (it != mapQuorums.end() && it->second.nTime >= GetTime() - SWIFTTX_QUORUM_SECONDS) {
+            quorum = it->second;
+            fFound = true;
+        }
+        nGeneration = nQuorumGeneration;
+    }
+
+    if (!fFound) {
+        // ranked without cs held, mnodeman.cs and cs_main are never taken inside it
+        if (!mnodeman.GetTopRankedMasternodes(nBlockHeight, MIN_SWIFTTX_PROTO_VERSION, SWIFTTX_SIGNATURES_TOTAL, quorum.vecMembers))
+            return -1;
+        quorum.nTime = GetTime();
+
+        uint256 hashRanked;
+        LOCK(cs);
+        if (nGeneration == nQuorumGeneration && GetBlockHash(hashRanked, nBlockHeight) && hashRanked == hashBlock)
+            mapQuorums[hashBlock] = quorum;
+    }
+
+    for (unsigned int i = 0; i < quorum.vecMembers.size(); i++) {
+        if (quorum.vecMembers[i].prevout == vin.prevout)
+            return i + 1;
+    }
+    return -1;
+}
+
+void CTransactionLockManager::SetExpiration(CTransactionLock& lock, int64_t nExpiration)
+{
+    LOCK(cs);
+    setExpirations.erase(make_pair((int64_t)lock.nExpiration, lock.txHash));
+    lock.nExpiration = nExpiration;
+    setExpirations.insert(make_pair(nExpiration, lock.txHash));
+}
+
+void CTransactionLockManager::PopExpired(int64_t nTime, std::vector<uint256>& vecExpired)
+{
+    LOCK(cs);
+    while (!setExpirations.empty() && setExpirations.begin()->first < nTime) {
+        vecExpired.push_back(setExpirations.begin()->second);
+        setExpirations.erase(setExpirations.begin());
+    }
+}
+
+void CTransactionLockManager::CleanQuorums()
+{
+    LOCK(cs);
+    std::map<uint256, CQuorum>::iterator it = mapQuorums.begin();
+    while (it != mapQuorums.end()) {
+        if (it->second.nTime < GetTime() - SWIFTTX_QUORUM_SECONDS)
+            mapQuorums.erase(it++);
+        else
+            ++it;
+    }
+}
+
+void CTransactionLockManager::ClearQuorums()
+{
+    LOCK(cs);
+    mapQuorums.clear();
+    nQuorumGeneration++;
+}
+
+void CTransactionLockManager::LockCompleted(CTransactionLock& lock)
+{
+    if (lock.nTimeReceived == 0) return;
+
+    int64_t nLatency = GetTimeMicros() - lock.nTimeReceived;
+    LogPrint("swifttx", "CTransactionLockManager::LockCompleted - %s locked in %.2fms\n", lock.txHash.ToString(), nLatency * 0.001);
+
+    LOCK(cs);
+    nLocksCompleted++;
+    nLatencyTotal += nLatency;
+    nLatencyMax = std::max(nLatencyMax, nLatency);
+    nLatencyLast = nLatency;
+}
+
+void CTransactionLockManager::GetLatencyStats(int64_t& nCount, int64_t& nAverage, int64_t& nMax, int64_t& nLast) const
+{
+    LOCK(cs);
+    nCount = nLocksCompleted;
+    nAverage = nLocksCompleted ? nLatencyTotal / nLocksCompleted : 0;
+    nMax = nLatencyMax;
+    nLast = nLatencyLast;
+}
+
+int CTransactionLockManager::CountQuorums() const
+{
+    LOCK(cs);
+    return mapQuorums.size();
+}
@@ -10,10 +10,13 @@
 #include "key.h"
 #include "main.h"
 #include "net.h"
+#include "seencache.h"
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
 
+#include <set>
+
 /*
     At 15 signatures, 1/2 of the masternode network can be owned by
     one party without comprimising the security of SwiftTX
@@ -26,6 +29,13 @@
 #define SWIFTTX_SIGNATURES_REQUIRED 6
 #define SWIFTTX_SIGNATURES_TOTAL 10
 
+// bounds of the seen lock vote cache
+#define SWIFTTX_SEEN_VOTES_MAX 50000
+#define SWIFTTX_SEEN_VOTES_SECONDS (60 * 60)
+
+// how long the quorum ranked for a block is reused while the masternode list stays the same
+#define SWIFTTX_QUORUM_SECONDS 60
+
 using namespace std;
 using namespace boost;
 
@@ -37,7 +47,7 @@ static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
 
 extern map<uint256, CTransaction> mapTxLockReq;
 extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
+extern seencache<uint256, CConsensusVote> mapTxLockVote; // guarded by cs_main
 extern map<uint256, CTransactionLock> mapTxLocks;
 extern std::map<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
@@ -75,6 +85,8 @@ public:
 
     bool SignatureValid();
     bool Sign();
+    /// The message covered by vchMasterNodeSignature
+    std::string GetStrMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -96,6 +108,11 @@ public:
     std::vector<CConsensusVote> vecConsensusVotes;
     int nExpiration;
     int nTimeout;
+    // when the "ix" request came in (micros), 0 if it was never seen
+    int64_t nTimeReceived;
+    bool fCompleted;
+
+    CTransactionLock() : nBlockHeight(0), nExpiration(0), nTimeout(0), nTimeReceived(0), fCompleted(false) {}
 
     bool SignaturesValid();
     int CountSignatures();
@@ -107,5 +124,54 @@ public:
     }
 };
 
+/**
+ * Bookkeeping that keeps vote handling and cleaning of the transaction locks
+ * independent of how many there are: the quorum ranked for each block, the
+ * locks in expiration order, and lock latency metrics. Quorums are dropped
+ * whenever the masternode list changes.
+ */
+class CTransactionLockManager
+{
+private:
+    struct CQuorum {
+        int64_t nTime;
+        //! the top SWIFTTX_SIGNATURES_TOTAL masternodes, best first
+        std::vector<CTxIn> vecMembers;
+    };
+
+    mutable CCriticalSection cs;
+    //! by the hash of the block the quorum was ranked for
+    std::map<uint256, CQuorum> mapQuorums;
+    //! bumped by ClearQuorums, a ranking made before that is not kept
+    uint64_t nQuorumGeneration;
+    std::set<std::pair<int64_t, uint256> > setExpirations;
+
+    int64_t nLocksCompleted;
+    int64_t nLatencyTotal;
+    int64_t nLatencyMax;
+    int64_t nLatencyLast;
+
+public:
+    CTransactionLockManager() : nQuorumGeneration(0), nLocksCompleted(0), nLatencyTotal(0), nLatencyMax(0), nLatencyLast(0) {}
+
+    /// Rank of vin in the quorum for nBlockHeight, or -1 if it isn't in it or the block is unknown
+    int GetQuorumRank(const CTxIn& vin, int nBlockHeight);
+    /// Move a lock to its new place in expiration order
+    void SetExpiration(CTransactionLock& lock, int64_t nExpiration);
+    /// Take the hashes of the locks that expired before nTime
+    void PopExpired(int64_t nTime, std::vector<uint256>& vecExpired);
+    /// Forget quorums that are due to be ranked again
+    void CleanQuorums();
+    /// Forget all quorums, the masternode list they were ranked from changed
+    void ClearQuorums();
+    /// Record the latency of a lock that just got its signatures
+    void LockCompleted(CTransactionLock& lock);
+
+    void GetLatencyStats(int64_t& nCount, int64_t& nAverage, int64_t& nMax, int64_t& nLast) const;
+    int CountQuorums() const;
+};
+
+extern CTransactionLockManager txLockManager;
+
 
 #endif
@@ -0,0 +1,107 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "crypto/sha256.h"
+#include "random.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+static std::atomic<unsigned int> nChecked(0);
+
+/** Counts itself, does some hashing and fails if asked to */
+struct FakeCheck {
+    bool fOk;
+    int nRounds;
+
+    FakeCheck(bool fOkIn = true, int nRoundsIn = 0) : fOk(fOkIn), nRounds(nRoundsIn) {}
+
+    bool operator()()
+    {
+        unsigned char buf[32] = {};
+        for (int i = 0; i < nRounds; i++)
+            CSHA256().Write(buf, sizeof(buf)).Finalize(buf);
+        nChecked++;
+        return fOk;
+    }
+
+    void swap(FakeCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+        std::swap(nRounds, check.nRounds);
+    }
+};
+
+typedef CCheckQueue<FakeCheck> FakeCheckQueue;
+
+static void StartWorkers(FakeCheckQueue& queue, boost::thread_group& threads, int nWorkers)
+{
+    for (int i = 0; i < nWorkers; i++)
+        threads.create_thread(boost::bind(&FakeCheckQueue::Thread, &queue));
+}
+
+static void StopWorkers(boost::thread_group& threads)
+{
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_ok)
+{
+    // Built for the most threads allowed, like the node's, then cut to those that run
+    FakeCheckQueue queue(128, 16);
+    queue.SetThreads(4);
+    boost::thread_group threads;
+    StartWorkers(queue, threads, 3);
+    for (int round = 0; round < 50; round++) {
+        nChecked = 0;
+        unsigned int nTotal = 0;
+        {
+            CCheckQueueControl<FakeCheck> control(&queue);
+            // Transactions of a handful of inputs, and the odd big one
+            int nTxs = insecure_rand() % 200;
+            for (int i = 0; i < nTxs; i++) {
+                std::vector<FakeCheck> vChecks(i % 50 == 49 ? 500 : 1 + insecure_rand() % 4);
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecked, nTotal);
+        BOOST_CHECK(queue.IsIdle());
+    }
+    StopWorkers(threads);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    // More workers than worker queues, so some share one
+    FakeCheckQueue queue(16, 2);
+    boost::thread_group threads;
+    StartWorkers(queue, threads, 4);
+    for (int round = 0; round < 50; round++) {
+        bool fFail = round % 2 == 0;
+        CCheckQueueControl<FakeCheck> control(&queue);
+        for (int i = 0; i < 100; i++) {
+            std::vector<FakeCheck> vChecks(3);
+            if (fFail && i == round)
+                vChecks[1] = FakeCheck(false);
+            control.Add(vChecks);
+        }
+        // A failure is reported once, and does not stick to the next round
+        BOOST_CHECK_EQUAL(control.Wait(), !fFail);
+        BOOST_CHECK(queue.IsIdle());
+    }
+    StopWorkers(threads);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
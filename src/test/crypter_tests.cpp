@@ -0,0 +1,95 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypter.h"
+
+#include "random.h"
+#include "script/standard.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(crypter_tests)
+
+/** Opens up encryption and unlocking, which CWallet normally drives */
+class TestCryptoKeyStore : public CCryptoKeyStore
+{
+public:
+    bool EncryptKeys(CKeyingMaterial& vMasterKeyIn) { return CCryptoKeyStore::EncryptKeys(vMasterKeyIn); }
+    bool Unlock(const CKeyingMaterial& vMasterKeyIn) { return CCryptoKeyStore::Unlock(vMasterKeyIn); }
+};
+
+static CKeyingMaterial NewMasterKey()
+{
+    CKeyingMaterial vMasterKey(WALLET_CRYPTO_KEY_SIZE);
+    GetRandBytes(&vMasterKey[0], WALLET_CRYPTO_KEY_SIZE);
+    return vMasterKey;
+}
+
+/** Fill keystore with nKeys fresh keys and encrypt it with vMasterKey */
+static void MakeKeys(TestCryptoKeyStore& keystore, CKeyingMaterial& vMasterKey, int nKeys, std::vector<CKey>& vKeys)
+{
+    for (int i = 0; i < nKeys; i++) {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        vKeys.push_back(key);
+        BOOST_REQUIRE(keystore.AddKeyPubKey(key, key.GetPubKey()));
+    }
+    BOOST_REQUIRE(keystore.EncryptKeys(vMasterKey));
+}
+
+static bool SameKey(const CKey& a, const CKey& b)
+{
+    return a.IsCompressed() == b.IsCompressed() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+BOOST_AUTO_TEST_CASE(crypter_key_cache)
+{
+    TestCryptoKeyStore keystore;
+    CKeyingMaterial vMasterKey = NewMasterKey();
+    std::vector<CKey> vKeys;
+    MakeKeys(keystore, vMasterKey, 20, vKeys);
+
+    CKey key;
+    BOOST_CHECK(keystore.IsLocked());
+    BOOST_CHECK(!keystore.GetKey(vKeys[0].GetPubKey().GetID(), key));
+
+    // Decrypted on the first use, then served from the cache
+    BOOST_REQUIRE(keystore.Unlock(vMasterKey));
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (unsigned int i = 0; i < vKeys.size(); i++) {
+            BOOST_CHECK(keystore.GetKey(vKeys[i].GetPubKey().GetID(), key));
+            BOOST_CHECK(SameKey(key, vKeys[i]));
+        }
+    }
+
+    // Locking wipes the cache along with the master key
+    BOOST_REQUIRE(keystore.Lock());
+    for (unsigned int i = 0; i < vKeys.size(); i++)
+        BOOST_CHECK(!keystore.GetKey(vKeys[i].GetPubKey().GetID(), key));
+
+    // Warming only takes keys the keystore holds, and nothing while locked
+    std::set<CKeyID> setAddress;
+    for (unsigned int i = 0; i < vKeys.size(); i++)
+        setAddress.insert(vKeys[i].GetPubKey().GetID());
+    CKey other;
+    other.MakeNewKey(true);
+    setAddress.insert(other.GetPubKey().GetID());
+    keystore.WarmKeyCache(setAddress, 3);
+    BOOST_CHECK(!keystore.GetKey(vKeys[0].GetPubKey().GetID(), key));
+
+    BOOST_REQUIRE(keystore.Unlock(vMasterKey));
+    keystore.WarmKeyCache(setAddress, 3);
+    for (unsigned int i = 0; i < vKeys.size(); i++) {
+        BOOST_CHECK(keystore.GetKey(vKeys[i].GetPubKey().GetID(), key));
+        BOOST_CHECK(SameKey(key, vKeys[i]));
+    }
+    BOOST_CHECK(!keystore.GetKey(other.GetPubKey().GetID(), key));
+
+    BOOST_CHECK(!keystore.Unlock(NewMasterKey()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
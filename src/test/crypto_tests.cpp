@@ -2,16 +2,21 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "bip38.h"
 #include "crypto/rfc6979_hmac_sha256.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
+#include "primitives/block.h"
 #include "random.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/assign/list_of.hpp>
@@ -282,4 +287,94 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Every count from below the 4-way batch to past two 8-way batches
+    for (int i = 0; i <= 34; i++) {
+        std::vector<unsigned char> in(64 * i), out(32 * i);
+        if (i) GetRandBytes(&in[0], in.size());
+        SHA256D64(out.data(), in.data(), i);
+        for (int j = 0; j < i; j++) {
+            uint256 hash = Hash(in.begin() + 64 * j, in.begin() + 64 * (j + 1));
+            BOOST_CHECK(std::equal(hash.begin(), hash.end(), out.begin() + 32 * j));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merkle_levels)
+{
+    for (int nLeaves = 1; nLeaves <= 70; nLeaves++) {
+        std::vector<uint256> vLeaves;
+        for (int i = 0; i < nLeaves; i++)
+            vLeaves.push_back(GetRandHash());
+
+        // Reference: hash each pair, duplicating the last hash of odd levels
+        std::vector<uint256> vExpected(vLeaves);
+        size_t j = 0;
+        for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2) {
+            for (size_t i = 0; i < nSize; i += 2) {
+                size_t i2 = std::min(i + 1, nSize - 1);
+                vExpected.push_back(Hash(BEGIN(vExpected[j + i]), END(vExpected[j + i]), BEGIN(vExpected[j + i2]), END(vExpected[j + i2])));
+            }
+            j += nSize;
+        }
+
+        std::vector<uint256> vTree(vLeaves);
+        BOOST_CHECK(!BuildMerkleLevels(vTree));
+        BOOST_CHECK(vTree == vExpected);
+
+        // Two identical hashes at the end of an even level are flagged
+        if (nLeaves % 2 == 0) {
+            vTree = vLeaves;
+            vTree.back() = vTree[nLeaves - 2];
+            BOOST_CHECK(BuildMerkleLevels(vTree));
+        }
+    }
+}
+
+void TestScrypt(const std::string& pass, const std::string& salt, unsigned int N, unsigned int r, unsigned int p, const std::string& hexout)
+{
+    std::vector<unsigned char> out = ParseHex(hexout);
+    std::vector<unsigned char> result(out.size());
+    scrypt(pass.data(), pass.size(), salt.data(), salt.size(), (char*)&result[0], N, r, p, out.size());
+    BOOST_CHECK(result == out);
+    // Every way of splitting up the lanes gives the same key, whatever order the parts run in
+    for (unsigned int nParts = 1; nParts <= p + 1; nParts++) {
+        std::vector<uint8_t> B(128 * r * p);
+        scrypt_begin(pass.data(), pass.size(), salt.data(), salt.size(), &B[0], r, p);
+        for (unsigned int i = nParts; i-- > 0;)
+            scrypt_lanes(&B[0], r, N, p, i, nParts);
+        std::fill(result.begin(), result.end(), 0);
+        scrypt_end(pass.data(), pass.size(), &B[0], r, p, (char*)&result[0], out.size());
+        BOOST_CHECK(result == out);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_testvectors)
+{
+    // RFC 7914, section 12
+    TestScrypt("", "", 16, 1, 1,
+               "77d6576238657b203b19ca42c18a0497f16b4844e3074ae8dfdffa3fede21442"
+               "fcd0069ded0948f8326a753a0fc81f17e8d3e0fb2e0d3628cf35e20c38d18906");
+    TestScrypt("password", "NaCl", 1024, 8, 16,
+               "fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b373162"
+               "2eaf30d92e22a3886ff109279d9830dac727afb94a83ee6d8360cbdfa2cc0640");
+    // An odd number of lanes leaves one without a partner
+    TestScrypt("pleaseletmein", "SodiumChloride", 64, 2, 3,
+               "99541e801d21807e1eba5980d9c09bfb47835e97e80fadb4f862f1317818da60"
+               "3f06c675be6e1e76bd076552392492831a7ead6aad02f4e8d0a1657e1a65a774");
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_bip38_threads)
+{
+    // BIP38 spreads the lanes over threads of its own; any number of them gives the single threaded key
+    std::vector<unsigned char> vSingle(64), vThreaded(64);
+    scrypt("passphrase", 10, "salt", 4, (char*)&vSingle[0], 16384, 8, 8, 64);
+    for (unsigned int nThreads = 0; nThreads <= 9; nThreads += 3) {
+        std::fill(vThreaded.begin(), vThreaded.end(), 0);
+        BIP38_Scrypt("passphrase", 10, "salt", 4, (char*)&vThreaded[0], 64, nThreads);
+        BOOST_CHECK(vSingle == vThreaded);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,8 @@
 #include "key.h"
 
 #include "base58.h"
+#include "ecwrapper.h"
+#include "random.h"
 #include "script/script.h"
 #include "uint256.h"
 #include "util.h"
@@ -187,4 +189,115 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("20469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf5892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1"));
 }
 
+
+/** DER sequence of the integers R and S, encoded as given */
+static std::vector<unsigned char> EncodeSignature(const std::vector<unsigned char>& vchR, const std::vector<unsigned char>& vchS)
+{
+    std::vector<unsigned char> vchSig;
+    vchSig.push_back(0x30);
+    vchSig.push_back(4 + vchR.size() + vchS.size());
+    vchSig.push_back(0x02);
+    vchSig.push_back(vchR.size());
+    vchSig.insert(vchSig.end(), vchR.begin(), vchR.end());
+    vchSig.push_back(0x02);
+    vchSig.push_back(vchS.size());
+    vchSig.insert(vchSig.end(), vchS.begin(), vchS.end());
+    return vchSig;
+}
+
+/** n - s for a big-endian scalar s, as 32 bytes */
+static std::vector<unsigned char> NegateScalar(const std::vector<unsigned char>& vchS)
+{
+    std::vector<unsigned char> vchOrder = ParseHex("fffffffffffffffffffffffffffffffebaaedce6af48a03bbfd25e8cd0364141");
+    std::vector<unsigned char> vch(32 - vchS.size(), 0);
+    vch.insert(vch.end(), vchS.begin(), vchS.end());
+    int nBorrow = 0;
+    for (int i = 31; i >= 0; i--) {
+        int n = vchOrder[i] - vch[i] - nBorrow;
+        nBorrow = n < 0;
+        vch[i] = n + (nBorrow << 8);
+    }
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(key_verify_lax_der)
+{
+    CBitcoinSecret bsecret2;
+    BOOST_CHECK(bsecret2.SetString(strSecret2));
+    CPubKey pubkey2 = bsecret2.GetKey().GetPubKey();
+    string strMsg = "Very deterministic message";
+    uint256 hashMsg = Hash(strMsg.begin(), strMsg.end());
+    const string strR = "469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf";
+    const string strS = "5892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1";
+
+    // Strict DER, and the encodings OpenSSL used to accept along with it
+    BOOST_CHECK(pubkey2.Verify(hashMsg, ParseHex("30440220" + strR + "0220" + strS)));
+    BOOST_CHECK(pubkey2.Verify(hashMsg, ParseHex("3045022100" + strR + "0220" + strS)));
+    BOOST_CHECK(pubkey2.Verify(hashMsg, ParseHex("30450220" + strR + "028120" + strS)));
+    BOOST_CHECK(pubkey2.Verify(hashMsg, ParseHex("3081440220" + strR + "0220" + strS)));
+    BOOST_CHECK(pubkey2.Verify(hashMsg, ParseHex("30440220" + strR + "0220" + strS + "0102")));
+
+    // R too long to be a scalar, truncated, not a sequence, empty
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("3045022101" + strR + "0220" + strS)));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("30440220" + strR + "0220" + strS.substr(0, 62))));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("31440220" + strR + "0220" + strS)));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, std::vector<unsigned char>()));
+
+    // A sequence length that does not cover R and S exactly, or runs past the input
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("30000220" + strR + "0220" + strS)));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("30430220" + strR + "0220" + strS)));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("30450220" + strR + "0220" + strS + "00")));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("30460220" + strR + "0220" + strS + "00")));
+    BOOST_CHECK(!pubkey2.Verify(hashMsg, ParseHex("30810220" + strR + "0220" + strS)));
+
+    // R and S with the high bit set verify with and without the zero that
+    // keeps them positive in DER, as OpenSSL read them unsigned. Blocks and
+    // transactions from before DERSIG depend on it.
+    for (int nInt = 0; nInt < 2; nInt++) {
+        std::vector<unsigned char> vchSig, vchR, vchS;
+        uint256 hash;
+        do {
+            hash = GetRandHash();
+            BOOST_CHECK(bsecret2.GetKey().Sign(hash, vchSig));
+            vchR.assign(vchSig.begin() + 4, vchSig.begin() + 4 + vchSig[3]);
+            vchS.assign(vchSig.begin() + 6 + vchSig[3], vchSig.end());
+        } while (nInt == 0 && vchR[0] != 0);
+        // The high S of the same signature, n - S, is just as valid
+        if (nInt == 1)
+            vchS = NegateScalar(vchS);
+        std::vector<unsigned char>& vchInt = nInt == 0 ? vchR : vchS;
+        while (vchInt.size() > 32)
+            vchInt.erase(vchInt.begin());
+        BOOST_REQUIRE(vchInt[0] & 0x80);
+
+        std::vector<unsigned char> vchPadded = vchInt;
+        vchPadded.insert(vchPadded.begin(), 0);
+        BOOST_CHECK(pubkey2.Verify(hash, EncodeSignature(nInt == 0 ? vchPadded : vchR, nInt == 1 ? vchPadded : vchS)));
+        BOOST_CHECK(pubkey2.Verify(hash, EncodeSignature(vchR, vchS)));
+    }
+
+    // Same answers as OpenSSL, for uncompressed, hybrid and compressed keys
+    for (int i = 0; i < 16; i++) {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        CPubKey pubkey = key.GetPubKey();
+        std::vector<unsigned char> vchPubKey(pubkey.begin(), pubkey.end());
+        if (i % 4 == 1)
+            vchPubKey[0] = 0x06 | (vchPubKey[64] & 1);
+        pubkey.Set(vchPubKey.begin(), vchPubKey.end());
+        BOOST_CHECK(pubkey.IsFullyValid());
+
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        if (i % 8 >= 4)
+            vchSig[5 + insecure_rand() % (vchSig.size() - 5)] ^= 1 << (insecure_rand() % 8);
+
+        CECKey eckey;
+        BOOST_CHECK(eckey.SetPubKey(pubkey.begin(), pubkey.size()));
+        BOOST_CHECK_EQUAL(pubkey.Verify(hash, vchSig), eckey.Verify(hash, vchSig));
+        BOOST_CHECK_EQUAL(pubkey.Verify(hash, vchSig), i % 8 < 4);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,9 +6,16 @@
 
 #include "primitives/transaction.h"
 #include "main.h"
+#include "checkpoints.h"
+#include "coins.h"
+#include "keystore.h"
+#include "script/sign.h"
+#include "script/standard.h"
 
 #include <boost/test/unit_test.hpp>
 
+extern CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx, const CScript& scriptPubKey);
+
 BOOST_AUTO_TEST_SUITE(main_tests)
 
 CAmount nMoneySupplyPoWEnd = 500000 * COIN;
@@ -26,4 +33,200 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 50000000000000ULL);
 }
 
+/** A block of nTxs distinct transactions */
+static void MakeBlock(CBlock& block, int nTxs)
+{
+    block.vtx.clear();
+    block.vtx.reserve(nTxs);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(2);
+    tx.vout[0].nValue = tx.vout[1].nValue = COIN;
+    tx.vout[0].scriptPubKey = tx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    for (int i = 0; i < nTxs; i++) {
+        tx.vin[0].prevout.n = i;
+        block.vtx.push_back(tx);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merkle_parallel)
+{
+    // Around the level size that gets spread over the threads, and odd sizes at every level
+    const int vSizes[] = {1, 2, 3, 1000, 2047, 2048, 2049, 4097, 10001};
+    for (unsigned int n = 0; n < sizeof(vSizes) / sizeof(vSizes[0]); n++) {
+        CBlock block;
+        MakeBlock(block, vSizes[n]);
+        for (int fDuplicate = 0; fDuplicate < 2; fDuplicate++) {
+            // Repeating the last transaction of an even block is caught either way (CVE-2012-2459)
+            if (fDuplicate) {
+                if (vSizes[n] % 2 == 0)
+                    continue;
+                block.vtx.push_back(block.vtx.back());
+            }
+            bool fMutated, fMutatedParallel;
+            uint256 hashRoot = block.BuildMerkleTree(&fMutated);
+            std::vector<uint256> vTree = block.vMerkleTree;
+            BOOST_CHECK(block.BuildMerkleTree(&fMutatedParallel, ParallelSHA256D64) == hashRoot);
+            BOOST_CHECK(block.vMerkleTree == vTree);
+            BOOST_CHECK_EQUAL(fMutated, fMutatedParallel);
+            BOOST_CHECK_EQUAL(fMutated, fDuplicate == 1);
+        }
+    }
+}
+
+/** nTxs signed transactions, each spending its own pay-to-pubkey-hash coin added to coins */
+static std::vector<CTransaction> MakeSpends(CCoinsViewCache& coins, int nTxs)
+{
+    coins.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CMutableTransaction txFrom;
+    txFrom.vout.resize(nTxs);
+    for (int i = 0; i < nTxs; i++) {
+        txFrom.vout[i].nValue = COIN;
+        txFrom.vout[i].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    }
+    coins.ModifyCoins(txFrom.GetHash())->FromTx(txFrom, 0);
+
+    std::vector<CTransaction> vSpends;
+    for (int i = 0; i < nTxs; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txFrom.GetHash(), i);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        BOOST_REQUIRE(SignSignature(keystore, txFrom, tx, 0));
+        vSpends.push_back(tx);
+    }
+    return vSpends;
+}
+
+BOOST_AUTO_TEST_CASE(script_cache)
+{
+    LOCK(cs_main);
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    CTransaction tx = MakeSpends(coins, 1)[0];
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    CValidationState state;
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, flags, true, true));
+
+    // Make the script fail, so only a cached result lets the transaction pass
+    coins.ModifyCoins(tx.vin[0].prevout.hash)->vout[0].scriptPubKey = CScript() << OP_FALSE;
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, flags, true, true));
+    BOOST_CHECK(!CheckInputs(tx, state, coins, true, flags & ~SCRIPT_VERIFY_NULLDUMMY, true, true));
+
+    // A lookup that does not store results takes the transaction out
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, flags, false, false));
+    BOOST_CHECK(!CheckInputs(tx, state, coins, true, flags, false, false));
+
+    // Storing the signatures only leaves the transaction out of the cache
+    CTransaction txSigs = MakeSpends(coins, 1)[0];
+    BOOST_CHECK(CheckInputs(txSigs, state, coins, true, flags, true, false));
+    coins.ModifyCoins(txSigs.vin[0].prevout.hash)->vout[0].scriptPubKey = CScript() << OP_FALSE;
+    BOOST_CHECK(!CheckInputs(txSigs, state, coins, true, flags, true, false));
+}
+
+BOOST_AUTO_TEST_CASE(address_indexes)
+{
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    Checkpoints::fEnabled = false;
+    fAddressIndex = fSpentIndex = fTimestampIndex = true;
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    uint160 hashKey = key.GetPubKey().GetID();
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = CScript() << OP_TRUE;
+
+    // A coinbase to the key, and once it is mature a spend sending half back
+    std::vector<CMutableTransaction> vNoTx;
+    CBlock blockFirst = CreateAndProcessBlock(vNoTx, scriptPubKey);
+    for (int i = 0; i < Params().COINBASE_MATURITY(); i++)
+        CreateAndProcessBlock(vNoTx, scriptOther);
+    const CTransaction& txCoinbase = blockFirst.vtx[0];
+    CAmount nValue = txCoinbase.vout[0].nValue;
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txCoinbase.GetHash(), 0);
+    txSpend.vout.resize(2);
+    txSpend.vout[0].nValue = nValue / 2;
+    txSpend.vout[0].scriptPubKey = scriptPubKey;
+    txSpend.vout[1].nValue = nValue - nValue / 2;
+    txSpend.vout[1].scriptPubKey = scriptOther;
+    BOOST_CHECK(SignSignature(keystore, txCoinbase, txSpend, 0));
+    CBlock blockSpend = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, txSpend), scriptOther);
+    int nSpendHeight = Params().COINBASE_MATURITY() + 2;
+    BOOST_CHECK_EQUAL(chainActive.Height(), nSpendHeight);
+    BOOST_CHECK(AddressIndexesSynced());
+
+    // After connecting: the credit, the debit and the change
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    BOOST_CHECK(GetAddressIndex(hashKey, ADDRESS_INDEX_PUBKEYHASH, vAddressIndex));
+    BOOST_REQUIRE_EQUAL(vAddressIndex.size(), 3U);
+    CAmount nBalance = 0;
+    for (unsigned int i = 0; i < vAddressIndex.size(); i++)
+        nBalance += vAddressIndex[i].second;
+    BOOST_CHECK_EQUAL(nBalance, nValue / 2);
+    BOOST_CHECK_EQUAL(vAddressIndex[0].first.blockHeight, 1);
+    BOOST_CHECK_EQUAL(vAddressIndex[2].first.blockHeight, nSpendHeight);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(GetAddressUnspent(hashKey, ADDRESS_INDEX_PUBKEYHASH, vUnspent));
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == txSpend.GetHash());
+    BOOST_CHECK_EQUAL(vUnspent[0].second.blockHeight, nSpendHeight);
+
+    CSpentIndexValue spentInfo;
+    BOOST_CHECK(GetSpentIndex(CSpentIndexKey(txCoinbase.GetHash(), 0), spentInfo));
+    BOOST_CHECK(spentInfo.txid == txSpend.GetHash());
+    BOOST_CHECK_EQUAL(spentInfo.blockHeight, nSpendHeight);
+    BOOST_CHECK_EQUAL(spentInfo.satoshis, nValue);
+
+    std::vector<uint256> vHashes;
+    BOOST_CHECK(GetTimestampIndex(blockSpend.nTime, blockSpend.nTime, vHashes));
+    BOOST_CHECK(std::count(vHashes.begin(), vHashes.end(), blockSpend.GetHash()));
+
+    // After disconnecting the spend, the coinbase is unspent again
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainActive.Tip()));
+    }
+    BOOST_CHECK(AddressIndexesSynced());
+    vAddressIndex.clear();
+    BOOST_CHECK(GetAddressIndex(hashKey, ADDRESS_INDEX_PUBKEYHASH, vAddressIndex));
+    BOOST_REQUIRE_EQUAL(vAddressIndex.size(), 1U);
+    BOOST_CHECK_EQUAL(vAddressIndex[0].second, nValue);
+    vUnspent.clear();
+    BOOST_CHECK(GetAddressUnspent(hashKey, ADDRESS_INDEX_PUBKEYHASH, vUnspent));
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == txCoinbase.GetHash());
+    BOOST_CHECK_EQUAL(vUnspent[0].second.blockHeight, 1);
+    BOOST_CHECK(!GetSpentIndex(CSpentIndexKey(txCoinbase.GetHash(), 0), spentInfo));
+    vHashes.clear();
+    BOOST_CHECK(GetTimestampIndex(blockSpend.nTime, blockSpend.nTime, vHashes));
+    BOOST_CHECK(!std::count(vHashes.begin(), vHashes.end(), blockSpend.GetHash()));
+
+    // Rewind the chain for the tests that follow
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainActive[1]));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+    vAddressIndex.clear();
+    BOOST_CHECK(GetAddressIndex(hashKey, ADDRESS_INDEX_PUBKEYHASH, vAddressIndex));
+    BOOST_CHECK(vAddressIndex.empty());
+    fAddressIndex = fSpentIndex = fTimestampIndex = false;
+    Checkpoints::fEnabled = true;
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,622 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "masternode.h"
+#include "masternode-budget.h"
+#include "masternode-helpers.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "spork.h"
+#include "swifttx.h"
+#include "utiltime.h"
+#include "validationinterface.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <stdint.h>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+static CPubKey RandomPubKey()
+{
+    unsigned char vch[33];
+    GetRandBytes(vch, sizeof(vch));
+    vch[0] = 0x02;
+    return CPubKey(vch, vch + sizeof(vch));
+}
+
+static CMasternode RandomMasternode()
+{
+    CMasternode mn;
+    mn.vin = CTxIn(GetRandHash(), GetRandInt(4));
+    mn.pubKeyCollateralAddress = RandomPubKey();
+    mn.pubKeyMasternode = RandomPubKey();
+    return mn;
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_index)
+{
+    CMasternodeMan mnman;
+    CMasternode mn = RandomMasternode();
+    BOOST_CHECK(mnman.Add(mn));
+    BOOST_CHECK(!mnman.Add(mn));
+    BOOST_CHECK_EQUAL(mnman.size(), 1);
+
+    CMasternodePtr pmn = mnman.Find(mn.vin);
+    BOOST_REQUIRE(pmn);
+    BOOST_CHECK(mnman.Find(mn.pubKeyMasternode) == pmn);
+    BOOST_CHECK(mnman.Find(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID())) == pmn);
+
+    // A newer broadcast with new keys re-keys the entry in place
+    CMasternodeBroadcast mnb(mn);
+    mnb.sigTime = mn.sigTime + 1;
+    mnb.pubKeyMasternode = RandomPubKey();
+    BOOST_CHECK(mnman.UpdateFromNewBroadcast(pmn, mnb));
+    BOOST_CHECK(mnman.Find(mn.vin) == pmn);
+    BOOST_CHECK(mnman.Find(mnb.pubKeyMasternode) == pmn);
+    BOOST_CHECK(!mnman.Find(mn.pubKeyMasternode));
+
+    // Adding more entries leaves handed out pointers alone
+    for (int i = 0; i < 100; i++) {
+        CMasternode mnOther = RandomMasternode();
+        mnman.Add(mnOther);
+    }
+    BOOST_CHECK(mnman.Find(mn.vin) == pmn);
+
+    // A removed entry can still be read through an old pointer
+    mnman.Remove(mn.vin);
+    BOOST_CHECK(!mnman.Find(mn.vin));
+    BOOST_CHECK(!mnman.Find(mnb.pubKeyMasternode));
+    BOOST_CHECK_EQUAL(mnman.size(), 100);
+    BOOST_CHECK(pmn->vin == mn.vin);
+
+    // Round trip through serialization rebuilds the indexes
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mnman;
+    CMasternodeMan mnmanLoaded;
+    ss >> mnmanLoaded;
+    BOOST_CHECK_EQUAL(mnmanLoaded.size(), 100);
+    std::vector<CMasternode> vMasternodes = mnman.GetFullMasternodeVector();
+    BOOST_FOREACH (CMasternode& mnLoaded, vMasternodes) {
+        CMasternodePtr pmnLoaded = mnmanLoaded.Find(mnLoaded.vin);
+        BOOST_REQUIRE(pmnLoaded);
+        BOOST_CHECK(mnmanLoaded.Find(mnLoaded.pubKeyMasternode) == pmnLoaded);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_handles)
+{
+    const int nMasternodes = 50;
+
+    CMasternodeMan mnman;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < nMasternodes; i++) {
+        vMasternodes.push_back(RandomMasternode());
+        BOOST_CHECK(mnman.Add(vMasternodes.back()));
+    }
+
+    // Pings resolve their sender by outpoint and their signer by pubkey to the
+    // same entry, and an update through a handle is seen by every later lookup
+    std::vector<CMasternodePtr> vHandles;
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternodePtr pmn = mnman.Find(vMasternodes[i].vin);
+        BOOST_REQUIRE(pmn);
+        BOOST_CHECK(mnman.Find(pmn->pubKeyMasternode) == pmn);
+        BOOST_CHECK(mnman.Find(GetScriptForDestination(pmn->pubKeyCollateralAddress.GetID())) == pmn);
+        pmn->lastPing.vin = pmn->vin;
+        pmn->lastPing.sigTime = i + 1;
+        vHandles.push_back(pmn);
+    }
+    for (int i = 0; i < nMasternodes; i++)
+        BOOST_CHECK_EQUAL(mnman.Find(vMasternodes[i].vin)->lastPing.sigTime, i + 1);
+
+    // Handles outlive the list: removed and cleared entries stay readable
+    // until the last holder lets go
+    mnman.Remove(vMasternodes[0].vin);
+    BOOST_CHECK(!mnman.Find(vMasternodes[0].vin));
+    BOOST_CHECK(vHandles[0]->vin == vMasternodes[0].vin);
+    BOOST_CHECK_EQUAL(vHandles[0].use_count(), 1);
+    mnman.Clear();
+    BOOST_CHECK_EQUAL(mnman.size(), 0);
+    for (int i = 0; i < nMasternodes; i++) {
+        BOOST_CHECK(vHandles[i]->vin == vMasternodes[i].vin);
+        BOOST_CHECK_EQUAL(vHandles[i]->lastPing.sigTime, i + 1);
+        BOOST_CHECK_EQUAL(vHandles[i].use_count(), 1);
+    }
+
+    // A re-added entry is a new object, not the one the old handle points to
+    BOOST_CHECK(mnman.Add(vMasternodes[1]));
+    BOOST_CHECK(mnman.Find(vMasternodes[1].vin) != vHandles[1]);
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_collateral_spends)
+{
+    CMasternodeMan mnman;
+    CMasternode mn = RandomMasternode();
+    CMasternode mnOther = RandomMasternode();
+    BOOST_CHECK(mnman.Add(mn));
+    BOOST_CHECK(mnman.Add(mnOther));
+    BOOST_CHECK(!mnman.IsCollateralSpent(mn.vin.prevout));
+
+    RegisterValidationInterface(&mnman);
+
+    // Transactions that don't touch a collateral leave the list alone
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(GetRandHash(), 0));
+    tx.vout.push_back(CTxOut(1 * COIN, CScript()));
+    SyncWithWallets(tx, NULL);
+    BOOST_CHECK(!mnman.IsCollateralSpent(mn.vin.prevout));
+    BOOST_CHECK(!mnman.IsCollateralSpent(mnOther.vin.prevout));
+
+    // A spend of the collateral flags it, wherever it was seen first
+    tx.vin.push_back(mn.vin);
+    SyncWithWallets(tx, NULL);
+    BOOST_CHECK(mnman.IsCollateralSpent(mn.vin.prevout));
+    BOOST_CHECK(!mnman.IsCollateralSpent(mnOther.vin.prevout));
+    CBlock block;
+    block.vtx.push_back(tx);
+    SyncWithWallets(tx, &block);
+    BOOST_CHECK(mnman.IsCollateralSpent(mn.vin.prevout));
+
+    // Disconnected blocks and conflicted spends are notified the same way, so
+    // the flag only sticks while the coin is really gone
+    {
+        LOCK(cs_main);
+        CMutableTransaction txCollateral;
+        txCollateral.vout.resize(mn.vin.prevout.n + 1);
+        txCollateral.vout[mn.vin.prevout.n].nValue = MASTERNODE_COLLATERAL * COIN;
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(mn.vin.prevout.hash);
+        coins->FromTx(txCollateral, 0);
+    }
+    mnman.RecheckSpentCollaterals();
+    BOOST_CHECK(!mnman.IsCollateralSpent(mn.vin.prevout));
+    SyncWithWallets(tx, NULL);
+    BOOST_CHECK(mnman.IsCollateralSpent(mn.vin.prevout));
+    {
+        LOCK(cs_main);
+        pcoinsTip->ModifyCoins(mn.vin.prevout.hash)->Clear();
+    }
+    mnman.RecheckSpentCollaterals();
+    BOOST_CHECK(mnman.IsCollateralSpent(mn.vin.prevout));
+
+    UnregisterValidationInterface(&mnman);
+
+    // Collaterals are followed for as long as their entry is listed
+    mnman.Remove(mn.vin);
+    BOOST_CHECK(!mnman.IsCollateralSpent(mn.vin.prevout));
+    BOOST_CHECK(mnman.Add(mn));
+    BOOST_CHECK(!mnman.IsCollateralSpent(mn.vin.prevout));
+}
+
+BOOST_AUTO_TEST_CASE(masternodeman_list_digest)
+{
+    CMasternodeMan mnman;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 50; i++) {
+        vMasternodes.push_back(RandomMasternode());
+        vMasternodes.back().sigTime = GetRandInt(1000000);
+        mnman.Add(vMasternodes.back());
+    }
+
+    // A snapshot loaded from disk has the same digest as the list it was saved from
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mnman;
+    CMasternodeMan mnmanSnapshot;
+    ss >> mnmanSnapshot;
+    std::vector<uint64_t> vShortIds, vSnapshotShortIds;
+    uint256 hashList = mnman.GetListDigest(vShortIds);
+    BOOST_CHECK(mnmanSnapshot.GetListDigest(vSnapshotShortIds) == hashList);
+    BOOST_CHECK(vSnapshotShortIds == vShortIds);
+    BOOST_CHECK_EQUAL(vShortIds.size(), 50U);
+
+    // New entries and new broadcasts of known ones show up as missing short ids
+    CMasternode mnNew = RandomMasternode();
+    mnman.Add(mnNew);
+    CMasternodePtr pmn = mnman.Find(vMasternodes[0].vin);
+    CMasternodeBroadcast mnb(*pmn);
+    mnb.sigTime++;
+    mnman.UpdateFromNewBroadcast(pmn, mnb);
+    BOOST_CHECK(mnman.GetListDigest(vShortIds) != hashList);
+
+    std::vector<uint64_t> vMissing;
+    std::set_difference(vShortIds.begin(), vShortIds.end(), vSnapshotShortIds.begin(), vSnapshotShortIds.end(), std::back_inserter(vMissing));
+    BOOST_CHECK_EQUAL(vMissing.size(), 2U);
+    BOOST_CHECK(std::count(vMissing.begin(), vMissing.end(), CMasternodeBroadcast(mnNew).GetHash().GetLow64()));
+    BOOST_CHECK(std::count(vMissing.begin(), vMissing.end(), mnb.GetHash().GetLow64()));
+}
+
+static void CheckTallies(CBudgetProposal& proposal)
+{
+    int nYeas = 0, nNays = 0, nAbstains = 0, nAllYeas = 0, nAllNays = 0;
+    for (std::map<uint256, CBudgetVote>::iterator it = proposal.mapVotes.begin(); it != proposal.mapVotes.end(); ++it) {
+        if (it->second.nVote == VOTE_YES) nAllYeas++;
+        if (it->second.nVote == VOTE_NO) nAllNays++;
+        if (!it->second.fValid) continue;
+        if (it->second.nVote == VOTE_YES) nYeas++;
+        if (it->second.nVote == VOTE_NO) nNays++;
+        if (it->second.nVote == VOTE_ABSTAIN) nAbstains++;
+    }
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), nYeas);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), nNays);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), nAbstains);
+    BOOST_CHECK_EQUAL(proposal.GetRatio(), nAllYeas + nAllNays ? (double)nAllYeas / (nAllYeas + nAllNays) : 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(budget_vote_tallies)
+{
+    const int nVoters = 30;
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+
+    CBudgetProposal proposal("test", "http://test", 0, 100, CScript(), 10 * COIN, GetRandHash());
+    std::vector<CMasternode> vVoters;
+    std::string strError;
+    for (int i = 0; i < nVoters; i++) {
+        vVoters.push_back(RandomMasternode());
+        // two thirds of the voters are listed masternodes
+        if (i % 3 != 0)
+            mnodeman.Add(vVoters.back());
+        CBudgetVote vote(vVoters.back().vin, proposal.GetHash(), i % 3 == 0 ? VOTE_ABSTAIN : (i % 3 == 1 ? VOTE_YES : VOTE_NO));
+        BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    }
+    CheckTallies(proposal);
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), nVoters / 3);
+
+    // Changed votes move between tallies
+    CBudgetVote vote(vVoters[1].vin, proposal.GetHash(), VOTE_NO);
+    BOOST_CHECK(!proposal.AddOrUpdateVote(vote, strError));
+    vote.nTime = nNow + BUDGET_VOTE_UPDATE_MIN;
+    BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    CheckTallies(proposal);
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), nVoters / 3 - 1);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), nVoters / 3 + 1);
+
+    // Votes of unknown masternodes stop counting, but stay in the ratio
+    proposal.CleanAndRemove(false);
+    CheckTallies(proposal);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 0);
+
+    // Loaded and copied proposals recount
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << proposal;
+    CBudgetProposal proposalLoaded;
+    ss >> proposalLoaded;
+    CheckTallies(proposalLoaded);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetAbstains(), nVoters / 3);
+    CBudgetProposal proposalCopy(proposal);
+    CheckTallies(proposalCopy);
+
+    // The manager recounts its proposals once a voter leaves the masternode list
+    uint256 hash = proposal.GetHash();
+    budget.mapProposals.insert(std::make_pair(hash, proposal));
+    budget.GetAllProposals();
+    mnodeman.Remove(vVoters[4].vin);
+    budget.GetAllProposals();
+    CheckTallies(budget.mapProposals[hash]);
+    BOOST_CHECK_EQUAL(budget.mapProposals[hash].GetYeas(), nVoters / 3 - 2);
+    budget.mapProposals.erase(hash);
+
+    BOOST_FOREACH (const CMasternode& mn, vVoters)
+        mnodeman.Remove(mn.vin);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_payment_store)
+{
+    CMasternodePaymentDB db(0, true);
+    CMasternodePayments payments;
+    for (int i = 1; i <= 3; i++) {
+        CMasternodePaymentWinner winner(CTxIn(GetRandHash(), 0));
+        winner.nBlockHeight = i;
+        winner.payee = GetScriptForDestination(RandomPubKey().GetID());
+        payments.mapMasternodePayeeVotes.insert(std::make_pair(winner.GetHash(), winner));
+        payments.mapMasternodeBlocks[i] = CMasternodeBlockPayees(i);
+        payments.mapMasternodeBlocks[i].AddPayee(winner.payee, 1);
+        payments.setDirtyBlocks.insert(i);
+    }
+
+    // Only the records marked as changed go to disk
+    unsigned int nWritten, nErased;
+    db.StageChanges('v', payments.mapMasternodePayeeVotes, payments.mapMasternodePayeeVotes.changed_keys());
+    db.StageChanges('b', payments.mapMasternodeBlocks, payments.setDirtyBlocks);
+    BOOST_CHECK(db.Commit(nWritten, nErased));
+    BOOST_CHECK_EQUAL(nWritten, 6U);
+    BOOST_CHECK_EQUAL(nErased, 0U);
+    BOOST_CHECK(payments.mapMasternodePayeeVotes.changed_keys().empty());
+    BOOST_CHECK(payments.setDirtyBlocks.empty());
+    BOOST_CHECK(db.Write(payments));
+    db.StageChanges('v', payments.mapMasternodePayeeVotes, payments.mapMasternodePayeeVotes.changed_keys());
+    db.StageChanges('b', payments.mapMasternodeBlocks, payments.setDirtyBlocks);
+    BOOST_CHECK(db.Commit(nWritten, nErased));
+    BOOST_CHECK_EQUAL(nWritten, 0U);
+    BOOST_CHECK_EQUAL(nErased, 0U);
+
+    // Changed entries are rewritten and the ones gone are erased
+    payments.mapMasternodeBlocks[2].AddPayee(payments.mapMasternodeBlocks[1].vecPayments[0].scriptPubKey, 1);
+    payments.setDirtyBlocks.insert(2);
+    payments.mapMasternodeBlocks.erase(3);
+    payments.setDirtyBlocks.insert(3);
+    payments.mapMasternodePayeeVotes.erase(payments.mapMasternodePayeeVotes.begin());
+    db.StageChanges('v', payments.mapMasternodePayeeVotes, payments.mapMasternodePayeeVotes.changed_keys());
+    db.StageChanges('b', payments.mapMasternodeBlocks, payments.setDirtyBlocks);
+    BOOST_CHECK(db.Commit(nWritten, nErased));
+    BOOST_CHECK_EQUAL(nWritten, 1U);
+    BOOST_CHECK_EQUAL(nErased, 2U);
+
+    // Records that don't decode are skipped on load and dropped by the next flush
+    BOOST_CHECK(db.CLevelDBWrapper::Write(std::make_pair('b', 4), std::string("x")));
+    CMasternodePayments paymentsLoaded;
+    BOOST_CHECK(db.Read(paymentsLoaded));
+    BOOST_CHECK_EQUAL(paymentsLoaded.mapMasternodePayeeVotes.size(), 2U);
+    BOOST_CHECK_EQUAL(paymentsLoaded.mapMasternodeBlocks.size(), 2U);
+    BOOST_CHECK_EQUAL(paymentsLoaded.mapMasternodeBlocks[2].vecPayments.size(), 2U);
+    BOOST_CHECK(paymentsLoaded.mapMasternodePayeeVotes.changed_keys().empty());
+    db.StageChanges('v', paymentsLoaded.mapMasternodePayeeVotes, paymentsLoaded.mapMasternodePayeeVotes.changed_keys());
+    db.StageChanges('b', paymentsLoaded.mapMasternodeBlocks, paymentsLoaded.setDirtyBlocks);
+    BOOST_CHECK(db.Commit(nWritten, nErased));
+    BOOST_CHECK_EQUAL(nWritten, 0U);
+    BOOST_CHECK_EQUAL(nErased, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_payments_last_paid)
+{
+    CMasternodePayments payments;
+    CScript payeeA = GetScriptForDestination(RandomPubKey().GetID());
+    CScript payeeB = GetScriptForDestination(RandomPubKey().GetID());
+    CScript payeeC = GetScriptForDestination(RandomPubKey().GetID());
+    payments.mapMasternodeBlocks[10] = CMasternodeBlockPayees(10);
+    payments.mapMasternodeBlocks[10].AddPayee(payeeA, 2);
+    payments.mapMasternodeBlocks[10].AddPayee(payeeB, 1);
+    payments.mapMasternodeBlocks[20] = CMasternodeBlockPayees(20);
+    payments.mapMasternodeBlocks[20].AddPayee(payeeA, 1);
+    payments.mapMasternodeBlocks[30] = CMasternodeBlockPayees(30);
+    payments.mapMasternodeBlocks[30].AddPayee(payeeB, 3);
+    payments.mapMasternodeBlocks[40] = CMasternodeBlockPayees(40);
+    payments.mapMasternodeBlocks[40].AddPayee(payeeA, 5);
+    payments.ReindexPaidHeights();
+
+    // Only blocks with enough votes count, and only within the blocks looked back over
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeA, 35, 100), 10);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeA, 45, 100), 40);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeA, 40, 1), 40);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeA, 39, 29), 0);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeA, 39, 30), 10);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeB, 35, 100), 30);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeB, 29, 100), 0);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeC, 45, 100), 0);
+
+    // The test chain is at genesis, so blocks 0 to 8 are scheduled
+    payments.mapMasternodeBlocks[5] = CMasternodeBlockPayees(5);
+    payments.mapMasternodeBlocks[5].AddPayee(payeeC, 1);
+    payments.mapMasternodeBlocks[9] = CMasternodeBlockPayees(9);
+    payments.mapMasternodeBlocks[9].AddPayee(payeeB, 1);
+    BOOST_CHECK(payments.GetScheduledPayees(0).count(payeeC));
+    BOOST_CHECK(!payments.GetScheduledPayees(5).count(payeeC));
+    BOOST_CHECK(!payments.GetScheduledPayees(0).count(payeeB));
+}
+
+static CDataStream SignedPing(CKey& key)
+{
+    CMasternodePing mnp;
+    mnp.vin = CTxIn(GetRandHash(), 0);
+    mnp.sigTime = GetAdjustedTime();
+    std::string errorMessage;
+    BOOST_CHECK(masternodeSigner.SignMessage(mnp.GetStrMessage(), errorMessage, mnp.vchSig, key));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << mnp;
+    return ss;
+}
+
+BOOST_AUTO_TEST_CASE(masternode_message_verifier)
+{
+    const int nMessages = 50;
+    const int nThreads = 4;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+
+    // A cached signer still has to match the expected key
+    CMasternodePing mnp;
+    CDataStream ssPing = SignedPing(key);
+    ssPing >> mnp;
+    std::string errorMessage;
+    BOOST_CHECK(!masternodeSigner.HaveMessageSigner(mnp.GetStrMessage(), mnp.vchSig));
+    BOOST_CHECK(masternodeSigner.VerifyMessage(pubkey, mnp.vchSig, mnp.GetStrMessage(), errorMessage));
+    BOOST_CHECK(masternodeSigner.HaveMessageSigner(mnp.GetStrMessage(), mnp.vchSig));
+    BOOST_CHECK(masternodeSigner.VerifyMessage(pubkey, mnp.vchSig, mnp.GetStrMessage(), errorMessage));
+    BOOST_CHECK(!masternodeSigner.VerifyMessage(keyOther.GetPubKey(), mnp.vchSig, mnp.GetStrMessage(), errorMessage));
+
+    // Only masternode messages are ever held back for their signatures
+    BOOST_CHECK(CMasternodeMessageVerifier::IsVerifiedCommand("mnlistdiff"));
+    BOOST_CHECK(CMasternodeMessageVerifier::IsVerifiedCommand("txlvote"));
+    BOOST_CHECK(!CMasternodeMessageVerifier::IsVerifiedCommand("block"));
+    BOOST_CHECK(!CMasternodeMessageVerifier::IsVerifiedCommand("headers"));
+
+    // Without threads messages are processed right away
+    CMasternodeMessageVerifier verifier;
+    BOOST_CHECK(!verifier.Push(1, "mnp", SignedPing(key)));
+
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&CMasternodeMessageVerifier::Thread, &verifier));
+    MilliSleep(10);
+
+    // Verified messages come back in the order they were pushed, and hit the cache after that
+    std::vector<CDataStream> vMessages;
+    for (int i = 0; i < nMessages; i++) {
+        vMessages.push_back(SignedPing(key));
+        BOOST_CHECK(verifier.Push(1, "mnp", vMessages.back()));
+    }
+    int nPopped = 0;
+    int64_t nTimeout = GetTimeMillis() + 60 * 1000;
+    while (nPopped < nMessages && GetTimeMillis() < nTimeout) {
+        std::string strCommand;
+        CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+        if (!verifier.PopVerified(1, strCommand, vRecv)) {
+            MilliSleep(1);
+            continue;
+        }
+        BOOST_CHECK_EQUAL(strCommand, "mnp");
+        BOOST_CHECK(vRecv.str() == vMessages[nPopped].str());
+        CMasternodePing mnpVerified;
+        vRecv >> mnpVerified;
+        BOOST_CHECK(masternodeSigner.HaveMessageSigner(mnpVerified.GetStrMessage(), mnpVerified.vchSig));
+        BOOST_CHECK(masternodeSigner.VerifyMessage(pubkey, mnpVerified.vchSig, mnpVerified.GetStrMessage(), errorMessage));
+        nPopped++;
+    }
+    BOOST_CHECK_EQUAL(nPopped, nMessages);
+
+    // A peer with too many messages waiting is held back, without dropping any or holding back others
+    CDataStream ssFlood = SignedPing(key);
+    for (unsigned int i = 0; i < MAX_MASTERNODE_VERIFY_PENDING; i++) {
+        BOOST_CHECK(!verifier.IsFull(3));
+        BOOST_CHECK(verifier.Push(3, "mnp", ssFlood));
+    }
+    BOOST_CHECK(verifier.IsFull(3));
+    BOOST_CHECK(!verifier.IsFull(4));
+    BOOST_CHECK(verifier.Push(4, "mnp", SignedPing(key)));
+    nPopped = 0;
+    nTimeout = GetTimeMillis() + 60 * 1000;
+    while (nPopped < (int)MAX_MASTERNODE_VERIFY_PENDING && GetTimeMillis() < nTimeout) {
+        std::string strCommand;
+        CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+        if (!verifier.PopVerified(3, strCommand, vRecv)) {
+            MilliSleep(1);
+            continue;
+        }
+        nPopped++;
+    }
+    BOOST_CHECK_EQUAL(nPopped, (int)MAX_MASTERNODE_VERIFY_PENDING);
+    BOOST_CHECK(!verifier.IsFull(3));
+    verifier.RemoveNode(3);
+    verifier.RemoveNode(4);
+
+    // Messages of a disconnected peer are dropped
+    BOOST_CHECK(verifier.Push(2, "mnp", SignedPing(key)));
+    verifier.RemoveNode(2);
+    MilliSleep(10);
+    std::string strCommand;
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(!verifier.PopVerified(2, strCommand, vRecv));
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_lock_manager)
+{
+    CTransactionLockManager manager;
+    std::vector<CTransactionLock> vLocks(4);
+    for (unsigned int i = 0; i < vLocks.size(); i++) {
+        vLocks[i].txHash = GetRandHash();
+        manager.SetExpiration(vLocks[i], 1000 + i * 100);
+    }
+
+    // Moving a lock takes it out of its old place in the order
+    manager.SetExpiration(vLocks[0], 1500);
+    manager.SetExpiration(vLocks[3], 1050);
+
+    std::vector<uint256> vExpired;
+    manager.PopExpired(1000, vExpired);
+    BOOST_CHECK(vExpired.empty());
+    manager.PopExpired(1201, vExpired);
+    BOOST_CHECK_EQUAL(vExpired.size(), 3U);
+    BOOST_CHECK(vExpired[0] == vLocks[3].txHash);
+    BOOST_CHECK(vExpired[1] == vLocks[1].txHash);
+    BOOST_CHECK(vExpired[2] == vLocks[2].txHash);
+    vExpired.clear();
+    manager.PopExpired(2000, vExpired);
+    BOOST_CHECK_EQUAL(vExpired.size(), 1U);
+    BOOST_CHECK(vExpired[0] == vLocks[0].txHash);
+
+    // Only locks whose request was seen count towards the latency
+    int64_t nCount, nAverage, nMax, nLast;
+    manager.LockCompleted(vLocks[0]);
+    vLocks[1].nTimeReceived = GetTimeMicros() - 4000;
+    manager.LockCompleted(vLocks[1]);
+    vLocks[2].nTimeReceived = GetTimeMicros() - 2000;
+    manager.LockCompleted(vLocks[2]);
+    manager.GetLatencyStats(nCount, nAverage, nMax, nLast);
+    BOOST_CHECK_EQUAL(nCount, 2);
+    BOOST_CHECK(nMax >= 4000);
+    BOOST_CHECK(nLast >= 2000 && nLast <= nMax);
+    BOOST_CHECK(nAverage >= 3000 && nAverage <= nMax);
+
+    // There is no quorum for a block that isn't known
+    BOOST_CHECK_EQUAL(manager.GetQuorumRank(CTxIn(GetRandHash(), 0), 1000000), -1);
+    BOOST_CHECK_EQUAL(manager.CountQuorums(), 0);
+
+    // Quorums are kept by block hash, and dropped when the masternode list changes
+    const int nBlockHeight = 1000;
+    mapCacheBlockHashes[nBlockHeight] = GetRandHash();
+    BOOST_CHECK_EQUAL(manager.GetQuorumRank(CTxIn(GetRandHash(), 0), nBlockHeight), -1);
+    BOOST_CHECK_EQUAL(manager.CountQuorums(), 1);
+    BOOST_CHECK_EQUAL(manager.GetQuorumRank(CTxIn(GetRandHash(), 0), nBlockHeight), -1);
+    BOOST_CHECK_EQUAL(manager.CountQuorums(), 1);
+    mapCacheBlockHashes[nBlockHeight] = GetRandHash();
+    BOOST_CHECK_EQUAL(manager.GetQuorumRank(CTxIn(GetRandHash(), 0), nBlockHeight), -1);
+    BOOST_CHECK_EQUAL(manager.CountQuorums(), 2);
+    manager.ClearQuorums();
+    BOOST_CHECK_EQUAL(manager.CountQuorums(), 0);
+    mapCacheBlockHashes.erase(nBlockHeight);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_rank_sporks)
+{
+    // Payment enforcement makes ranking skip masternodes younger than SPORK_16
+    CSporkMessage spork;
+    spork.nSporkID = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT;
+    spork.nValue = 0;
+    spork.nTimeSigned = GetTime();
+    SetSporkActive(spork);
+    BOOST_CHECK(IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT));
+    BOOST_CHECK_EQUAL(GetSporkValue(SPORK_16_MN_WINNER_MINIMUM_AGE), SPORK_16_MN_WINNER_MINIMUM_AGE_DEFAULT);
+    BOOST_CHECK_EQUAL(GetSporkValue(SPORK_END + 1), -1);
+
+    const int nBlockHeight = 1000;
+    mapCacheBlockHashes[nBlockHeight] = GetRandHash();
+
+    CMasternodeMan mnman;
+    const int nMasternodes = 200;
+    std::vector<CTxIn> vecVin;
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternode mn = RandomMasternode();
+        mn.sigTime = GetAdjustedTime() - SPORK_16_MN_WINNER_MINIMUM_AGE_DEFAULT * 2;
+        mn.protocolVersion = PROTOCOL_VERSION;
+        mnman.Add(mn);
+        vecVin.push_back(mn.vin);
+    }
+    CMasternode mnYoung = RandomMasternode();
+    mnYoung.sigTime = GetAdjustedTime();
+    mnYoung.protocolVersion = PROTOCOL_VERSION;
+    mnman.Add(mnYoung);
+
+    std::set<int> setRanks;
+    const int nRuns = 20;
+    for (int i = 0; i < nRuns; i++)
+        setRanks.insert(mnman.GetMasternodeRank(vecVin[i], nBlockHeight, 0, false));
+    BOOST_CHECK_EQUAL(setRanks.size(), (size_t)nRuns);
+    BOOST_CHECK(*setRanks.begin() >= 1 && *setRanks.rbegin() <= nMasternodes);
+    BOOST_CHECK_EQUAL(mnman.GetMasternodeRank(mnYoung.vin, nBlockHeight, 0, false), -1);
+
+    spork.nValue = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
+    spork.nTimeSigned++;
+    SetSporkActive(spork);
+    BOOST_CHECK(!IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT));
+    BOOST_CHECK(mnman.GetMasternodeRank(mnYoung.vin, nBlockHeight, 0, false) > 0);
+    mapCacheBlockHashes.erase(nBlockHeight);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,11 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "hash.h"
 #include "key.h"
 #include "keystore.h"
 #include "main.h"
+#include "random.h"
 #include "script/script.h"
 #include "script/script_error.h"
 #include "script/interpreter.h"
@@ -277,6 +279,40 @@ BOOST_AUTO_TEST_CASE(multisig_Solver1)
     }
 }
 
+#ifdef ENABLE_WALLET
+BOOST_AUTO_TEST_CASE(multisig_IsMine_index)
+{
+    // IsMine() rejects P2PKH, P2PK and P2SH scripts the keystore did not index
+    CBasicKeyStore keystore;
+    CKey key[3];
+    for (int i = 0; i < 3; i++)
+        key[i].MakeNewKey(i != 2);
+    keystore.AddKey(key[0]);
+
+    CScript redeem = GetScriptForDestination(key[0].GetPubKey().GetID());
+    BOOST_CHECK(!IsMine(keystore, GetScriptForDestination(CScriptID(redeem))));
+    keystore.AddCScript(redeem);
+    BOOST_CHECK(IsMine(keystore, GetScriptForDestination(CScriptID(redeem))));
+
+    BOOST_CHECK(IsMine(keystore, CScript() << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG));
+    BOOST_CHECK(!IsMine(keystore, CScript() << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG));
+    BOOST_CHECK(!IsMine(keystore, CScript() << ToByteVector(key[2].GetPubKey()) << OP_CHECKSIG));
+
+    CScript watched = GetScriptForDestination(key[1].GetPubKey().GetID());
+    BOOST_CHECK(!IsMine(keystore, watched));
+    keystore.AddWatchOnly(watched);
+    BOOST_CHECK(IsMine(keystore, watched) == ISMINE_WATCH_ONLY);
+
+    keystore.AddKey(key[2]);
+    BOOST_CHECK(IsMine(keystore, CScript() << ToByteVector(key[2].GetPubKey()) << OP_CHECKSIG));
+    BOOST_CHECK(IsMine(keystore, GetScriptForDestination(key[2].GetPubKey().GetID())));
+
+    // Outputs paying to other wallets
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK(!IsMine(keystore, GetScriptForDestination(CKeyID(Hash160(ToByteVector(GetRandHash()))))));
+}
+#endif
+
 BOOST_AUTO_TEST_CASE(multisig_Sign)
 {
     // Test SignSignature() (and therefore the version of Solver() that signs transactions)
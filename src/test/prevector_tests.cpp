@@ -0,0 +1,143 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "prevector.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "serialize.h"
+#include "streams.h"
+
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(prevector_tests)
+
+typedef prevector<8, unsigned char> small_vector;
+typedef prevector<2, small_vector> nested_vector;
+
+static void CheckEqual(const small_vector& pre, const std::vector<unsigned char>& real)
+{
+    BOOST_REQUIRE_EQUAL(pre.size(), real.size());
+    BOOST_CHECK_EQUAL(pre.empty(), real.empty());
+    BOOST_CHECK(pre.capacity() >= pre.size());
+    for (unsigned int i = 0; i < real.size(); i++)
+        BOOST_CHECK_EQUAL(pre[i], real[i]);
+    BOOST_CHECK_EQUAL(pre.allocated_memory() == 0, pre.capacity() == 8);
+
+    // Serializes like the std::vector
+    CDataStream ssPre(SER_DISK, CLIENT_VERSION);
+    CDataStream ssReal(SER_DISK, CLIENT_VERSION);
+    ssPre << pre;
+    ssReal << real;
+    BOOST_CHECK(ssPre.str() == ssReal.str());
+    small_vector preLoaded;
+    ssPre >> preLoaded;
+    BOOST_CHECK(preLoaded == pre);
+}
+
+BOOST_AUTO_TEST_CASE(prevector_random)
+{
+    seed_insecure_rand(false);
+    for (int run = 0; run < 64; run++) {
+        small_vector pre;
+        std::vector<unsigned char> real;
+        for (int i = 0; i < 1024; i++) {
+            unsigned char value = insecure_rand();
+            unsigned int pos = real.empty() ? 0 : insecure_rand() % real.size();
+            switch (insecure_rand() % 10) {
+            case 0:
+                pre.push_back(value);
+                real.push_back(value);
+                break;
+            case 1:
+                if (!real.empty()) {
+                    pre.pop_back();
+                    real.pop_back();
+                }
+                break;
+            case 2:
+                pre.insert(pre.begin() + pos, value);
+                real.insert(real.begin() + pos, value);
+                break;
+            case 3: {
+                unsigned int count = insecure_rand() % 16;
+                pre.insert(pre.begin() + pos, count, value);
+                real.insert(real.begin() + pos, count, value);
+                break;
+            }
+            case 4: {
+                unsigned char range[12];
+                unsigned int count = insecure_rand() % sizeof(range);
+                for (unsigned int j = 0; j < count; j++)
+                    range[j] = insecure_rand();
+                pre.insert(pre.begin() + pos, range, range + count);
+                real.insert(real.begin() + pos, range, range + count);
+                break;
+            }
+            case 5:
+                if (!real.empty()) {
+                    unsigned int last = pos + insecure_rand() % (real.size() - pos + 1);
+                    pre.erase(pre.begin() + pos, pre.begin() + last);
+                    real.erase(real.begin() + pos, real.begin() + last);
+                }
+                break;
+            case 6: {
+                unsigned int size = insecure_rand() % 24;
+                pre.resize(size);
+                real.resize(size);
+                break;
+            }
+            case 7:
+                if (insecure_rand() % 2)
+                    pre.shrink_to_fit();
+                else
+                    pre.reserve(insecure_rand() % 32);
+                break;
+            case 8: {
+                small_vector copy(pre);
+                BOOST_CHECK(copy == pre);
+                small_vector moved(std::move(copy));
+                BOOST_CHECK(copy.empty());
+                pre.swap(moved);
+                BOOST_CHECK(moved == pre);
+                break;
+            }
+            case 9:
+                if (insecure_rand() % 8 == 0) {
+                    pre.clear();
+                    real.clear();
+                }
+                break;
+            }
+            CheckEqual(pre, real);
+        }
+        BOOST_CHECK_EQUAL(pre < small_vector(), real < std::vector<unsigned char>());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prevector_nested)
+{
+    // Elements that own heap memory move with the storage they are in
+    nested_vector v;
+    for (unsigned char i = 1; i <= 20; i++) {
+        small_vector elem((small_vector::size_type)i, i);
+        v.insert(v.begin() + v.size() / 2, elem);
+    }
+    v.erase(v.begin(), v.begin() + 5);
+    nested_vector copy = v;
+    v.clear();
+    v.shrink_to_fit();
+    BOOST_CHECK_EQUAL(v.allocated_memory(), 0U);
+
+    BOOST_REQUIRE_EQUAL(copy.size(), 15U);
+    for (unsigned int i = 0; i < copy.size(); i++) {
+        BOOST_REQUIRE(!copy[i].empty());
+        BOOST_CHECK_EQUAL(copy[i].size(), copy[i][0]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -268,7 +268,7 @@ public:
 
     TestBuilder& PushRedeem()
     {
-        DoPush(static_cast<std::vector<unsigned char> >(scriptPubKey));
+        DoPush(ToByteVector(scriptPubKey));
         return *this;
     }
 
@@ -667,6 +667,34 @@ BOOST_AUTO_TEST_CASE(script_invalid)
     }
 }
 
+BOOST_AUTO_TEST_CASE(script_inline_storage)
+{
+    // A pay-to-pubkey-hash spend is evaluated without touching the heap for
+    // its scripts or stack elements
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CMutableTransaction txFrom = BuildCreditingTransaction(GetScriptForDestination(key.GetPubKey().GetID()));
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), txFrom);
+    BOOST_REQUIRE(SignSignature(keystore, txFrom, txTo, 0));
+    const CScript& scriptPubKey = txFrom.vout[0].scriptPubKey;
+    const CScript& scriptSig = txTo.vin[0].scriptSig;
+    BOOST_CHECK_EQUAL(scriptPubKey.allocated_memory(), 0U);
+
+    ScriptError err;
+    CScriptStack stack;
+    BOOST_REQUIRE(EvalScript(stack, scriptSig, flags, BaseSignatureChecker(), &err));
+    BOOST_REQUIRE_EQUAL(stack.size(), 2U);
+    BOOST_CHECK_EQUAL(stack.allocated_memory(), 0U);
+    BOOST_FOREACH (const CScriptStackElement& elem, stack)
+        BOOST_CHECK_EQUAL(elem.allocated_memory(), 0U);
+
+    BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&txTo, 0), &err));
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_OK);
+}
+
 BOOST_AUTO_TEST_CASE(script_PushData)
 {
     // Check that PUSHDATA1, PUSHDATA2, and PUSHDATA4 create the same value on
@@ -878,7 +906,7 @@ BOOST_AUTO_TEST_CASE(script_combineSigs)
     combined = CombineSignatures(scriptPubKey, txTo, 0, scriptSigCopy, scriptSig);
     BOOST_CHECK(combined == scriptSigCopy || combined == scriptSig);
     // dummy scriptSigCopy with placeholder, should always choose non-placeholder:
-    scriptSigCopy = CScript() << OP_0 << static_cast<vector<unsigned char> >(pkSingle);
+    scriptSigCopy = CScript() << OP_0 << ToByteVector(pkSingle);
     combined = CombineSignatures(scriptPubKey, txTo, 0, scriptSigCopy, scriptSig);
     BOOST_CHECK(combined == scriptSig);
     combined = CombineSignatures(scriptPubKey, txTo, 0, scriptSig, scriptSigCopy);
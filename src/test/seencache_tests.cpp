@@ -0,0 +1,228 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "seencache.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(seencache_tests)
+
+BOOST_AUTO_TEST_CASE(seencache_size)
+{
+    seencache<uint256, int> cache(100);
+    std::vector<uint256> vKeys;
+    for (int i = 0; i < 150; i++) {
+        vKeys.push_back(GetRandHash());
+        BOOST_CHECK(cache.insert(std::make_pair(vKeys.back(), i)).second);
+        BOOST_CHECK(!cache.insert(std::make_pair(vKeys.back(), i)).second);
+    }
+
+    // The oldest entries went first
+    BOOST_CHECK_EQUAL(cache.size(), 100U);
+    for (int i = 0; i < 150; i++)
+        BOOST_CHECK_EQUAL(cache.count(vKeys[i]), i < 50 ? 0U : 1U);
+    BOOST_CHECK_EQUAL(cache.find(vKeys[120])->second, 120);
+
+    size_t nUsage = cache.memory_usage();
+    BOOST_CHECK(nUsage > 0);
+    BOOST_CHECK_EQUAL(cache.erase(vKeys[120]), 1U);
+    BOOST_CHECK_EQUAL(cache.erase(vKeys[120]), 0U);
+    BOOST_CHECK(cache.memory_usage() < nUsage);
+
+    seencache<uint256, int>::iterator it = cache.begin();
+    while (it != cache.end())
+        it = cache.erase(it);
+    BOOST_CHECK(cache.empty());
+    BOOST_CHECK_EQUAL(cache.memory_usage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(seencache_age)
+{
+    SetMockTime(1000000);
+    seencache<uint256, int> cache(0, 60);
+    uint256 hashOld = GetRandHash();
+    cache.insert(std::make_pair(hashOld, 1));
+
+    SetMockTime(1000040);
+    uint256 hashNew = GetRandHash();
+    cache.insert(std::make_pair(hashNew, 2));
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+    // Entries past their age go on the next insert or expire
+    SetMockTime(1000070);
+    cache.expire();
+    BOOST_CHECK(!cache.count(hashOld));
+    BOOST_CHECK(cache.count(hashNew));
+
+    SetMockTime(1000200);
+    cache.insert(std::make_pair(GetRandHash(), 3));
+    BOOST_CHECK(!cache.count(hashNew));
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(seencache_insert)
+{
+    SetMockTime(1000000);
+    seencache<uint256, std::string> cache(0, 60);
+    uint256 hash = GetRandHash();
+    BOOST_CHECK(cache.Insert(hash, std::string()).second);
+    size_t nUsageEmpty = cache.memory_usage();
+
+    // Replacing a value counts the memory of the new one and keeps the age
+    SetMockTime(1000040);
+    BOOST_CHECK(!cache.Insert(hash, std::string(1000, 'x')).second);
+    BOOST_CHECK_EQUAL(cache.find(hash)->second.size(), 1000U);
+    BOOST_CHECK(cache.memory_usage() >= nUsageEmpty + 1000);
+    BOOST_CHECK(cache.Insert(GetRandHash(), std::string()).second);
+    SetMockTime(1000070);
+    cache.expire();
+    BOOST_CHECK(!cache.count(hash));
+    BOOST_CHECK_EQUAL(cache.memory_usage(), nUsageEmpty);
+
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.memory_usage(), 0U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(seencache_changes)
+{
+    seencache<uint256, int> cache(2);
+    uint256 hash1 = GetRandHash(), hash2 = GetRandHash(), hash3 = GetRandHash();
+    cache.Insert(hash1, 1);
+    BOOST_CHECK(cache.changed_keys().empty());
+
+    // Once tracked, inserts, replacements, evictions and erases are all kept
+    cache.track_changes();
+    cache.Insert(hash1, 2);
+    cache.Insert(hash2, 2);
+    cache.Insert(hash3, 3);
+    BOOST_CHECK(!cache.count(hash1));
+    BOOST_CHECK_EQUAL(cache.changed_keys().size(), 3U);
+    cache.changed_keys().clear();
+    cache.erase(hash2);
+    BOOST_CHECK_EQUAL(cache.changed_keys().size(), 1U);
+    BOOST_CHECK(cache.changed_keys().count(hash2));
+    cache.changed_keys().clear();
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.changed_keys().size(), 1U);
+    BOOST_CHECK(cache.changed_keys().count(hash3));
+}
+
+static bool IsEven(const uint256& hash, const int& n)
+{
+    return n % 2 == 0;
+}
+
+BOOST_AUTO_TEST_CASE(seencache_keep)
+{
+    // Entries the owner keeps survive both bounds, the others go in their place
+    SetMockTime(1000000);
+    seencache<uint256, int> cache(10, 60);
+    cache.keep_if(IsEven);
+    std::vector<uint256> vKeys;
+    for (int i = 0; i < 30; i++) {
+        vKeys.push_back(GetRandHash());
+        cache.insert(std::make_pair(vKeys.back(), i));
+    }
+    for (int i = 0; i < 30; i += 2)
+        BOOST_CHECK(cache.count(vKeys[i]));
+    // inserts move a few kept entries at most, expire() goes through them all
+    BOOST_CHECK(cache.size() >= 15U);
+    cache.expire();
+    BOOST_CHECK_EQUAL(cache.size(), 15U);
+
+    SetMockTime(1000100);
+    cache.expire();
+    BOOST_CHECK_EQUAL(cache.size(), 15U);
+
+    // Once no longer kept they are evicted like any other
+    cache.keep_if(seencache<uint256, int>::keep_function());
+    cache.expire();
+    BOOST_CHECK_EQUAL(cache.size(), 10U);
+    SetMockTime(1000200);
+    cache.expire();
+    BOOST_CHECK(cache.empty());
+    SetMockTime(0);
+}
+
+static unsigned int nKeepCalls = 0;
+
+static bool CountKeep(const uint256& hash, const int& n)
+{
+    nKeepCalls++;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(seencache_keep_bounded)
+{
+    // With more kept entries than the maximum, an insert doesn't walk all of them
+    seencache<uint256, int> cache(10);
+    cache.keep_if(CountKeep);
+    for (int i = 0; i < 1000; i++) {
+        nKeepCalls = 0;
+        cache.insert(std::make_pair(GetRandHash(), i));
+        BOOST_CHECK(nKeepCalls <= SEENCACHE_KEPT_PER_INSERT);
+    }
+    BOOST_CHECK_EQUAL(cache.size(), 1000U);
+    nKeepCalls = 0;
+    cache.expire();
+    BOOST_CHECK_EQUAL(nKeepCalls, 1000U);
+}
+
+BOOST_AUTO_TEST_CASE(seencache_serialize)
+{
+    // Same format as the std::map it replaces on disk
+    std::map<uint256, std::string> map;
+    seencache<uint256, std::string> cache;
+    for (int i = 0; i < 10; i++) {
+        uint256 hash = GetRandHash();
+        map.insert(std::make_pair(hash, strprintf("%d", i)));
+        cache.insert(std::make_pair(hash, strprintf("%d", i)));
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << map;
+    BOOST_CHECK_EQUAL(ss.size(), ::GetSerializeSize(cache, SER_DISK, CLIENT_VERSION));
+    seencache<uint256, std::string> cacheLoaded;
+    ss >> cacheLoaded;
+    BOOST_CHECK_EQUAL(cacheLoaded.size(), 10U);
+
+    ss << cacheLoaded;
+    std::map<uint256, std::string> mapLoaded;
+    ss >> mapLoaded;
+    BOOST_CHECK(mapLoaded == map);
+
+    // Copies keep their own eviction order
+    seencache<uint256, std::string> cacheCopy(cache);
+    cache.clear();
+    BOOST_CHECK_EQUAL(cacheCopy.size(), 10U);
+    while (!cacheCopy.empty())
+        cacheCopy.erase(cacheCopy.begin());
+
+    // Ages are not stored, loaded entries start over at load time
+    SetMockTime(1000000);
+    seencache<uint256, std::string> cacheAged(0, 60);
+    cacheAged.insert(std::make_pair(GetRandHash(), std::string("old")));
+    ss << cacheAged;
+    SetMockTime(1000050);
+    seencache<uint256, std::string> cacheAgedLoaded(0, 60);
+    ss >> cacheAgedLoaded;
+    SetMockTime(1000070);
+    cacheAged.expire();
+    cacheAgedLoaded.expire();
+    BOOST_CHECK(cacheAged.empty());
+    BOOST_CHECK_EQUAL(cacheAgedLoaded.size(), 1U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
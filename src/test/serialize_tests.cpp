@@ -5,6 +5,9 @@
 #include "serialize.h"
 #include "streams.h"
 
+#include "clientversion.h"
+#include "primitives/transaction.h"
+
 #include <stdint.h>
 
 #include <boost/test/unit_test.hpp>
@@ -161,4 +164,44 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[1].prevout.n = 7;
+    tx.vin[1].scriptSig = CScript() << OP_1 << std::vector<unsigned char>(100, 0x42);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 12345;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << VARINT(300) << std::string("span") << CTransaction(tx);
+    std::string strData = ss.str();
+
+    // Reads what CDataStream reads, in place
+    CSpanReader reader(strData.data(), strData.data() + strData.size(), SER_DISK, CLIENT_VERSION);
+    int n;
+    std::string str;
+    CTransaction txRead;
+    reader >> VARINT(n) >> str;
+    BOOST_CHECK_EQUAL(n, 300);
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_EQUAL(reader.size(), ::GetSerializeSize(CTransaction(tx), SER_DISK, CLIENT_VERSION));
+    reader >> txRead;
+    BOOST_CHECK(txRead.GetHash() == CTransaction(tx).GetHash());
+    BOOST_CHECK(reader.eof());
+
+    // And stops at the end of its memory
+    CSpanReader shortReader(strData.data(), strData.data() + strData.size() - 1, SER_DISK, CLIENT_VERSION);
+    shortReader >> VARINT(n) >> str;
+    BOOST_CHECK_THROW(shortReader >> txRead, std::ios_base::failure);
+    CSpanReader emptyReader(strData.data(), strData.data(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK_THROW(emptyReader.ignore(1), std::ios_base::failure);
+
+    // The wiping stream serializes the same bytes
+    CSecureDataStream ssSecure(SER_DISK, CLIENT_VERSION);
+    ssSecure << VARINT(300) << std::string("span") << CTransaction(tx);
+    BOOST_CHECK(ssSecure.str() == strData);
+    CDataStream ssCopy(std::vector<unsigned char>(ssSecure.begin(), ssSecure.end()), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(ssCopy.str() == strData);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
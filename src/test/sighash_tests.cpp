@@ -206,6 +206,44 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
 
         sh = SignatureHash(scriptCode, tx, nIn, nHashType);
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
+
+        CSignatureHashCache sighashCache(tx);
+        BOOST_CHECK_MESSAGE(sighashCache.SignatureHash(scriptCode, nIn, nHashType) == sh, strTest);
+    }
+}
+
+// Goal: check that the sighash cache matches SignatureHash for every input and hash type
+BOOST_AUTO_TEST_CASE(sighash_cache)
+{
+    seed_insecure_rand(false);
+
+    static const int hashTypes[] = {SIGHASH_ALL, SIGHASH_NONE, SIGHASH_SINGLE};
+    for (int i = 0; i < 2000; i++) {
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, i % 2 == 0);
+        CTransaction tx(txTo);
+        CSignatureHashCache sighashCache(tx);
+        CSignatureHashCache sighashCacheMutable(txTo);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+
+        // Including inputs out of range and the hash types nothing defines
+        for (unsigned int nIn = 0; nIn <= tx.vin.size(); nIn++) {
+            for (unsigned int t = 0; t < 3; t++) {
+                int nHashType = hashTypes[t] | ((insecure_rand() % 2) ? SIGHASH_ANYONECANPAY : 0);
+                uint256 sh = SignatureHash(scriptCode, tx, nIn, nHashType);
+                BOOST_CHECK(sighashCache.SignatureHash(scriptCode, nIn, nHashType) == sh);
+                BOOST_CHECK(sighashCacheMutable.SignatureHash(scriptCode, nIn, nHashType) == sh);
+            }
+            int nHashType = insecure_rand();
+            BOOST_CHECK(sighashCache.SignatureHash(scriptCode, nIn, nHashType) == SignatureHash(scriptCode, tx, nIn, nHashType));
+        }
     }
+
+    // A transaction without inputs or outputs
+    CTransaction txEmpty;
+    CSignatureHashCache sighashCacheEmpty(txEmpty);
+    BOOST_CHECK(sighashCacheEmpty.SignatureHash(CScript(), 0, SIGHASH_ALL) == 1);
 }
+
 BOOST_AUTO_TEST_SUITE_END()
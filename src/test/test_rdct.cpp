@@ -2,10 +2,12 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#define BOOST_TEST_MODULE RDCT Test Suite
-
+#include "crypto/scrypt.h"
+#include "crypto/sha256.h"
 #include "main.h"
+#include "pow.h"
 #include "random.h"
+#include "timedata.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -31,6 +33,8 @@ struct TestingSetup {
 
     TestingSetup() {
         SetupEnvironment();
+        SHA256AutoDetect();
+        ScryptAutoDetect();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::UNITTEST);
@@ -75,6 +79,7 @@ struct TestingSetup {
     }
 };
 
+/** Shared by test_rdct and bench_rdct, whose main files define the test module */
 BOOST_GLOBAL_FIXTURE(TestingSetup);
 
 void Shutdown(void* parg)
@@ -91,3 +96,34 @@ bool ShutdownRequested()
 {
   return false;
 }
+
+/**
+ * Build a block with the given transactions on top of the active chain, its
+ * coinbase paying to scriptPubKey, and process it. Proof of work is not ground,
+ * so callers turn the check off with ModifiableParams()->setSkipProofOfWorkCheck.
+ */
+CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx, const CScript& scriptPubKey)
+{
+    CBlock block;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        CMutableTransaction txCoinbase;
+        txCoinbase.vin.resize(1);
+        txCoinbase.vin[0].prevout.SetNull();
+        txCoinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+        txCoinbase.vout.resize(1);
+        txCoinbase.vout[0].scriptPubKey = scriptPubKey;
+        txCoinbase.vout[0].nValue = GetBlockValue(pindexPrev->nHeight + 1);
+        block.vtx.push_back(txCoinbase);
+        for (unsigned int i = 0; i < vtx.size(); i++)
+            block.vtx.push_back(vtx[i]);
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+        block.nBits = GetNextWorkRequired(pindexPrev, &block);
+        block.hashMerkleRoot = block.BuildMerkleTree();
+    }
+    CValidationState state;
+    ProcessNewBlock(state, NULL, &block);
+    return block;
+}
@@ -0,0 +1,7 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#define BOOST_TEST_MODULE RDCT Test Suite
+
+#include <boost/test/unit_test.hpp>
@@ -4,6 +4,12 @@
 
 #include "wallet.h"
 
+#include "checkpoints.h"
+#include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txmempool.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -23,6 +29,8 @@ using namespace std;
 
 typedef set<pair<const CWalletTx*,unsigned int> > CoinSet;
 
+extern CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx, const CScript& scriptPubKey);
+
 BOOST_AUTO_TEST_SUITE(wallet_tests)
 
 static CWallet wallet;
@@ -305,4 +313,126 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(balance_cache_tests)
+{
+    CWallet keyWallet;
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(keyWallet.cs_wallet);
+        BOOST_CHECK(keyWallet.AddKeyPubKey(key, key.GetPubKey()));
+    }
+
+    CMutableTransaction txCredit;
+    txCredit.vin.resize(1);
+    txCredit.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txCredit.vout.resize(2);
+    txCredit.vout[0].nValue = 5 * COIN;
+    txCredit.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    txCredit.vout[1].nValue = 3 * COIN;
+    txCredit.vout[1].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txCredit.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 5 * COIN;
+    txSpend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    CTransaction credit(txCredit);
+    CTransaction spend(txSpend);
+    LOCK2(cs_main, keyWallet.cs_wallet);
+    mempool.addUnchecked(credit.GetHash(), CTxMemPoolEntry(credit, 0, 0, 0.0, 1));
+    BOOST_CHECK(keyWallet.AddToWallet(CWalletTx(&keyWallet, credit), true));
+    BOOST_CHECK_EQUAL(keyWallet.GetUnconfirmedBalance(), 8 * COIN);
+
+    // Spending an output updates the cached balance
+    mempool.addUnchecked(spend.GetHash(), CTxMemPoolEntry(spend, 0, 0, 0.0, 1));
+    BOOST_CHECK(keyWallet.AddToWallet(CWalletTx(&keyWallet, spend), true));
+    BOOST_CHECK_EQUAL(keyWallet.GetUnconfirmedBalance(), 3 * COIN);
+    BOOST_CHECK_EQUAL(keyWallet.GetBalance(), 0);
+
+    // So does the credit leaving the mempool
+    std::list<CTransaction> removed;
+    mempool.remove(credit, removed, true);
+    BOOST_CHECK_EQUAL(keyWallet.GetUnconfirmedBalance(), 0);
+
+    // Leave the mempool as the next suites expect it
+    mempool.remove(spend, removed, true);
+    BOOST_CHECK(!mempool.exists(spend.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(rescan_pipeline)
+{
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    Checkpoints::fEnabled = false;
+
+    CBasicKeyStore keystore;
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    // Coinbases to the wallet, blocks paying elsewhere, and once mature a
+    // spend whose only link to the wallet is its input
+    std::vector<CMutableTransaction> vNoTx;
+    CBlock blockFirst = CreateAndProcessBlock(vNoTx, scriptPubKey);
+    for (int i = 0; i < Params().COINBASE_MATURITY(); i++)
+        CreateAndProcessBlock(vNoTx, i % 2 ? scriptPubKey : scriptOther);
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(blockFirst.vtx[0].GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = blockFirst.vtx[0].vout[0].nValue;
+    txSpend.vout[0].scriptPubKey = scriptOther;
+    BOOST_CHECK(SignSignature(keystore, blockFirst.vtx[0], txSpend, 0));
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(1, txSpend), scriptOther);
+    CreateAndProcessBlock(vNoTx, scriptPubKey);
+    BOOST_CHECK_EQUAL(chainActive.Height(), Params().COINBASE_MATURITY() + 3);
+
+    // The pipeline finds what a serial scan of every transaction finds
+    mapArgs["-walletbackend"] = "leveldb";
+    CWallet walletPipeline("wallet_rescan_pipeline.dat"), walletSerial("wallet_rescan_serial.dat");
+    bool fFirstRun;
+    walletPipeline.LoadWallet(fFirstRun);
+    walletSerial.LoadWallet(fFirstRun);
+    BOOST_CHECK(walletPipeline.AddKeyPubKey(key, key.GetPubKey()));
+    BOOST_CHECK(walletSerial.AddKeyPubKey(key, key.GetPubKey()));
+    walletPipeline.nTimeFirstKey = walletSerial.nTimeFirstKey = 1;
+
+    int nPipeline = walletPipeline.ScanForWalletTransactions(chainActive.Genesis(), true);
+    int nSerial = 0;
+    {
+        LOCK2(cs_main, walletSerial.cs_wallet);
+        for (CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, pindex));
+            BOOST_FOREACH (const CTransaction& tx, block.vtx)
+                if (walletSerial.AddToWalletIfInvolvingMe(tx, &block, true))
+                    nSerial++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nPipeline, nSerial);
+    BOOST_CHECK_EQUAL(nSerial, Params().COINBASE_MATURITY() / 2 + 3);
+    BOOST_CHECK_EQUAL(walletPipeline.mapWallet.size(), walletSerial.mapWallet.size());
+    for (map<uint256, CWalletTx>::const_iterator it = walletSerial.mapWallet.begin(); it != walletSerial.mapWallet.end(); ++it) {
+        BOOST_REQUIRE(walletPipeline.mapWallet.count(it->first));
+        BOOST_CHECK(walletPipeline.mapWallet[it->first].hashBlock == it->second.hashBlock);
+    }
+    BOOST_CHECK(walletPipeline.mapWallet.count(txSpend.GetHash()));
+    mapArgs.erase("-walletbackend");
+
+    // Rewind the chain for the tests that follow
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainActive[1]));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+    Checkpoints::fEnabled = true;
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
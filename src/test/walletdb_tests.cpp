@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet.h"
+#include "walletdb.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdint.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(walletdb_tests)
+
+/** Whether any file of a LevelDB wallet directory contains the bytes of a secret */
+static bool WalletFilesContain(const std::string& strFile, const CKey& key)
+{
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it(GetDataDir() / strFile); it != end; ++it) {
+        std::ifstream file(it->path().string().c_str(), std::ios::binary);
+        std::string strData((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (std::search(strData.begin(), strData.end(), key.begin(), key.end()) != strData.end())
+            return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_leveldb)
+{
+    const std::string strFile = "wallet_leveldb.dat";
+    mapArgs["-walletbackend"] = "leveldb";
+
+    CWalletTx wtx;
+    {
+        CWalletDB walletdb(strFile, "cr+");
+        BOOST_CHECK(CDBEnv::IsLevelDB(strFile));
+
+        CAccount account;
+        account.vchPubKey = CPubKey();
+        BOOST_CHECK(walletdb.WriteAccount("a", account));
+        BOOST_CHECK(walletdb.ReadAccount("a", account));
+        BOOST_CHECK(!walletdb.ReadAccount("b", account));
+
+        // Writes of a transaction are seen by its own reads, and only land on commit
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteAccount("b", account));
+        BOOST_CHECK(walletdb.ReadAccount("b", account));
+        BOOST_CHECK(walletdb.TxnAbort());
+        BOOST_CHECK(!walletdb.ReadAccount("b", account));
+
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteAccount("b", account));
+        BOOST_CHECK(walletdb.TxnCommit());
+        BOOST_CHECK(walletdb.ReadAccount("b", account));
+
+        // Ranged cursor reads
+        CAccountingEntry ae;
+        ae.strAccount = "a";
+        ae.nCreditDebit = 1;
+        BOOST_CHECK(walletdb.WriteAccountingEntry(ae));
+        ae.nCreditDebit = 2;
+        BOOST_CHECK(walletdb.WriteAccountingEntry(ae));
+        ae.strAccount = "b";
+        ae.nCreditDebit = 4;
+        BOOST_CHECK(walletdb.WriteAccountingEntry(ae));
+        BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("a"), 3);
+        BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("b"), 4);
+        BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("*"), 7);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = 1;
+        tx.vin[0].prevout.n = 0;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * COIN;
+        wtx = CWalletTx(NULL, tx);
+        BOOST_CHECK(walletdb.WriteTx(wtx.GetHash(), wtx));
+    }
+
+    // Transaction records go through the parallel loader
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DB_LOAD_OK);
+    BOOST_CHECK(wallet.mapWallet.count(wtx.GetHash()));
+
+    mapArgs.erase("-walletbackend");
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_leveldb_encrypt)
+{
+    const std::string strFile = "wallet_leveldb_crypt.dat";
+    mapArgs["-walletbackend"] = "leveldb";
+    mapArgs["-keypool"] = "1";
+
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DB_LOAD_OK);
+    BOOST_CHECK(CDBEnv::IsLevelDB(strFile));
+
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    }
+    BOOST_CHECK(WalletFilesContain(strFile, key));
+
+    // The rewrite after encryption leaves no unencrypted key in the log or tables
+    BOOST_CHECK(wallet.EncryptWallet("passphrase"));
+    BOOST_CHECK(!WalletFilesContain(strFile, key));
+    BOOST_CHECK(wallet.HaveKey(key.GetPubKey().GetID()));
+
+    mapArgs.erase("-keypool");
+    mapArgs.erase("-walletbackend");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
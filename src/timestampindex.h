@@ -0,0 +1,83 @@
+// Copyright (c) 2016 BitPay, Inc.
+// Copyright (c) 2018 The RDCT developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TIMESTAMPINDEX_H
+#define BITCOIN_TIMESTAMPINDEX_H
+
+#include "crypto/common.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Key of an entry in the timestamp index: a block of the active chain by its header time */
+struct CTimestampIndexKey {
+    unsigned int timestamp;
+    uint256 blockHash;
+
+    CTimestampIndexKey(unsigned int time, const uint256& hash)
+    {
+        timestamp = time;
+        blockHash = hash;
+    }
+
+    CTimestampIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        timestamp = 0;
+        blockHash = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 36;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        // Timestamps are stored big-endian for key sorting in LevelDB
+        unsigned char buf[4];
+        WriteBE32(buf, timestamp);
+        s.write((char*)buf, 4);
+        blockHash.Serialize(s, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[4];
+        s.read((char*)buf, 4);
+        timestamp = ReadBE32(buf);
+        blockHash.Unserialize(s, nType, nVersion);
+    }
+};
+
+/** Prefix of CTimestampIndexKey used to seek to the first block at or after a time */
+struct CTimestampIndexIteratorKey {
+    unsigned int timestamp;
+
+    CTimestampIndexIteratorKey(unsigned int time)
+    {
+        timestamp = time;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        WriteBE32(buf, timestamp);
+        s.write((char*)buf, 4);
+    }
+};
+
+#endif // BITCOIN_TIMESTAMPINDEX_H
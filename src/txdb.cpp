@@ -131,12 +131,12 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
             if (chType == 'c') {
                 leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CSpanReader ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CCoins coins;
                 ssValue >> coins;
                 uint256 txhash;
@@ -182,6 +182,208 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', key), value);
+}
+
+void CBlockTreeDB::UpdateSpentIndex(CLevelDBBatch& batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect)
+{
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            // keys past the prefix may be too short to decode as index keys
+            if (chType != 'u')
+                break;
+            CAddressUnspentKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+void CBlockTreeDB::UpdateAddressUnspentIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart, int nEnd)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (nStart > 0 && nEnd > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorHeightKey(type, addressHash, nStart));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            CAddressIndexKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.type != (unsigned int)type || indexKey.hashBytes != addressHash)
+                break;
+            if (nEnd > 0 && indexKey.blockHeight > nEnd)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CSpanReader ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(indexKey, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+void CBlockTreeDB::WriteAddressIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Write(make_pair('a', it->first), it->second);
+}
+
+void CBlockTreeDB::EraseAddressIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
+        batch.Erase(make_pair('a', it->first));
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('s', CTimestampIndexIteratorKey(nLow));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 's')
+                break;
+            CTimestampIndexKey indexKey;
+            ssKey >> indexKey;
+            if (indexKey.timestamp > nHigh)
+                break;
+
+            vect.push_back(indexKey.blockHash);
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+void CBlockTreeDB::WriteTimestampIndex(CLevelDBBatch& batch, const CTimestampIndexKey& key)
+{
+    batch.Write(make_pair('s', key), '0');
+}
+
+void CBlockTreeDB::EraseTimestampIndex(CLevelDBBatch& batch, const CTimestampIndexKey& key)
+{
+    batch.Erase(make_pair('s', key));
+}
+
+/** Erase all entries with the given prefix, keyed by K, in batches of limited size */
+template <typename K>
+static bool EraseKeysWithPrefix(CLevelDBWrapper& db, char chPrefix)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << chPrefix;
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        CLevelDBBatch batch;
+        // Keep the batches small, the indexes can hold millions of entries
+        for (unsigned int n = 0; n < 10000 && pcursor->Valid(); n++) {
+            boost::this_thread::interruption_point();
+            leveldb::Slice slKey = pcursor->key();
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            K key;
+            try {
+                ssKey >> chType;
+                if (chType != chPrefix)
+                    return db.WriteBatch(batch);
+                ssKey >> key;
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+            batch.Erase(make_pair(chPrefix, key));
+            pcursor->Next();
+        }
+        if (!db.WriteBatch(batch))
+            return false;
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::WipeAddressIndexes()
+{
+    return EraseKeysWithPrefix<CAddressIndexKey>(*this, 'a') &&
+           EraseKeysWithPrefix<CAddressUnspentKey>(*this, 'u') &&
+           EraseKeysWithPrefix<CSpentIndexKey>(*this, 'p') &&
+           EraseKeysWithPrefix<CTimestampIndexKey>(*this, 's');
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -201,11 +403,26 @@ bool CBlockTreeDB::WriteInt(const std::string& name, int nValue)
     return Write(std::make_pair('I', name), nValue);
 }
 
+void CBlockTreeDB::WriteInt(CLevelDBBatch& batch, const std::string& name, int nValue)
+{
+    batch.Write(std::make_pair('I', name), nValue);
+}
+
 bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
 {
     return Read(std::make_pair('I', name), nValue);
 }
 
+void CBlockTreeDB::WriteHash(CLevelDBBatch& batch, const std::string& name, const uint256& hash)
+{
+    batch.Write(std::make_pair('H', name), hash);
+}
+
+bool CBlockTreeDB::ReadHash(const std::string& name, uint256& hash)
+{
+    return Read(std::make_pair('H', name), hash);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -220,12 +437,12 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
             if (chType == 'b') {
                 leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CSpanReader ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
                 CDiskBlockIndex diskindex;
                 ssValue >> diskindex;
 
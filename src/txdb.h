@@ -7,8 +7,11 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
+#include "timestampindex.h"
 
 #include <map>
 #include <string>
@@ -61,10 +64,24 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+    void UpdateSpentIndex(CLevelDBBatch& batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    void UpdateAddressUnspentIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart = 0, int nEnd = 0);
+    void WriteAddressIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    void EraseAddressIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vect);
+    void WriteTimestampIndex(CLevelDBBatch& batch, const CTimestampIndexKey& key);
+    void EraseTimestampIndex(CLevelDBBatch& batch, const CTimestampIndexKey& key);
+    bool WipeAddressIndexes();
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
+    void WriteInt(CLevelDBBatch& batch, const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    void WriteHash(CLevelDBBatch& batch, const std::string& name, const uint256& hash);
+    bool ReadHash(const std::string& name, uint256& hash);
     bool LoadBlockIndexGuts();
 };
 
@@ -11,7 +11,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70912;
+static const int PROTOCOL_VERSION = 70913;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -36,5 +36,8 @@ static const int MEMPOOL_GD_VERSION = 60002;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 70005;
 
+//! "mnlistdigest" and "mnlistdiff" masternode list sync starts with this version
+static const int MNLISTDIFF_VERSION = 70913;
+
 
 #endif // BITCOIN_VERSION_H
@@ -456,6 +456,63 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+/**
+ * Queue a changed transaction, and the ones it spends from, to be re-checked
+ * against setUnspentTx, and drop the cached balances.
+ */
+void CWallet::MarkUnspentTxDirty(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    setUnspentTxDirty.insert(wtx.GetHash());
+    if (!wtx.IsCoinBase()) {
+        BOOST_FOREACH (const CTxIn& txin, wtx.vin) {
+            setUnspentTxDirty.insert(txin.prevout.hash);
+            map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+            if (mi != mapWallet.end())
+                mi->second.MarkDirty();
+        }
+    }
+    fBalancesCached = false;
+}
+
+/**
+ * Outpoint is spent by a transaction in the main chain. Unlike IsSpent this only
+ * changes when blocks are connected or disconnected, which the wallet is told about.
+ */
+bool CWallet::IsSpentInMainChain(const uint256& hash, unsigned int n) const
+{
+    const COutPoint outpoint(hash, n);
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0)
+            return true;
+    }
+    return false;
+}
+
+const std::set<uint256>& CWallet::GetUnspentTx() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    BOOST_FOREACH (const uint256& hash, setUnspentTxDirty) {
+        bool fUnspent = false;
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            const CWalletTx& wtx = mi->second;
+            for (unsigned int i = 0; i < wtx.vout.size() && !fUnspent; i++)
+                fUnspent = IsMine(wtx.vout[i]) != ISMINE_NO && !IsSpentInMainChain(hash, i);
+        }
+        if (fUnspent)
+            setUnspentTx.insert(hash);
+        else
+            setUnspentTx.erase(hash);
+    }
+    setUnspentTxDirty.clear();
+    return setUnspentTx;
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -648,12 +705,15 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
-        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
+        BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet) {
             item.second.MarkDirty();
+            setUnspentTxDirty.insert(item.first);
+        }
+        fBalancesCached = false;
     }
 }
 
-bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
+bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
 {
     uint256 hash = wtxIn.GetHash();
 
@@ -661,8 +721,22 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        MarkUnspentTxDirty(mapWallet[hash]);
     } else {
         LOCK(cs_wallet);
+        // The order position and the transaction go to disk in one transaction,
+        // a single synced write for every stake on a LevelDB wallet
+        CWalletDB* pwalletdbTxn = NULL;
+        if (fFileBacked && !pwalletdb) {
+            pwalletdbTxn = new CWalletDB(strWalletFile);
+            pwalletdb = pwalletdbTxn;
+            if (!pwalletdb->TxnBegin()) {
+                delete pwalletdbTxn;
+                pwalletdbTxn = NULL;
+                pwalletdb = NULL;
+            }
+        }
+
         // Inserts only if not already there, returns tx inserted or tx found
         pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
@@ -670,7 +744,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         bool fInsertedNew = ret.second;
         if (fInsertedNew) {
             wtx.nTimeReceived = GetAdjustedTime();
-            wtx.nOrderPos = IncOrderPosNext();
+            wtx.nOrderPos = IncOrderPosNext(pwalletdb);
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (wtxIn.hashBlock != 0) {
@@ -735,12 +809,20 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
         // Write to disk
-        if (fInsertedNew || fUpdated)
-            if (!wtx.WriteToDisk())
-                return false;
+        bool fWritten = !(fInsertedNew || fUpdated) || wtx.WriteToDisk(pwalletdb);
+        if (pwalletdbTxn) {
+            if (fWritten)
+                fWritten = pwalletdbTxn->TxnCommit();
+            else
+                pwalletdbTxn->TxnAbort();
+            delete pwalletdbTxn;
+        }
+        if (!fWritten)
+            return false;
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        MarkUnspentTxDirty(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -799,8 +881,12 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            MarkUnspentTxDirty(mi->second);
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
@@ -983,11 +1069,137 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
 }
 
 
-bool CWalletTx::WriteToDisk()
+bool CWalletTx::WriteToDisk(CWalletDB* pwalletdb)
 {
+    if (pwalletdb)
+        return pwalletdb->WriteTx(GetHash(), *this);
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+/**
+ * Blocks of a rescan in flight. A prefetch thread reads them from disk ahead of
+ * the wallet, filter threads mark the transactions that pay to wallet scripts,
+ * and ScanForWalletTransactions takes them in chain order from Front().
+ */
+class CRescanPipeline
+{
+private:
+    enum SlotState {
+        SLOT_EMPTY,
+        SLOT_READ,
+        SLOT_FILTERED,
+    };
+
+    struct CSlot {
+        CBlock block;
+        std::vector<bool> vMatch;
+        SlotState state;
+    };
+
+    const CWallet& wallet;
+    const std::vector<CBlockIndex*>& vIndex;
+    //! where the blocks are on disk, copied under cs_main
+    const std::vector<CDiskBlockPos>& vPos;
+    std::vector<CSlot> vSlots;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    size_t nRead;      //! blocks read by the prefetch thread
+    size_t nFiltering; //! blocks handed to filter threads
+    size_t nApplied;   //! blocks released by the wallet
+    bool fStop;
+    boost::thread_group threadGroup;
+
+    void ThreadPrefetch()
+    {
+        RenameThread("rdct-rescan");
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && i >= nApplied + vSlots.size())
+                    cond.wait(lock);
+                if (fStop)
+                    return;
+            }
+            // Only this thread touches empty slots
+            CSlot& slot = vSlots[i % vSlots.size()];
+            if (ReadBlockFromDisk(slot.block, vPos[i]) && slot.block.GetHash() != vIndex[i]->GetBlockHash())
+                slot.block.SetNull();
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            slot.state = SLOT_READ;
+            nRead = i + 1;
+            cond.notify_all();
+        }
+    }
+
+    void ThreadFilter()
+    {
+        RenameThread("rdct-rescan");
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nFiltering == nRead)
+                    cond.wait(lock);
+                if (fStop)
+                    return;
+                i = nFiltering++;
+            }
+            CSlot& slot = vSlots[i % vSlots.size()];
+            slot.vMatch.assign(slot.block.vtx.size(), false);
+            for (unsigned int n = 0; n < slot.block.vtx.size(); n++)
+                slot.vMatch[n] = wallet.IsMine(slot.block.vtx[n]);
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            slot.state = SLOT_FILTERED;
+            cond.notify_all();
+        }
+    }
+
+public:
+    CRescanPipeline(const CWallet& walletIn, const std::vector<CBlockIndex*>& vIndexIn, const std::vector<CDiskBlockPos>& vPosIn, int nThreads)
+        : wallet(walletIn), vIndex(vIndexIn), vPos(vPosIn), vSlots(nThreads * 16), nRead(0), nFiltering(0), nApplied(0), fStop(false)
+    {
+        for (unsigned int i = 0; i < vSlots.size(); i++)
+            vSlots[i].state = SLOT_EMPTY;
+        threadGroup.create_thread(boost::bind(&CRescanPipeline::ThreadPrefetch, this));
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CRescanPipeline::ThreadFilter, this));
+    }
+
+    ~CRescanPipeline()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+            cond.notify_all();
+        }
+        threadGroup.join_all();
+    }
+
+    /** Wait for the next block in chain order and which of its transactions pay to the wallet */
+    const CBlock& Front(const std::vector<bool>*& pvMatch)
+    {
+        CSlot& slot = vSlots[nApplied % vSlots.size()];
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (slot.state != SLOT_FILTERED)
+            cond.wait(lock);
+        pvMatch = &slot.vMatch;
+        return slot.block;
+    }
+
+    /** Hand the slot of the front block back to the prefetch thread */
+    void PopFront()
+    {
+        CSlot& slot = vSlots[nApplied % vSlots.size()];
+        boost::unique_lock<boost::mutex> lock(mutex);
+        slot.state = SLOT_EMPTY;
+        nApplied++;
+        cond.notify_all();
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -998,37 +1210,110 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     int ret = 0;
     int64_t nNow = GetTime();
 
-    CBlockIndex* pindex = pindexStart;
+    {
+        LOCK(cs_scan);
+        if (fScanningWallet) {
+            LogPrintf("%s : a rescan is already in progress\n", __func__);
+            return -1;
+        }
+        fScanningWallet = true;
+        fAbortRescan = false;
+        nScanStartTime = GetTimeMillis();
+        dScanProgress = 0;
+    }
+
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<CDiskBlockPos> vPos;
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
+        CBlockIndex* pindex = pindexStart;
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+        for (; pindex; pindex = chainActive.Next(pindex)) {
+            vIndex.push_back(pindex);
+            vPos.push_back(pindex->GetBlockPos());
+        }
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    bool fAborted = false;
+    {
+        int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency() - 1, MAX_RESCAN_THREADS));
+        CRescanPipeline pipeline(*this, vIndex, vPos, nThreads);
+        for (unsigned int i = 0; i < vIndex.size(); i++) {
+            CBlockIndex* pindex = vIndex[i];
+            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                double dProgress = (Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart);
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(dProgress * 100))));
+                LOCK(cs_scan);
+                dScanProgress = dProgress;
             }
-            pindex = chainActive.Next(pindex);
+            {
+                LOCK(cs_scan);
+                fAborted = fAbortRescan;
+            }
+            if (fAborted) {
+                LogPrintf("Rescan aborted at block %d\n", pindex->nHeight);
+                break;
+            }
+
+            const std::vector<bool>* pvMatch;
+            const CBlock& block = pipeline.Front(pvMatch);
+            {
+                LOCK2(cs_main, cs_wallet);
+                // Blocks disconnected since the scan started reach the wallet through SyncTransaction
+                if (chainActive.Contains(pindex)) {
+                    for (unsigned int n = 0; n < block.vtx.size(); n++) {
+                        const CTransaction& tx = block.vtx[n];
+                        // Filter threads only see outputs, spends and known transactions are checked here
+                        bool fRelevant = (*pvMatch)[n] || mapWallet.count(tx.GetHash());
+                        for (unsigned int j = 0; !fRelevant && j < tx.vin.size(); j++)
+                            fRelevant = mapWallet.count(tx.vin[j].prevout.hash);
+                        if (fRelevant && AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                            ret++;
+                    }
+                }
+            }
+            pipeline.PopFront();
+
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
-    return ret;
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+    LOCK(cs_scan);
+    fScanningWallet = false;
+    return fAborted ? -1 : ret;
+}
+
+bool CWallet::IsScanning() const
+{
+    LOCK(cs_scan);
+    return fScanningWallet;
+}
+
+void CWallet::GetScanProgress(int64_t& nDuration, double& dProgress) const
+{
+    LOCK(cs_scan);
+    nDuration = fScanningWallet ? GetTimeMillis() - nScanStartTime : 0;
+    dProgress = fScanningWallet ? dScanProgress : 0;
+}
+
+void CWallet::AbortRescan()
+{
+    LOCK(cs_scan);
+    if (fScanningWallet)
+        fAbortRescan = true;
 }
 
 void CWallet::ReacceptWalletTransactions()
@@ -1131,88 +1416,83 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+/**
+ * Recompute all balance totals in one pass over setUnspentTx, unless nothing they
+ * depend on changed since the last time.
+ */
+void CWallet::CacheBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (fBalancesCached && pindexBalancesCached == chainActive.Tip() && nMempoolUpdatesBalancesCached == mempool.GetTransactionsUpdated())
+        return;
+
+    nBalanceCached = 0;
+    nUnconfirmedBalanceCached = 0;
+    nImmatureBalanceCached = 0;
+    nWatchOnlyBalanceCached = 0;
+    nUnconfirmedWatchOnlyBalanceCached = 0;
+    nImmatureWatchOnlyBalanceCached = 0;
+    BOOST_FOREACH (const uint256& hash, GetUnspentTx()) {
+        const CWalletTx* pcoin = &mapWallet.find(hash)->second;
+        bool fTrusted = pcoin->IsTrusted();
+        if (fTrusted) {
+            nBalanceCached += pcoin->GetAvailableCredit();
+            nWatchOnlyBalanceCached += pcoin->GetAvailableWatchOnlyCredit();
+        }
+        if (!IsFinalTx(*pcoin) || (!fTrusted && pcoin->GetDepthInMainChain() == 0)) {
+            nUnconfirmedBalanceCached += pcoin->GetAvailableCredit();
+            nUnconfirmedWatchOnlyBalanceCached += pcoin->GetAvailableWatchOnlyCredit();
         }
+        nImmatureBalanceCached += pcoin->GetImmatureCredit();
+        nImmatureWatchOnlyBalanceCached += pcoin->GetImmatureWatchOnlyCredit();
     }
 
-    return nTotal;
+    fBalancesCached = true;
+    pindexBalancesCached = chainActive.Tip();
+    nMempoolUpdatesBalancesCached = mempool.GetTransactionsUpdated();
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return nBalanceCached;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return nUnconfirmedBalanceCached;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return nImmatureBalanceCached;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return nWatchOnlyBalanceCached;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return nUnconfirmedWatchOnlyBalanceCached;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    CacheBalances();
+    return nImmatureWatchOnlyBalanceCached;
 }
 
 /**
@@ -1224,9 +1504,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        BOOST_FOREACH (const uint256& wtxid, GetUnspentTx()) {
+            const CWalletTx* pcoin = &mapWallet.find(wtxid)->second;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1266,11 +1545,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 if (mine == ISMINE_WATCH_ONLY)
                     continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
                     continue;
                 if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
                     continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
                     continue;
 
                 bool fIsSpendable = false;
@@ -1369,6 +1648,46 @@ bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int
     return true;
 }
 
+void CWallet::WarmStakingKeyCache()
+{
+    vector<COutput> vCoins;
+    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
+
+    std::set<CKeyID> setKeys;
+    for (const COutput& out : vCoins) {
+        txnouttype whichType;
+        vector<valtype> vSolutions;
+        if (!Solver(out.tx->vout[out.i].scriptPubKey, whichType, vSolutions))
+            continue;
+        if (whichType == TX_PUBKEYHASH)
+            setKeys.insert(CKeyID(uint160(vSolutions[0])));
+        else if (whichType == TX_PUBKEY)
+            setKeys.insert(CPubKey(vSolutions[0]).GetID());
+    }
+    WarmKeyCache(setKeys);
+}
+
+void CWallet::ThreadWarmStakingKeyCache()
+{
+    RenameThread("rdct-warmkeys");
+    try {
+        WarmStakingKeyCache();
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ThreadWarmStakingKeyCache()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ThreadWarmStakingKeyCache()");
+    }
+}
+
+void CWallet::StartWarmStakingKeyCache()
+{
+    // The RPC and the GUI may unlock at the same time
+    LOCK(cs_warmkeys);
+    if (threadWarmKeys.joinable())
+        threadWarmKeys.join();
+    threadWarmKeys = boost::thread(boost::bind(&CWallet::ThreadWarmStakingKeyCache, this));
+}
+
 bool CWallet::MintableCoins()
 {
     CAmount nBalance = GetBalance();
@@ -1753,8 +2072,9 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 
                 // Sign
                 int nIn = 0;
+                const CSignatureHashCache sighashCache(txNew);
                 BOOST_FOREACH (const PAIRTYPE(const CWalletTx*, unsigned int) & coin, setCoins)
-                    if (!SignSignature(*this, *coin.first, txNew, nIn++)) {
+                    if (!SignSignature(*this, *coin.first, txNew, nIn++, SIGHASH_ALL, &sighashCache)) {
                         strFailReason = _("Signing transaction failed");
                         return false;
                     }
@@ -1982,8 +2302,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     // Sign
     int nIn = 0;
+    const CSignatureHashCache sighashCache(txNew);
     BOOST_FOREACH (const CWalletTx* pcoin, vwtxPrev) {
-        if (!SignSignature(*this, *pcoin, txNew, nIn++))
+        if (!SignSignature(*this, *pcoin, txNew, nIn++, SIGHASH_ALL, &sighashCache))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
@@ -2324,9 +2645,9 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
     map<CTxDestination, CAmount> balances;
 
     {
-        LOCK(cs_wallet);
-        BOOST_FOREACH (PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet) {
-            CWalletTx* pcoin = &walletEntry.second;
+        LOCK2(cs_main, cs_wallet);
+        BOOST_FOREACH (const uint256& wtxid, GetUnspentTx()) {
+            const CWalletTx* pcoin = &mapWallet.find(wtxid)->second;
 
             if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
                 continue;
@@ -2345,7 +2666,7 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
                 if (!ExtractDestination(pcoin->vout[i].scriptPubKey, addr))
                     continue;
 
-                CAmount n = IsSpent(walletEntry.first, i) ? 0 : pcoin->vout[i].nValue;
+                CAmount n = IsSpent(wtxid, i) ? 0 : pcoin->vout[i].nValue;
 
                 if (!balances.count(addr))
                     balances[addr] = 0;
@@ -2511,6 +2832,8 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            // A completed SwiftTX lock changes the depth, and so the trust, of the transaction
+            fBalancesCached = false;
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
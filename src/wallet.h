@@ -32,6 +32,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread.hpp>
+
 /**
  * Settings
  */
@@ -53,6 +55,8 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Maximum number of threads filtering blocks during a rescan
+static const int MAX_RESCAN_THREADS = 8;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -159,9 +163,53 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Wallet transactions with an output of ours that is not spent in the main chain.
+     * Balances and coin selection only look at these instead of all of mapWallet;
+     * entries in setUnspentTxDirty are re-checked on the next lookup.
+     */
+    mutable std::set<uint256> setUnspentTx;
+    mutable std::set<uint256> setUnspentTxDirty;
+    void MarkUnspentTxDirty(const CWalletTx& wtx);
+    bool IsSpentInMainChain(const uint256& hash, unsigned int n) const;
+    const std::set<uint256>& GetUnspentTx() const;
+
+    /**
+     * Balance totals, valid for the chain tip and mempool state they were computed at
+     * until a wallet transaction changes.
+     */
+    mutable bool fBalancesCached;
+    mutable const CBlockIndex* pindexBalancesCached;
+    mutable unsigned int nMempoolUpdatesBalancesCached;
+    mutable CAmount nBalanceCached;
+    mutable CAmount nUnconfirmedBalanceCached;
+    mutable CAmount nImmatureBalanceCached;
+    mutable CAmount nWatchOnlyBalanceCached;
+    mutable CAmount nUnconfirmedWatchOnlyBalanceCached;
+    mutable CAmount nImmatureWatchOnlyBalanceCached;
+    void CacheBalances() const;
+
+    /** State of the running rescan, readable while it runs without cs_wallet */
+    mutable CCriticalSection cs_scan;
+    bool fScanningWallet;
+    bool fAbortRescan;
+    int64_t nScanStartTime;
+    double dScanProgress;
+
+    //! Decrypts the staking keys after a staking-only unlock, joined before the next one starts
+    CCriticalSection cs_warmkeys;
+    boost::thread threadWarmKeys; // guarded by cs_warmkeys
+
+    //! Body of threadWarmKeys, which logs what WarmStakingKeyCache throws instead of passing it on
+    void ThreadWarmStakingKeyCache();
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
+    //! Decrypt the keys of our stakable outputs ahead of the staker needing them
+    void WarmStakingKeyCache();
+    //! Run WarmStakingKeyCache on a background thread, so an unlock returns at once
+    void StartWarmStakingKeyCache();
     int CountInputsWithAmount(CAmount nInputAmount);
 
     /*
@@ -218,6 +266,11 @@ public:
 
     ~CWallet()
     {
+        {
+            LOCK(cs_warmkeys);
+            if (threadWarmKeys.joinable())
+                threadWarmKeys.join();
+        }
         delete pwalletdbEncryption;
     }
 
@@ -233,6 +286,13 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockStakingOnly = false;
+        fBalancesCached = false;
+        pindexBalancesCached = NULL;
+        nMempoolUpdatesBalancesCached = 0;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanStartTime = 0;
+        dScanProgress = 0;
 
         // Stake Settings
         nHashDrift = 45;
@@ -375,11 +435,22 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
-    bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
+    bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false, CWalletDB* pwalletdb = NULL);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
+    /**
+     * Scan the chain from pindexStart for wallet transactions. Blocks are read and
+     * filtered against the wallet's scripts on worker threads; cs_main and cs_wallet
+     * are only taken to add each block's matches.
+     * @return number of transactions added or updated, or -1 if the rescan was
+     * aborted or another one is already running
+     */
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    bool IsScanning() const;
+    //! Milliseconds since the running rescan started and its progress in [0, 1]
+    void GetScanProgress(int64_t& nDuration, double& dProgress) const;
+    void AbortRescan();
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;
@@ -1016,7 +1087,7 @@ public:
         return true;
     }
 
-    bool WriteToDisk();
+    bool WriteToDisk(CWalletDB* pwalletdb = NULL);
 
     int64_t GetTxTime() const;
     int64_t GetComputedTxTime() const;
@@ -37,6 +37,11 @@ isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest)
 
 isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey)
 {
+    // Most outputs use one of these templates, which are only ours if the keystore indexed them
+    if ((scriptPubKey.IsPayToPublicKeyHash() || scriptPubKey.IsPayToScriptHash() || scriptPubKey.IsPayToPublicKey()) &&
+        !keystore.HaveScriptPubKey(scriptPubKey))
+        return ISMINE_NO;
+
     if(keystore.HaveWatchOnly(scriptPubKey))
         return ISMINE_WATCH_ONLY;
     if(keystore.HaveMultiSig(scriptPubKey))
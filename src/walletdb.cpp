@@ -26,6 +26,9 @@ using namespace std;
 
 static uint64_t nAccountingEntryNumber = 0;
 
+//! Smallest share of wallet transactions worth a loader thread of its own
+static const size_t nWalletTxsPerThread = 1000;
+
 //
 // CWalletDB
 //
@@ -296,22 +299,22 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error("CWalletDB::ListAccountCreditDebit() : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
     while (true) {
         // Read next record
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
         if (fFlags == DB_SET_RANGE)
             ssKey << std::make_pair(std::string("acentry"), std::make_pair((fAllAccounts ? string("") : strAccount), uint64_t(0)));
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
         int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
         fFlags = DB_NEXT;
         if (ret == DB_NOTFOUND)
             break;
         else if (ret != 0) {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error("CWalletDB::ListAccountCreditDebit() : error scanning DB");
         }
 
@@ -330,7 +333,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    delete pcursor;
 }
 
 DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
@@ -416,7 +419,75 @@ public:
     }
 };
 
-bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, string& strType, string& strErr)
+/**
+ * Decode a "tx" record whose type was already read from ssKey. Touches no
+ * wallet state, so LoadWallet runs it for many records in parallel.
+ */
+static bool ReadWalletTx(CSecureDataStream& ssKey, CSecureDataStream& ssValue, CWalletTx& wtx, bool& fUpgrade, string& strErr)
+{
+    uint256 hash;
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    fUpgrade = (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703);
+    if (fUpgrade) {
+        if (!ssValue.empty()) {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        } else {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+    }
+    return true;
+}
+
+static void LoadWalletTx(CWallet* pwallet, CWalletTx& wtx, bool fUpgrade, CWalletScanState& wss)
+{
+    if (fUpgrade)
+        wss.vWalletUpgrade.push_back(wtx.GetHash());
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->AddToWallet(wtx, true);
+}
+
+/** A "tx" record read by LoadWallet, decoded by one of its loader threads */
+struct CWalletTxRecord {
+    CSecureDataStream ssKey;
+    CSecureDataStream ssValue;
+    CWalletTx wtx;
+    bool fUpgrade;
+    bool fOK;
+    string strErr;
+
+    CWalletTxRecord(const CSecureDataStream& ssKeyIn, const CSecureDataStream& ssValueIn) : ssKey(ssKeyIn), ssValue(ssValueIn), fUpgrade(false), fOK(false) {}
+};
+
+static void ThreadReadWalletTxs(std::vector<CWalletTxRecord>* pvRecords, size_t nBegin, size_t nEnd)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        CWalletTxRecord& record = (*pvRecords)[i];
+        try {
+            string strType;
+            record.ssKey >> strType;
+            record.fOK = ReadWalletTx(record.ssKey, record.ssValue, record.wtx, record.fUpgrade, record.strErr);
+        } catch (...) {
+            record.fOK = false;
+        }
+    }
+}
+
+bool ReadKeyValue(CWallet* pwallet, CSecureDataStream& ssKey, CSecureDataStream& ssValue, CWalletScanState& wss, string& strType, string& strErr)
 {
     try {
         // Unserialize
@@ -432,34 +503,11 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             ssKey >> strAddress;
             ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].purpose;
         } else if (strType == "tx") {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgrade;
+            if (!ReadWalletTx(ssKey, ssValue, wtx, fUpgrade, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
-                if (!ssValue.empty()) {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                        wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                } else {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->AddToWallet(wtx, true);
+            LoadWalletTx(pwallet, wtx, fUpgrade, wss);
         } else if (strType == "acentry") {
             string strAccount;
             ssKey >> strAccount;
@@ -686,24 +734,33 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor) {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
         }
 
+        // Transactions are most of a wallet, they are decoded in parallel once the cursor is done
+        std::vector<CWalletTxRecord> vTxRecords;
+        static const char pszTxKey[] = "\x02tx";
         while (true) {
             // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
             int ret = ReadAtCursor(pcursor, ssKey, ssValue);
             if (ret == DB_NOTFOUND)
                 break;
             else if (ret != 0) {
+                delete pcursor;
                 LogPrintf("Error reading next record from wallet database\n");
                 return DB_CORRUPT;
             }
 
+            if (ssKey.size() > 3 && memcmp(&ssKey[0], pszTxKey, 3) == 0) {
+                vTxRecords.push_back(CWalletTxRecord(ssKey, ssValue));
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
             string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
@@ -722,7 +779,32 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        delete pcursor;
+
+        int64_t nStart = GetTimeMillis();
+        size_t nThreads = std::max(1u, boost::thread::hardware_concurrency());
+        nThreads = std::min(nThreads, (vTxRecords.size() + nWalletTxsPerThread - 1) / nWalletTxsPerThread);
+        if (nThreads > 1) {
+            boost::thread_group threadGroup;
+            for (size_t i = 0; i < nThreads; i++)
+                threadGroup.create_thread(boost::bind(&ThreadReadWalletTxs, &vTxRecords,
+                    vTxRecords.size() * i / nThreads, vTxRecords.size() * (i + 1) / nThreads));
+            threadGroup.join_all();
+        } else
+            ThreadReadWalletTxs(&vTxRecords, 0, vTxRecords.size());
+
+        BOOST_FOREACH (CWalletTxRecord& record, vTxRecords) {
+            if (record.fOK)
+                LoadWalletTx(pwallet, record.wtx, record.fUpgrade, wss);
+            else {
+                // Rescan if there is a bad transaction record:
+                fNoncriticalErrors = true;
+                SoftSetBoolArg("-rescan", true);
+            }
+            if (!record.strErr.empty())
+                LogPrintf("%s\n", record.strErr);
+        }
+        LogPrint("db", "LoadWallet : %u transactions loaded on %u threads in %dms\n", vTxRecords.size(), std::max(nThreads, (size_t)1), GetTimeMillis() - nStart);
     } catch (boost::thread_interrupted) {
         throw;
     } catch (...) {
@@ -778,7 +860,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor) {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
@@ -786,12 +868,13 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
 
         while (true) {
             // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue(SER_DISK, CLIENT_VERSION);
             int ret = ReadAtCursor(pcursor, ssKey, ssValue);
             if (ret == DB_NOTFOUND)
                 break;
             else if (ret != 0) {
+                delete pcursor;
                 LogPrintf("Error reading next record from wallet database\n");
                 return DB_CORRUPT;
             }
@@ -809,7 +892,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        delete pcursor;
     } catch (boost::thread_interrupted) {
         throw;
     } catch (...) {
@@ -914,6 +997,17 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
                     pathDest /= wallet.strWalletFile;
 
                 try {
+                    if (CDBEnv::IsLevelDB(wallet.strWalletFile)) {
+                        // A LevelDB wallet is a directory of log and table files
+                        filesystem::create_directories(pathDest);
+                        for (filesystem::directory_iterator it(pathSrc); it != filesystem::directory_iterator(); ++it) {
+                            if (it->path().filename() == "LOCK")
+                                continue;
+                            filesystem::copy_file(it->path(), pathDest / it->path().filename(), filesystem::copy_option::overwrite_if_exists);
+                        }
+                        LogPrintf("copied wallet.dat to %s\n", pathDest.string());
+                        return true;
+                    }
 #if BOOST_VERSION >= 158000
                     filesystem::copy_file(pathSrc, pathDest, filesystem::copy_option::overwrite_if_exists);
 #else
@@ -946,6 +1040,11 @@ bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
     // Rewrite salvaged data to wallet.dat
     // Set -rescan so any missing transactions will be
     // found.
+    if (CDBEnv::IsLevelDB(filename)) {
+        LogPrintf("Salvaging is not supported for LevelDB wallet %s\n", filename);
+        return false;
+    }
+
     int64_t now = GetTime();
     std::string newFilename = strprintf("wallet.%d.bak", now);
 
@@ -984,8 +1083,8 @@ bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
     DbTxn* ptxn = dbenv.TxnBegin();
     BOOST_FOREACH (CDBEnv::KeyValPair& row, salvagedData) {
         if (fOnlyKeys) {
-            CDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
+            CSecureDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
             string strType, strErr;
             bool fReadOK = ReadKeyValue(&dummyWallet, ssKey, ssValue,
                 wss, strType, strErr);